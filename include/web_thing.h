@@ -24,15 +24,19 @@
 #define WEB_THING_H
 
 #include <string.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/timers.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "cJSON.h"
+#include "web_thing_json.h"
+#include "web_thing_pool.h"
 
 typedef enum ThingPropertyValueType {
   NO_STATE,
@@ -81,12 +85,27 @@ typedef enum ThingPropertyType{
 	eKEEP_LAST
 }ThingPropertyType;
 
+/* Fixed details of a property type , see getPropertyTypeDescriptor() */
+typedef struct PropertyTypeDescriptor
+{
+	const char* key;		// property key , the last segment of the property URL
+	const char* schema;		// @type of the property
+	ThingPropertyValueType valueType;
+	bool isRange;			// minimum and maximum go into the description
+}PropertyTypeDescriptor;
+
 typedef void(*PropertyChange_cb)(ThingPropertyValue);
 typedef struct ThingProperty ThingProperty;
+typedef struct Thing Thing;
+typedef struct ThingAction ThingAction;				// see web_thing_actions.h
+typedef struct ThingActionLog ThingActionLog;
+typedef struct ThingEvent ThingEvent;				// see web_thing_events.h
+typedef struct ThingEventLog ThingEventLog;
 
 typedef struct PropertyInfo
 {
 	ThingPropertyType type;
+	const char* key;		// property key and last segment of the property URL , NULL = key of the type
 	ThingPropertyValue value;
 	ThingPropertyValueType valueType;
 	double minimum;
@@ -95,23 +114,72 @@ typedef struct PropertyInfo
 	bool readOnly;
 	PropertyUnits unit;
 	const char** propertyEnum;	
+	double deadband;		// setPropertyValue() ignores number changes up to this size , 0 = off
+	uint32_t minInterval;	// minimum time between two notifications in milliseconds , 0 = off
+	bool persist;			// value is saved in NVS and restored by addProperty() , see saveThingProperties()
 }PropertyInfo;
 
 struct ThingProperty
 {
 	char* title;
+	char* key;				// property key , unique within the thing once added
 	ThingProperty* next;
 	PropertyInfo info;
 	PropertyChange_cb callback;
+	Thing* thing;			// thing the property was added to
+	char* href;				// URL of the property , set by addProperty()
+	ThingPropertyValue published[2];	// values readers copy , see getPropertyValue()
+	uint32_t seq;			// write sequence of published , odd while a value is written
+	uint32_t readers;		// readers using a published string
+	char* retired;			// replaced string buffers , freed once readers is 0
+	char* spare;			// second string buffer with the static pool
+	uint16_t valueSize;		// size of the string value buffers in the static pool , 0 if they are on the heap
+	bool checkRange;		// info.minimum and info.maximum are enforced , see checkPropertyValue()
+	double stepInverse;		// 1 / info.multipleOf , 0 if any number is allowed
+	uint16_t* enumIndex;	// hash set of info.propertyEnum , slots hold position + 1
+	uint16_t enumIndexSize;	// power of two , 0 without an enum
+	int64_t lastNotified;	// time of the last pushed change in microseconds
+	uint32_t keyHash;		// hash of the property key , set by addProperty()
+	uint16_t index;			// position of the property in the thing
 };
 
-typedef struct Thing
+struct Thing
 {
 	char* id;
 	char* title;
 	char** type;
+	char* href;							// URL of the thing , "/things/<id>"
+	char* propertiesHref;				// "/things/<id>/properties"
+	char* actionsHref;					// "/things/<id>/actions"
+	char* eventsHref;					// "/things/<id>/events"
 	ThingProperty* property;
-}Thing;
+	ThingProperty* propertyTail;		// last property in the list , for appending
+	ThingProperty** propertyIndex;		// hash table of properties keyed by property key
+	uint16_t propertyIndexSize;			// number of slots in propertyIndex , power of two
+	uint16_t propertyCount;
+	uint16_t propertyCapacity;			// size of properties , multiple of 32
+	ThingProperty** properties;			// properties by index
+	ThingAction* action;				// actions added with addAction()
+	ThingActionLog* actionLog;			// action requests , created with the first action
+	ThingEvent* event;					// events added with addEvent()
+	ThingEventLog* eventLog;			// recent events , created with the first event
+	uint32_t* changed;					// bit per property index , see notifyPropertyChanged()
+	uint32_t* unsaved;					// bit per persisted property changed since the last save
+	uint16_t unsavedCount;
+	TimerHandle_t saveTimer;			// runs saveThingProperties() , created for the first persisted property
+	void(*propertyChanged)(Thing*);		// called after a property was marked changed , an event was emitted or
+										// an action changed its status , set by the adapter
+	uint32_t version;					// counts value changes of all properties , see getThingVersion()
+	uint32_t descriptionVersion;		// counts rebuilds of the description , bumped by invalidateThingDescription()
+	char* description;		// cached Thing Description, see getThingDescription()
+	size_t descriptionLen;	// 0 while the description has to be rebuilt
+	size_t descriptionSize;	// size of the description buffer
+	char* descriptionDeflated;	// deflate compressed copy of description
+	size_t descriptionDeflatedLen;
+	size_t descriptionDeflatedSize;
+	bool descriptionNotDeflated;	// compressing the description failed or did not make it smaller ,
+									// the plain copy is served until invalidateThingDescription()
+};
 
 /* 	
 	Creates a thing.
@@ -122,6 +190,13 @@ typedef struct Thing
 */
 Thing* createThing(const char* _title, char** _type);
 
+/* 
+	Like createThing() with an id given by the caller , e.g. the address of a device behind
+	a bridge. The id is the last segment of the thing URL , only unreserved URL characters.
+	Returns NULL if the id is not valid.
+*/
+Thing* createThingWithId(const char* _id,const char* _title,char** _type);
+
 
 /* 
 	Creates a property.
@@ -135,10 +210,15 @@ Thing* createThing(const char* _title, char** _type);
 		_min/_max = minimum and maximum value in range (applicable to only certain properties). 
 		_callback = is the callback function in the main.c which will be notified whenever controls are changed . 
 					Callback function needs to have the format void(*function_name)(ThingPropertyValue)
+					It may call setPropertyValue() with the value the hardware actually applied ,
+					the response to the PUT then carries that value.
 */
 ThingProperty* createProperty(char* title,PropertyInfo info,PropertyChange_cb _callback);
 
 /* Adds property to the thing.
+	Property keys are unique within a thing. The key is info.key if it was given , otherwise
+	the key of the property type. A key which is already taken gets a number appended ,
+	so eight temperature properties become "temp" , "temp_2" ... "temp_8".
 
 	Parameters:
 		_thing = pointer to the thing object 
@@ -147,10 +227,111 @@ ThingProperty* createProperty(char* title,PropertyInfo info,PropertyChange_cb _c
 void addProperty(Thing* _thing,ThingProperty* _property);
 
 
+/* 
+	Looks up a property of the thing by its key (the last segment of the property URL).
+	Returns NULL if the thing has no such property.
+
+	Parameters:
+		_thing = pointer to the thing object 
+		_key = property key , e.g. "on" , "brightness" or "temp_2"
+*/
+ThingProperty* findProperty(Thing* _thing,const char* _key);
+
+/* Like findProperty() for a key of _len characters which need not be NUL terminated , e.g. part of a URL */
+ThingProperty* findPropertyN(Thing* _thing,const char* _key,size_t _len);
+
+/* Keys of properties , actions and events end up in URLs , only unreserved URL characters are allowed */
+bool isValidThingKey(const char* key);
+
+/* Hash of the key of len characters , used by the property and thing indexes */
+uint32_t hashThingKey(const char* key,size_t len);
+
+
+/* 
+	Marks the property as changed so that its current value is pushed to all
+	WebSocket subscribers. Changes are collected and sent together once per push
+	interval (CONFIG_WEB_THING_WS_PUSH_INTERVAL_MS). Can be called from any task.
+	A boolean or number written to info.value directly is published to readers first ,
+	string values have to be changed with setPropertyValue().
+
+	Parameters:
+		_property = pointer to the property whose value was changed
+*/
+void notifyPropertyChanged(ThingProperty* _property);
+
+/* 
+	Sets the value of a property from the firmware and notifies subscribers if it changed.
+	Number changes not bigger than info.deadband are ignored , and changes of a property
+	with info.minInterval set are pushed at most once per interval (the latest value wins).
+	Can be called from any task , writers take turns. With the static pool a new string is
+	refused while a reader still copies the previous one.
+	Returns true if the value was changed.
+
+	Parameters:
+		_property = pointer to the property 
+		_value = new value , strings are copied
+*/
+bool setPropertyValue(ThingProperty* _property,ThingPropertyValue _value);
+
+/* 
+	Copies the current value of the property. Can be called from any task while other
+	tasks or the http server set the value , it never waits for them and never returns
+	a half written value. info.value of the property is only safe to read in the task
+	which sets the value.
+	Returns false if the property has no value.
+
+	Parameters:
+		_property = pointer to the property 
+		_value = set to the value , a string is copied to _buf and _value->string points to it
+		_buf/_size = buffer for string values , longer strings are cut off
+*/
+bool getPropertyValue(ThingProperty* _property,ThingPropertyValue* _value,char* _buf,size_t _size);
+
+/* 
+	Version of the value of the property , it goes up whenever a new value is published.
+	Read it before the value : the value is then at least as new as the version , which
+	is what an ETag needs.
+*/
+uint32_t getPropertyVersion(ThingProperty* _property);
+
+/* Version of the values of all properties of the thing , goes up with every property version. */
+uint32_t getThingVersion(Thing* _thing);
+
+/* 
+	Writes the values of persisted properties changed since the last save to NVS and
+	commits them , once per 256 property indexes. Runs on a timer CONFIG_WEB_THING_PERSIST_INTERVAL_MS after the
+	first change , or soon after CONFIG_WEB_THING_PERSIST_UNSAVED_MAX properties changed ,
+	and from cleanUpThing(). Call it before a planned restart.
+	Returns false if a value could not be saved , such values stay marked and the save
+	timer tries them again.
+
+	Parameters:
+		_thing = pointer to the thing
+*/
+bool saveThingProperties(Thing* _thing);
+
+/* 
+	Calls the callback of the property with its current value , in the calling task.
+	Used by the callback task , see web_thing_callbacks.h .
+*/
+void runPropertyCallback(ThingProperty* _property);
+
+typedef void(*PropertyVisit_cb)(ThingProperty* property,void* ctx);
+
+/* 
+	Calls visit for every property marked by notifyPropertyChanged() since the last
+	call and clears the marks. Properties still inside their info.minInterval stay 
+	marked for a later call. Returns the number of visited properties.
+*/
+uint16_t takeChangedProperties(Thing* _thing,PropertyVisit_cb visit,void* ctx);
+
+
 /* 
 	Clean up property.
 
-	Deallocates memory allocated to thing and associated properties.
+	Deallocates memory allocated to thing and associated properties. Unsaved persisted values
+	are written first , after waiting for a save already running on the timer task , so it
+	must not be called from a timer callback.
  
 	Parameters:
 		_thing = pointer to the thing object 
@@ -158,6 +339,41 @@ void addProperty(Thing* _thing,ThingProperty* _property);
 void cleanUpThing(Thing* _thing);
 
 
+/* 
+	Returns the rendered Thing Description of the thing.
+	The description is built on first use and kept until it goes stale, so repeated
+	requests only send the cached buffer. Do not free the returned string.
+
+	Parameters:
+		_thing = pointer to the thing object 
+		_len = set to the length of the description , can be NULL
+*/
+const char* getThingDescription(Thing* _thing,size_t* _len);
+
+
+/* 
+	Returns the cached Thing Description compressed with deflate (zlib format) , 
+	NULL if CONFIG_WEB_THING_DEFLATE_DESCRIPTION is off or compression did not help.
+	Do not free the returned buffer.
+
+	Parameters:
+		_thing = pointer to the thing object 
+		_len = set to the length of the compressed data
+*/
+const char* getThingDescriptionDeflated(Thing* _thing,size_t* _len);
+
+
+/* 
+	Drops the cached Thing Description so that it gets rebuilt on the next request.
+	addProperty() does this for you, call it after changing thing or property metadata
+	(title, unit, minimum/maximum etc.) once the adapter is running.
+
+	Parameters:
+		_thing = pointer to the thing object 
+*/
+void invalidateThingDescription(Thing* _thing);
+
+
 /* 
 	Returns a cJSON object representing the thing object .
 	Note: Please cleanup the jSON obejct using cJSON_Delete() function
@@ -177,6 +393,39 @@ void serializeDevice(Thing* thing,cJSON* deviceJson) ;
 */
 void serialise_property_item(ThingProperty* property,cJSON* jsonProp);
 
+/* 
+	Writes the thing description of the thing , same content as serializeDevice().
+
+	Parameters:
+		w = writer the description is streamed into
+		_thing = pointer to the thing object 
+*/
+void writeThingDescription(JsonWriter* w,Thing* thing);
+
+/* 
+	Writes the description of a single property , same content as the cJSON object
+	serializeDevice() creates for it.
+*/
+void writePropertyDescription(JsonWriter* w,Thing* thing,ThingProperty* property);
+
+/* 
+	Writes the "<keyname>":<value> member of the property into the current object , 
+	same content as serialise_property_item().
+*/
+void writePropertyValue(JsonWriter* w,ThingProperty* property);
+
+/* JSON schema type of a value type , "number" for NUMBER , NULL for NO_STATE */
+const char* valueTypeToStr(ThingPropertyValueType valueType);
+
+/* Writes a value of the given type , null for NO_STATE and missing strings */
+void writeThingValue(JsonWriter* w,ThingPropertyValueType type,ThingPropertyValue value);
+
+/* Writes the time as an ISO 8601 string in UTC , like "2019-06-01T12:00:00+00:00" */
+void writeThingTime(JsonWriter* w,time_t time);
+
+/* Descriptor of the property type , unknown types get the eKEEP_LAST entry */
+const PropertyTypeDescriptor* getPropertyTypeDescriptor(ThingPropertyType type);
+
 /* Helper functions to get keyname , title ,typeschema(@type)*/
 const char* get_property_keyname(ThingProperty* property);
 const char* get_property_title(ThingProperty* property);
@@ -185,13 +434,66 @@ const bool get_property_isRange(ThingProperty* property);
 const ThingPropertyValueType get_property_valueType(ThingProperty* property);
 
 /* 
-	Updates the current value of the property 
+	Checks a value from a client against the constraints of the property which the
+	description announces : minimum and maximum of range types , multipleOf and the
+	enum of string properties. Numbers have to be finite.
+	Returns NULL if the value is allowed , otherwise a short reason.
+*/
+const char* checkPropertyValue(ThingProperty* _property,ThingPropertyValue _value);
+
+/* 
+	Updates the current value of the property , values rejected by checkPropertyValue()
+	are not stored and the callback is not called.
 	Paremeters:
 		property = pointer to thing property
 		newvalue = cJSON object representing the new value to be updated .
 */
 bool update_thing_property(ThingProperty* property,cJSON* newvalue);
 
+/* 
+	Updates several properties of the thing at once.
+	All members are checked before anything is changed , so if one of them is unknown , 
+	read only , has the wrong type or is rejected by checkPropertyValue() no property is updated. The callback of every property
+	whose value changed is called once.
+	The values are stored all or none as well : when the heap is full or a static pool
+	string is being read (THING_ERROR_BUSY) no property is updated either.
+	At most CONFIG_MAX_PROPERTY different properties can be set at once (THING_ERROR_TOO_MANY).
+	Bulk updates are serialised , a property callback must not start another one.
+	Paremeters:
+		thing = pointer to thing object
+		newvalues = cJSON object mapping property keys to their new values
+		error = set to a short reason when the update is rejected
+*/
+bool update_thing_properties(Thing* thing,cJSON* newvalues,const char** error);
+
+/* The error of the update functions for a body which is no valid JSON */
+#define THING_ERROR_INVALID_JSON "invalid JSON"
+
+/* The error of the update functions while a static pool string is being read , the update can be tried again */
+#define THING_ERROR_BUSY "property is being read , try again"
+
+/* The error of the bulk updates for more than CONFIG_MAX_PROPERTY different properties */
+#define THING_ERROR_TOO_MANY "too many properties"
+
+/* 
+	Same as update_thing_property() , but reads the value straight from the raw request
+	body without building a cJSON tree. The body is unescaped in place. The callback has
+	run when it returns (unless it was queued to the callback task) , so the stored value
+	is the one to answer with.
+	Paremeters:
+		property = pointer to thing property
+		body = JSON object text , modified
+		len = length of body
+		error = set to a short reason when the update is rejected
+*/
+bool update_thing_property_json(ThingProperty* property,char* body,size_t len,const char** error);
+
+/* 
+	Same as update_thing_properties() for a raw request body , which is unescaped in place.
+	A property listed more than once takes its last value.
+*/
+bool update_thing_properties_json(Thing* thing,char* body,size_t len,const char** error);
+
 char* getPropertyEndpointUrl(Thing* device,ThingProperty* property);
 char* getThingDescriptionUrl(Thing* device);
 #endif
\ No newline at end of file
@@ -0,0 +1,175 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_ACTIONS_H
+#define WEB_THING_ACTIONS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "web_thing.h"
+
+/*
+	Actions.
+
+	An action like "calibrate" or "fade" is requested with POST /things/<id>/actions or
+	POST /things/<id>/actions/<name> and runs longer than the request : the request is
+	answered with 201 and the new action request , an action task started by startAdapter()
+	runs the requests one after the other. The thing keeps CONFIG_WEB_THING_ACTION_LOG_SIZE
+	requests for GET /things/<id>/actions , finished ones are reused oldest first and a
+	new request is refused with 503 while every slot is pending or running , so the memory
+	used never grows. DELETE on the URL of a request cancels it. Status changes go to the
+	WebSocket subscribers as actionStatus messages.
+
+	Inputs are a single value , e.g. {"fade":{"input":50}} , of the type given to createAction().
+*/
+
+typedef enum ThingActionStatus
+{
+	eACTION_NONE,			// unused slot
+	eACTION_PENDING,
+	eACTION_RUNNING,
+	eACTION_COMPLETED,
+	eACTION_FAILED,
+	eACTION_CANCELLED
+}ThingActionStatus;
+
+typedef struct ThingActionRequest ThingActionRequest;
+
+// error of a request refused because every slot of the log is pending or running
+#define ACTION_ERROR_BUSY "too many actions"
+
+/* 
+	Runs an action request in the action task , it may take as long as it needs and should
+	return early once isActionCancelled() is true.
+	Returns false if the action failed.
+*/
+typedef bool(*ActionRun_cb)(ThingActionRequest* request);
+
+struct ThingAction
+{
+	char* name;						// key in the description and last segment of the action URL
+	char* title;
+	const char* description;		// NULL if there is none , not copied
+	ThingPropertyValueType inputType;	// type of the input , NO_STATE for actions without input
+	double minimum;					// range of number inputs , checked if minimum < maximum
+	double maximum;
+	ActionRun_cb run;
+	char* href;						// URL of the action , set by addAction()
+	ThingAction* next;
+	Thing* thing;
+};
+
+struct ThingActionRequest
+{
+	ThingAction* action;
+	uint32_t id;					// last segment of the request URL , counts from 1
+	ThingActionStatus status;
+	ThingPropertyValue input;		// a string input points to string
+	time_t timeRequested;
+	time_t timeCompleted;			// 0 until the request finished
+	uint32_t changed;				// status change the request last had , see takeChangedActions()
+	bool cancel;					// set by cancelAction() while the request runs
+	char string[CONFIG_WEB_THING_LOG_STRING_SIZE];
+};
+
+typedef struct ThingActionStats
+{
+	uint32_t requested;		// requests accepted
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t cancelled;
+	uint32_t rejected;		// requests refused because all slots were busy
+	uint16_t busy;			// requests pending or running now
+}ThingActionStats;
+
+typedef void(*ActionVisit_cb)(const ThingActionRequest* request,void* ctx);
+
+/* 
+	Creates an action.
+	Parameters:
+		_name = key of the action , only unreserved URL characters
+		_title = human friendly name
+		_inputType = type of the input , NO_STATE for none
+		_run = runs a request in the action task
+*/
+ThingAction* createAction(const char* _name,const char* _title,ThingPropertyValueType _inputType,ActionRun_cb _run);
+
+/* Adds the action to the thing , before startAdapter() */
+void addAction(Thing* _thing,ThingAction* _action);
+
+/* Looks up an action by its name of _len characters */
+ThingAction* findAction(Thing* _thing,const char* _name,size_t _len);
+
+/* 
+	Queues a request of the action , from any task. A string input is copied.
+	Returns the id of the request , 0 with error set if it was refused.
+*/
+uint32_t requestAction(ThingAction* _action,ThingPropertyValue _input,const char** _error);
+
+/* 
+	Queues the request in a body like {"<name>":{"input":<value>}}. With _action set the
+	body has to name that action.
+	Returns the id of the request , 0 with error set if it was refused.
+*/
+uint32_t requestActionJson(Thing* _thing,ThingAction* _action,cJSON* _body,const char** _error);
+
+/* 
+	Cancels a pending request , asks a running one to stop and removes a finished one.
+	Returns false if there is no request with the id.
+*/
+bool cancelAction(Thing* _thing,uint32_t _id);
+
+/* True once the request was cancelled , for the run function */
+bool isActionCancelled(ThingActionRequest* _request);
+
+/* Copies the request with the id , false if there is none */
+bool getActionRequest(Thing* _thing,uint32_t _id,ThingActionRequest* _copy);
+
+/* Waits until no request is pending or running , false if that took longer than _timeoutMs */
+bool waitThingActions(uint32_t _timeoutMs);
+
+/* Copies the action counters of the thing */
+void getThingActionStats(Thing* _thing,ThingActionStats* _stats);
+
+/* Starts the action task , called by startAdapter() */
+bool startActionTask();
+
+/* Writes the "actions" member of the Thing Description , nothing without actions */
+void writeActionsDescription(JsonWriter* w,Thing* thing);
+void serializeActions(Thing* thing,cJSON* deviceJson);
+
+/* Writes {"<name>":{"input":..,"href":..,"timeRequested":..,"status":..}} for the request */
+void writeActionRequest(JsonWriter* w,const ThingActionRequest* request);
+
+/* Writes the array of kept requests , oldest first , only those of filter unless it is NULL */
+void writeActionLog(JsonWriter* w,Thing* thing,ThingAction* filter);
+
+/* 
+	Visits the requests whose status changed after *cursor , in the order of the changes ,
+	and advances it. Returns the number of visited requests.
+*/
+uint16_t takeChangedActions(Thing* thing,uint32_t* cursor,ActionVisit_cb visit,void* ctx);
+
+/* Frees the actions and the requests , called by cleanUpThing() */
+void cleanUpActions(Thing* thing);
+
+#endif
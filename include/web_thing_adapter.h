@@ -33,6 +33,20 @@
 */
 void initAdapter(Thing* thing);
 
+/* 
+  Adds another thing to the adapter , all things share the web server and the mDNS service.
+  "/" then lists the descriptions of all things and each is served below "/things/<id>".
+  Note: call this after initAdapter() , before or after startAdapter() , from one task at a time.
+  A thing added while the server runs is served and pushes to WebSocket subscribers right away.
+  Paremeters:
+    thing = pointer to thing object , its id has to differ from the ids of the other things.
+  Returns false if the id is used already or CONFIG_WEB_THING_MAX_THINGS things were added.
+*/
+bool addThing(Thing* thing);
+
+/* Returns the thing added with the id , NULL if there is none */
+Thing* findThing(const char* id);
+
 /* 
   Starts the webserver and initialises the handles 
   Note : call this after ESP gets connected to the wifi network
@@ -0,0 +1,69 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_CALLBACKS_H
+#define WEB_THING_CALLBACKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "web_thing.h"
+
+/*
+	Property callbacks.
+
+	By default the callback of a property runs in the http server task , inside the
+	request which set the value , so a slow callback holds up every client. With
+	CONFIG_WEB_THING_ASYNC_CALLBACKS the request only queues the property and answers
+	right away , a callback task started by startAdapter() runs the callbacks in order.
+	A callback gets the value the property has when it runs , so a queued callback
+	still sees the latest value. When the queue is full the newest or the oldest
+	callback is dropped (CONFIG_WEB_THING_CALLBACK_DROP_OLDEST).
+*/
+
+typedef struct ThingCallbackStats
+{
+	uint32_t queued;		// callbacks handed to the callback task
+	uint32_t dispatched;	// callbacks the task has run
+	uint32_t dropped;		// callbacks lost because the queue was full
+	uint16_t waiting;		// callbacks in the queue now
+	uint16_t highWater;		// most callbacks waiting at once
+	uint32_t maxWaitUs;		// longest time from queueing to the start of a callback
+	uint64_t totalWaitUs;	// summed over the dispatched callbacks
+	uint32_t maxRunUs;		// longest running callback
+}ThingCallbackStats;
+
+/* Starts the callback task , called by startAdapter(). Does nothing without the option. */
+bool startCallbackTask();
+
+/* Queues the callback of the property , false if it has to be called right away */
+bool queuePropertyCallback(ThingProperty* _property);
+
+/* 
+	Waits until all queued callbacks ran , e.g. before cleanUpThing().
+	Returns false if they did not within _timeoutMs.
+*/
+bool waitPropertyCallbacks(uint32_t _timeoutMs);
+
+/* Copies the callback counters , all 0 without CONFIG_WEB_THING_ASYNC_CALLBACKS */
+void getThingCallbackStats(ThingCallbackStats* stats);
+
+#endif
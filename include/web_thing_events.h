@@ -0,0 +1,116 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_EVENTS_H
+#define WEB_THING_EVENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "web_thing.h"
+
+/*
+	Events.
+
+	An event like "overheated" is described in the Thing Description and emitted by the
+	firmware with emitEvent() , from any task. The thing keeps the last
+	CONFIG_WEB_THING_EVENT_LOG_SIZE events in a ring , GET /things/<id>/events lists them
+	oldest first and GET /things/<id>/events/<name> those of one event. When the ring is
+	full a new event overwrites the oldest , so the memory used never grows. Emitted events
+	also go to the WebSocket subscribers with the next push.
+*/
+
+struct ThingEvent
+{
+	char* name;						// key in the description and last segment of the event URL
+	char* title;
+	const char* description;		// NULL if there is none , not copied
+	ThingPropertyValueType valueType;	// type of the event data , NO_STATE for events without data
+	char* href;						// URL of the event , set by addEvent()
+	ThingEvent* next;
+	Thing* thing;
+};
+
+typedef struct ThingEventStats
+{
+	uint32_t emitted;		// events emitted since the first addEvent()
+	uint32_t overwritten;	// events pushed out of the log by newer ones
+	uint16_t stored;		// events in the log now
+}ThingEventStats;
+
+/* An event as it was emitted , string data is copied into string */
+typedef struct ThingEventRecord
+{
+	ThingEvent* event;
+	ThingPropertyValue data;
+	time_t timestamp;
+	uint32_t seq;			// number of the event , counts from 1
+	char string[CONFIG_WEB_THING_LOG_STRING_SIZE];
+}ThingEventRecord;
+
+typedef void(*EventVisit_cb)(const ThingEventRecord* record,void* ctx);
+
+/* 
+	Creates an event.
+	Parameters:
+		_name = key of the event , only unreserved URL characters
+		_title = human friendly name
+		_valueType = type of the data passed to emitEvent() , NO_STATE for none
+*/
+ThingEvent* createEvent(const char* _name,const char* _title,ThingPropertyValueType _valueType);
+
+/* Adds the event to the thing , before startAdapter() */
+void addEvent(Thing* _thing,ThingEvent* _event);
+
+/* Looks up an event by its name of _len characters */
+ThingEvent* findEvent(Thing* _thing,const char* _name,size_t _len);
+
+/* 
+	Logs the event and queues it for the WebSocket subscribers. Can be called from any
+	task , it never waits for a client. String data is copied and cut off at
+	CONFIG_WEB_THING_LOG_STRING_SIZE - 1 bytes.
+	Returns false if the event was not added to a thing.
+*/
+bool emitEvent(ThingEvent* _event,ThingPropertyValue _data);
+
+/* Copies the counters of the event log */
+void getThingEventStats(Thing* _thing,ThingEventStats* _stats);
+
+/* Writes the "events" member of the Thing Description , nothing without events */
+void writeEventsDescription(JsonWriter* w,Thing* thing);
+void serializeEvents(Thing* thing,cJSON* deviceJson);
+
+/* Writes the object of one logged event , {"<name>":{"data":..,"timestamp":".."}} */
+void writeEventRecord(JsonWriter* w,const ThingEventRecord* record);
+
+/* Writes the array of logged events , oldest first , only those of filter unless it is NULL */
+void writeEventLog(JsonWriter* w,Thing* thing,ThingEvent* filter);
+
+/* 
+	Visits the events logged after *cursor in order and advances it , events which were
+	overwritten meanwhile are skipped. Returns the number of visited events.
+*/
+uint16_t takeNewEvents(Thing* thing,uint32_t* cursor,EventVisit_cb visit,void* ctx);
+
+/* Frees the events and the log , called by cleanUpThing() */
+void cleanUpEvents(Thing* thing);
+
+#endif
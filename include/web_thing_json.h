@@ -0,0 +1,151 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_JSON_H
+#define WEB_THING_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+	Streaming JSON writer.
+
+	Values are formatted into a fixed buffer which is handed to the flush callback
+	whenever it fills up, so a response never exists as a whole in memory and no
+	cJSON tree is needed. With `format` set the output is laid out exactly like
+	cJSON_Print(), otherwise like cJSON_PrintUnformatted().
+*/
+
+#define JSON_WRITER_MAX_DEPTH 32
+
+/* Layout used for all responses , see CONFIG_WEB_THING_COMPACT_JSON */
+#ifdef CONFIG_WEB_THING_COMPACT_JSON
+#define JSON_WRITER_FORMAT false
+#else
+#define JSON_WRITER_FORMAT true
+#endif
+
+/*
+	Receives the next piece of output.
+	Return 0 on success, any other value aborts the writer.
+*/
+typedef int(*JsonWriterFlush_cb)(void* ctx,const char* buf,size_t len);
+
+typedef struct JsonWriter
+{
+	char buf[CONFIG_WEB_THING_JSON_CHUNK_SIZE];
+	size_t len;				// bytes waiting in buf
+	size_t total;			// bytes produced so far
+	uint32_t hasItems;		// bit per nesting level , set once the level has a member
+	uint32_t isArray;		// bit per nesting level , set for arrays
+	uint8_t depth;
+	bool format;
+	bool error;
+	JsonWriterFlush_cb flush;
+	void* ctx;
+}JsonWriter;
+
+/* 
+	Initialises the writer.
+	Parameters:
+		format = true to pretty print like cJSON_Print()
+		flush = called with every full buffer , NULL only counts the produced bytes
+		ctx = passed to flush as is
+*/
+void jsonWriterInit(JsonWriter* w,bool format,JsonWriterFlush_cb flush,void* ctx);
+
+/* Flushes the remaining output , returns false if any flush failed. */
+bool jsonWriterFinish(JsonWriter* w);
+
+/* 
+	Hands out the output that was not flushed yet and empties the buffer , for
+	callers which send the last piece differently , e.g. as the final WebSocket frame.
+	Returns NULL if the writer failed.
+*/
+const char* jsonWriterTakePending(JsonWriter* w,size_t* len);
+
+void jsonBeginObject(JsonWriter* w);
+void jsonEndObject(JsonWriter* w);
+void jsonBeginArray(JsonWriter* w);
+void jsonEndArray(JsonWriter* w);
+
+/* Starts a member of the current object , follow it with exactly one value. */
+void jsonKey(JsonWriter* w,const char* key);
+
+void jsonString(JsonWriter* w,const char* value);
+void jsonNumber(JsonWriter* w,double value);
+void jsonBool(JsonWriter* w,bool value);
+void jsonNull(JsonWriter* w);
+
+/* Writes one string value from several pieces , e.g. URLs built from the thing id. */
+void jsonStringBegin(JsonWriter* w);
+void jsonStringAppend(JsonWriter* w,const char* part);
+void jsonStringEnd(JsonWriter* w);
+
+/* Formats a number the way cJSON prints it , buf needs at least 26 bytes. */
+size_t jsonFormatNumber(double value,char* buf);
+
+/*
+	In-place JSON reader for request bodies.
+
+	Walks a flat object like {"key":value,...} member by member without allocating:
+	keys and strings are unescaped into the body itself and NUL terminated , so the
+	returned pointers stay valid as long as the buffer. Nested objects and arrays are
+	rejected , as is anything but whitespace after the closing brace.
+*/
+
+typedef enum
+{
+	JSON_VALUE_STRING,
+	JSON_VALUE_NUMBER,
+	JSON_VALUE_BOOL,
+	JSON_VALUE_NULL
+}JsonValueType;
+
+typedef struct JsonMember
+{
+	const char* key;
+	JsonValueType type;
+	double number;
+	bool boolean;
+	const char* string;
+}JsonMember;
+
+typedef struct JsonReader
+{
+	char* pos;
+	char* end;
+	uint8_t state;
+}JsonReader;
+
+/* Starts reading the object in buf , len excludes any terminator. The buffer is modified. */
+void jsonReaderInit(JsonReader* r,char* buf,size_t len);
+
+/* 
+	Reads the next member of the object.
+	Returns 1 with member filled in , 0 after the closing brace or -1 if the body is not
+	a valid flat JSON object. Once -1 or 0 was returned every further call does the same.
+*/
+int jsonReaderNext(JsonReader* r,JsonMember* member);
+
+#endif
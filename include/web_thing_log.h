@@ -0,0 +1,70 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_LOG_H
+#define WEB_THING_LOG_H
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+/*
+	Logging of the component.
+
+	THING_LOGx() is ESP_LOGx() for messages up to CONFIG_WEB_THING_LOG_LEVEL , above it the
+	call and its arguments are compiled out , so a debug message on a request path costs
+	nothing unless the level is raised in menuconfig. Up to the level the runtime level of
+	esp_log still applies. Errors and warnings are on by default , the informational
+	messages on request paths are not , UART output at 115200 baud takes longer than the
+	request itself.
+*/
+// numbered like esp_log_level_t , whose values are no macros the preprocessor could compare
+#ifndef CONFIG_WEB_THING_LOG_LEVEL
+#define CONFIG_WEB_THING_LOG_LEVEL 2
+#endif
+
+// only the tag is used , so a file whose messages are all compiled out still compiles clean
+#define THING_LOG_DISCARD(tag,format,...) do { (void)(tag); } while(0)
+
+#if CONFIG_WEB_THING_LOG_LEVEL >= 1
+#define THING_LOGE(tag,format,...) ESP_LOGE(tag,format,##__VA_ARGS__)
+#else
+#define THING_LOGE(tag,format,...) THING_LOG_DISCARD(tag,format,##__VA_ARGS__)
+#endif
+
+#if CONFIG_WEB_THING_LOG_LEVEL >= 2
+#define THING_LOGW(tag,format,...) ESP_LOGW(tag,format,##__VA_ARGS__)
+#else
+#define THING_LOGW(tag,format,...) THING_LOG_DISCARD(tag,format,##__VA_ARGS__)
+#endif
+
+#if CONFIG_WEB_THING_LOG_LEVEL >= 3
+#define THING_LOGI(tag,format,...) ESP_LOGI(tag,format,##__VA_ARGS__)
+#else
+#define THING_LOGI(tag,format,...) THING_LOG_DISCARD(tag,format,##__VA_ARGS__)
+#endif
+
+#if CONFIG_WEB_THING_LOG_LEVEL >= 4
+#define THING_LOGD(tag,format,...) ESP_LOGD(tag,format,##__VA_ARGS__)
+#else
+#define THING_LOGD(tag,format,...) THING_LOG_DISCARD(tag,format,##__VA_ARGS__)
+#endif
+
+#endif
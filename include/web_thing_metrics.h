@@ -0,0 +1,106 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_METRICS_H
+#define WEB_THING_METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "web_thing_json.h"
+
+/*
+	Runtime metrics.
+
+	With CONFIG_WEB_THING_METRICS the adapter counts every request by route , with the bytes
+	sent and a histogram of the time the handler took , and GET /metrics reports them with the
+	heap , the sockets of the http server , the property callbacks and the WebSocket pushes.
+	The counters are static and only ever added to with atomic adds , recording a request
+	takes no lock and no allocation , so the metrics can stay on in production. Counters are
+	32 bit and wrap around , readers take differences between two reads.
+*/
+
+typedef enum ThingMetricRoute
+{
+	eMETRIC_ROOT,				// GET /
+	eMETRIC_THING,				// GET /things/<id>
+	eMETRIC_PROPERTIES_GET,		// GET /things/<id>/properties
+	eMETRIC_PROPERTIES_PUT,
+	eMETRIC_PROPERTY_GET,		// GET /things/<id>/properties/<key>
+	eMETRIC_PROPERTY_PUT,
+	eMETRIC_ACTIONS_GET,		// GET below /things/<id>/actions
+	eMETRIC_ACTIONS_POST,
+	eMETRIC_ACTIONS_DELETE,
+	eMETRIC_EVENTS_GET,			// GET below /things/<id>/events
+	eMETRIC_WEBSOCKET,			// messages of WebSocket subscribers
+	eMETRIC_METRICS,			// GET /metrics
+	eMETRIC_OTHER,				// unknown things , URLs and methods
+	eMETRIC_ROUTE_COUNT
+}ThingMetricRoute;
+
+/* Bucket i counts durations below 16 << i microseconds , the last one all longer ones */
+#define THING_METRIC_BUCKETS 14
+#define THING_METRIC_FIRST_BOUND_US 16
+
+typedef struct ThingRouteMetrics
+{
+	uint32_t requests;
+	uint32_t failures;			// handler failed , the socket was closed
+	uint32_t bytesOut;			// body bytes sent
+	uint32_t maxUs;				// longest request
+	uint32_t buckets[THING_METRIC_BUCKETS];
+}ThingRouteMetrics;
+
+typedef struct ThingMetrics
+{
+	ThingRouteMetrics routes[eMETRIC_ROUTE_COUNT];
+	uint32_t parseFailures;		// bodies and WebSocket messages which are no valid JSON
+	uint32_t callbacks;			// property callbacks run , in the server or the callback task
+	uint32_t callbackMaxUs;
+	uint32_t callbackBuckets[THING_METRIC_BUCKETS];
+	uint32_t wsMessagesOut;		// messages pushed to WebSocket subscribers , counted per subscriber
+	uint32_t wsBytesOut;
+}ThingMetrics;
+
+/* Microseconds since boot , 0 without the option so callers need no #ifdef */
+int64_t metricsStart();
+
+/* Counts a request which started at start , bytes is the body sent in the response */
+void recordRequest(ThingMetricRoute route,int64_t start,uint32_t bytes,bool failed);
+
+/* Counts a property callback which started at start */
+void recordCallback(int64_t start);
+
+void recordParseFailure();
+
+/* Counts a frame pushed to a WebSocket subscriber , final for the last frame of a message */
+void recordWsFrame(uint32_t bytes,bool final);
+
+/* Copies the counters , they are read one by one , not as one snapshot */
+void getThingMetrics(ThingMetrics* metrics);
+
+/* 
+	Writes the counters and the heap as members of an open object , the adapter adds the
+	sockets. Routes without requests are left out.
+*/
+void writeThingMetrics(JsonWriter* writer);
+
+#endif
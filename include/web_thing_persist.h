@@ -0,0 +1,58 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_PERSIST_H
+#define WEB_THING_PERSIST_H
+
+#include <stdbool.h>
+#include "nvs_flash.h"
+#include "web_thing.h"
+
+/*
+	NVS storage of property values.
+
+	Properties created with info.persist get their saved value back when they are
+	added to the thing. Changed values are not written by the request which set them ,
+	they are collected and written together with one commit when
+	CONFIG_WEB_THING_PERSIST_INTERVAL_MS passed or CONFIG_WEB_THING_PERSIST_UNSAVED_MAX
+	properties are waiting , see saveThingProperties().
+
+	Values are kept in a namespace per thing ("wt" and the thing id) under the property
+	key , names longer than NVS allows are replaced by a hash. nvs_flash_init() has to be
+	called by the application before properties are added.
+*/
+
+/* Opens the NVS namespace of the thing , false if NVS is not usable */
+bool openPropertyStore(Thing* _thing,nvs_open_mode_t _mode,nvs_handle_t* _handle);
+
+/* 
+	Reads the saved value of the property. A string is allocated with malloc() and
+	has to be freed by the caller. Returns false if there is none.
+*/
+bool readStoredValue(nvs_handle_t _handle,ThingProperty* _property,ThingPropertyValue* _value);
+
+/* Writes the value of the property , it is only kept after closePropertyStore() committed */
+bool writeStoredValue(nvs_handle_t _handle,ThingProperty* _property,ThingPropertyValue _value);
+
+/* Commits the written values if _commit is set and closes the namespace */
+bool closePropertyStore(nvs_handle_t _handle,bool _commit);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_POOL_H
+#define WEB_THING_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+	Storage of things and properties.
+
+	With CONFIG_WEB_THING_STATIC_POOL the thing and property structs, titles, URLs,
+	string values , the property index and the cached description all come from one
+	static arena of WEB_THING_POOL_SIZE bytes , so once the thing is set up serving
+	GET and PUT requests does not use the general heap. The arena is sized for
+	CONFIG_WEB_THING_POOL_THINGS things of CONFIG_MAX_PROPERTY properties , all
+	things of the adapter share it. Arena memory is not reused , except that freeing
+	the most recent allocation gives it back , so a rebuilt description reuses or
+	grows its buffer and keeps some headroom. Without the pool the functions below
+	are plain malloc and free.
+	The heap is still used by the compressor of a rebuilt description and for restoring
+	saved strings , through thingHeapAlloc() , and by the cJSON trees of action requests
+	and WebSocket messages. getThingAllocStats() counts the allocations made through
+	these functions , not those of cJSON.
+*/
+
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+#ifndef CONFIG_WEB_THING_POOL_THINGS
+#define CONFIG_WEB_THING_POOL_THINGS 1
+#endif
+#define WEB_THING_POOL_SIZE (CONFIG_WEB_THING_POOL_THINGS * (CONFIG_MAX_PROPERTY * CONFIG_WEB_THING_POOL_BYTES_PER_PROPERTY + 512))
+#endif
+
+typedef struct ThingAllocStats
+{
+	uint32_t heapAllocs;	// heap allocations made by the component
+	uint32_t heapFrees;
+	size_t poolUsed;		// bytes taken from the arena , 0 without CONFIG_WEB_THING_STATIC_POOL
+	size_t poolSize;
+	uint32_t poolFailures;	// allocations the arena was too small for
+}ThingAllocStats;
+
+/* Returns size bytes from the arena or the heap , NULL if there is no room */
+void* thingAlloc(size_t size);
+
+/* Returns size bytes from the heap in both modes , for buffers only needed for a moment , release it with thingFree() */
+void* thingHeapAlloc(size_t size);
+
+/* Like thingAlloc() , the memory is zeroed */
+void* thingCalloc(size_t count,size_t size);
+
+/* Copies str with thingAlloc() , NULL stays NULL */
+char* thingStrdup(const char* str);
+
+/* 
+	Releases memory from thingAlloc() , arena memory is only reclaimed by thingPoolRelease()
+	unless it was the most recent allocation
+*/
+void thingFree(void* ptr);
+
+/* Called by createThing() and cleanUpThing() , the arena is reset when the last thing is gone */
+void thingPoolAcquire();
+void thingPoolRelease();
+
+/* Copies the allocation counters */
+void getThingAllocStats(ThingAllocStats* stats);
+
+#endif
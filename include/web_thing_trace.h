@@ -0,0 +1,85 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef WEB_THING_TRACE_H
+#define WEB_THING_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+	Trace points.
+
+	THING_TRACE() marks where a request , a property callback , a WebSocket push or an
+	action starts and ends. With CONFIG_WEB_THING_TRACE and tracing switched on by
+	setThingTrace() every point is stored with its time in a ring of the last
+	CONFIG_WEB_THING_TRACE_SIZE records , takeThingTrace() reads them. Storing a record takes
+	a timer read and atomic stores , no lock , switched off a point is one load , without
+	the option it is compiled out. Records are best effort , one overwritten while it is read
+	is skipped.
+*/
+
+typedef enum ThingTracePoint
+{
+	eTRACE_REQUEST_BEGIN,	// arg = HTTP method , 0 for a WebSocket frame
+	eTRACE_BODY_RECEIVED,	// arg = body length
+	eTRACE_REQUEST_END,		// arg = ThingMetricRoute the request was counted under
+	eTRACE_CALLBACK_BEGIN,	// arg = index of the property
+	eTRACE_CALLBACK_END,
+	eTRACE_PUSH_BEGIN,		// WebSocket push , arg = number of things
+	eTRACE_PUSH_END,
+	eTRACE_ACTION_BEGIN,	// arg = id of the action request
+	eTRACE_ACTION_END
+}ThingTracePoint;
+
+typedef struct ThingTraceRecord
+{
+	uint32_t timeUs;		// esp_timer_get_time() , wraps after 71 minutes
+	uint32_t point;			// ThingTracePoint
+	uint32_t arg;
+	uint32_t sequence;		// number of the record + 1 , 0 while it is written
+}ThingTraceRecord;
+
+typedef void (*ThingTraceVisit_cb)(const ThingTraceRecord* record,void* ctx);
+
+#ifdef CONFIG_WEB_THING_TRACE
+extern bool gThingTraceOn;
+#define THING_TRACE(point,arg) do {											\
+		if(__atomic_load_n(&gThingTraceOn,__ATOMIC_RELAXED))					\
+			recordThingTrace(point,arg);										\
+	} while(0)
+#else
+#define THING_TRACE(point,arg) do { } while(0)
+#endif
+
+/* Switches tracing on or off , does nothing without CONFIG_WEB_THING_TRACE */
+void setThingTrace(bool on);
+
+void recordThingTrace(ThingTracePoint point,uint32_t arg);
+
+/* 
+	Visits the records after cursor , oldest first , and moves cursor past them. Records
+	which were overwritten before they were read are skipped. Returns the number visited.
+*/
+uint16_t takeThingTrace(uint32_t* cursor,ThingTraceVisit_cb visit,void* ctx);
+
+#endif
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+Compares size and latency of the thing description served by a web thing.
+
+Fetches `/` repeatedly with and without `Accept-Encoding: deflate` and reports
+bytes on the wire and request latency for each. Run it once against a build with
+CONFIG_WEB_THING_COMPACT_JSON off and once with it on to compare pretty and
+compact output, e.g. for a device exposing 20 properties:
+
+    python3 bench_description.py 192.168.1.20 --port 8888 --requests 200
+"""
+
+import argparse
+import http.client
+import statistics
+import sys
+import time
+import zlib
+
+
+def fetch(host, port, path, headers):
+	conn = http.client.HTTPConnection(host, port, timeout=10)
+	start = time.perf_counter()
+	conn.request("GET", path, headers=headers)
+	res = conn.getresponse()
+	body = res.read()
+	elapsed = time.perf_counter() - start
+	encoding = res.getheader("Content-Encoding", "identity")
+	conn.close()
+	if res.status != 200:
+		raise RuntimeError("GET %s returned %d" % (path, res.status))
+	return body, encoding, elapsed
+
+
+def run(host, port, path, requests, headers):
+	latencies = []
+	body, encoding = b"", "identity"
+	for _ in range(requests):
+		body, encoding, elapsed = fetch(host, port, path, headers)
+		latencies.append(elapsed * 1000.0)
+	return body, encoding, latencies
+
+
+def report(name, body, encoding, latencies):
+	latencies.sort()
+	p99 = latencies[min(len(latencies) - 1, int(len(latencies) * 0.99))]
+	print("%-10s %-9s %8d bytes   mean %7.2f ms   p50 %7.2f ms   p99 %7.2f ms" % (
+		name, encoding, len(body), statistics.mean(latencies), statistics.median(latencies), p99))
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("host", help="device IP or host name")
+	parser.add_argument("--port", type=int, default=8888)
+	parser.add_argument("--path", default="/")
+	parser.add_argument("--requests", type=int, default=50)
+	args = parser.parse_args()
+
+	plain, _, plain_lat = run(args.host, args.port, args.path, args.requests, {})
+	report("plain", plain, "identity", plain_lat)
+
+	packed, encoding, packed_lat = run(args.host, args.port, args.path, args.requests, {"Accept-Encoding": "deflate"})
+	report("deflate", packed, encoding, packed_lat)
+
+	if encoding == "deflate":
+		if zlib.decompress(packed) != plain:
+			print("deflated description does not match the plain one")
+			return 1
+		print("compression ratio %.2f" % (len(plain) / float(len(packed))))
+	else:
+		print("server did not compress (CONFIG_WEB_THING_DEFLATE_DESCRIPTION off?)")
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
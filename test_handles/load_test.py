@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+"""
+Concurrent load test for a web thing.
+
+Reads the thing description, then runs N workers which each keep one HTTP/1.1
+connection open and send a mix of GET and PUT requests to the property URLs
+(PUT only to writable properties, with values that fit the property type and
+range). Reports requests per second and p50/p90/p99 latency per request type.
+If the thing reports its heap (JSON with freeHeap / minFreeHeap, GET /metrics
+of the component) the free heap before and after and the lowest free heap seen
+are printed too , with the requests and the longest handler time per route as
+the server counted them.
+
+    # against a device
+    python3 load_test.py 192.168.1.20 --port 8888 --concurrency 4 --duration 30
+
+    # against the host build , the server is started on a free port and stopped afterwards
+    python3 load_test.py --spawn build/test_host/webthing_host_server --duration 5
+
+Like esp_http_server the host server keeps at most 7 connections open, more
+workers wait until a connection is closed.
+
+Exits with 1 if a limit given with --max-p99-ms, --min-rps or --max-errors is
+broken, so it can gate a release.
+"""
+
+import argparse
+import http.client
+import json
+import random
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+
+def percentile(values, fraction):
+	if not values:
+		return 0.0
+	return values[min(len(values) - 1, int(len(values) * fraction))]
+
+
+class Target(object):
+	def __init__(self, key, href, description):
+		self.key = key
+		self.href = href
+		self.type = description.get("type")
+		self.read_only = description.get("readOnly", False)
+		self.minimum = description.get("minimum", 0)
+		self.maximum = description.get("maximum", 100)
+
+	def random_value(self, rng):
+		if self.type == "boolean":
+			return rng.random() < 0.5
+		if self.type == "number":
+			return round(rng.uniform(self.minimum, self.maximum), 1)
+		if self.type == "string":
+			return "#%06x" % rng.randrange(0x1000000)
+		return None
+
+
+def load_targets(host, port, timeout):
+	conn = http.client.HTTPConnection(host, port, timeout=timeout)
+	conn.request("GET", "/")
+	res = conn.getresponse()
+	body = res.read()
+	conn.close()
+	if res.status != 200:
+		raise RuntimeError("GET / returned %d" % res.status)
+
+	description = json.loads(body)
+	targets = []
+	for key, prop in description.get("properties", {}).items():
+		links = prop.get("links") or [{}]
+		href = links[0].get("href")
+		if href and prop.get("type") in ("boolean", "number", "string"):
+			targets.append(Target(key, href, prop))
+	if not targets:
+		raise RuntimeError("thing has no properties")
+	return targets
+
+
+def read_heap(host, port, path, timeout):
+	if not path:
+		return None
+	try:
+		conn = http.client.HTTPConnection(host, port, timeout=timeout)
+		conn.request("GET", path)
+		res = conn.getresponse()
+		body = res.read()
+		conn.close()
+		if res.status != 200:
+			return None
+		heap = json.loads(body)
+		return heap if "freeHeap" in heap else None
+	except (OSError, ValueError, http.client.HTTPException):
+		return None
+
+
+class Stats(object):
+	def __init__(self):
+		self.lock = threading.Lock()
+		self.latencies = {"GET": [], "PUT": []}
+		self.errors = 0
+		self.statuses = {}
+
+	def add(self, method, status, elapsed_ms, error):
+		with self.lock:
+			if error:
+				self.errors += 1
+			else:
+				self.latencies[method].append(elapsed_ms)
+			self.statuses[status] = self.statuses.get(status, 0) + 1
+
+
+def worker(args, targets, writable, stats, deadline, budget, seed):
+	rng = random.Random(seed)
+	conn = None
+	while time.time() < deadline:
+		if budget is not None:
+			with budget["lock"]:
+				if budget["left"] <= 0:
+					break
+				budget["left"] -= 1
+
+		if writable and rng.random() < args.put_ratio:
+			target = rng.choice(writable)
+			method = "PUT"
+			body = json.dumps({target.key: target.random_value(rng)})
+			headers = {"Content-Type": "application/json"}
+		else:
+			target = rng.choice(targets)
+			method, body, headers = "GET", None, {}
+
+		start = time.perf_counter()
+		status, error = 0, False
+		try:
+			if conn is None:
+				conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+			conn.request(method, target.href, body=body, headers=headers)
+			res = conn.getresponse()
+			res.read()
+			status = res.status
+			error = status != 200
+			if res.getheader("Connection", "").lower() == "close":
+				conn.close()
+				conn = None
+		except (OSError, http.client.HTTPException):
+			error = True
+			if conn is not None:
+				conn.close()
+			conn = None
+		stats.add(method, status, (time.perf_counter() - start) * 1000.0, error)
+
+	if conn is not None:
+		conn.close()
+
+
+def free_port():
+	sock = socket.socket()
+	sock.bind(("127.0.0.1", 0))
+	port = sock.getsockname()[1]
+	sock.close()
+	return port
+
+
+def spawn_server(path, port, properties):
+	server = subprocess.Popen([path, "--port", str(port), "--properties", str(properties)],
+		stdout=subprocess.PIPE, universal_newlines=True)
+	line = server.stdout.readline()
+	if "listening" not in line:
+		server.kill()
+		raise RuntimeError("host server did not start: %s" % line.strip())
+	return server
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("host", nargs="?", default="127.0.0.1", help="device IP or host name")
+	parser.add_argument("--port", type=int, default=8888)
+	parser.add_argument("--concurrency", "-c", type=int, default=4, help="parallel connections")
+	parser.add_argument("--duration", type=float, default=10.0, help="seconds to run")
+	parser.add_argument("--requests", type=int, help="stop after this many requests")
+	parser.add_argument("--put-ratio", type=float, default=0.2, help="share of PUT requests")
+	parser.add_argument("--timeout", type=float, default=5.0, help="socket timeout in seconds")
+	parser.add_argument("--seed", type=int, default=1)
+	parser.add_argument("--heap-path", default="/metrics", help="URL reporting freeHeap/minFreeHeap, empty to skip")
+	parser.add_argument("--spawn", metavar="SERVER", help="start this webthing_host_server on a free port")
+	parser.add_argument("--properties", type=int, default=20, help="properties of the spawned server")
+	parser.add_argument("--json", action="store_true", help="print the results as JSON")
+	parser.add_argument("--max-p99-ms", type=float, help="fail if the p99 latency is higher")
+	parser.add_argument("--min-rps", type=float, help="fail if fewer requests per second were served")
+	parser.add_argument("--max-errors", type=int, help="fail if more requests failed")
+	args = parser.parse_args()
+
+	server = None
+	if args.spawn:
+		args.host, args.port = "127.0.0.1", free_port()
+		server = spawn_server(args.spawn, args.port, args.properties)
+
+	try:
+		targets = load_targets(args.host, args.port, args.timeout)
+		writable = [t for t in targets if not t.read_only]
+		heap_before = read_heap(args.host, args.port, args.heap_path, args.timeout)
+
+		stats = Stats()
+		budget = {"left": args.requests, "lock": threading.Lock()} if args.requests else None
+		start = time.time()
+		deadline = start + args.duration
+		workers = [threading.Thread(target=worker, args=(args, targets, writable, stats, deadline, budget, args.seed + i))
+			for i in range(args.concurrency)]
+		for w in workers:
+			w.start()
+		for w in workers:
+			w.join()
+		elapsed = time.time() - start
+		heap_after = read_heap(args.host, args.port, args.heap_path, args.timeout)
+	finally:
+		if server:
+			server.terminate()
+			server.wait()
+
+	result = {"concurrency": args.concurrency, "seconds": round(elapsed, 3), "properties": len(targets),
+		"errors": stats.errors, "statuses": {str(k): v for k, v in sorted(stats.statuses.items())}}
+	everything = []
+	for method, latencies in sorted(stats.latencies.items()):
+		latencies.sort()
+		everything.extend(latencies)
+		result[method] = {"requests": len(latencies), "rps": round(len(latencies) / elapsed, 1),
+			"p50_ms": round(percentile(latencies, 0.50), 3), "p90_ms": round(percentile(latencies, 0.90), 3),
+			"p99_ms": round(percentile(latencies, 0.99), 3), "max_ms": round(latencies[-1], 3) if latencies else 0.0}
+	everything.sort()
+	result["rps"] = round(len(everything) / elapsed, 1)
+	result["p50_ms"] = round(percentile(everything, 0.50), 3)
+	result["p99_ms"] = round(percentile(everything, 0.99), 3)
+	if heap_before and heap_after:
+		result["heap"] = {"free_before": heap_before["freeHeap"], "free_after": heap_after["freeHeap"],
+			"min_free": heap_after.get("minFreeHeap")}
+		before = heap_before.get("routes", {})
+		result["server"] = {name: {"requests": route["requests"] - before.get(name, {}).get("requests", 0),
+			"max_us": route["maxUs"]} for name, route in heap_after.get("routes", {}).items()}
+
+	if args.json:
+		print(json.dumps(result, indent=2))
+	else:
+		print("%d connections , %.1f s , %d properties" % (args.concurrency, elapsed, len(targets)))
+		for method in ("GET", "PUT"):
+			r = result[method]
+			print("%-4s %7d req %9.1f req/s   p50 %7.2f ms   p90 %7.2f ms   p99 %7.2f ms   max %7.2f ms" % (
+				method, r["requests"], r["rps"], r["p50_ms"], r["p90_ms"], r["p99_ms"], r["max_ms"]))
+		print("all  %7d req %9.1f req/s   p50 %7.2f ms   p99 %7.2f ms   errors %d" % (
+			len(everything), result["rps"], result["p50_ms"], result["p99_ms"], stats.errors))
+		print("status codes: %s" % ", ".join("%s x%d" % item for item in result["statuses"].items()))
+		if "heap" in result:
+			h = result["heap"]
+			print("free heap: %d before , %d after , lowest %s" % (h["free_before"], h["free_after"], h["min_free"]))
+		for name, route in sorted(result.get("server", {}).items()):
+			if route["requests"]:
+				print("server %-16s %7d req   max %7d us" % (name, route["requests"], route["max_us"]))
+
+	failed = []
+	if args.max_p99_ms is not None and result["p99_ms"] > args.max_p99_ms:
+		failed.append("p99 %.2f ms > %.2f ms" % (result["p99_ms"], args.max_p99_ms))
+	if args.min_rps is not None and result["rps"] < args.min_rps:
+		failed.append("%.1f req/s < %.1f req/s" % (result["rps"], args.min_rps))
+	if args.max_errors is not None and stats.errors > args.max_errors:
+		failed.append("%d errors > %d" % (stats.errors, args.max_errors))
+	for reason in failed:
+		print("FAILED: %s" % reason)
+	return 1 if failed else 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
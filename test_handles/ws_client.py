@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""
+Minimal Web Thing WebSocket client for testing property notifications.
+
+Uses only the standard library. Connects to the thing URL, optionally sends a
+setProperty message and prints every message the thing pushes.
+
+    # print propertyStatus messages as the device reports changes
+    python3 ws_client.py 192.168.1.20 --port 8888
+
+    # set properties and wait until the thing confirms them
+    python3 ws_client.py 192.168.1.20 --set on=true --set brightness=40 --expect
+"""
+
+import argparse
+import base64
+import hashlib
+import json
+import os
+import socket
+import struct
+import sys
+import time
+import urllib.request
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+OP_CONT, OP_TEXT, OP_BINARY, OP_CLOSE, OP_PING, OP_PONG = 0x0, 0x1, 0x2, 0x8, 0x9, 0xA
+
+
+class WebSocket(object):
+	def __init__(self, host, port, path, timeout):
+		self.sock = socket.create_connection((host, port), timeout=timeout)
+		key = base64.b64encode(os.urandom(16)).decode()
+		request = (
+			"GET %s HTTP/1.1\r\n"
+			"Host: %s:%d\r\n"
+			"Upgrade: websocket\r\n"
+			"Connection: Upgrade\r\n"
+			"Sec-WebSocket-Key: %s\r\n"
+			"Sec-WebSocket-Version: 13\r\n\r\n" % (path, host, port, key))
+		self.sock.sendall(request.encode())
+
+		response = b""
+		while b"\r\n\r\n" not in response:
+			data = self.sock.recv(1024)
+			if not data:
+				raise RuntimeError("connection closed during handshake")
+			response += data
+		head, self.pending = response.split(b"\r\n\r\n", 1)
+		lines = head.decode(errors="replace").split("\r\n")
+		if " 101 " not in lines[0]:
+			raise RuntimeError("handshake failed: %s" % lines[0])
+		accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+		if not any(l.lower().startswith("sec-websocket-accept:") and l.split(":", 1)[1].strip() == accept for l in lines):
+			raise RuntimeError("bad Sec-WebSocket-Accept")
+
+	def _recv_exact(self, n):
+		while len(self.pending) < n:
+			data = self.sock.recv(4096)
+			if not data:
+				raise RuntimeError("connection closed")
+			self.pending += data
+		data, self.pending = self.pending[:n], self.pending[n:]
+		return data
+
+	def send(self, opcode, payload):
+		header = bytes([0x80 | opcode])
+		mask = os.urandom(4)
+		if len(payload) < 126:
+			header += bytes([0x80 | len(payload)])
+		elif len(payload) < 65536:
+			header += bytes([0x80 | 126]) + struct.pack("!H", len(payload))
+		else:
+			header += bytes([0x80 | 127]) + struct.pack("!Q", len(payload))
+		masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+		self.sock.sendall(header + mask + masked)
+
+	def send_text(self, text):
+		self.send(OP_TEXT, text.encode())
+
+	def recv_message(self):
+		"""Returns the next complete text message, joining fragments."""
+		message = b""
+		while True:
+			b0, b1 = self._recv_exact(2)
+			fin, opcode, length = b0 & 0x80, b0 & 0x0F, b1 & 0x7F
+			if length == 126:
+				length = struct.unpack("!H", self._recv_exact(2))[0]
+			elif length == 127:
+				length = struct.unpack("!Q", self._recv_exact(8))[0]
+			mask = self._recv_exact(4) if b1 & 0x80 else None
+			payload = self._recv_exact(length)
+			if mask:
+				payload = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+
+			if opcode == OP_PING:
+				self.send(OP_PONG, payload)
+				continue
+			if opcode == OP_CLOSE:
+				raise RuntimeError("closed by server")
+			if opcode in (OP_TEXT, OP_CONT):
+				message += payload
+				if fin:
+					return message.decode()
+
+	def close(self):
+		try:
+			self.send(OP_CLOSE, b"")
+		finally:
+			self.sock.close()
+
+
+def parse_assignment(text):
+	key, _, value = text.partition("=")
+	try:
+		return key, json.loads(value)
+	except ValueError:
+		return key, value
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("host", help="device IP or host name")
+	parser.add_argument("--port", type=int, default=8888)
+	parser.add_argument("--set", action="append", default=[], metavar="KEY=VALUE",
+		help="property to set, VALUE is parsed as JSON (true, 40, \"#ff0000\")")
+	parser.add_argument("--expect", action="store_true",
+		help="exit with an error unless every set property is confirmed by a propertyStatus message")
+	parser.add_argument("--timeout", type=float, default=5.0, help="seconds to wait for messages")
+	args = parser.parse_args()
+
+	description = json.loads(urllib.request.urlopen("http://%s:%d/" % (args.host, args.port), timeout=args.timeout).read())
+	path = "/things/%s" % description["id"]
+	ws = WebSocket(args.host, args.port, path, args.timeout)
+	print("connected to %s" % path)
+
+	wanted = dict(parse_assignment(a) for a in args.set)
+	if wanted:
+		ws.send_text(json.dumps({"messageType": "setProperty", "data": wanted}))
+
+	deadline = time.time() + args.timeout
+	confirmed = {}
+	try:
+		while time.time() < deadline or not (args.expect or wanted):
+			try:
+				message = json.loads(ws.recv_message())
+			except socket.timeout:
+				if args.expect or wanted:
+					break
+				continue
+			print(json.dumps(message))
+			if message.get("messageType") == "error":
+				return 1
+			if message.get("messageType") == "propertyStatus":
+				confirmed.update(message.get("data", {}))
+				if wanted and all(confirmed.get(k) == v for k, v in wanted.items()):
+					break
+	finally:
+		ws.close()
+
+	if args.expect and not all(confirmed.get(k) == v for k, v in wanted.items()):
+		print("not confirmed: %s" % ", ".join(k for k, v in wanted.items() if confirmed.get(k) != v))
+		return 1
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,527 @@
+/*
+	Host benchmark of the response paths.
+
+	    bench_web_thing [iterations]
+
+	Compares the cJSON tree serialisers with the cached description and the
+	streaming writer for a thing with 20 properties: time and heap allocations
+	per request , peak heap and output size. Also times the routing of property
+	requests with 5 , 50 and 200 properties , the parsing of PUT bodies , emitting
+	events , the round trip of an action request through the action task and the
+	cost of the trace points on a request. Heap
+	numbers need a build without sanitizers (the tracker is off then).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esp_http_server.h"
+#include "mock_heap.h"
+#include "sample_thing.h"
+#include "web_thing_actions.h"
+#include "web_thing_adapter.h"
+#include "web_thing_events.h"
+#include "web_thing_trace.h"
+
+typedef struct {
+	double nsPerOp;
+	double allocsPerOp;
+	size_t peak;		// heap above the starting point
+} Result;
+
+typedef void (*BenchFn)(void* ctx);
+
+static int64_t nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static Result run(BenchFn fn,void* ctx,int iterations)
+{
+	mock_heap_stats_t before,after;
+	fn(ctx);	// warm up , fills caches
+	mock_heap_reset_peak();
+	mock_heap_stats(&before);
+	int64_t start = nowNs();
+	for(int i = 0;i < iterations;i++)
+		fn(ctx);
+	int64_t elapsed = nowNs() - start;
+	mock_heap_stats(&after);
+
+	Result result;
+	result.nsPerOp = (double)elapsed / iterations;
+	result.allocsPerOp = (double)(after.allocs - before.allocs) / iterations;
+	result.peak = after.peak - before.current;
+	return result;
+}
+
+static void report(const char* name,Result result)
+{
+	if(mock_heap_tracking())
+		printf("  %-34s %9.0f ns/op %8.1f allocs/op %8zu B peak\n",name,result.nsPerOp,result.allocsPerOp,result.peak);
+	else
+		printf("  %-34s %9.0f ns/op\n",name,result.nsPerOp);
+}
+
+static int discard(void* ctx,const char* buf,size_t len)
+{
+	*(size_t*)ctx += len;
+	return 0;
+}
+
+typedef struct {
+	char* buf;
+	size_t len;
+} Capture;
+
+static int capture(void* ctx,const char* buf,size_t len)
+{
+	Capture* out = (Capture*)ctx;
+	memcpy(out->buf + out->len,buf,len);
+	out->len += len;
+	out->buf[out->len] = '\0';
+	return 0;
+}
+
+/*
+	Cases
+*/
+static void describeWithCJSON(void* ctx)
+{
+	cJSON* json = cJSON_CreateObject();
+	serializeDevice((Thing*)ctx,json);
+	char* text = JSON_WRITER_FORMAT ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+	free(text);
+	cJSON_Delete(json);
+}
+
+static void describeCached(void* ctx)
+{
+	size_t len;
+	getThingDescription((Thing*)ctx,&len);
+}
+
+static void describeRebuilt(void* ctx)
+{
+	invalidateThingDescription((Thing*)ctx);
+	getThingDescription((Thing*)ctx,NULL);
+}
+
+static void valueWithCJSON(void* ctx)
+{
+	cJSON* json = cJSON_CreateObject();
+	serialise_property_item((ThingProperty*)ctx,json);
+	char* text = JSON_WRITER_FORMAT ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+	free(text);
+	cJSON_Delete(json);
+}
+
+static void valueStreamed(void* ctx)
+{
+	size_t sent = 0;
+	JsonWriter writer;
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,discard,&sent);
+	jsonBeginObject(&writer);
+	writePropertyValue(&writer,(ThingProperty*)ctx);
+	jsonEndObject(&writer);
+	jsonWriterFinish(&writer);
+}
+
+static void allValuesWithCJSON(void* ctx)
+{
+	cJSON* json = cJSON_CreateObject();
+	for(ThingProperty* property = ((Thing*)ctx)->property;property;property = property->next)
+		serialise_property_item(property,json);
+	char* text = JSON_WRITER_FORMAT ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+	free(text);
+	cJSON_Delete(json);
+}
+
+static void allValuesStreamed(void* ctx)
+{
+	size_t sent = 0;
+	JsonWriter writer;
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,discard,&sent);
+	jsonBeginObject(&writer);
+	for(ThingProperty* property = ((Thing*)ctx)->property;property;property = property->next)
+		writePropertyValue(&writer,property);
+	jsonEndObject(&writer);
+	jsonWriterFinish(&writer);
+}
+
+/*
+	PUT body parsing , cJSON tree against the in-place reader. Both start from a fresh copy
+	of the body , the reader because it unescapes into it.
+*/
+typedef struct {
+	const char* body;
+	size_t len;
+	char buf[256];
+	double sum;
+} ParseCase;
+
+static void parseWithCJSON(void* ctx)
+{
+	ParseCase* parse = (ParseCase*)ctx;
+	memcpy(parse->buf,parse->body,parse->len + 1);
+	cJSON* json = cJSON_Parse(parse->buf);
+	cJSON* item = NULL;
+	cJSON_ArrayForEach(item,json)
+	{
+		if(cJSON_IsNumber(item))
+			parse->sum += item->valuedouble;
+	}
+	cJSON_Delete(json);
+}
+
+static void parseInPlace(void* ctx)
+{
+	ParseCase* parse = (ParseCase*)ctx;
+	JsonReader reader;
+	JsonMember member;
+	memcpy(parse->buf,parse->body,parse->len + 1);
+	jsonReaderInit(&reader,parse->buf,parse->len);
+	while(jsonReaderNext(&reader,&member) > 0)
+	{
+		if(member.type == JSON_VALUE_NUMBER)
+			parse->sum += member.number;
+	}
+}
+
+static void benchParse(int iterations)
+{
+	static const char* bodies[] = {
+		"{\"brightness\":42}",
+		"{\"on\":true,\"brightness\":42,\"level\":20.5,\"color\":\"#00ff00\",\"heating\":\"cooling\"}",
+	};
+	static const char* names[] = {"1 member","5 members"};
+	printf("\nPUT body parsing\n");
+	for(int i = 0;i < sizeof(bodies) / sizeof(bodies[0]);i++)
+	{
+		char name[64];
+		ParseCase parse = {bodies[i],strlen(bodies[i])};
+		snprintf(name,sizeof(name),"%s , cJSON_Parse",names[i]);
+		report(name,run(parseWithCJSON,&parse,iterations));
+		snprintf(name,sizeof(name),"%s , in-place reader",names[i]);
+		report(name,run(parseInPlace,&parse,iterations));
+	}
+}
+
+typedef struct {
+	httpd_handle_t server;
+	mock_httpd_request_t request;
+	mock_httpd_response_t* response;
+} HttpCase;
+
+static void httpRequest(void* ctx)
+{
+	HttpCase* http = (HttpCase*)ctx;
+	mock_httpd_request(http->server,&http->request,http->response);
+}
+
+/*
+	Dispatch , the wildcard handler of the adapter against the former table with a GET and
+	a PUT handler per property , which httpd searches linearly for every request.
+*/
+static int sendChunk(void* ctx,const char* buf,size_t len)
+{
+	return httpd_resp_send_chunk((httpd_req_t*)ctx,buf,len);
+}
+
+static esp_err_t handlerPerProperty(httpd_req_t* req)
+{
+	JsonWriter writer;
+	httpd_resp_set_type(req,"application/json");
+	httpd_resp_set_hdr(req,"Access-Control-Allow-Origin","*");
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendChunk,req);
+	jsonBeginObject(&writer);
+	writePropertyValue(&writer,(ThingProperty*)req->user_ctx);
+	jsonEndObject(&writer);
+	jsonWriterFinish(&writer);
+	return httpd_resp_send_chunk(req,NULL,0);
+}
+
+static httpd_handle_t startPerPropertyServer(Thing* thing)
+{
+	httpd_handle_t server = NULL;
+	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+	config.max_uri_handlers = thing->propertyCount * 2 + 4;
+	httpd_start(&server,&config);
+
+	httpd_uri_t uri = {.uri = "/",.method = HTTP_GET,.handler = handlerPerProperty};
+	httpd_register_uri_handler(server,&uri);
+	uri.uri = thing->href;
+	httpd_register_uri_handler(server,&uri);
+	for(ThingProperty* property = thing->property;property;property = property->next)
+	{
+		uri.uri = property->href;
+		uri.user_ctx = property;
+		uri.method = HTTP_GET;
+		httpd_register_uri_handler(server,&uri);
+		uri.method = HTTP_PUT;
+		httpd_register_uri_handler(server,&uri);
+	}
+	return server;
+}
+
+typedef struct {
+	HttpCase http;
+	Thing* thing;
+	uint16_t next;
+} DispatchCase;
+
+/* GET on the properties in turn */
+static void dispatchRequest(void* ctx)
+{
+	DispatchCase* dispatch = (DispatchCase*)ctx;
+	dispatch->http.request.uri = dispatch->thing->properties[dispatch->next]->href;
+	dispatch->next = (dispatch->next + 1) % dispatch->thing->propertyCount;
+	mock_httpd_request(dispatch->http.server,&dispatch->http.request,dispatch->http.response);
+}
+
+static void benchDispatch(int iterations,mock_httpd_response_t* response)
+{
+	static const int sizes[] = {5,50,200};
+	printf("\nproperty GET dispatch (in-process , all properties in turn)\n");
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	printf("  needs a build without CONFIG_WEB_THING_STATIC_POOL\n");
+	return;
+#endif
+	for(int i = 0;i < sizeof(sizes) / sizeof(sizes[0]);i++)
+	{
+		char name[64];
+		Thing* thing = createSampleThing(sizes[i],NULL);
+		DispatchCase dispatch = {{NULL,{0},response},thing,0};
+		dispatch.http.request.method = HTTP_GET;
+
+		dispatch.http.server = startPerPropertyServer(thing);
+		snprintf(name,sizeof(name),"%3d properties , handler each",sizes[i]);
+		report(name,run(dispatchRequest,&dispatch,iterations));
+		httpd_stop(dispatch.http.server);
+
+		initAdapter(thing);
+		startAdapter();
+		dispatch.http.server = mock_httpd_last_server();
+		snprintf(name,sizeof(name),"%3d properties , wildcard",sizes[i]);
+		report(name,run(dispatchRequest,&dispatch,iterations));
+	}
+}
+
+typedef struct {
+	HttpCase http;
+	Thing** things;
+	int count;
+	int next;
+} GatewayCase;
+
+/* GET on a property of the things in turn */
+static void gatewayRequest(void* ctx)
+{
+	GatewayCase* gateway = (GatewayCase*)ctx;
+	gateway->http.request.uri = gateway->things[gateway->next]->property->href;
+	gateway->next = (gateway->next + 1) % gateway->count;
+	mock_httpd_request(gateway->http.server,&gateway->http.request,gateway->http.response);
+}
+
+/* One adapter for 1 and CONFIG_WEB_THING_MAX_THINGS things , the id lookup should not show */
+static void benchGateway(int iterations,mock_httpd_response_t* response)
+{
+	static Thing* things[CONFIG_WEB_THING_MAX_THINGS];
+	const int counts[] = {1,CONFIG_WEB_THING_MAX_THINGS};
+	printf("\nproperty GET with several things (in-process , things in turn)\n");
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	printf("  needs a build without CONFIG_WEB_THING_STATIC_POOL\n");
+	return;
+#endif
+	for(int i = 0;i < CONFIG_WEB_THING_MAX_THINGS;i++)
+	{
+		char id[16];
+		snprintf(id,sizeof(id),"thing-%d",i + 1);
+		things[i] = createSampleThingWithId(id,5,NULL);
+	}
+	for(int i = 0;i < sizeof(counts) / sizeof(counts[0]);i++)
+	{
+		char name[64];
+		GatewayCase gateway = {{NULL,{0},response},things,counts[i],0};
+		gateway.http.request.method = HTTP_GET;
+		initAdapter(things[0]);
+		for(int n = 1;n < counts[i];n++)
+			addThing(things[n]);
+		startAdapter();
+		gateway.http.server = mock_httpd_last_server();
+		snprintf(name,sizeof(name),"%3d things",counts[i]);
+		report(name,run(gatewayRequest,&gateway,iterations));
+		gateway.http.request.uri = "/";
+		snprintf(name,sizeof(name),"%3d things , GET /",counts[i]);
+		report(name,run(httpRequest,&gateway.http,iterations));
+	}
+}
+
+static size_t renderedSize(Thing* thing,bool format)
+{
+	size_t len = 0;
+	JsonWriter writer;
+	jsonWriterInit(&writer,format,discard,&len);
+	writeThingDescription(&writer,thing);
+	jsonWriterFinish(&writer);
+	return len;
+}
+
+static bool sameAsCJSON(Thing* thing,bool format)
+{
+	static char buf[MOCK_HTTPD_MAX_BODY];
+	Capture out = {buf,0};
+	JsonWriter writer;
+	jsonWriterInit(&writer,format,capture,&out);
+	writeThingDescription(&writer,thing);
+	jsonWriterFinish(&writer);
+
+	cJSON* json = cJSON_CreateObject();
+	serializeDevice(thing,json);
+	char* text = format ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+	bool same = strcmp(text,buf) == 0;
+	free(text);
+	cJSON_Delete(json);
+	return same;
+}
+
+/* The property requests of the http handler cases with the trace points switched off and on */
+static void benchTrace(HttpCase* http,const char* propertyUrl,int iterations)
+{
+	printf("\ntrace points (in-process)\n");
+#ifdef CONFIG_WEB_THING_TRACE
+	http->request.uri = propertyUrl;
+	http->request.headers[0] = (mock_httpd_header_t){NULL,NULL};
+	for(int on = 0;on < 2;on++)
+	{
+		setThingTrace(on);
+		http->request.method = HTTP_GET;
+		report(on ? "GET property (trace on)" : "GET property (trace off)",run(httpRequest,http,iterations));
+		http->request.method = HTTP_PUT;
+		report(on ? "PUT property (trace on)" : "PUT property (trace off)",run(httpRequest,http,iterations));
+	}
+	setThingTrace(false);
+#else
+	printf("  compiled out (CONFIG_WEB_THING_TRACE)\n");
+#endif
+}
+
+/*
+	Events and actions , added after the other cases so they do not change the description
+*/
+static void emitOne(void* ctx)
+{
+	emitEvent((ThingEvent*)ctx,(ThingPropertyValue){.number = 42});
+}
+
+static bool runNothing(ThingActionRequest* request)
+{
+	return true;
+}
+
+/* Queues a request and spins until the action task finished it */
+static void actionRoundTrip(void* ctx)
+{
+	ThingAction* action = (ThingAction*)ctx;
+	ThingActionStats stats;
+	const char* error = NULL;
+	getThingActionStats(action->thing,&stats);
+	uint32_t completed = stats.completed;
+	if(requestAction(action,(ThingPropertyValue){0},&error) == 0)
+		return;
+	do
+		getThingActionStats(action->thing,&stats);
+	while(stats.completed == completed);
+}
+
+static void benchEventsAndActions(Thing* thing,HttpCase* http,int iterations)
+{
+	ThingEvent* event = createEvent("overheated","Overheated",NUMBER);
+	ThingAction* action = createAction("reset","Reset",NO_STATE,runNothing);
+	addEvent(thing,event);
+	addAction(thing,action);
+
+	printf("\nevents and actions\n");
+	report("emitEvent",run(emitOne,event,iterations));
+	http->request.method = HTTP_GET;
+	http->request.uri = thing->eventsHref;
+	http->request.headers[0] = (mock_httpd_header_t){NULL,NULL};
+	report("GET events (full log)",run(httpRequest,http,iterations));
+	report("action round trip",run(actionRoundTrip,action,iterations));
+}
+
+int main(int argc,char** argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+	if(iterations <= 0)
+		iterations = 2000;
+
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	ThingProperty* property = findProperty(thing,"brightness");
+
+	printf("thing with %d properties , %d iterations , %s output\n\n",thing->propertyCount,iterations,
+		JSON_WRITER_FORMAT ? "pretty" : "compact");
+
+	printf("thing description\n");
+	report("cJSON tree + print",run(describeWithCJSON,thing,iterations));
+	report("rebuild cache (two pass writer)",run(describeRebuilt,thing,iterations));
+	report("cached",run(describeCached,thing,iterations));
+
+	printf("\nproperty value\n");
+	report("cJSON tree + print",run(valueWithCJSON,property,iterations));
+	report("streaming writer",run(valueStreamed,property,iterations));
+
+	printf("\nall property values\n");
+	report("cJSON tree + print",run(allValuesWithCJSON,thing,iterations));
+	report("streaming writer",run(allValuesStreamed,thing,iterations));
+
+	mock_httpd_set_port(0);
+	initAdapter(thing);
+	startAdapter();
+	HttpCase http = {mock_httpd_last_server(),{0},malloc(sizeof(mock_httpd_response_t))};
+	char* propertyUrl = getPropertyEndpointUrl(thing,property);
+	printf("\nhttp handlers (in-process)\n");
+	http.request.method = HTTP_GET;
+	http.request.uri = "/";
+	report("GET /",run(httpRequest,&http,iterations));
+	http.request.headers[0] = (mock_httpd_header_t){"Accept-Encoding","deflate"};
+	report("GET / (deflate)",run(httpRequest,&http,iterations));
+	http.request.headers[0] = (mock_httpd_header_t){NULL,NULL};
+	http.request.uri = propertyUrl;
+	report("GET property",run(httpRequest,&http,iterations));
+	char etag[32];
+	snprintf(etag,sizeof(etag),"%s",mock_httpd_response_header(http.response,"ETag"));
+	http.request.headers[0] = (mock_httpd_header_t){"If-None-Match",etag};
+	report("GET property (304)",run(httpRequest,&http,iterations));
+	http.request.headers[0] = (mock_httpd_header_t){NULL,NULL};
+	http.request.method = HTTP_PUT;
+	http.request.body = "{\"brightness\":42}";
+	http.request.body_len = strlen(http.request.body);
+	report("PUT property",run(httpRequest,&http,iterations));
+	benchTrace(&http,propertyUrl,iterations);
+
+	benchParse(iterations);
+
+	benchDispatch(iterations,http.response);
+	benchGateway(iterations,http.response);
+
+	size_t deflated = 0;
+	getThingDescriptionDeflated(thing,&deflated);
+	printf("\ndescription size\n");
+	printf("  pretty   %6zu bytes (writer output %s cJSON_Print)\n",renderedSize(thing,true),
+		sameAsCJSON(thing,true) ? "identical to" : "DIFFERS from");
+	printf("  compact  %6zu bytes (writer output %s cJSON_PrintUnformatted)\n",renderedSize(thing,false),
+		sameAsCJSON(thing,false) ? "identical to" : "DIFFERS from");
+	if(deflated)
+		printf("  deflate  %6zu bytes (of the %s description)\n",deflated,JSON_WRITER_FORMAT ? "pretty" : "compact");
+	else
+		printf("  deflate  off (CONFIG_WEB_THING_DEFLATE_DESCRIPTION)\n");
+
+	bool same = sameAsCJSON(thing,true) && sameAsCJSON(thing,false);
+	benchEventsAndActions(thing,&http,iterations);
+
+	free(propertyUrl);
+	free(http.response);
+	return same ? 0 : 1;
+}
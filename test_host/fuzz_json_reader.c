@@ -0,0 +1,197 @@
+/*
+	Fuzz target of the in-place JSON reader used for PUT bodies.
+
+	    fuzz_json_reader [iterations] [files...]
+
+	Every input is read with jsonReaderNext() from a buffer of exactly its size , so the
+	sanitizer builds catch any read past the body. An input the reader accepts has to be
+	parsed by cJSON to the same members with the same values , in order ; the reader may
+	reject more than cJSON does , never less. Without a fuzzing engine the inputs are
+	mutations of a few seed bodies from a fixed random sequence , files given on the
+	command line are replayed first. Built with clang and WEBTHING_HOST_FUZZ the same
+	check runs as a libFuzzer target.
+*/
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "web_thing_json.h"
+
+#define MAX_INPUT 512
+
+static void fail(const char* what,const uint8_t* data,size_t size)
+{
+	fprintf(stderr,"fuzz_json_reader: %s for input of %zu bytes:\n",what,size);
+	fwrite(data,1,size,stderr);
+	fputc('\n',stderr);
+	abort();
+}
+
+static bool sameValue(const JsonMember* member,const cJSON* item)
+{
+	switch(member->type)
+	{
+		case JSON_VALUE_STRING:
+			return cJSON_IsString(item) && strcmp(member->string,item->valuestring) == 0;
+		case JSON_VALUE_NUMBER:
+			return cJSON_IsNumber(item) && (member->number == item->valuedouble ||
+				(isnan(member->number) && isnan(item->valuedouble)));
+		case JSON_VALUE_BOOL:
+			return member->boolean ? cJSON_IsTrue(item) : cJSON_IsFalse(item);
+		case JSON_VALUE_NULL:
+			return cJSON_IsNull(item);
+	}
+	return false;
+}
+
+/* Returns 1 if the reader accepted the input */
+static int checkInput(const uint8_t* data,size_t size)
+{
+	static JsonMember members[MAX_INPUT * 8 + 1];
+	JsonReader reader;
+	size_t count = 0;
+	int ret = -1;
+	char* body = malloc(size ? size : 1);
+	memcpy(body,data,size);
+
+	// members are handed out before the end is seen , only a complete body counts
+	jsonReaderInit(&reader,body,size);
+	while(count < MAX_INPUT * 8 && (ret = jsonReaderNext(&reader,&members[count])) > 0)
+		count++;
+	if(ret <= 0 && jsonReaderNext(&reader,&members[count]) != ret)
+		fail("reader did not stay finished",data,size);
+
+	if(ret == 0)
+	{
+		char* text = malloc(size + 1);
+		memcpy(text,data,size);
+		text[size] = '\0';
+		cJSON* json = cJSON_Parse(text);
+		if(json == NULL || !cJSON_IsObject(json))
+			fail("accepted what cJSON rejects",data,size);
+		cJSON* item = json->child;
+		for(size_t i = 0;i < count;i++,item = item->next)
+		{
+			if(item == NULL || strcmp(members[i].key,item->string) != 0)
+				fail("member differs from cJSON",data,size);
+			if(!sameValue(&members[i],item))
+				fail("value differs from cJSON",data,size);
+		}
+		if(item != NULL)
+			fail("members missing",data,size);
+		cJSON_Delete(json);
+		free(text);
+	}
+	free(body);
+	return ret == 0;
+}
+
+#ifdef WEBTHING_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t* data,size_t size)
+{
+	checkInput(data,size);
+	return 0;
+}
+#else
+static const char* seeds[] = {
+	"{\"brightness\":75}",
+	"{\"on\":true,\"brightness\":10,\"color\":\"#00ff00\",\"on\":false}",
+	" {\r\n\t\"level\" : -0.25e+3 , \"mode\":null } \n",
+	"{\"esc\":\"q\\\" b\\\\ s\\/ \\b\\f\\n\\r\\t\",\"u\":\"\\u00e9\\u20ac\\ud83d\\ude00\"}",
+	"{\"utf\":\"\xc3\xa9\xe2\x82\xac\",\"n\":[1,2],\"o\":{\"a\":1}}",
+	"{\"big\":1e999,\"small\":4.9e-324,\"int\":-2147483648,\"zero\":0.0}",
+	"{}",
+};
+
+static const char alphabet[] = "{}[]\":,\\ \t\n0123456789.-+eEtrufalsn\x01\x7f\xc3\xa9u";
+
+static uint32_t gRandom = 0x2545F491;
+
+static uint32_t nextRandom(void)
+{
+	gRandom ^= gRandom << 13;
+	gRandom ^= gRandom >> 17;
+	gRandom ^= gRandom << 5;
+	return gRandom;
+}
+
+static size_t mutate(uint8_t* buf,size_t size)
+{
+	int edits = 1 + nextRandom() % 4;
+	while(edits--)
+	{
+		size_t at = size ? nextRandom() % size : 0;
+		switch(nextRandom() % 4)
+		{
+			case 0:	// replace a byte
+				if(size)
+					buf[at] = alphabet[nextRandom() % (sizeof(alphabet) - 1)];
+				break;
+			case 1:	// insert a byte
+				if(size < MAX_INPUT)
+				{
+					memmove(buf + at + 1,buf + at,size - at);
+					buf[at] = alphabet[nextRandom() % (sizeof(alphabet) - 1)];
+					size++;
+				}
+				break;
+			case 2:	// delete a byte
+				if(size)
+				{
+					memmove(buf + at,buf + at + 1,size - at - 1);
+					size--;
+				}
+				break;
+			default:	// cut the input short
+				size = at;
+				break;
+		}
+	}
+	return size;
+}
+
+static int replayFile(const char* path)
+{
+	uint8_t buf[MAX_INPUT * 8];
+	FILE* file = fopen(path,"rb");
+	if(file == NULL)
+	{
+		perror(path);
+		return 1;
+	}
+	size_t size = fread(buf,1,sizeof(buf),file);
+	fclose(file);
+	checkInput(buf,size);
+	return 0;
+}
+
+int main(int argc,char** argv)
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 100000;
+	long accepted = 0;
+	uint8_t buf[MAX_INPUT];
+	const size_t seedCount = sizeof(seeds) / sizeof(seeds[0]);
+
+	for(int i = 2;i < argc;i++)
+	{
+		if(replayFile(argv[i]) != 0)
+			return 1;
+	}
+
+	for(size_t i = 0;i < seedCount;i++)
+		accepted += checkInput((const uint8_t*)seeds[i],strlen(seeds[i]));
+
+	for(long i = 0;i < iterations;i++)
+	{
+		const char* seed = seeds[nextRandom() % seedCount];
+		size_t size = strlen(seed);
+		memcpy(buf,seed,size);
+		size = mutate(buf,size);
+		accepted += checkInput(buf,size);
+	}
+	printf("%ld inputs , %ld accepted , all matching cJSON\n",iterations + (long)seedCount,accepted);
+	return 0;
+}
+#endif
@@ -0,0 +1,127 @@
+/*
+	Runs the web thing on the host , for the scripts in test_handles.
+
+	    webthing_host_server [--port 8888] [--properties 1..CONFIG_MAX_PROPERTY]
+	                         [--things 1..CONFIG_WEB_THING_MAX_THINGS] [--simulate]
+
+	The thing is the sample thing of the tests with the requested number of
+	properties , with --things N there are N of them with the ids thing-1 ... thing-N
+	like the devices behind a gateway. With --simulate its number properties change every 100 ms
+	through setPropertyValue(). GET /host/heap reports the heap use of the process.
+*/
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_http_server.h"
+#include "esp_system.h"
+#include "mock_heap.h"
+#include "sample_thing.h"
+#include "web_thing_adapter.h"
+
+static volatile sig_atomic_t gStop;
+
+static void onSignal(int sig)
+{
+	gStop = 1;
+}
+
+static void onChanged(ThingPropertyValue value)
+{
+}
+
+/* Heap use of the process in the field names test_handles/load_test.py looks for */
+static esp_err_t handleHeap(httpd_req_t* req)
+{
+	char json[160];
+	mock_heap_stats_t heap;
+	mock_heap_stats(&heap);
+	snprintf(json,sizeof(json),"{\"freeHeap\":%u,\"minFreeHeap\":%u,\"heapPeak\":%zu,\"allocations\":%llu}",
+		esp_get_free_heap_size(),esp_get_minimum_free_heap_size(),heap.peak,(unsigned long long)heap.allocs);
+	httpd_resp_set_type(req,"application/json");
+	return httpd_resp_send(req,json,HTTPD_RESP_USE_STRLEN);
+}
+
+int main(int argc,char** argv)
+{
+	int port = CONFIG_WEB_THING_PORT;
+	int count = SAMPLE_THING_MAX_PROPERTIES;
+	int thingCount = 1;
+	bool simulate = false;
+	for(int i = 1;i < argc;i++)
+	{
+		if(strcmp(argv[i],"--port") == 0 && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else if(strcmp(argv[i],"--properties") == 0 && i + 1 < argc)
+			count = atoi(argv[++i]);
+		else if(strcmp(argv[i],"--things") == 0 && i + 1 < argc)
+			thingCount = atoi(argv[++i]);
+		else if(strcmp(argv[i],"--simulate") == 0)
+			simulate = true;
+		else
+		{
+			fprintf(stderr,"usage: %s [--port N] [--properties N] [--things N] [--simulate]\n",argv[0]);
+			return 2;
+		}
+	}
+	if(count < 1 || count > CONFIG_MAX_PROPERTY)
+	{
+		fprintf(stderr,"between 1 and %d properties\n",CONFIG_MAX_PROPERTY);
+		return 2;
+	}
+	if(thingCount < 1 || thingCount > CONFIG_WEB_THING_MAX_THINGS)
+	{
+		fprintf(stderr,"between 1 and %d things\n",CONFIG_WEB_THING_MAX_THINGS);
+		return 2;
+	}
+
+	static ThingProperty* sensors[CONFIG_MAX_PROPERTY * CONFIG_WEB_THING_MAX_THINGS];
+	int sensorCount = 0;
+	mock_httpd_set_port(port);
+	for(int n = 1;n <= thingCount;n++)
+	{
+		char id[16];
+		snprintf(id,sizeof(id),"thing-%d",n);
+		Thing* thing = thingCount == 1 ? createSampleThing(count,onChanged) : createSampleThingWithId(id,count,onChanged);
+		if(thing == NULL)
+			return 1;
+		for(ThingProperty* property = thing->property;property;property = property->next)
+		{
+			if(property->info.valueType == NUMBER)
+				sensors[sensorCount++] = property;
+		}
+		if(n == 1)
+			initAdapter(thing);
+		else
+			addThing(thing);
+	}
+	startAdapter();
+	if(mock_httpd_last_server() == NULL)
+		return 1;
+	httpd_uri_t heapUri = {.uri = "/host/heap",.method = HTTP_GET,.handler = handleHeap};
+	if(httpd_register_uri_handler(mock_httpd_last_server(),&heapUri) != ESP_OK)
+		fprintf(stderr,"no room for /host/heap\n");
+	printf("listening on port %d with %d things of %d properties\n",port,thingCount,count);
+	fflush(stdout);
+
+	signal(SIGINT,onSignal);
+	signal(SIGTERM,onSignal);
+	int tick = 0;
+	while(!gStop)
+	{
+		usleep(100 * 1000);
+		tick++;
+		for(int i = 0;simulate && i < sensorCount;i++)
+		{
+			ThingPropertyValue value = {.number = 20 + ((tick + i) % 50) / 10.0};
+			setPropertyValue(sensors[i],value);
+		}
+	}
+
+	mock_heap_stats_t heap;
+	mock_heap_stats(&heap);
+	if(mock_heap_tracking())
+		printf("heap: %llu allocations , peak %zu bytes\n",(unsigned long long)heap.allocs,heap.peak);
+	return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef MOCK_ESP_EVENT_H
+#define MOCK_ESP_EVENT_H
+
+#include "esp_err.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef MOCK_ESP_EVENT_LOOP_H
+#define MOCK_ESP_EVENT_LOOP_H
+
+#include "esp_event.h"
+
+#endif
@@ -0,0 +1,1287 @@
+#include "esp_http_server.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MAX_SESSIONS		16
+#define MAX_REQ_HEADERS		16
+#define HEAD_BUFFER_SIZE	(HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN * 4)
+#define WS_INBOX_SIZE		(32 * 1024)
+#define WS_RECORD_HEADER	5		// type byte with the final bit , 4 byte length
+
+typedef struct {
+	int fd;					// -1 when free
+	bool websocket;
+	bool inProcess;
+	esp_err_t (*wsHandler)(httpd_req_t* r);
+	void* wsUserCtx;
+	uint8_t* inbox;					// frames sent to an in-process client , WS_INBOX_SIZE bytes
+	size_t inboxLen;
+	size_t headLen;					// bytes of a pipelined request already read from the socket
+	char head[HEAD_BUFFER_SIZE];
+} Session;
+
+typedef struct Server {
+	httpd_config_t config;
+	httpd_uri_t* handlers;
+	size_t handlerCount;
+	pthread_mutex_t lock;
+	int listenFd;
+	int wakeFd[2];
+	pthread_t thread;
+	bool listening;
+	volatile bool running;
+	Session sessions[MAX_SESSIONS];
+} Server;
+
+typedef struct {
+	Server* server;
+	Session* session;
+	int fd;
+
+	// request
+	mock_httpd_header_t headers[MAX_REQ_HEADERS];
+	size_t headerCount;
+	size_t remaining;		// body bytes not handed to the handler yet
+
+	// in-process body
+	const char* body;
+	size_t bodyLen;
+	size_t bodyPos;
+	size_t fragment;
+	int stalls;
+	int stallsLeft;
+
+	// socket body , bytes which arrived with the head come first
+	const char* early;
+	size_t earlyLen;
+
+	// WebSocket frame given to the handler
+	const uint8_t* wsData;
+	size_t wsLen;
+	httpd_ws_type_t wsType;
+
+	// response
+	const char* status;
+	const char* type;
+	mock_httpd_header_t respHeaders[MOCK_HTTPD_MAX_HEADERS];
+	size_t respHeaderCount;
+	bool headSent;
+	bool chunked;
+	bool complete;
+	bool failed;
+	mock_httpd_response_t* capture;
+	size_t captureHeaderUsed;
+} Request;
+
+static void* gLastServer;
+static int gPortOverride = -1;
+static int gNextFd = 1000;
+
+static void lockServer(Server* server)
+{
+	pthread_mutex_lock(&server->lock);
+}
+
+static void unlockServer(Server* server)
+{
+	pthread_mutex_unlock(&server->lock);
+}
+
+static Request* requestOf(httpd_req_t* r)
+{
+	return r ? (Request*)r->aux : NULL;
+}
+
+/*
+	Matching
+*/
+bool httpd_uri_match_wildcard(const char* tpl,const char* uri,size_t len)
+{
+	const size_t tplLen = strlen(tpl);
+	size_t exactMatchChars = tplLen;
+
+	// a trailing '*' allows any suffix , a trailing '?' makes the character before it optional
+	const char last = tplLen > 0 ? tpl[tplLen - 1] : 0;
+	const char prevLast = tplLen > 1 ? tpl[tplLen - 2] : 0;
+	const bool asterisk = last == '*' || (prevLast == '*' && last == '?');
+	const bool quest = last == '?' || (prevLast == '?' && last == '*');
+
+	if(exactMatchChars < (size_t)(asterisk + quest*2))
+		return false;
+	exactMatchChars -= asterisk + quest*2;
+
+	if(len < exactMatchChars)
+		return false;
+
+	if(!quest)
+	{
+		if(!asterisk && len != exactMatchChars)
+			return false;
+		return strncmp(tpl,uri,exactMatchChars) == 0;
+	}
+
+	if(len > exactMatchChars && tpl[exactMatchChars] != uri[exactMatchChars])
+		return false;
+	if(strncmp(tpl,uri,exactMatchChars) != 0)
+		return false;
+	return asterisk || len <= exactMatchChars + 1;
+}
+
+static bool uriMatches(Server* server,const char* reference,const char* uri,size_t len)
+{
+	if(server->config.uri_match_fn)
+		return server->config.uri_match_fn(reference,uri,len);
+	return strlen(reference) == len && strncmp(reference,uri,len) == 0;
+}
+
+static const httpd_uri_t* findHandler(Server* server,const char* uri,int method,bool* uriFound)
+{
+	size_t len = strcspn(uri,"?");
+	*uriFound = false;
+	for(size_t i = 0;i < server->handlerCount;i++)
+	{
+		const httpd_uri_t* handler = &server->handlers[i];
+		if(!uriMatches(server,handler->uri,uri,len))
+			continue;
+		*uriFound = true;
+		if((int)handler->method == method)
+			return handler;
+	}
+	return NULL;
+}
+
+/*
+	Server
+*/
+static void* listenThread(void* arg);
+
+esp_err_t httpd_start(httpd_handle_t* handle,const httpd_config_t* config)
+{
+	if(handle == NULL || config == NULL)
+		return ESP_ERR_INVALID_ARG;
+
+	Server* server = calloc(1,sizeof(Server));
+	if(server == NULL)
+		return ESP_ERR_HTTPD_ALLOC_MEM;
+	server->config = *config;
+	server->handlers = calloc(config->max_uri_handlers,sizeof(httpd_uri_t));
+	if(server->handlers == NULL && config->max_uri_handlers > 0)
+	{
+		free(server);
+		return ESP_ERR_HTTPD_ALLOC_MEM;
+	}
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&server->lock,&attr);
+	pthread_mutexattr_destroy(&attr);
+	for(int i = 0;i < MAX_SESSIONS;i++)
+		server->sessions[i].fd = -1;
+	server->listenFd = -1;
+	if(gPortOverride >= 0)
+		server->config.server_port = gPortOverride;
+
+	if(server->config.server_port != 0)
+	{
+		struct sockaddr_in addr = {0};
+		int one = 1;
+		server->listenFd = socket(AF_INET,SOCK_STREAM,0);
+		setsockopt(server->listenFd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(server->config.server_port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		if(server->listenFd < 0 || bind(server->listenFd,(struct sockaddr*)&addr,sizeof(addr)) != 0 ||
+			listen(server->listenFd,config->backlog_conn) != 0 || pipe(server->wakeFd) != 0)
+		{
+			fprintf(stderr,"httpd: cannot listen on port %d: %s\n",server->config.server_port,strerror(errno));
+			if(server->listenFd >= 0)
+				close(server->listenFd);
+			pthread_mutex_destroy(&server->lock);
+			free(server->handlers);
+			free(server);
+			return ESP_ERR_HTTPD_TASK;
+		}
+		server->running = true;
+		server->listening = true;
+		pthread_create(&server->thread,NULL,listenThread,server);
+	}
+
+	gLastServer = server;
+	*handle = server;
+	return ESP_OK;
+}
+
+static void closeSession(Server* server,Session* session)
+{
+	if(session->fd < 0)
+		return;
+	int fd = session->fd;
+	session->fd = -1;
+	session->websocket = false;
+	session->inboxLen = 0;
+	session->headLen = 0;
+	free(session->inbox);
+	session->inbox = NULL;
+	if(server->config.close_fn)
+		server->config.close_fn(server,fd);
+	else
+		close(fd);
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL)
+		return ESP_ERR_INVALID_ARG;
+
+	if(server->listening)
+	{
+		server->running = false;
+		if(write(server->wakeFd[1],"x",1) < 0)
+			perror("httpd: wake");
+		pthread_join(server->thread,NULL);
+		close(server->listenFd);
+		close(server->wakeFd[0]);
+		close(server->wakeFd[1]);
+	}
+
+	lockServer(server);
+	for(int i = 0;i < MAX_SESSIONS;i++)
+		closeSession(server,&server->sessions[i]);
+	for(size_t i = 0;i < server->handlerCount;i++)
+		free((char*)server->handlers[i].uri);
+	unlockServer(server);
+
+	pthread_mutex_destroy(&server->lock);
+	free(server->handlers);
+	if(gLastServer == server)
+		gLastServer = NULL;
+	free(server);
+	return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle,const httpd_uri_t* uri_handler)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || uri_handler == NULL || uri_handler->uri == NULL)
+		return ESP_ERR_INVALID_ARG;
+
+	lockServer(server);
+	for(size_t i = 0;i < server->handlerCount;i++)
+	{
+		if(server->handlers[i].method == uri_handler->method &&
+			uriMatches(server,server->handlers[i].uri,uri_handler->uri,strlen(uri_handler->uri)))
+		{
+			unlockServer(server);
+			return ESP_ERR_HTTPD_HANDLER_EXISTS;
+		}
+	}
+	if(server->handlerCount >= server->config.max_uri_handlers)
+	{
+		unlockServer(server);
+		return ESP_ERR_HTTPD_HANDLERS_FULL;
+	}
+
+	httpd_uri_t* copy = &server->handlers[server->handlerCount];
+	*copy = *uri_handler;
+	copy->uri = strdup(uri_handler->uri);
+	server->handlerCount++;
+	unlockServer(server);
+	return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle,const char* uri,httpd_method_t method)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || uri == NULL)
+		return ESP_ERR_INVALID_ARG;
+
+	lockServer(server);
+	for(size_t i = 0;i < server->handlerCount;i++)
+	{
+		if(server->handlers[i].method == method && strcmp(server->handlers[i].uri,uri) == 0)
+		{
+			free((char*)server->handlers[i].uri);
+			memmove(&server->handlers[i],&server->handlers[i+1],(server->handlerCount - i - 1)*sizeof(httpd_uri_t));
+			server->handlerCount--;
+			unlockServer(server);
+			return ESP_OK;
+		}
+	}
+	unlockServer(server);
+	return ESP_ERR_NOT_FOUND;
+}
+
+/* Work runs under the server lock , just like on the server task */
+esp_err_t httpd_queue_work(httpd_handle_t handle,httpd_work_fn_t work,void* arg)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || work == NULL)
+		return ESP_ERR_INVALID_ARG;
+	lockServer(server);
+	work(arg);
+	unlockServer(server);
+	return ESP_OK;
+}
+
+/*
+	Response output
+*/
+static void captureBody(Request* req,const char* data,size_t len)
+{
+	mock_httpd_response_t* capture = req->capture;
+	size_t room = MOCK_HTTPD_MAX_BODY - capture->body_len;
+	if(len > room)
+		len = room;
+	memcpy(capture->body + capture->body_len,data,len);
+	capture->body_len += len;
+	capture->body[capture->body_len] = '\0';
+}
+
+static const char* captureString(Request* req,const char* text)
+{
+	size_t len = strlen(text) + 1;
+	if(req->captureHeaderUsed + len > sizeof(req->capture->header_data))
+		return "";
+	char* copy = req->capture->header_data + req->captureHeaderUsed;
+	memcpy(copy,text,len);
+	req->captureHeaderUsed += len;
+	return copy;
+}
+
+static bool sendAll(int fd,const char* data,size_t len)
+{
+	while(len > 0)
+	{
+		ssize_t sent = send(fd,data,len,MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR)
+			continue;
+		if(sent <= 0)
+			return false;
+		data += sent;
+		len -= sent;
+	}
+	return true;
+}
+
+static esp_err_t output(Request* req,const char* data,size_t len)
+{
+	if(req->failed)
+		return ESP_ERR_HTTPD_RESP_SEND;
+	if(req->capture)
+	{
+		captureBody(req,data,len);
+		return ESP_OK;
+	}
+	if(!sendAll(req->fd,data,len))
+	{
+		req->failed = true;
+		return ESP_ERR_HTTPD_RESP_SEND;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t sendHead(Request* req,bool chunked,size_t contentLength)
+{
+	req->headSent = true;
+	req->chunked = chunked;
+	if(req->capture)
+	{
+		mock_httpd_response_t* capture = req->capture;
+		capture->status = atoi(req->status);
+		snprintf(capture->status_line,sizeof(capture->status_line),"%s",req->status);
+		snprintf(capture->content_type,sizeof(capture->content_type),"%s",req->type);
+		capture->chunked = chunked;
+		for(size_t i = 0;i < req->respHeaderCount;i++)
+		{
+			capture->headers[i].name = captureString(req,req->respHeaders[i].name);
+			capture->headers[i].value = captureString(req,req->respHeaders[i].value);
+		}
+		return ESP_OK;
+	}
+
+	char head[1024];
+	int len = snprintf(head,sizeof(head),"HTTP/1.1 %s\r\nContent-Type: %s\r\n",req->status,req->type);
+	for(size_t i = 0;i < req->respHeaderCount && len < (int)sizeof(head);i++)
+		len += snprintf(head+len,sizeof(head)-len,"%s: %s\r\n",req->respHeaders[i].name,req->respHeaders[i].value);
+	if(len < (int)sizeof(head))
+	{
+		if(chunked)
+			len += snprintf(head+len,sizeof(head)-len,"Transfer-Encoding: chunked\r\n\r\n");
+		else
+			len += snprintf(head+len,sizeof(head)-len,"Content-Length: %zu\r\n\r\n",contentLength);
+	}
+	if(len >= (int)sizeof(head))
+		return ESP_ERR_HTTPD_RESP_HDR;
+	return output(req,head,len);
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r,const char* status)
+{
+	Request* req = requestOf(r);
+	if(req == NULL || status == NULL)
+		return ESP_ERR_INVALID_ARG;
+	req->status = status;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r,const char* type)
+{
+	Request* req = requestOf(r);
+	if(req == NULL || type == NULL)
+		return ESP_ERR_INVALID_ARG;
+	req->type = type;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r,const char* field,const char* value)
+{
+	Request* req = requestOf(r);
+	if(req == NULL || field == NULL || value == NULL)
+		return ESP_ERR_INVALID_ARG;
+	if(req->respHeaderCount >= req->server->config.max_resp_headers || req->respHeaderCount >= MOCK_HTTPD_MAX_HEADERS)
+		return ESP_ERR_HTTPD_RESP_HDR;
+	req->respHeaders[req->respHeaderCount].name = field;
+	req->respHeaders[req->respHeaderCount].value = value;
+	req->respHeaderCount++;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r,const char* buf,ssize_t buf_len)
+{
+	Request* req = requestOf(r);
+	if(req == NULL)
+		return ESP_ERR_HTTPD_INVALID_REQ;
+	if(req->headSent)
+		return ESP_ERR_HTTPD_RESP_HDR;
+	if(buf == NULL)
+		buf_len = 0;
+	else if(buf_len == HTTPD_RESP_USE_STRLEN)
+		buf_len = strlen(buf);
+
+	esp_err_t ret = sendHead(req,false,buf_len);
+	if(ret == ESP_OK && buf_len > 0)
+		ret = output(req,buf,buf_len);
+	req->complete = true;
+	return ret;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r,const char* buf,ssize_t buf_len)
+{
+	Request* req = requestOf(r);
+	if(req == NULL)
+		return ESP_ERR_HTTPD_INVALID_REQ;
+	if(req->complete || (req->headSent && !req->chunked))
+		return ESP_ERR_HTTPD_RESP_HDR;
+	if(buf == NULL)
+		buf_len = 0;
+	else if(buf_len == HTTPD_RESP_USE_STRLEN)
+		buf_len = strlen(buf);
+
+	esp_err_t ret = ESP_OK;
+	if(!req->headSent)
+		ret = sendHead(req,true,0);
+	if(ret != ESP_OK)
+		return ret;
+
+	if(req->capture)
+	{
+		if(buf_len == 0)
+			req->complete = true;
+		else
+			captureBody(req,buf,buf_len);
+		return ESP_OK;
+	}
+
+	char size[16];
+	int len = snprintf(size,sizeof(size),"%zx\r\n",(size_t)buf_len);
+	if(buf_len == 0)
+	{
+		req->complete = true;
+		return output(req,"0\r\n\r\n",5);
+	}
+	if((ret = output(req,size,len)) != ESP_OK || (ret = output(req,buf,buf_len)) != ESP_OK)
+		return ret;
+	return output(req,"\r\n",2);
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t* r,const char* str)
+{
+	return httpd_resp_send(r,str,str ? HTTPD_RESP_USE_STRLEN : 0);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* r,httpd_err_code_t error,const char* msg)
+{
+	const char* status;
+	const char* text;
+	switch(error)
+	{
+		case HTTPD_501_METHOD_NOT_IMPLEMENTED:
+			status = "501 Method Not Implemented";
+			text = "Request method is not supported by server";
+			break;
+		case HTTPD_505_VERSION_NOT_SUPPORTED:
+			status = "505 Version Not Supported";
+			text = "HTTP version not supported by server";
+			break;
+		case HTTPD_400_BAD_REQUEST:
+			status = "400 Bad Request";
+			text = "Bad request syntax";
+			break;
+		case HTTPD_401_UNAUTHORIZED:
+			status = "401 Unauthorized";
+			text = "No permission to access";
+			break;
+		case HTTPD_403_FORBIDDEN:
+			status = "403 Forbidden";
+			text = "Request forbidden";
+			break;
+		case HTTPD_404_NOT_FOUND:
+			status = "404 Not Found";
+			text = "This URI does not exist";
+			break;
+		case HTTPD_405_METHOD_NOT_ALLOWED:
+			status = "405 Method Not Allowed";
+			text = "Request method for this URI is not handled by server";
+			break;
+		case HTTPD_408_REQ_TIMEOUT:
+			status = "408 Request Timeout";
+			text = "Server closed this connection";
+			break;
+		case HTTPD_411_LENGTH_REQUIRED:
+			status = "411 Length Required";
+			text = "Chunked encoding not supported";
+			break;
+		case HTTPD_414_URI_TOO_LONG:
+			status = "414 URI Too Long";
+			text = "URI is too long";
+			break;
+		case HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE:
+			status = "431 Request Header Fields Too Large";
+			text = "Header fields are too long";
+			break;
+		default:
+			status = "500 Internal Server Error";
+			text = "Server has encountered an unexpected error";
+			break;
+	}
+
+	httpd_resp_set_status(r,status);
+	httpd_resp_set_type(r,"text/html");
+	return httpd_resp_send(r,msg ? msg : text,HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_404(httpd_req_t* r)
+{
+	return httpd_resp_send_err(r,HTTPD_404_NOT_FOUND,NULL);
+}
+
+esp_err_t httpd_resp_send_408(httpd_req_t* r)
+{
+	return httpd_resp_send_err(r,HTTPD_408_REQ_TIMEOUT,NULL);
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t* r)
+{
+	return httpd_resp_send_err(r,HTTPD_500_INTERNAL_SERVER_ERROR,NULL);
+}
+
+/*
+	Request input
+*/
+static const mock_httpd_header_t* findHeader(Request* req,const char* field)
+{
+	for(size_t i = 0;i < req->headerCount;i++)
+	{
+		if(strcasecmp(req->headers[i].name,field) == 0)
+			return &req->headers[i];
+	}
+	return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t* r,const char* field)
+{
+	Request* req = requestOf(r);
+	const mock_httpd_header_t* header = req && field ? findHeader(req,field) : NULL;
+	return header ? strlen(header->value) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r,const char* field,char* val,size_t val_size)
+{
+	Request* req = requestOf(r);
+	if(req == NULL || field == NULL)
+		return ESP_ERR_INVALID_ARG;
+	const mock_httpd_header_t* header = findHeader(req,field);
+	if(header == NULL)
+		return ESP_ERR_NOT_FOUND;
+	if(val == NULL || val_size == 0)
+		return ESP_ERR_HTTPD_RESULT_TRUNC;
+
+	size_t len = strlen(header->value);
+	size_t copy = len < val_size - 1 ? len : val_size - 1;
+	memcpy(val,header->value,copy);
+	val[copy] = '\0';
+	return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r)
+{
+	Request* req = requestOf(r);
+	return req ? req->fd : -1;
+}
+
+int httpd_req_recv(httpd_req_t* r,char* buf,size_t buf_len)
+{
+	Request* req = requestOf(r);
+	if(req == NULL || buf == NULL)
+		return HTTPD_SOCK_ERR_INVALID;
+	if(req->remaining == 0 || buf_len == 0)
+		return 0;
+	if(buf_len > req->remaining)
+		buf_len = req->remaining;
+
+	if(req->body)
+	{
+		if(req->stallsLeft > 0)
+		{
+			req->stallsLeft--;
+			return HTTPD_SOCK_ERR_TIMEOUT;
+		}
+		size_t n = req->bodyLen - req->bodyPos;
+		if(req->fragment && n > req->fragment)
+			n = req->fragment;
+		if(n > buf_len)
+			n = buf_len;
+		if(n == 0)
+			return 0;		// the client sent less than it announced and closed
+		memcpy(buf,req->body + req->bodyPos,n);
+		req->bodyPos += n;
+		req->remaining -= n;
+		req->stallsLeft = req->stalls;
+		return n;
+	}
+
+	if(req->earlyLen > 0)
+	{
+		size_t n = req->earlyLen < buf_len ? req->earlyLen : buf_len;
+		memcpy(buf,req->early,n);
+		req->early += n;
+		req->earlyLen -= n;
+		req->remaining -= n;
+		return n;
+	}
+
+	if(req->capture)
+		return 0;
+
+	ssize_t n;
+	do
+		n = recv(req->fd,buf,buf_len,0);
+	while(n < 0 && errno == EINTR);
+	if(n < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+	req->remaining -= n;
+	return n;
+}
+
+/*
+	Dispatch
+*/
+static void initRequest(Request* req,httpd_req_t* r,Server* server,int fd)
+{
+	memset(req,0,sizeof(*req));
+	memset(r,0,sizeof(*r));
+	req->server = server;
+	req->fd = fd;
+	req->status = HTTPD_200;
+	req->type = "text/html";
+	r->handle = server;
+	r->aux = req;
+}
+
+static void setUri(httpd_req_t* r,const char* uri)
+{
+	snprintf((char*)r->uri,sizeof(r->uri),"%s",uri);
+}
+
+/* Runs the handler for the request , sends 404 or 405 if there is none. Server lock held. */
+static esp_err_t dispatch(Server* server,Request* req,httpd_req_t* r,const httpd_uri_t** matched)
+{
+	bool uriFound = false;
+	const httpd_uri_t* handler = findHandler(server,r->uri,r->method,&uriFound);
+	*matched = handler;
+	if(handler == NULL)
+	{
+		httpd_resp_send_err(r,uriFound ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND,NULL);
+		return ESP_ERR_NOT_FOUND;
+	}
+	r->user_ctx = handler->user_ctx;
+	return handler->handler(r);
+}
+
+static Session* newSession(Server* server,int fd,bool inProcess)
+{
+	for(int i = 0;i < MAX_SESSIONS;i++)
+	{
+		Session* session = &server->sessions[i];
+		if(session->fd < 0)
+		{
+			session->fd = fd;
+			session->inProcess = inProcess;
+			session->websocket = false;
+			session->inboxLen = 0;
+			session->headLen = 0;
+			return session;
+		}
+	}
+	return NULL;
+}
+
+static Session* findSession(Server* server,int fd)
+{
+	for(int i = 0;i < MAX_SESSIONS;i++)
+	{
+		if(server->sessions[i].fd == fd && fd >= 0)
+			return &server->sessions[i];
+	}
+	return NULL;
+}
+
+esp_err_t mock_httpd_request(httpd_handle_t handle,const mock_httpd_request_t* request,mock_httpd_response_t* response)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || request == NULL || request->uri == NULL || response == NULL)
+		return ESP_ERR_INVALID_ARG;
+
+	Request req;
+	httpd_req_t r;
+	initRequest(&req,&r,server,-1);
+	memset(response,0,offsetof(mock_httpd_response_t,body));
+	response->body[0] = '\0';
+	req.capture = response;
+	for(int i = 0;i < MOCK_HTTPD_MAX_HEADERS && request->headers[i].name;i++)
+		req.headers[req.headerCount++] = request->headers[i];
+
+	static const char empty[1] = "";
+	req.body = request->body ? request->body : empty;
+	req.bodyLen = request->body ? request->body_len : 0;
+	req.fragment = request->fragment;
+	req.stalls = request->stalls;
+	req.stallsLeft = request->stalls;
+	r.content_len = request->content_len ? request->content_len : req.bodyLen;
+	req.remaining = r.content_len;
+	r.method = request->method;
+	setUri(&r,request->uri);
+
+	lockServer(server);
+	req.fd = gNextFd++;
+	const httpd_uri_t* handler = NULL;
+	esp_err_t ret = dispatch(server,&req,&r,&handler);
+	unlockServer(server);
+
+	response->handler_result = ret;
+	response->closed = handler && ret != ESP_OK;
+	if(r.free_ctx && r.sess_ctx)
+		r.free_ctx(r.sess_ctx);
+	if(!req.headSent)
+		response->status = 0;
+	return handler ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+const char* mock_httpd_response_header(const mock_httpd_response_t* response,const char* name)
+{
+	for(int i = 0;i < MOCK_HTTPD_MAX_HEADERS && response->headers[i].name;i++)
+	{
+		if(strcasecmp(response->headers[i].name,name) == 0)
+			return response->headers[i].value;
+	}
+	return NULL;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle,size_t* fds,int* client_fds)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || fds == NULL || client_fds == NULL)
+		return ESP_ERR_INVALID_ARG;
+	size_t count = 0;
+	lockServer(server);
+	for(int i = 0;i < MAX_SESSIONS && count < *fds;i++)
+	{
+		if(server->sessions[i].fd >= 0)
+			client_fds[count++] = server->sessions[i].fd;
+	}
+	unlockServer(server);
+	*fds = count;
+	return ESP_OK;
+}
+
+/*
+	WebSocket
+*/
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd,int fd)
+{
+	Server* server = (Server*)hd;
+	if(server == NULL)
+		return HTTPD_WS_CLIENT_INVALID;
+	lockServer(server);
+	Session* session = findSession(server,fd);
+	httpd_ws_client_info_t info = session == NULL ? HTTPD_WS_CLIENT_INVALID :
+		session->websocket ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP;
+	unlockServer(server);
+	return info;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t* r,httpd_ws_frame_t* pkt,size_t max_len)
+{
+	Request* req = requestOf(r);
+	if(req == NULL || pkt == NULL)
+		return ESP_ERR_INVALID_ARG;
+	if(req->wsData == NULL)
+		return ESP_ERR_INVALID_STATE;
+
+	pkt->type = req->wsType;
+	pkt->final = true;
+	pkt->fragmented = false;
+	pkt->len = req->wsLen;
+	if(max_len == 0)
+		return ESP_OK;
+	if(pkt->payload == NULL)
+		return ESP_ERR_INVALID_ARG;
+	if(req->wsLen > max_len)
+		return ESP_ERR_INVALID_SIZE;
+	memcpy(pkt->payload,req->wsData,req->wsLen);
+	return ESP_OK;
+}
+
+static esp_err_t queueFrame(Session* session,httpd_ws_frame_t* frame)
+{
+	if(session == NULL || !session->websocket)
+		return ESP_ERR_INVALID_ARG;
+	if(!session->inProcess || session->inbox == NULL)
+		return ESP_ERR_NOT_SUPPORTED;
+	if(session->inboxLen + WS_RECORD_HEADER + frame->len > WS_INBOX_SIZE)
+		return ESP_FAIL;
+
+	uint8_t* record = session->inbox + session->inboxLen;
+	uint32_t len = frame->len;
+	bool final = frame->final || !frame->fragmented;
+	record[0] = (uint8_t)frame->type | (final ? 0x80 : 0);
+	memcpy(record + 1,&len,4);
+	memcpy(record + WS_RECORD_HEADER,frame->payload,len);
+	session->inboxLen += WS_RECORD_HEADER + len;
+	return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t* r,httpd_ws_frame_t* pkt)
+{
+	Request* req = requestOf(r);
+	if(req == NULL || pkt == NULL)
+		return ESP_ERR_INVALID_ARG;
+	lockServer(req->server);
+	esp_err_t ret = queueFrame(findSession(req->server,req->fd),pkt);
+	unlockServer(req->server);
+	return ret;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd,int fd,httpd_ws_frame_t* frame)
+{
+	Server* server = (Server*)hd;
+	if(server == NULL || frame == NULL)
+		return ESP_ERR_INVALID_ARG;
+	lockServer(server);
+	esp_err_t ret = queueFrame(findSession(server,fd),frame);
+	unlockServer(server);
+	return ret;
+}
+
+int mock_httpd_ws_connect(httpd_handle_t handle,const char* uri)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || uri == NULL)
+		return -1;
+
+	// a real descriptor , close_fn may close() it
+	int fd = open("/dev/null",O_RDWR);
+	if(fd < 0)
+		return -1;
+
+	lockServer(server);
+	bool uriFound;
+	const httpd_uri_t* handler = findHandler(server,uri,HTTP_GET,&uriFound);
+	Session* session = handler && handler->is_websocket ? newSession(server,fd,true) : NULL;
+	if(session)
+		session->inbox = malloc(WS_INBOX_SIZE);
+	if(session == NULL || session->inbox == NULL)
+	{
+		if(session)
+			session->fd = -1;
+		unlockServer(server);
+		close(fd);
+		return -1;
+	}
+
+	// the handshake reaches the handler as a GET with the upgrade headers
+	Request req;
+	httpd_req_t r;
+	initRequest(&req,&r,server,fd);
+	req.session = session;
+	req.headers[req.headerCount++] = (mock_httpd_header_t){"Upgrade","websocket"};
+	req.headers[req.headerCount++] = (mock_httpd_header_t){"Connection","Upgrade"};
+	r.method = HTTP_GET;
+	r.user_ctx = handler->user_ctx;
+	setUri(&r,uri);
+	session->websocket = true;
+	session->wsHandler = handler->handler;
+	session->wsUserCtx = handler->user_ctx;
+	if(handler->handler(&r) != ESP_OK)
+	{
+		closeSession(server,session);
+		fd = -1;
+	}
+	unlockServer(server);
+	return fd;
+}
+
+esp_err_t mock_httpd_ws_send_text(httpd_handle_t handle,int fd,const char* text)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || text == NULL)
+		return ESP_ERR_INVALID_ARG;
+
+	lockServer(server);
+	Session* session = findSession(server,fd);
+	if(session == NULL || !session->websocket)
+	{
+		unlockServer(server);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	// frames reach the handler with method 0 , like on the server task
+	Request req;
+	httpd_req_t r;
+	initRequest(&req,&r,server,fd);
+	req.session = session;
+	req.wsData = (const uint8_t*)text;
+	req.wsLen = strlen(text);
+	req.wsType = HTTPD_WS_TYPE_TEXT;
+	r.user_ctx = session->wsUserCtx;
+	esp_err_t ret = session->wsHandler(&r);
+	if(ret != ESP_OK)
+		closeSession(server,session);
+	unlockServer(server);
+	return ret;
+}
+
+int mock_httpd_ws_receive(httpd_handle_t handle,int fd,char* buf,size_t size)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL || buf == NULL || size == 0)
+		return -1;
+
+	lockServer(server);
+	Session* session = findSession(server,fd);
+	if(session == NULL)
+	{
+		unlockServer(server);
+		return -1;
+	}
+
+	// find the end of the first complete message
+	size_t pos = 0;
+	size_t total = 0;
+	bool complete = false;
+	while(pos + WS_RECORD_HEADER <= session->inboxLen)
+	{
+		uint32_t len;
+		memcpy(&len,session->inbox + pos + 1,4);
+		bool final = session->inbox[pos] & 0x80;
+		size_t copy = total < size - 1 ? size - 1 - total : 0;
+		if(copy > len)
+			copy = len;
+		memcpy(buf + total,session->inbox + pos + WS_RECORD_HEADER,copy);
+		total += copy;
+		pos += WS_RECORD_HEADER + len;
+		if(final)
+		{
+			complete = true;
+			break;
+		}
+	}
+
+	if(!complete)
+	{
+		unlockServer(server);
+		return -1;
+	}
+	buf[total] = '\0';
+	memmove(session->inbox,session->inbox + pos,session->inboxLen - pos);
+	session->inboxLen -= pos;
+	unlockServer(server);
+	return (int)total;
+}
+
+void mock_httpd_ws_close(httpd_handle_t handle,int fd)
+{
+	Server* server = (Server*)handle;
+	if(server == NULL)
+		return;
+	lockServer(server);
+	Session* session = findSession(server,fd);
+	if(session)
+		closeSession(server,session);
+	unlockServer(server);
+}
+
+/*
+	TCP listener
+
+	Connections are polled and served one request at a time , which is how the
+	server task on the device works. Handlers see the same API as in-process
+	requests. WebSocket upgrades are refused here.
+*/
+static int methodFromName(const char* name)
+{
+	static const struct { const char* name; int method; } methods[] = {
+		{"DELETE",HTTP_DELETE},{"GET",HTTP_GET},{"HEAD",HTTP_HEAD},{"POST",HTTP_POST},{"PUT",HTTP_PUT}
+	};
+	for(size_t i = 0;i < sizeof(methods)/sizeof(methods[0]);i++)
+	{
+		if(strcmp(methods[i].name,name) == 0)
+			return methods[i].method;
+	}
+	return -1;
+}
+
+static void sendSimpleError(Server* server,int fd,httpd_err_code_t code)
+{
+	Request req;
+	httpd_req_t r;
+	initRequest(&req,&r,server,fd);
+	httpd_resp_send_err(&r,code,NULL);
+}
+
+/* Reads one request head into the session buffer , returns its length or 0 to close the connection */
+static size_t readHead(Server* server,Session* session)
+{
+	for(;;)
+	{
+		char* end = NULL;
+		if(session->headLen > 0)
+		{
+			session->head[session->headLen] = '\0';
+			end = strstr(session->head,"\r\n\r\n");
+		}
+		if(end)
+			return end - session->head + 4;
+		if(session->headLen >= sizeof(session->head) - 1)
+		{
+			sendSimpleError(server,session->fd,HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+			return 0;
+		}
+
+		ssize_t n = recv(session->fd,session->head + session->headLen,sizeof(session->head) - 1 - session->headLen,0);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return 0;
+		session->headLen += n;
+	}
+}
+
+/* Serves one request from the connection , returns false when it has to be closed */
+static bool serveRequest(Server* server,Session* session)
+{
+	size_t headLen = readHead(server,session);
+	if(headLen == 0)
+		return false;
+
+	Request req;
+	httpd_req_t r;
+	initRequest(&req,&r,server,session->fd);
+	req.session = session;
+
+	char* line = session->head;
+	char* next = strstr(line,"\r\n");
+	*next = '\0';
+	char* method = strtok(line," ");
+	char* uri = strtok(NULL," ");
+	char* version = strtok(NULL," ");
+	if(method == NULL || uri == NULL || version == NULL || strncmp(version,"HTTP/1.",7) != 0)
+	{
+		sendSimpleError(server,session->fd,HTTPD_400_BAD_REQUEST);
+		return false;
+	}
+	r.method = methodFromName(method);
+	if(r.method < 0)
+	{
+		sendSimpleError(server,session->fd,HTTPD_501_METHOD_NOT_IMPLEMENTED);
+		return false;
+	}
+	if(strlen(uri) > HTTPD_MAX_URI_LEN)
+	{
+		sendSimpleError(server,session->fd,HTTPD_414_URI_TOO_LONG);
+		return false;
+	}
+	setUri(&r,uri);
+
+	bool keepAlive = strcmp(version,"HTTP/1.1") == 0;
+	for(line = next + 2;line < session->head + headLen - 2;line = next + 2)
+	{
+		next = strstr(line,"\r\n");
+		*next = '\0';
+		char* colon = strchr(line,':');
+		if(colon == NULL)
+			continue;
+		*colon = '\0';
+		char* value = colon + 1;
+		while(*value == ' ' || *value == '\t')
+			value++;
+		if(strcasecmp(line,"Content-Length") == 0)
+			r.content_len = strtoul(value,NULL,10);
+		else if(strcasecmp(line,"Connection") == 0)
+			keepAlive = strcasecmp(value,"close") != 0;
+		else if(strcasecmp(line,"Transfer-Encoding") == 0)
+		{
+			sendSimpleError(server,session->fd,HTTPD_411_LENGTH_REQUIRED);
+			return false;
+		}
+		if(req.headerCount < MAX_REQ_HEADERS)
+			req.headers[req.headerCount++] = (mock_httpd_header_t){line,value};
+	}
+	if(findHeader(&req,"Upgrade"))
+	{
+		sendSimpleError(server,session->fd,HTTPD_501_METHOD_NOT_IMPLEMENTED);
+		return false;
+	}
+
+	req.remaining = r.content_len;
+	req.early = session->head + headLen;
+	req.earlyLen = session->headLen - headLen;
+	if(req.earlyLen > req.remaining)
+		req.earlyLen = req.remaining;
+
+	const httpd_uri_t* handler = NULL;
+	lockServer(server);
+	esp_err_t ret = dispatch(server,&req,&r,&handler);
+	unlockServer(server);
+	if(r.free_ctx && r.sess_ctx)
+		r.free_ctx(r.sess_ctx);
+	if(ret != ESP_OK && handler)
+		return false;
+	if(req.failed)
+		return false;
+
+	// drop what the handler did not read , keep the start of a pipelined request
+	char discard[512];
+	while(req.remaining > 0)
+	{
+		int n = httpd_req_recv(&r,discard,sizeof(discard));
+		if(n <= 0)
+			return false;
+	}
+	size_t used = headLen + (req.early - (session->head + headLen));
+	memmove(session->head,session->head + used,session->headLen - used);
+	session->headLen -= used;
+	return keepAlive;
+}
+
+static void* listenThread(void* arg)
+{
+	Server* server = (Server*)arg;
+	struct pollfd fds[MAX_SESSIONS + 2];
+
+	while(server->running)
+	{
+		int count = 0;
+		int open = 0;
+		fds[count++] = (struct pollfd){server->wakeFd[0],POLLIN,0};
+		lockServer(server);
+		for(int i = 0;i < MAX_SESSIONS;i++)
+		{
+			if(server->sessions[i].fd >= 0 && !server->sessions[i].inProcess)
+			{
+				fds[count++] = (struct pollfd){server->sessions[i].fd,POLLIN,0};
+				open++;
+			}
+		}
+		unlockServer(server);
+		if(open < server->config.max_open_sockets)
+			fds[count++] = (struct pollfd){server->listenFd,POLLIN,0};
+
+		if(poll(fds,count,-1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		if(!server->running)
+			break;
+
+		for(int i = 1;i < count;i++)
+		{
+			if(!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			if(fds[i].fd == server->listenFd)
+			{
+				int fd = accept(server->listenFd,NULL,NULL);
+				if(fd < 0)
+					continue;
+				struct timeval timeout = {server->config.recv_wait_timeout,0};
+				struct timeval sendTimeout = {server->config.send_wait_timeout,0};
+				int one = 1;
+				setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+				setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,&sendTimeout,sizeof(sendTimeout));
+				setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+				lockServer(server);
+				if(newSession(server,fd,false) == NULL)
+					close(fd);
+				unlockServer(server);
+				continue;
+			}
+
+			lockServer(server);
+			Session* session = findSession(server,fds[i].fd);
+			unlockServer(server);
+			if(session == NULL)
+				continue;
+			// serve everything already buffered , pipelined requests included
+			bool keep;
+			do
+				keep = serveRequest(server,session);
+			while(keep && session->headLen > 0 && strstr(session->head,"\r\n\r\n") != NULL);
+			if(!keep)
+			{
+				lockServer(server);
+				closeSession(server,session);
+				unlockServer(server);
+			}
+		}
+	}
+	return NULL;
+}
+
+httpd_handle_t mock_httpd_last_server(void)
+{
+	return gLastServer;
+}
+
+void mock_httpd_set_port(int port)
+{
+	gPortOverride = port;
+}
@@ -0,0 +1,238 @@
+#ifndef MOCK_ESP_HTTP_SERVER_H
+#define MOCK_ESP_HTTP_SERVER_H
+
+/*
+	Host stand-in for the ESP-IDF http server.
+
+	Handlers are registered and matched like in esp_http_server and always run one
+	at a time , as they would in the single server task. Requests reach them either
+	from a TCP listener on config.server_port (set it to 0 to skip the listener) or
+	in-process through mock_httpd_request() , which captures the response for tests.
+	WebSocket sessions are only available in-process , see mock_httpd_ws_*().
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+typedef void* httpd_handle_t;
+
+typedef enum {
+	HTTP_DELETE = 0,
+	HTTP_GET = 1,
+	HTTP_HEAD = 2,
+	HTTP_POST = 3,
+	HTTP_PUT = 4,
+} httpd_method_t;
+
+#define HTTPD_MAX_URI_LEN		512
+#define HTTPD_MAX_REQ_HDR_LEN	512
+
+#define HTTPD_SOCK_ERR_FAIL		-1
+#define HTTPD_SOCK_ERR_INVALID	-2
+#define HTTPD_SOCK_ERR_TIMEOUT	-3
+
+#define HTTPD_RESP_USE_STRLEN	-1
+
+#define HTTPD_200	"200 OK"
+#define HTTPD_204	"204 No Content"
+#define HTTPD_400	"400 Bad Request"
+#define HTTPD_404	"404 Not Found"
+#define HTTPD_408	"408 Request Timeout"
+#define HTTPD_500	"500 Internal Server Error"
+
+typedef struct httpd_req {
+	httpd_handle_t handle;
+	int method;
+	const char uri[HTTPD_MAX_URI_LEN + 1];
+	size_t content_len;
+	void* aux;
+	void* user_ctx;
+	void* sess_ctx;
+	void (*free_ctx)(void* ctx);
+	bool ignore_sess_ctx_changes;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+	const char* uri;
+	httpd_method_t method;
+	esp_err_t (*handler)(httpd_req_t* r);
+	void* user_ctx;
+	bool is_websocket;
+	bool handle_ws_control_frames;
+	const char* supported_subprotocol;
+} httpd_uri_t;
+
+typedef enum {
+	HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+	HTTPD_501_METHOD_NOT_IMPLEMENTED,
+	HTTPD_505_VERSION_NOT_SUPPORTED,
+	HTTPD_400_BAD_REQUEST,
+	HTTPD_401_UNAUTHORIZED,
+	HTTPD_403_FORBIDDEN,
+	HTTPD_404_NOT_FOUND,
+	HTTPD_405_METHOD_NOT_ALLOWED,
+	HTTPD_408_REQ_TIMEOUT,
+	HTTPD_411_LENGTH_REQUIRED,
+	HTTPD_414_URI_TOO_LONG,
+	HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE,
+	HTTPD_ERR_CODE_MAX
+} httpd_err_code_t;
+
+typedef enum {
+	HTTPD_WS_TYPE_CONTINUE = 0x0,
+	HTTPD_WS_TYPE_TEXT = 0x1,
+	HTTPD_WS_TYPE_BINARY = 0x2,
+	HTTPD_WS_TYPE_CLOSE = 0x8,
+	HTTPD_WS_TYPE_PING = 0x9,
+	HTTPD_WS_TYPE_PONG = 0xA
+} httpd_ws_type_t;
+
+typedef enum {
+	HTTPD_WS_CLIENT_INVALID = 0x0,
+	HTTPD_WS_CLIENT_HTTP = 0x1,
+	HTTPD_WS_CLIENT_WEBSOCKET = 0x2,
+} httpd_ws_client_info_t;
+
+typedef struct httpd_ws_frame {
+	bool final;
+	bool fragmented;
+	httpd_ws_type_t type;
+	uint8_t* payload;
+	size_t len;
+} httpd_ws_frame_t;
+
+typedef void (*httpd_work_fn_t)(void* arg);
+typedef void (*httpd_close_func_t)(httpd_handle_t hd,int sockfd);
+typedef bool (*httpd_uri_match_func_t)(const char* reference_uri,const char* uri_to_match,size_t match_upto);
+
+typedef struct httpd_config {
+	unsigned task_priority;
+	size_t stack_size;
+	uint16_t server_port;
+	uint16_t ctrl_port;
+	uint16_t max_open_sockets;
+	uint16_t max_uri_handlers;
+	uint16_t max_resp_headers;
+	uint16_t backlog_conn;
+	bool lru_purge_enable;
+	uint16_t recv_wait_timeout;
+	uint16_t send_wait_timeout;
+	void* global_user_ctx;
+	httpd_close_func_t close_fn;
+	httpd_uri_match_func_t uri_match_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() {			\
+		.task_priority = 5,					\
+		.stack_size = 4096,					\
+		.server_port = 80,					\
+		.ctrl_port = 32768,					\
+		.max_open_sockets = 7,				\
+		.max_uri_handlers = 8,				\
+		.max_resp_headers = 8,				\
+		.backlog_conn = 5,					\
+		.lru_purge_enable = false,			\
+		.recv_wait_timeout = 5,				\
+		.send_wait_timeout = 5,				\
+		.global_user_ctx = NULL,			\
+		.close_fn = NULL,					\
+		.uri_match_fn = NULL				\
+	}
+
+esp_err_t httpd_start(httpd_handle_t* handle,const httpd_config_t* config);
+esp_err_t httpd_stop(httpd_handle_t handle);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle,const httpd_uri_t* uri_handler);
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle,const char* uri,httpd_method_t method);
+esp_err_t httpd_queue_work(httpd_handle_t handle,httpd_work_fn_t work,void* arg);
+bool httpd_uri_match_wildcard(const char* uri_template,const char* uri_to_match,size_t match_upto);
+
+int httpd_req_recv(httpd_req_t* r,char* buf,size_t buf_len);
+int httpd_req_to_sockfd(httpd_req_t* r);
+size_t httpd_req_get_hdr_value_len(httpd_req_t* r,const char* field);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r,const char* field,char* val,size_t val_size);
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r,const char* status);
+esp_err_t httpd_resp_set_type(httpd_req_t* r,const char* type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r,const char* field,const char* value);
+esp_err_t httpd_resp_send(httpd_req_t* r,const char* buf,ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r,const char* buf,ssize_t buf_len);
+esp_err_t httpd_resp_sendstr(httpd_req_t* r,const char* str);
+esp_err_t httpd_resp_send_err(httpd_req_t* req,httpd_err_code_t error,const char* msg);
+esp_err_t httpd_resp_send_404(httpd_req_t* r);
+esp_err_t httpd_resp_send_408(httpd_req_t* r);
+esp_err_t httpd_resp_send_500(httpd_req_t* r);
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t* req,httpd_ws_frame_t* pkt,size_t max_len);
+esp_err_t httpd_ws_send_frame(httpd_req_t* req,httpd_ws_frame_t* pkt);
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd,int fd,httpd_ws_frame_t* frame);
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd,int fd);
+
+/* Sockets of open sessions , fds holds the size of client_fds and is set to the count */
+esp_err_t httpd_get_client_list(httpd_handle_t handle,size_t* fds,int* client_fds);
+
+/*
+	In-process requests
+*/
+#define MOCK_HTTPD_MAX_HEADERS	8
+#define MOCK_HTTPD_MAX_BODY		(64 * 1024)
+
+typedef struct {
+	const char* name;
+	const char* value;
+} mock_httpd_header_t;
+
+typedef struct {
+	httpd_method_t method;
+	const char* uri;
+	mock_httpd_header_t headers[MOCK_HTTPD_MAX_HEADERS];	// unused entries have name NULL
+	const char* body;
+	size_t body_len;
+	size_t content_len;		// announced length , 0 means body_len
+	size_t fragment;		// httpd_req_recv() returns at most this many bytes , 0 = no limit
+	int stalls;				// httpd_req_recv() times out this many times before each fragment
+} mock_httpd_request_t;
+
+typedef struct {
+	int status;							// numeric status code
+	char status_line[64];
+	char content_type[64];
+	mock_httpd_header_t headers[MOCK_HTTPD_MAX_HEADERS];
+	char header_data[1024];				// copies of the header names and values
+	bool chunked;
+	bool closed;						// handler asked to close the connection (returned ESP_FAIL)
+	esp_err_t handler_result;
+	size_t body_len;
+	char body[MOCK_HTTPD_MAX_BODY + 1];	// always NUL terminated
+} mock_httpd_response_t;
+
+/* Runs one request through the handler table , returns ESP_ERR_NOT_FOUND if no handler matched */
+esp_err_t mock_httpd_request(httpd_handle_t handle,const mock_httpd_request_t* request,mock_httpd_response_t* response);
+
+/* Value of a captured response header , NULL if it was not set */
+const char* mock_httpd_response_header(const mock_httpd_response_t* response,const char* name);
+
+/* Opens an in-process WebSocket on uri , returns the session fd or -1 */
+int mock_httpd_ws_connect(httpd_handle_t handle,const char* uri);
+
+/* Delivers a text message from the client to the server */
+esp_err_t mock_httpd_ws_send_text(httpd_handle_t handle,int fd,const char* text);
+
+/*
+	Takes the next complete message the server sent to the client , fragments are joined.
+	Returns the message length or -1 if there is none.
+*/
+int mock_httpd_ws_receive(httpd_handle_t handle,int fd,char* buf,size_t size);
+
+/* Closes the session like a client disconnect , calls config.close_fn */
+void mock_httpd_ws_close(httpd_handle_t handle,int fd);
+
+/* The server started last , lets tests reach a server the component keeps private */
+httpd_handle_t mock_httpd_last_server(void);
+
+/* Port used by servers started from now on instead of config.server_port , 0 skips the listener , -1 restores */
+void mock_httpd_set_port(int port);
+
+#endif
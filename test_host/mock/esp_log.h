@@ -0,0 +1,26 @@
+#ifndef MOCK_ESP_LOG_H
+#define MOCK_ESP_LOG_H
+
+#include <stdio.h>
+#include "sdkconfig.h"
+
+/* Levels as in ESP-IDF , CONFIG_LOG_DEFAULT_LEVEL picks what is printed to stderr */
+#define ESP_LOG_NONE	0
+#define ESP_LOG_ERROR	1
+#define ESP_LOG_WARN	2
+#define ESP_LOG_INFO	3
+#define ESP_LOG_DEBUG	4
+#define ESP_LOG_VERBOSE	5
+
+#define MOCK_LOG(level,letter,tag,format,...) do {							\
+		if(CONFIG_LOG_DEFAULT_LEVEL >= level)								\
+			fprintf(stderr,letter " (%s) " format "\n",tag,##__VA_ARGS__);	\
+	} while(0)
+
+#define ESP_LOGE(tag,format,...) MOCK_LOG(ESP_LOG_ERROR,"E",tag,format,##__VA_ARGS__)
+#define ESP_LOGW(tag,format,...) MOCK_LOG(ESP_LOG_WARN,"W",tag,format,##__VA_ARGS__)
+#define ESP_LOGI(tag,format,...) MOCK_LOG(ESP_LOG_INFO,"I",tag,format,##__VA_ARGS__)
+#define ESP_LOGD(tag,format,...) MOCK_LOG(ESP_LOG_DEBUG,"D",tag,format,##__VA_ARGS__)
+#define ESP_LOGV(tag,format,...) MOCK_LOG(ESP_LOG_VERBOSE,"V",tag,format,##__VA_ARGS__)
+
+#endif
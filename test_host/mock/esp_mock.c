@@ -0,0 +1,90 @@
+/*
+	Wifi , mDNS , esp_timer and esp_random stand-ins for the host build.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "mdns.h"
+
+static uint8_t gMac[6] = {0x24,0x0a,0xc4,0x00,0x00,0x01};
+static mock_mdns_state_t gMdns;
+static int64_t gTimeOffset;
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx,uint8_t mac[6])
+{
+	memcpy(mac,gMac,sizeof(gMac));
+	return ESP_OK;
+}
+
+void mock_wifi_set_mac(const uint8_t mac[6])
+{
+	memcpy(gMac,mac,sizeof(gMac));
+}
+
+esp_err_t mdns_init(void)
+{
+	memset(&gMdns,0,sizeof(gMdns));
+	return ESP_OK;
+}
+
+esp_err_t mdns_hostname_set(const char* hostname)
+{
+	snprintf(gMdns.hostname,sizeof(gMdns.hostname),"%s",hostname ? hostname : "");
+	return ESP_OK;
+}
+
+esp_err_t mdns_instance_name_set(const char* instance_name)
+{
+	snprintf(gMdns.instance,sizeof(gMdns.instance),"%s",instance_name ? instance_name : "");
+	return ESP_OK;
+}
+
+esp_err_t mdns_service_add(const char* instance_name,const char* service_type,const char* proto,
+							uint16_t port,mdns_txt_item_t txt[],size_t num_items)
+{
+	if(service_type == NULL || proto == NULL)
+		return ESP_ERR_INVALID_ARG;
+	snprintf(gMdns.service,sizeof(gMdns.service),"%s",service_type);
+	snprintf(gMdns.proto,sizeof(gMdns.proto),"%s",proto);
+	gMdns.port = port;
+	gMdns.services++;
+	return ESP_OK;
+}
+
+const mock_mdns_state_t* mock_mdns_state(void)
+{
+	return &gMdns;
+}
+
+int64_t esp_timer_get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000 + __atomic_load_n(&gTimeOffset,__ATOMIC_RELAXED);
+}
+
+void mock_timer_advance(int64_t us)
+{
+	__atomic_add_fetch(&gTimeOffset,us,__ATOMIC_RELAXED);
+}
+
+uint32_t esp_random(void)
+{
+	static uint32_t state;
+	uint32_t x = __atomic_load_n(&state,__ATOMIC_RELAXED);
+	if(x == 0)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME,&now);
+		x = (uint32_t)now.tv_nsec ^ (uint32_t)now.tv_sec ^ ((uint32_t)getpid() << 16) ^ 0x9e3779b9u;
+	}
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	__atomic_store_n(&state,x,__ATOMIC_RELAXED);
+	return x;
+}
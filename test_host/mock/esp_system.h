@@ -0,0 +1,14 @@
+#ifndef MOCK_ESP_SYSTEM_H
+#define MOCK_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Backed by the heap tracker , see mock_heap.h */
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+/* Different in every process , like the hardware generator after a reboot */
+uint32_t esp_random(void);
+
+#endif
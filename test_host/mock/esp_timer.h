@@ -0,0 +1,12 @@
+#ifndef MOCK_ESP_TIMER_H
+#define MOCK_ESP_TIMER_H
+
+#include <stdint.h>
+
+/* Microseconds since start , monotonic clock plus the offset from mock_timer_advance() */
+int64_t esp_timer_get_time(void);
+
+/* Moves esp_timer_get_time() forward , lets tests step over time based throttling */
+void mock_timer_advance(int64_t us);
+
+#endif
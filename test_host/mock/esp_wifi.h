@@ -0,0 +1,17 @@
+#ifndef MOCK_ESP_WIFI_H
+#define MOCK_ESP_WIFI_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+	WIFI_IF_STA = 0,
+	WIFI_IF_AP,
+} wifi_interface_t;
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx,uint8_t mac[6]);
+
+/* Sets the MAC returned by esp_wifi_get_mac() , defaults to 24:0a:c4:00:00:01 */
+void mock_wifi_set_mac(const uint8_t mac[6]);
+
+#endif
@@ -0,0 +1,415 @@
+/*
+	FreeRTOS tasks , queues and software timers on pthreads.
+*/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+struct MockTask {
+	TaskFunction_t fn;
+	void* arg;
+};
+
+struct MockTimer {
+	TickType_t period;
+	bool autoReload;
+	void* id;
+	TimerCallbackFunction_t callback;
+	bool active;
+	int64_t expiry;			// esp_timer_get_time() when it fires
+	int running;			// callbacks of the timer running now
+	bool deleted;			// freed when the last running callback returns
+	struct MockTimer* next;
+};
+
+struct MockPendedCall {
+	PendedFunction_t function;
+	void* param1;
+	uint32_t param2;
+	struct MockPendedCall* next;
+};
+
+static pthread_mutex_t gTimerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gTimerWake = PTHREAD_COND_INITIALIZER;
+static struct MockTimer* gTimers;
+static struct MockPendedCall* gPendedCalls;		// oldest first
+static bool gTimerThreadStarted;
+
+static void* taskEntry(void* arg)
+{
+	struct MockTask task = *(struct MockTask*)arg;
+	free(arg);
+	task.fn(task.arg);
+	return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn,const char* name,uint32_t stackDepth,void* arg,
+						UBaseType_t priority,TaskHandle_t* handle)
+{
+	struct MockTask* task = malloc(sizeof(struct MockTask));
+	pthread_t thread;
+	if(task == NULL)
+		return pdFAIL;
+	task->fn = fn;
+	task->arg = arg;
+	if(pthread_create(&thread,NULL,taskEntry,task) != 0)
+	{
+		free(task);
+		return pdFAIL;
+	}
+	pthread_detach(thread);
+	if(handle)
+		*handle = NULL;
+	return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+	if(task == NULL)
+		pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	struct timespec delay = {ticks / configTICK_RATE_HZ,(long)(ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ)};
+	nanosleep(&delay,NULL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	return (TickType_t)(esp_timer_get_time() / (1000 * portTICK_PERIOD_MS));
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer)
+{
+	pthread_mutex_init(&buffer->mutex,NULL);
+	return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore,TickType_t ticksToWait)
+{
+	if(ticksToWait == 0)
+		return pthread_mutex_trylock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+	pthread_mutex_lock(&semaphore->mutex);
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+	pthread_mutex_unlock(&semaphore->mutex);
+	return pdTRUE;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length,UBaseType_t itemSize,uint8_t* storage,StaticQueue_t* buffer)
+{
+	pthread_mutex_init(&buffer->lock,NULL);
+	pthread_cond_init(&buffer->changed,NULL);
+	buffer->storage = storage;
+	buffer->length = length;
+	buffer->itemSize = itemSize;
+	buffer->head = 0;
+	buffer->count = 0;
+	return buffer;
+}
+
+/* Waits for the queue to change , false once ticksToWait passed. Queue lock held. */
+static bool waitQueue(QueueHandle_t queue,TickType_t ticksToWait,const struct timespec* deadline)
+{
+	if(ticksToWait == 0)
+		return false;
+	if(ticksToWait == portMAX_DELAY)
+		return pthread_cond_wait(&queue->changed,&queue->lock) == 0;
+	return pthread_cond_timedwait(&queue->changed,&queue->lock,deadline) == 0;
+}
+
+static void queueDeadline(TickType_t ticksToWait,struct timespec* deadline)
+{
+	int64_t wait = (int64_t)ticksToWait * portTICK_PERIOD_MS * 1000000;
+	clock_gettime(CLOCK_REALTIME,deadline);
+	deadline->tv_sec += wait / 1000000000L;
+	deadline->tv_nsec += wait % 1000000000L;
+	if(deadline->tv_nsec >= 1000000000L)
+	{
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue,const void* item,TickType_t ticksToWait)
+{
+	struct timespec deadline;
+	queueDeadline(ticksToWait,&deadline);
+	pthread_mutex_lock(&queue->lock);
+	while(queue->count == queue->length)
+	{
+		if(!waitQueue(queue,ticksToWait,&deadline))
+		{
+			pthread_mutex_unlock(&queue->lock);
+			return pdFAIL;
+		}
+	}
+	UBaseType_t tail = (queue->head + queue->count) % queue->length;
+	memcpy(queue->storage + tail * queue->itemSize,item,queue->itemSize);
+	queue->count++;
+	pthread_cond_broadcast(&queue->changed);
+	pthread_mutex_unlock(&queue->lock);
+	return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue,void* item,TickType_t ticksToWait)
+{
+	struct timespec deadline;
+	queueDeadline(ticksToWait,&deadline);
+	pthread_mutex_lock(&queue->lock);
+	while(queue->count == 0)
+	{
+		if(!waitQueue(queue,ticksToWait,&deadline))
+		{
+			pthread_mutex_unlock(&queue->lock);
+			return pdFAIL;
+		}
+	}
+	memcpy(item,queue->storage + queue->head * queue->itemSize,queue->itemSize);
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	pthread_cond_broadcast(&queue->changed);
+	pthread_mutex_unlock(&queue->lock);
+	return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	UBaseType_t count = queue->count;
+	pthread_mutex_unlock(&queue->lock);
+	return count;
+}
+
+/* Takes the first due timer off the active set , timer lock held */
+static struct MockTimer* takeDueTimer(int64_t now,int64_t* nextExpiry)
+{
+	*nextExpiry = INT64_MAX;
+	for(struct MockTimer* timer = gTimers;timer;timer = timer->next)
+	{
+		if(!timer->active)
+			continue;
+		if(timer->expiry <= now)
+		{
+			if(timer->autoReload)
+				timer->expiry = now + (int64_t)timer->period * portTICK_PERIOD_MS * 1000;
+			else
+				timer->active = false;
+			return timer;
+		}
+		if(timer->expiry < *nextExpiry)
+			*nextExpiry = timer->expiry;
+	}
+	return NULL;
+}
+
+/* Runs the callback unlocked , so it can start timers again , timer lock held */
+static void runTimerCallback(struct MockTimer* timer)
+{
+	timer->running++;
+	pthread_mutex_unlock(&gTimerLock);
+	timer->callback(timer);
+	pthread_mutex_lock(&gTimerLock);
+	if(--timer->running == 0 && timer->deleted)
+		free(timer);
+}
+
+static void* timerThread(void* arg)
+{
+	pthread_mutex_lock(&gTimerLock);
+	for(;;)
+	{
+		if(gPendedCalls)
+		{
+			struct MockPendedCall* call = gPendedCalls;
+			gPendedCalls = call->next;
+			pthread_mutex_unlock(&gTimerLock);
+			call->function(call->param1,call->param2);
+			free(call);
+			pthread_mutex_lock(&gTimerLock);
+			continue;
+		}
+
+		int64_t nextExpiry;
+		struct MockTimer* due = takeDueTimer(esp_timer_get_time(),&nextExpiry);
+		if(due)
+		{
+			runTimerCallback(due);
+			continue;
+		}
+
+		if(nextExpiry == INT64_MAX)
+		{
+			pthread_cond_wait(&gTimerWake,&gTimerLock);
+		}
+		else
+		{
+			struct timespec deadline;
+			int64_t wait = nextExpiry - esp_timer_get_time();
+			clock_gettime(CLOCK_REALTIME,&deadline);
+			if(wait > 0)
+			{
+				deadline.tv_sec += wait / 1000000;
+				deadline.tv_nsec += (wait % 1000000) * 1000;
+				if(deadline.tv_nsec >= 1000000000L)
+				{
+					deadline.tv_sec++;
+					deadline.tv_nsec -= 1000000000L;
+				}
+				pthread_cond_timedwait(&gTimerWake,&gTimerLock,&deadline);
+			}
+		}
+	}
+	return NULL;
+}
+
+TimerHandle_t xTimerCreate(const char* name,TickType_t period,UBaseType_t autoReload,void* id,
+							TimerCallbackFunction_t callback)
+{
+	struct MockTimer* timer = calloc(1,sizeof(struct MockTimer));
+	if(timer == NULL)
+		return NULL;
+	timer->period = period;
+	timer->autoReload = autoReload;
+	timer->id = id;
+	timer->callback = callback;
+
+	pthread_mutex_lock(&gTimerLock);
+	timer->next = gTimers;
+	gTimers = timer;
+	if(!gTimerThreadStarted)
+	{
+		pthread_t thread;
+		gTimerThreadStarted = pthread_create(&thread,NULL,timerThread,NULL) == 0;
+		if(gTimerThreadStarted)
+			pthread_detach(thread);
+	}
+	pthread_mutex_unlock(&gTimerLock);
+	return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer,TickType_t ticksToWait)
+{
+	if(timer == NULL)
+		return pdFAIL;
+	pthread_mutex_lock(&gTimerLock);
+	timer->active = true;
+	timer->expiry = esp_timer_get_time() + (int64_t)timer->period * portTICK_PERIOD_MS * 1000;
+	pthread_cond_signal(&gTimerWake);
+	pthread_mutex_unlock(&gTimerLock);
+	return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer,TickType_t period,TickType_t ticksToWait)
+{
+	if(timer == NULL)
+		return pdFAIL;
+	pthread_mutex_lock(&gTimerLock);
+	timer->period = period;
+	pthread_mutex_unlock(&gTimerLock);
+	return xTimerStart(timer,ticksToWait);
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer,TickType_t ticksToWait)
+{
+	return xTimerStart(timer,ticksToWait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer,TickType_t ticksToWait)
+{
+	if(timer == NULL)
+		return pdFAIL;
+	pthread_mutex_lock(&gTimerLock);
+	timer->active = false;
+	pthread_mutex_unlock(&gTimerLock);
+	return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+	pthread_mutex_lock(&gTimerLock);
+	BaseType_t active = timer && timer->active;
+	pthread_mutex_unlock(&gTimerLock);
+	return active;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer,TickType_t ticksToWait)
+{
+	if(timer == NULL)
+		return pdFAIL;
+	pthread_mutex_lock(&gTimerLock);
+	for(struct MockTimer** link = &gTimers;*link;link = &(*link)->next)
+	{
+		if(*link == timer)
+		{
+			*link = timer->next;
+			break;
+		}
+	}
+	timer->deleted = true;
+	if(timer->running == 0)
+		free(timer);
+	pthread_mutex_unlock(&gTimerLock);
+	return pdPASS;
+}
+
+void* pvTimerGetTimerID(TimerHandle_t timer)
+{
+	return timer ? timer->id : NULL;
+}
+
+BaseType_t xTimerPendFunctionCall(PendedFunction_t function,void* param1,uint32_t param2,TickType_t ticksToWait)
+{
+	struct MockPendedCall* call = malloc(sizeof(struct MockPendedCall));
+	if(call == NULL || !gTimerThreadStarted)
+	{
+		free(call);
+		return pdFAIL;
+	}
+	call->function = function;
+	call->param1 = param1;
+	call->param2 = param2;
+	call->next = NULL;
+
+	pthread_mutex_lock(&gTimerLock);
+	struct MockPendedCall** link = &gPendedCalls;
+	while(*link)
+		link = &(*link)->next;
+	*link = call;
+	pthread_cond_signal(&gTimerWake);
+	pthread_mutex_unlock(&gTimerLock);
+	return pdPASS;
+}
+
+int mock_timers_flush(void)
+{
+	int fired = 0;
+	pthread_mutex_lock(&gTimerLock);
+	for(;;)
+	{
+		int64_t nextExpiry;
+		struct MockTimer* due = takeDueTimer(INT64_MAX,&nextExpiry);
+		if(due == NULL)
+			break;
+		runTimerCallback(due);
+		fired++;
+		// an auto reload timer would fire forever , unless the callback deleted it
+		bool alive = false;
+		for(struct MockTimer* timer = gTimers;timer;timer = timer->next)
+			alive |= timer == due;
+		if(alive && due->autoReload)
+			due->expiry = esp_timer_get_time() + (int64_t)due->period * portTICK_PERIOD_MS * 1000;
+	}
+	pthread_mutex_unlock(&gTimerLock);
+	return fired;
+}
@@ -0,0 +1,22 @@
+#ifndef MOCK_FREERTOS_H
+#define MOCK_FREERTOS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE				((BaseType_t)0)
+#define pdTRUE				((BaseType_t)1)
+#define pdFAIL				pdFALSE
+#define pdPASS				pdTRUE
+#define portMAX_DELAY		((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ	1000
+#define portTICK_PERIOD_MS	((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)	((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef MOCK_FREERTOS_EVENT_GROUPS_H
+#define MOCK_FREERTOS_EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef MOCK_FREERTOS_QUEUE_H
+#define MOCK_FREERTOS_QUEUE_H
+
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+
+/* Statically allocated queues of fixed size items , copied in and out like FreeRTOS does */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	uint8_t* storage;
+	UBaseType_t length;
+	UBaseType_t itemSize;
+	UBaseType_t head;
+	UBaseType_t count;
+} StaticQueue_t;
+typedef StaticQueue_t* QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length,UBaseType_t itemSize,uint8_t* storage,StaticQueue_t* buffer);
+BaseType_t xQueueSend(QueueHandle_t queue,const void* item,TickType_t ticksToWait);
+BaseType_t xQueueReceive(QueueHandle_t queue,void* item,TickType_t ticksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif
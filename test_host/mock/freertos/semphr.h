@@ -0,0 +1,17 @@
+#ifndef MOCK_FREERTOS_SEMPHR_H
+#define MOCK_FREERTOS_SEMPHR_H
+
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+
+/* Mutexes only , on pthread mutexes. Timeouts other than 0 and portMAX_DELAY wait forever. */
+typedef struct {
+	pthread_mutex_t mutex;
+} StaticSemaphore_t;
+typedef StaticSemaphore_t* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore,TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif
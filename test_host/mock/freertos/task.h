@@ -0,0 +1,16 @@
+#ifndef MOCK_FREERTOS_TASK_H
+#define MOCK_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+/* Tasks are detached pthreads , priorities and stack sizes are ignored */
+typedef struct MockTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+BaseType_t xTaskCreate(TaskFunction_t fn,const char* name,uint32_t stackDepth,void* arg,
+						UBaseType_t priority,TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+#endif
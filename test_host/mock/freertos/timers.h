@@ -0,0 +1,31 @@
+#ifndef MOCK_FREERTOS_TIMERS_H
+#define MOCK_FREERTOS_TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+/*
+	Software timers run on one service thread like the FreeRTOS timer task.
+	mock_timers_flush() fires every started timer right away from the calling
+	thread so tests do not have to sleep through timer periods. Functions queued
+	with xTimerPendFunctionCall() run on the service thread between callbacks , a
+	timer deleted while its callback runs is freed once the callback returned.
+*/
+typedef struct MockTimer* TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+typedef void (*PendedFunction_t)(void* param1,uint32_t param2);
+
+TimerHandle_t xTimerCreate(const char* name,TickType_t period,UBaseType_t autoReload,void* id,
+							TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer,TickType_t ticksToWait);
+BaseType_t xTimerStop(TimerHandle_t timer,TickType_t ticksToWait);
+BaseType_t xTimerReset(TimerHandle_t timer,TickType_t ticksToWait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer,TickType_t period,TickType_t ticksToWait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+BaseType_t xTimerDelete(TimerHandle_t timer,TickType_t ticksToWait);
+void* pvTimerGetTimerID(TimerHandle_t timer);
+BaseType_t xTimerPendFunctionCall(PendedFunction_t function,void* param1,uint32_t param2,TickType_t ticksToWait);
+
+/* Fires all started timers now , returns the number of callbacks run */
+int mock_timers_flush(void);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+	tdefl on top of zlib , enough for one-shot compression with TDEFL_FINISH.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "rom/miniz.h"
+
+tdefl_status tdefl_init(tdefl_compressor* d,tdefl_put_buf_func_ptr pPut_buf_func,void* pPut_buf_user,int flags)
+{
+	if(d == NULL || pPut_buf_func == NULL)
+		return TDEFL_STATUS_BAD_PARAM;
+
+	z_stream* stream = calloc(1,sizeof(z_stream));
+	if(stream == NULL)
+		return TDEFL_STATUS_BAD_PARAM;
+
+	// miniz probes map roughly onto zlib levels , the zlib header flag picks the wrapper
+	int probes = flags & TDEFL_MAX_PROBES_MASK;
+	int level = probes == 0 ? 1 : probes >= TDEFL_DEFAULT_MAX_PROBES ? 6 : 3;
+	int windowBits = (flags & TDEFL_WRITE_ZLIB_HEADER) ? 15 : -15;
+	if(deflateInit2(stream,level,Z_DEFLATED,windowBits,8,probes == 0 ? Z_HUFFMAN_ONLY : Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free(stream);
+		return TDEFL_STATUS_BAD_PARAM;
+	}
+	d->stream = stream;
+	d->put = pPut_buf_func;
+	d->user = pPut_buf_user;
+	d->flags = flags;
+	return TDEFL_STATUS_OKAY;
+}
+
+tdefl_status tdefl_compress_buffer(tdefl_compressor* d,const void* pIn_buf,size_t in_buf_size,tdefl_flush flush)
+{
+	z_stream* stream = (z_stream*)d->stream;
+	if(stream == NULL)
+		return TDEFL_STATUS_BAD_PARAM;
+
+	unsigned char out[1024];
+	int mode = flush == TDEFL_FINISH ? Z_FINISH : flush == TDEFL_NO_FLUSH ? Z_NO_FLUSH :
+		flush == TDEFL_FULL_FLUSH ? Z_FULL_FLUSH : Z_SYNC_FLUSH;
+	int ret;
+	stream->next_in = (Bytef*)pIn_buf;
+	stream->avail_in = in_buf_size;
+	do
+	{
+		stream->next_out = out;
+		stream->avail_out = sizeof(out);
+		ret = deflate(stream,mode);
+		size_t produced = sizeof(out) - stream->avail_out;
+		if(produced > 0 && !d->put(out,(int)produced,d->user))
+		{
+			deflateEnd(stream);
+			free(stream);
+			d->stream = NULL;
+			return TDEFL_STATUS_PUT_BUF_FAILED;
+		}
+	}
+	while(stream->avail_out == 0 || (mode == Z_FINISH && ret != Z_STREAM_END));
+
+	if(mode == Z_FINISH)
+	{
+		deflateEnd(stream);
+		free(stream);
+		d->stream = NULL;
+		return TDEFL_STATUS_DONE;
+	}
+	return TDEFL_STATUS_OKAY;
+}
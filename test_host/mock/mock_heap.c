@@ -0,0 +1,175 @@
+#include "mock_heap.h"
+#include "esp_system.h"
+
+#ifndef MOCK_HEAP_TRACE
+#define MOCK_HEAP_TRACE 1
+#endif
+
+#if MOCK_HEAP_TRACE
+#include <errno.h>
+#include <malloc.h>
+#include <string.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n,size_t size);
+extern void* __libc_realloc(void* ptr,size_t size);
+extern void* __libc_memalign(size_t alignment,size_t size);
+extern void __libc_free(void* ptr);
+
+static uint64_t gAllocs;
+static uint64_t gFrees;
+static size_t gCurrent;
+static size_t gPeak;
+static size_t gPeakEver;
+
+static void raisePeak(size_t* peak,size_t current)
+{
+	size_t seen = __atomic_load_n(peak,__ATOMIC_RELAXED);
+	while(current > seen && !__atomic_compare_exchange_n(peak,&seen,current,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+}
+
+static void* tracked(void* ptr)
+{
+	if(ptr)
+	{
+		size_t current = __atomic_add_fetch(&gCurrent,malloc_usable_size(ptr),__ATOMIC_RELAXED);
+		__atomic_add_fetch(&gAllocs,1,__ATOMIC_RELAXED);
+		raisePeak(&gPeak,current);
+		raisePeak(&gPeakEver,current);
+	}
+	return ptr;
+}
+
+static void untrack(void* ptr)
+{
+	if(ptr)
+	{
+		__atomic_sub_fetch(&gCurrent,malloc_usable_size(ptr),__ATOMIC_RELAXED);
+		__atomic_add_fetch(&gFrees,1,__ATOMIC_RELAXED);
+	}
+}
+
+void* malloc(size_t size)
+{
+	return tracked(__libc_malloc(size));
+}
+
+void* calloc(size_t n,size_t size)
+{
+	return tracked(__libc_calloc(n,size));
+}
+
+void* realloc(void* ptr,size_t size)
+{
+	if(ptr == NULL)
+		return malloc(size);
+	if(size == 0)
+	{
+		free(ptr);
+		return NULL;
+	}
+
+	size_t old = malloc_usable_size(ptr);
+	void* moved = __libc_realloc(ptr,size);
+	if(moved)
+	{
+		size_t now = malloc_usable_size(moved);
+		if(now > old)
+		{
+			size_t current = __atomic_add_fetch(&gCurrent,now - old,__ATOMIC_RELAXED);
+			__atomic_add_fetch(&gAllocs,1,__ATOMIC_RELAXED);
+			raisePeak(&gPeak,current);
+			raisePeak(&gPeakEver,current);
+		}
+		else
+		{
+			__atomic_sub_fetch(&gCurrent,old - now,__ATOMIC_RELAXED);
+		}
+	}
+	return moved;
+}
+
+void* memalign(size_t alignment,size_t size)
+{
+	return tracked(__libc_memalign(alignment,size));
+}
+
+void* aligned_alloc(size_t alignment,size_t size)
+{
+	return memalign(alignment,size);
+}
+
+int posix_memalign(void** ptr,size_t alignment,size_t size)
+{
+	void* p = memalign(alignment,size);
+	if(p == NULL)
+		return ENOMEM;
+	*ptr = p;
+	return 0;
+}
+
+void free(void* ptr)
+{
+	untrack(ptr);
+	__libc_free(ptr);
+}
+
+bool mock_heap_tracking(void)
+{
+	return true;
+}
+
+void mock_heap_stats(mock_heap_stats_t* stats)
+{
+	stats->allocs = __atomic_load_n(&gAllocs,__ATOMIC_RELAXED);
+	stats->frees = __atomic_load_n(&gFrees,__ATOMIC_RELAXED);
+	stats->current = __atomic_load_n(&gCurrent,__ATOMIC_RELAXED);
+	stats->peak = __atomic_load_n(&gPeak,__ATOMIC_RELAXED);
+}
+
+void mock_heap_reset_peak(void)
+{
+	__atomic_store_n(&gPeak,__atomic_load_n(&gCurrent,__ATOMIC_RELAXED),__ATOMIC_RELAXED);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+	size_t current = __atomic_load_n(&gCurrent,__ATOMIC_RELAXED);
+	return current < MOCK_HEAP_SIZE ? MOCK_HEAP_SIZE - current : 0;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+	size_t peak = __atomic_load_n(&gPeakEver,__ATOMIC_RELAXED);
+	return peak < MOCK_HEAP_SIZE ? MOCK_HEAP_SIZE - peak : 0;
+}
+
+#else
+
+#include <string.h>
+
+bool mock_heap_tracking(void)
+{
+	return false;
+}
+
+void mock_heap_stats(mock_heap_stats_t* stats)
+{
+	memset(stats,0,sizeof(*stats));
+}
+
+void mock_heap_reset_peak(void)
+{
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+	return MOCK_HEAP_SIZE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+	return MOCK_HEAP_SIZE;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef MOCK_HEAP_H
+#define MOCK_HEAP_H
+
+/*
+	Heap tracker for the host build.
+
+	malloc , calloc , realloc and free are replaced for the whole process (glibc
+	allows this) and counted , so tests can check allocations per request and peak
+	heap use. Tracking is compiled out for sanitizer builds (MOCK_HEAP_TRACE=0),
+	mock_heap_tracking() then returns false and all counters stay 0.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOCK_HEAP_SIZE (300 * 1024)	// pretend heap size for esp_get_free_heap_size()
+
+typedef struct {
+	uint64_t allocs;		// successful malloc , calloc and growing realloc calls
+	uint64_t frees;
+	size_t current;			// bytes in use
+	size_t peak;			// highest current since start or mock_heap_reset_peak()
+} mock_heap_stats_t;
+
+bool mock_heap_tracking(void);
+void mock_heap_stats(mock_heap_stats_t* stats);
+void mock_heap_reset_peak(void);
+
+#endif
@@ -0,0 +1,270 @@
+/*
+	NVS stand-in , a fixed table of entries behind one lock.
+*/
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "nvs_flash.h"
+
+#define MOCK_NVS_ENTRIES 128
+#define MOCK_NVS_VALUE_SIZE 512
+#define MOCK_NVS_HANDLES 16
+
+typedef enum {
+	TYPE_U8 = 1,
+	TYPE_STR,
+	TYPE_BLOB
+} EntryType;
+
+typedef struct {
+	char ns[NVS_KEY_NAME_MAX_SIZE];
+	char key[NVS_KEY_NAME_MAX_SIZE];
+	EntryType type;
+	size_t len;
+	uint8_t data[MOCK_NVS_VALUE_SIZE];
+} Entry;
+
+typedef struct {
+	bool open;
+	nvs_open_mode_t mode;
+	char ns[NVS_KEY_NAME_MAX_SIZE];
+} Handle;
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static Entry gLive[MOCK_NVS_ENTRIES];
+static Entry gCommitted[MOCK_NVS_ENTRIES];
+static Handle gHandles[MOCK_NVS_HANDLES + 1];	// handle 0 is not used
+static mock_nvs_stats_t gStats;
+static uint32_t gCommitDelayUs;
+static unsigned gFailOpens;
+static unsigned gFailCommits;
+
+esp_err_t nvs_flash_init(void)
+{
+	return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name,nvs_open_mode_t mode,nvs_handle_t* handle)
+{
+	if(name == NULL || strlen(name) >= NVS_KEY_NAME_MAX_SIZE)
+		return ESP_ERR_NVS_INVALID_NAME;
+
+	pthread_mutex_lock(&gLock);
+	if(gFailOpens)
+	{
+		gFailOpens--;
+		pthread_mutex_unlock(&gLock);
+		return ESP_ERR_NVS_NOT_INITIALIZED;
+	}
+	for(nvs_handle_t i = 1;i <= MOCK_NVS_HANDLES;i++)
+	{
+		if(!gHandles[i].open)
+		{
+			gHandles[i].open = true;
+			gHandles[i].mode = mode;
+			strcpy(gHandles[i].ns,name);
+			pthread_mutex_unlock(&gLock);
+			*handle = i;
+			return ESP_OK;
+		}
+	}
+	pthread_mutex_unlock(&gLock);
+	return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+	pthread_mutex_lock(&gLock);
+	if(handle >= 1 && handle <= MOCK_NVS_HANDLES)
+		gHandles[handle].open = false;
+	pthread_mutex_unlock(&gLock);
+}
+
+/* lock held */
+static Entry* findEntry(const char* ns,const char* key)
+{
+	for(int i = 0;i < MOCK_NVS_ENTRIES;i++)
+		if(gLive[i].type && strcmp(gLive[i].ns,ns) == 0 && strcmp(gLive[i].key,key) == 0)
+			return &gLive[i];
+	return NULL;
+}
+
+static esp_err_t checkHandle(nvs_handle_t handle,const char* key,bool write)
+{
+	if(handle < 1 || handle > MOCK_NVS_HANDLES || !gHandles[handle].open)
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	if(key == NULL || strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+		return ESP_ERR_NVS_KEY_TOO_LONG;
+	if(write && gHandles[handle].mode == NVS_READONLY)
+		return ESP_ERR_NVS_READ_ONLY;
+	return ESP_OK;
+}
+
+static esp_err_t setEntry(nvs_handle_t handle,const char* key,EntryType type,const void* data,size_t len)
+{
+	if(len > MOCK_NVS_VALUE_SIZE)
+		return ESP_ERR_NVS_INVALID_LENGTH;
+
+	pthread_mutex_lock(&gLock);
+	esp_err_t err = checkHandle(handle,key,true);
+	if(err != ESP_OK)
+	{
+		pthread_mutex_unlock(&gLock);
+		return err;
+	}
+
+	Entry* entry = findEntry(gHandles[handle].ns,key);
+	if(entry && entry->type == type && entry->len == len && memcmp(entry->data,data,len) == 0)
+	{
+		pthread_mutex_unlock(&gLock);
+		return ESP_OK;
+	}
+	for(int i = 0;entry == NULL && i < MOCK_NVS_ENTRIES;i++)
+	{
+		if(gLive[i].type == 0)
+		{
+			entry = &gLive[i];
+			strcpy(entry->ns,gHandles[handle].ns);
+			strcpy(entry->key,key);
+		}
+	}
+	if(entry == NULL)
+	{
+		pthread_mutex_unlock(&gLock);
+		return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+	}
+	entry->type = type;
+	entry->len = len;
+	memcpy(entry->data,data,len);
+	gStats.writes++;
+	pthread_mutex_unlock(&gLock);
+	return ESP_OK;
+}
+
+/* copies the value out , with value NULL only the length is returned */
+static esp_err_t getEntry(nvs_handle_t handle,const char* key,EntryType type,void* value,size_t* len)
+{
+	pthread_mutex_lock(&gLock);
+	esp_err_t err = checkHandle(handle,key,false);
+	Entry* entry = err == ESP_OK ? findEntry(gHandles[handle].ns,key) : NULL;
+	if(err == ESP_OK && (entry == NULL || entry->type != type))
+		err = ESP_ERR_NVS_NOT_FOUND;
+	else if(err == ESP_OK && value && *len < entry->len)
+		err = ESP_ERR_NVS_INVALID_LENGTH;
+	if(err == ESP_OK)
+	{
+		if(value)
+			memcpy(value,entry->data,entry->len);
+		*len = entry->len;
+	}
+	pthread_mutex_unlock(&gLock);
+	return err;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle,const char* key,uint8_t value)
+{
+	return setEntry(handle,key,TYPE_U8,&value,1);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle,const char* key,uint8_t* value)
+{
+	size_t len = 1;
+	return getEntry(handle,key,TYPE_U8,value,&len);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle,const char* key,const char* value)
+{
+	return setEntry(handle,key,TYPE_STR,value,strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle,const char* key,char* value,size_t* length)
+{
+	return getEntry(handle,key,TYPE_STR,value,length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle,const char* key,const void* value,size_t length)
+{
+	return setEntry(handle,key,TYPE_BLOB,value,length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle,const char* key,void* value,size_t* length)
+{
+	return getEntry(handle,key,TYPE_BLOB,value,length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle,const char* key)
+{
+	pthread_mutex_lock(&gLock);
+	esp_err_t err = checkHandle(handle,key,true);
+	Entry* entry = err == ESP_OK ? findEntry(gHandles[handle].ns,key) : NULL;
+	if(err == ESP_OK && entry == NULL)
+		err = ESP_ERR_NVS_NOT_FOUND;
+	if(entry)
+	{
+		entry->type = 0;
+		gStats.writes++;
+	}
+	pthread_mutex_unlock(&gLock);
+	return err;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+	uint32_t delay = __atomic_load_n(&gCommitDelayUs,__ATOMIC_RELAXED);
+	if(delay)
+		usleep(delay);
+	pthread_mutex_lock(&gLock);
+	esp_err_t err = checkHandle(handle,"",false);
+	if(err == ESP_OK && gFailCommits)
+	{
+		gFailCommits--;
+		err = ESP_FAIL;
+	}
+	else if(err == ESP_OK)
+	{
+		memcpy(gCommitted,gLive,sizeof(gLive));
+		gStats.commits++;
+	}
+	pthread_mutex_unlock(&gLock);
+	return err;
+}
+
+void mock_nvs_stats(mock_nvs_stats_t* stats)
+{
+	pthread_mutex_lock(&gLock);
+	*stats = gStats;
+	stats->entries = 0;
+	for(int i = 0;i < MOCK_NVS_ENTRIES;i++)
+		if(gLive[i].type)
+			stats->entries++;
+	pthread_mutex_unlock(&gLock);
+}
+
+void mock_nvs_reboot(void)
+{
+	pthread_mutex_lock(&gLock);
+	memcpy(gLive,gCommitted,sizeof(gLive));
+	memset(gHandles,0,sizeof(gHandles));
+	pthread_mutex_unlock(&gLock);
+}
+
+void mock_nvs_erase(void)
+{
+	pthread_mutex_lock(&gLock);
+	memset(gLive,0,sizeof(gLive));
+	memset(gCommitted,0,sizeof(gCommitted));
+	pthread_mutex_unlock(&gLock);
+}
+
+void mock_nvs_set_commit_delay(uint32_t us)
+{
+	__atomic_store_n(&gCommitDelayUs,us,__ATOMIC_RELAXED);
+}
+
+void mock_nvs_fail(unsigned opens,unsigned commits)
+{
+	pthread_mutex_lock(&gLock);
+	gFailOpens = opens;
+	gFailCommits = commits;
+	pthread_mutex_unlock(&gLock);
+}
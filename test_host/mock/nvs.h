@@ -0,0 +1,61 @@
+#ifndef MOCK_NVS_H
+#define MOCK_NVS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+	In-memory NVS. Values written are visible right away , nvs_commit() makes them
+	survive mock_nvs_reboot(). Like NVS , writing the value a key already has does
+	not count as a flash write.
+*/
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+	NVS_READONLY,
+	NVS_READWRITE
+} nvs_open_mode_t;
+
+#define ESP_ERR_NVS_BASE				0x1100
+#define ESP_ERR_NVS_NOT_INITIALIZED		(ESP_ERR_NVS_BASE + 0x01)
+#define ESP_ERR_NVS_NOT_FOUND			(ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_TYPE_MISMATCH		(ESP_ERR_NVS_BASE + 0x03)
+#define ESP_ERR_NVS_READ_ONLY			(ESP_ERR_NVS_BASE + 0x04)
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE	(ESP_ERR_NVS_BASE + 0x05)
+#define ESP_ERR_NVS_INVALID_NAME		(ESP_ERR_NVS_BASE + 0x06)
+#define ESP_ERR_NVS_INVALID_HANDLE		(ESP_ERR_NVS_BASE + 0x07)
+#define ESP_ERR_NVS_KEY_TOO_LONG		(ESP_ERR_NVS_BASE + 0x09)
+#define ESP_ERR_NVS_INVALID_LENGTH		(ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_NO_FREE_PAGES		(ESP_ERR_NVS_BASE + 0x0d)
+
+#define NVS_KEY_NAME_MAX_SIZE 16
+
+esp_err_t nvs_open(const char* name,nvs_open_mode_t mode,nvs_handle_t* handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_set_u8(nvs_handle_t handle,const char* key,uint8_t value);
+esp_err_t nvs_get_u8(nvs_handle_t handle,const char* key,uint8_t* value);
+esp_err_t nvs_set_str(nvs_handle_t handle,const char* key,const char* value);
+esp_err_t nvs_get_str(nvs_handle_t handle,const char* key,char* value,size_t* length);
+esp_err_t nvs_set_blob(nvs_handle_t handle,const char* key,const void* value,size_t length);
+esp_err_t nvs_get_blob(nvs_handle_t handle,const char* key,void* value,size_t* length);
+esp_err_t nvs_erase_key(nvs_handle_t handle,const char* key);
+esp_err_t nvs_commit(nvs_handle_t handle);
+
+typedef struct {
+	unsigned writes;		// set calls which changed a value
+	unsigned commits;
+	unsigned entries;		// keys stored
+} mock_nvs_stats_t;
+
+void mock_nvs_stats(mock_nvs_stats_t* stats);
+/* Drops everything not committed , like a power cycle */
+void mock_nvs_reboot(void);
+/* Empties the flash */
+void mock_nvs_erase(void);
+/* Makes every nvs_commit() take this long before it commits , like a slow flash write */
+void mock_nvs_set_commit_delay(uint32_t us);
+/* Makes the next opens nvs_open() and commits nvs_commit() calls fail , like a flash error */
+void mock_nvs_fail(unsigned opens,unsigned commits);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef MOCK_NVS_FLASH_H
+#define MOCK_NVS_FLASH_H
+
+#include "esp_err.h"
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+
+#endif
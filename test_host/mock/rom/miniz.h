@@ -0,0 +1,56 @@
+#ifndef MOCK_ROM_MINIZ_H
+#define MOCK_ROM_MINIZ_H
+
+/*
+	The part of the ROM miniz deflate API used by the component , implemented on top of zlib.
+*/
+#include <stddef.h>
+
+typedef int mz_bool;
+#define MZ_FALSE 0
+#define MZ_TRUE 1
+
+typedef mz_bool (*tdefl_put_buf_func_ptr)(const void* pBuf,int len,void* pUser);
+
+enum {
+	TDEFL_HUFFMAN_ONLY = 0,
+	TDEFL_DEFAULT_MAX_PROBES = 128,
+	TDEFL_MAX_PROBES_MASK = 0xFFF
+};
+
+enum {
+	TDEFL_WRITE_ZLIB_HEADER = 0x01000,
+	TDEFL_COMPUTE_ADLER32 = 0x02000,
+	TDEFL_GREEDY_PARSING_FLAG = 0x04000,
+	TDEFL_NONDETERMINISTIC_PARSING_FLAG = 0x08000,
+	TDEFL_RLE_MATCHES = 0x10000,
+	TDEFL_FILTER_MATCHES = 0x20000,
+	TDEFL_FORCE_ALL_STATIC_BLOCKS = 0x40000,
+	TDEFL_FORCE_ALL_RAW_BLOCKS = 0x80000
+};
+
+typedef enum {
+	TDEFL_STATUS_BAD_PARAM = -2,
+	TDEFL_STATUS_PUT_BUF_FAILED = -1,
+	TDEFL_STATUS_OKAY = 0,
+	TDEFL_STATUS_DONE = 1
+} tdefl_status;
+
+typedef enum {
+	TDEFL_NO_FLUSH = 0,
+	TDEFL_SYNC_FLUSH = 2,
+	TDEFL_FULL_FLUSH = 3,
+	TDEFL_FINISH = 4
+} tdefl_flush;
+
+typedef struct {
+	void* stream;
+	tdefl_put_buf_func_ptr put;
+	void* user;
+	int flags;
+} tdefl_compressor;
+
+tdefl_status tdefl_init(tdefl_compressor* d,tdefl_put_buf_func_ptr pPut_buf_func,void* pPut_buf_user,int flags);
+tdefl_status tdefl_compress_buffer(tdefl_compressor* d,const void* pIn_buf,size_t in_buf_size,tdefl_flush flush);
+
+#endif
@@ -0,0 +1,137 @@
+/*
+	Host build configuration , stands in for the sdkconfig.h generated by ESP-IDF.
+	Every option can be overridden from CMake with -D.
+*/
+#ifndef MOCK_SDKCONFIG_H
+#define MOCK_SDKCONFIG_H
+
+// bigger than the Kconfig default so the benchmarks can register 20 and more properties
+#ifndef CONFIG_MAX_PROPERTY
+#define CONFIG_MAX_PROPERTY 32
+#endif
+
+#ifndef CONFIG_WEB_THING_MAX_THINGS
+#define CONFIG_WEB_THING_MAX_THINGS 32
+#endif
+
+// on by default like in menuconfig , CONFIG_WEB_THING_METRICS=0 leaves it out
+#ifndef CONFIG_WEB_THING_METRICS
+#define CONFIG_WEB_THING_METRICS 1
+#elif !CONFIG_WEB_THING_METRICS
+#undef CONFIG_WEB_THING_METRICS
+#endif
+
+// the host build traces to have the points tested , CONFIG_WEB_THING_TRACE=0 leaves it out
+#ifndef CONFIG_WEB_THING_TRACE
+#define CONFIG_WEB_THING_TRACE 1
+#elif !CONFIG_WEB_THING_TRACE
+#undef CONFIG_WEB_THING_TRACE
+#endif
+
+#ifdef CONFIG_WEB_THING_TRACE
+#ifndef CONFIG_WEB_THING_TRACE_SIZE
+#define CONFIG_WEB_THING_TRACE_SIZE 64
+#endif
+#endif
+
+#ifndef CONFIG_WEB_THING_LOG_LEVEL
+#define CONFIG_WEB_THING_LOG_LEVEL 2
+#endif
+
+#ifndef CONFIG_WEB_THING_PORT
+#define CONFIG_WEB_THING_PORT 8888
+#endif
+
+#ifndef CONFIG_WEB_THING_JSON_CHUNK_SIZE
+#define CONFIG_WEB_THING_JSON_CHUNK_SIZE 256
+#endif
+
+#ifndef CONFIG_HTTPD_WS_SUPPORT
+#define CONFIG_HTTPD_WS_SUPPORT 1
+#endif
+
+#if CONFIG_HTTPD_WS_SUPPORT && !defined(CONFIG_WEB_THING_WEBSOCKET)
+#define CONFIG_WEB_THING_WEBSOCKET 1
+#endif
+
+#ifndef CONFIG_WEB_THING_WS_MAX_CLIENTS
+#define CONFIG_WEB_THING_WS_MAX_CLIENTS 4
+#endif
+
+#ifndef CONFIG_WEB_THING_WS_PUSH_INTERVAL_MS
+#define CONFIG_WEB_THING_WS_PUSH_INTERVAL_MS 50
+#endif
+
+#ifndef CONFIG_WEB_THING_WS_MAX_MESSAGE
+#define CONFIG_WEB_THING_WS_MAX_MESSAGE 512
+#endif
+
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+#ifndef CONFIG_WEB_THING_POOL_BYTES_PER_PROPERTY
+#define CONFIG_WEB_THING_POOL_BYTES_PER_PROPERTY 768
+#endif
+#ifndef CONFIG_WEB_THING_POOL_STRING_SIZE
+#define CONFIG_WEB_THING_POOL_STRING_SIZE 32
+#endif
+// room for the small things of the gateway tests next to one full thing
+#ifndef CONFIG_WEB_THING_POOL_THINGS
+#define CONFIG_WEB_THING_POOL_THINGS 4
+#endif
+#endif
+
+#ifndef CONFIG_WEB_THING_MAX_BODY_SIZE
+#define CONFIG_WEB_THING_MAX_BODY_SIZE 512
+#endif
+
+#ifndef CONFIG_WEB_THING_BODY_RECV_RETRIES
+#define CONFIG_WEB_THING_BODY_RECV_RETRIES 2
+#endif
+
+#ifndef CONFIG_WEB_THING_PERSIST_INTERVAL_MS
+#define CONFIG_WEB_THING_PERSIST_INTERVAL_MS 5000
+#endif
+
+#ifndef CONFIG_WEB_THING_PERSIST_UNSAVED_MAX
+#define CONFIG_WEB_THING_PERSIST_UNSAVED_MAX 8
+#endif
+
+#ifdef CONFIG_WEB_THING_ASYNC_CALLBACKS
+#ifndef CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH
+#define CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH 8
+#endif
+#ifndef CONFIG_WEB_THING_CALLBACK_TASK_STACK
+#define CONFIG_WEB_THING_CALLBACK_TASK_STACK 3072
+#endif
+#ifndef CONFIG_WEB_THING_CALLBACK_TASK_PRIORITY
+#define CONFIG_WEB_THING_CALLBACK_TASK_PRIORITY 4
+#endif
+#if !defined(CONFIG_WEB_THING_CALLBACK_DROP_NEWEST) && !defined(CONFIG_WEB_THING_CALLBACK_DROP_OLDEST)
+#define CONFIG_WEB_THING_CALLBACK_DROP_OLDEST 1
+#endif
+#endif
+
+#ifndef CONFIG_WEB_THING_EVENT_LOG_SIZE
+#define CONFIG_WEB_THING_EVENT_LOG_SIZE 16
+#endif
+
+#ifndef CONFIG_WEB_THING_ACTION_LOG_SIZE
+#define CONFIG_WEB_THING_ACTION_LOG_SIZE 8
+#endif
+
+#ifndef CONFIG_WEB_THING_LOG_STRING_SIZE
+#define CONFIG_WEB_THING_LOG_STRING_SIZE 32
+#endif
+
+#ifndef CONFIG_WEB_THING_ACTION_TASK_STACK
+#define CONFIG_WEB_THING_ACTION_TASK_STACK 3072
+#endif
+
+#ifndef CONFIG_WEB_THING_ACTION_TASK_PRIORITY
+#define CONFIG_WEB_THING_ACTION_TASK_PRIORITY 3
+#endif
+
+#ifndef CONFIG_LOG_DEFAULT_LEVEL
+#define CONFIG_LOG_DEFAULT_LEVEL 2
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#include "sample_thing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+Thing* createSampleThing(int propertyCount,PropertyChange_cb callback)
+{
+	return createSampleThingWithId(NULL,propertyCount,callback);
+}
+
+Thing* createSampleThingWithId(const char* id,int propertyCount,PropertyChange_cb callback)
+{
+	static char* types[] = {"Light","OnOffSwitch",NULL};
+	Thing* thing = id ? createThingWithId(id,"Sample Thing",types) : createThing("Sample Thing",types);
+	if(thing == NULL)
+		return NULL;
+
+	// past one property per type the types repeat , the keys get numbered ("temp_2")
+	int added = 0;
+	for(int i = 0;added < propertyCount;i++)
+	{
+		int type = i % eKEEP_LAST;
+		if(type == eIMAGE || type == eVIDEO)
+			continue;
+
+		char title[32];
+		PropertyInfo info = {0};
+		info.type = type;
+		info.minimum = 0;
+		info.maximum = 100;
+		info.unit = type == eTEMPERATURE || type == eTARGET_TEMPERATURE ? eCELCUIS : eNONE;
+		if(type == eCOLOR || type == eHEATING_COOLING || type == eLOCKED || type == eTHERMOSTAT)
+			info.value.string = "#ff0000";
+		else if(type == eALARM || type == eBOOLEAN || type == eLEAK || type == eMOTION ||
+			type == eON_OFF || type == eOPEN || type == ePUSHED)
+			info.value.boolean = false;
+		else
+			info.value.number = 20.5;
+		snprintf(title,sizeof(title),"Property %d",added + 1);
+		addProperty(thing,createProperty(title,info,callback));
+		added++;
+	}
+	return thing;
+}
+
+void freeSampleThing(Thing* thing)
+{
+	cleanUpThing(thing);
+	thingFree(thing);
+}
@@ -0,0 +1,22 @@
+#ifndef SAMPLE_THING_H
+#define SAMPLE_THING_H
+
+#include "web_thing.h"
+
+/*
+	Builds a thing with propertyCount properties , the first SAMPLE_THING_MAX_PROPERTIES
+	are one per property type which has a value (image and video are skipped) , after
+	that the types repeat with numbered keys. Boolean properties start false , numbers
+	at 20.5 and strings at "#ff0000". Used by the tests , the benchmark and the host server.
+*/
+#define SAMPLE_THING_MAX_PROPERTIES 20
+
+Thing* createSampleThing(int propertyCount,PropertyChange_cb callback);
+
+/* The same with the id given instead of the MAC address , for several things on one adapter */
+Thing* createSampleThingWithId(const char* id,int propertyCount,PropertyChange_cb callback);
+
+/* cleanUpThing() plus the thing itself */
+void freeSampleThing(Thing* thing);
+
+#endif
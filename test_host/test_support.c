@@ -0,0 +1,67 @@
+#include "test_support.h"
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_TESTS 128
+
+typedef struct {
+	const char* name;
+	const char* tags;
+	TestFunction fn;
+} TestCase;
+
+static TestCase gTests[MAX_TESTS];
+static int gTestCount;
+
+void testRegister(const char* name,const char* tags,TestFunction fn)
+{
+	if(gTestCount < MAX_TESTS)
+		gTests[gTestCount++] = (TestCase){name,tags,fn};
+}
+
+void testFail(const char* file,int line,const char* message)
+{
+	fprintf(stderr,"%s:%d: %s\n",file,line,message);
+	fflush(stderr);
+	_exit(1);
+}
+
+/*
+	Usage: test_binary [filter]
+	Runs every case whose name or tags contain filter , all of them without one.
+*/
+int main(int argc,char** argv)
+{
+	const char* filter = argc > 1 ? argv[1] : NULL;
+	int run = 0;
+	int failed = 0;
+
+	setvbuf(stdout,NULL,_IONBF,0);
+	for(int i = 0;i < gTestCount;i++)
+	{
+		const TestCase* test = &gTests[i];
+		if(filter && !strstr(test->name,filter) && !strstr(test->tags,filter))
+			continue;
+
+		run++;
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			test->fn();
+			fflush(stdout);
+			exit(0);
+		}
+
+		int status = 0;
+		waitpid(pid,&status,0);
+		bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		printf("%s %s %s\n",passed ? "PASS" : "FAIL",test->name,test->tags);
+		if(!passed)
+			failed++;
+	}
+
+	printf("\n%d Tests %d Failures\n",run,failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+/*
+	A few Unity style macros so the host tests read like ESP-IDF component tests.
+	Every TEST_CASE runs in its own forked process , the component keeps global
+	state (the adapter's thing and server) which would otherwise leak between cases.
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef void (*TestFunction)(void);
+
+void testRegister(const char* name,const char* tags,TestFunction fn);
+void testFail(const char* file,int line,const char* message);
+
+#define TEST_CONCAT_(a,b) a##b
+#define TEST_CONCAT(a,b) TEST_CONCAT_(a,b)
+
+#define TEST_CASE(name,tags)																	\
+	static void TEST_CONCAT(testCase,__LINE__)(void);											\
+	__attribute__((constructor)) static void TEST_CONCAT(testRegister,__LINE__)(void)			\
+	{																							\
+		testRegister(name,tags,TEST_CONCAT(testCase,__LINE__));									\
+	}																							\
+	static void TEST_CONCAT(testCase,__LINE__)(void)
+
+#define TEST_ASSERT_MESSAGE(condition,message) do {												\
+		if(!(condition))																		\
+			testFail(__FILE__,__LINE__,message);												\
+	} while(0)
+
+#define TEST_ASSERT(condition) TEST_ASSERT_MESSAGE(condition,#condition)
+#define TEST_ASSERT_TRUE(condition) TEST_ASSERT(condition)
+#define TEST_ASSERT_FALSE(condition) TEST_ASSERT_MESSAGE(!(condition),"!(" #condition ")")
+#define TEST_ASSERT_NULL(pointer) TEST_ASSERT_MESSAGE((pointer) == NULL,#pointer " is not NULL")
+#define TEST_ASSERT_NOT_NULL(pointer) TEST_ASSERT_MESSAGE((pointer) != NULL,#pointer " is NULL")
+
+#define TEST_ASSERT_EQUAL(expected,actual) do {													\
+		long long _e = (long long)(expected),_a = (long long)(actual);							\
+		if(_e != _a)																			\
+		{																						\
+			char _m[160];																		\
+			snprintf(_m,sizeof(_m),"%s: expected %lld , got %lld",#actual,_e,_a);				\
+			testFail(__FILE__,__LINE__,_m);														\
+		}																						\
+	} while(0)
+
+#define TEST_ASSERT_EQUAL_DOUBLE(expected,actual) do {											\
+		double _e = (expected),_a = (actual);													\
+		if(!(_e == _a))																			\
+		{																						\
+			char _m[160];																		\
+			snprintf(_m,sizeof(_m),"%s: expected %.17g , got %.17g",#actual,_e,_a);				\
+			testFail(__FILE__,__LINE__,_m);														\
+		}																						\
+	} while(0)
+
+#define TEST_ASSERT_EQUAL_STRING(expected,actual) do {											\
+		const char* _e = (expected);															\
+		const char* _a = (actual);																\
+		if(_e == NULL || _a == NULL || strcmp(_e,_a) != 0)										\
+		{																						\
+			char _m[600];																		\
+			snprintf(_m,sizeof(_m),"%s:\n  expected \"%.200s\"\n  got      \"%.200s\"",			\
+				#actual,_e ? _e : "(null)",_a ? _a : "(null)");									\
+			testFail(__FILE__,__LINE__,_m);														\
+		}																						\
+	} while(0)
+
+#define TEST_ASSERT_CONTAINS(needle,haystack)	\
+	TEST_ASSERT_MESSAGE((haystack) != NULL && strstr((haystack),(needle)) != NULL,#haystack " does not contain " #needle)
+
+#endif
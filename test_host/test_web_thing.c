@@ -0,0 +1,2309 @@
+/*
+	Host tests of the web thing component , run with ctest or ./test_web_thing [filter].
+*/
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "freertos/timers.h"
+#include "mdns.h"
+#include "mock_heap.h"
+#include "nvs.h"
+#include "sample_thing.h"
+#include "test_support.h"
+#include "web_thing_actions.h"
+#include "web_thing_adapter.h"
+#include "web_thing_callbacks.h"
+#include "web_thing_events.h"
+#include "web_thing_log.h"
+#include "web_thing_metrics.h"
+#include "web_thing_trace.h"
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+#include <zlib.h>
+#endif
+
+static mock_httpd_response_t gResponse;
+static int gCallbacks;
+static ThingPropertyValue gLastValue;
+
+static void countCallback(ThingPropertyValue value)
+{
+	gCallbacks++;
+	gLastValue = value;
+}
+
+/* callbacks which ran , after the queued ones with CONFIG_WEB_THING_ASYNC_CALLBACKS */
+static int callbacks(void)
+{
+	TEST_ASSERT_TRUE(waitPropertyCallbacks(1000));
+	return gCallbacks;
+}
+
+typedef struct {
+	char* buf;
+	size_t len;
+	size_t size;
+} Output;
+
+static int appendOutput(void* ctx,const char* buf,size_t len)
+{
+	Output* out = (Output*)ctx;
+	if(out->len + len + 1 > out->size)
+		return -1;
+	memcpy(out->buf + out->len,buf,len);
+	out->len += len;
+	out->buf[out->len] = '\0';
+	return 0;
+}
+
+static httpd_handle_t startThing(Thing* thing)
+{
+	mock_httpd_set_port(0);
+	initAdapter(thing);
+	startAdapter();
+	httpd_handle_t server = mock_httpd_last_server();
+	TEST_ASSERT_NOT_NULL(server);
+	return server;
+}
+
+static mock_httpd_response_t* request(httpd_handle_t server,httpd_method_t method,const char* uri,const char* body)
+{
+	mock_httpd_request_t req = {0};
+	req.method = method;
+	req.uri = uri;
+	req.body = body;
+	req.body_len = body ? strlen(body) : 0;
+	mock_httpd_request(server,&req,&gResponse);
+	return &gResponse;
+}
+
+/* GETs the URL and parses the JSON body */
+static cJSON* getJson(httpd_handle_t server,const char* uri)
+{
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,uri,NULL)->status);
+	cJSON* json = cJSON_Parse(gResponse.body);
+	TEST_ASSERT_NOT_NULL(json);
+	return json;
+}
+
+/* Member of the only member , like the data of {"overheated":{"data":1}} */
+static cJSON* innerItem(cJSON* item,const char* key)
+{
+	TEST_ASSERT_NOT_NULL(item->child);
+	return cJSON_GetObjectItem(item->child,key);
+}
+
+static char* propertyUrl(Thing* thing,const char* key)
+{
+	ThingProperty* property = findProperty(thing,key);
+	TEST_ASSERT_NOT_NULL(property);
+	return getPropertyEndpointUrl(thing,property);
+}
+
+static char* printValues(Thing* thing,bool format)
+{
+	cJSON* json = cJSON_CreateObject();
+	for(ThingProperty* property = thing->property;property;property = property->next)
+		serialise_property_item(property,json);
+	char* text = format ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+	cJSON_Delete(json);
+	return text;
+}
+
+/*
+	Streaming writer
+*/
+TEST_CASE("writer output matches cJSON for numbers and strings","[json]")
+{
+	static const double numbers[] = {0,1,-1,42,20.5,-0.25,1e-7,123456789012.0,3.141592653589793,1e300,2147483647.0,-2147483648.0,4294967296.0,0.1};
+	static const char* strings[] = {"","plain","quote \" backslash \\ slash /","tab\tnew\nline\r","\x01\x1f control","utf-8 \xc3\xa9\xe2\x82\xac"};
+	char expected[64];
+	char actual[64];
+
+	for(size_t i = 0;i < sizeof(numbers)/sizeof(numbers[0]);i++)
+	{
+		cJSON* number = cJSON_CreateNumber(numbers[i]);
+		char* text = cJSON_PrintUnformatted(number);
+		snprintf(expected,sizeof(expected),"%s",text);
+		actual[jsonFormatNumber(numbers[i],actual)] = '\0';
+		TEST_ASSERT_EQUAL_STRING(expected,actual);
+		free(text);
+		cJSON_Delete(number);
+	}
+
+	for(size_t i = 0;i < sizeof(strings)/sizeof(strings[0]);i++)
+	{
+		char buf[128];
+		Output out = {buf,0,sizeof(buf)};
+		JsonWriter writer;
+		cJSON* string = cJSON_CreateString(strings[i]);
+		char* text = cJSON_PrintUnformatted(string);
+		jsonWriterInit(&writer,false,appendOutput,&out);
+		jsonString(&writer,strings[i]);
+		TEST_ASSERT_TRUE(jsonWriterFinish(&writer));
+		TEST_ASSERT_EQUAL_STRING(text,buf);
+		free(text);
+		cJSON_Delete(string);
+	}
+}
+
+TEST_CASE("writer flushes long output in chunks","[json]")
+{
+	static char buf[8192];
+	Output out = {buf,0,sizeof(buf)};
+	JsonWriter writer;
+	cJSON* json = cJSON_CreateArray();
+	jsonWriterInit(&writer,true,appendOutput,&out);
+	jsonBeginArray(&writer);
+	for(int i = 0;i < 300;i++)
+	{
+		cJSON_AddItemToArray(json,cJSON_CreateNumber(i * 1.5));
+		jsonNumber(&writer,i * 1.5);
+	}
+	jsonEndArray(&writer);
+	TEST_ASSERT_TRUE(jsonWriterFinish(&writer));
+
+	char* text = cJSON_Print(json);
+	TEST_ASSERT_EQUAL(strlen(text),writer.total);
+	TEST_ASSERT_EQUAL_STRING(text,buf);
+	free(text);
+	cJSON_Delete(json);
+}
+
+TEST_CASE("writer stops after a failed flush","[json]")
+{
+	char buf[16];
+	Output out = {buf,0,sizeof(buf)};
+	JsonWriter writer;
+	jsonWriterInit(&writer,false,appendOutput,&out);
+	jsonBeginArray(&writer);
+	for(int i = 0;i < 100;i++)
+		jsonString(&writer,"too long for the output");
+	jsonEndArray(&writer);
+	TEST_ASSERT_FALSE(jsonWriterFinish(&writer));
+}
+
+static int readAll(const char* text,JsonMember* members,int max)
+{
+	static char body[256];
+	JsonReader reader;
+	int count = 0;
+	int ret;
+	strcpy(body,text);
+	jsonReaderInit(&reader,body,strlen(body));
+	while((ret = jsonReaderNext(&reader,&members[count])) > 0 && count < max - 1)
+		count++;
+	return ret < 0 ? -1 : count;
+}
+
+TEST_CASE("reader returns the members of a flat object in place","[json]")
+{
+	JsonMember members[8];
+	TEST_ASSERT_EQUAL(5,readAll(" {\"on\" : true,\"level\":-12.5e-1,\"color\":\"#00ff00\",\"off\":false,\"mode\":null}\r\n",members,8));
+	TEST_ASSERT_EQUAL_STRING("on",members[0].key);
+	TEST_ASSERT_EQUAL(JSON_VALUE_BOOL,members[0].type);
+	TEST_ASSERT_TRUE(members[0].boolean);
+	TEST_ASSERT_EQUAL(JSON_VALUE_NUMBER,members[1].type);
+	TEST_ASSERT_EQUAL_DOUBLE(-1.25,members[1].number);
+	TEST_ASSERT_EQUAL(JSON_VALUE_STRING,members[2].type);
+	TEST_ASSERT_EQUAL_STRING("#00ff00",members[2].string);
+	TEST_ASSERT_FALSE(members[3].boolean);
+	TEST_ASSERT_EQUAL(JSON_VALUE_NULL,members[4].type);
+	TEST_ASSERT_EQUAL(0,readAll("{}",members,8));
+
+	// escapes are resolved into the body itself
+	TEST_ASSERT_EQUAL(1,readAll("{\"k\\\"ey\":\"a\\n\\u00e9\\ud83d\\ude00\\/\"}",members,8));
+	TEST_ASSERT_EQUAL_STRING("k\"ey",members[0].key);
+	TEST_ASSERT_EQUAL_STRING("a\n\xc3\xa9\xf0\x9f\x98\x80/",members[0].string);
+}
+
+TEST_CASE("reader rejects what is not a flat JSON object","[json]")
+{
+	static const char* invalid[] = {
+		"","[1,2]","{","{\"a\"}","{\"a\":}","{\"a\":1,}","{\"a\":1 \"b\":2}","{\"a\":1}x",
+		"{\"a\":{\"b\":1}}","{\"a\":[1]}","{\"a\":01}","{\"a\":1.}","{\"a\":+1}","{\"a\":.5}",
+		"{\"a\":1e}","{\"a\":tru}","{\"a\":\"\\x\"}","{\"a\":\"\\u12\"}","{\"a\":\"\\u0000\"}",
+		"{\"a\":\"\\ud83d\"}","{\"a\":\"\\ude00\"}","{\"a\":\"tab\there\"}","{\"a\":\"open}",
+		"{\"a\":1000000000000000000000000000000000000000000000000000000000000000000}",
+	};
+	JsonMember members[4];
+	for(size_t i = 0;i < sizeof(invalid)/sizeof(invalid[0]);i++)
+		TEST_ASSERT_MESSAGE(readAll(invalid[i],members,4) == -1,invalid[i]);
+}
+
+/*
+	Thing description
+*/
+TEST_CASE("cached description matches serializeDevice","[description]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	cJSON* json = cJSON_CreateObject();
+	serializeDevice(thing,json);
+	char* expected = JSON_WRITER_FORMAT ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+
+	size_t len = 0;
+	const char* description = getThingDescription(thing,&len);
+	TEST_ASSERT_EQUAL_STRING(expected,description);
+	TEST_ASSERT_EQUAL(strlen(expected),len);
+
+	free(expected);
+	cJSON_Delete(json);
+	freeSampleThing(thing);
+}
+
+TEST_CASE("description is built once and rebuilt after addProperty","[description]")
+{
+	Thing* thing = createSampleThing(3,NULL);
+	const char* first = getThingDescription(thing,NULL);
+	TEST_ASSERT_NOT_NULL(first);
+
+	mock_heap_stats_t before,after;
+	mock_heap_stats(&before);
+	for(int i = 0;i < 10;i++)
+		TEST_ASSERT_TRUE(getThingDescription(thing,NULL) == first);
+	mock_heap_stats(&after);
+	TEST_ASSERT_EQUAL(before.allocs,after.allocs);
+
+	PropertyInfo info = {0};
+	info.type = eVOLTAGE;
+	addProperty(thing,createProperty("Voltage",info,NULL));
+	TEST_ASSERT_EQUAL(0,thing->descriptionLen);
+	TEST_ASSERT_CONTAINS("\"voltage\"",getThingDescription(thing,NULL));
+	freeSampleThing(thing);
+}
+
+TEST_CASE("GET on the thing URL sends the cached description","[description][http]")
+{
+	Thing* thing = createSampleThing(5,NULL);
+	httpd_handle_t server = startThing(thing);
+	char* url = getThingDescriptionUrl(thing);
+
+	mock_httpd_response_t* res = request(server,HTTP_GET,"/",NULL);
+	TEST_ASSERT_EQUAL(200,res->status);
+	TEST_ASSERT_EQUAL_STRING("application/json",res->content_type);
+	TEST_ASSERT_EQUAL_STRING(getThingDescription(thing,NULL),res->body);
+
+	res = request(server,HTTP_GET,url,NULL);
+	TEST_ASSERT_EQUAL(200,res->status);
+	TEST_ASSERT_EQUAL_STRING(getThingDescription(thing,NULL),res->body);
+	free(url);
+}
+
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+TEST_CASE("deflated description inflates to the plain one","[description][deflate]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	httpd_handle_t server = startThing(thing);
+	size_t plainLen = 0;
+	const char* plain = getThingDescription(thing,&plainLen);
+
+	mock_httpd_request_t req = {0};
+	req.method = HTTP_GET;
+	req.uri = "/";
+	req.headers[0] = (mock_httpd_header_t){"Accept-Encoding","gzip, deflate"};
+	mock_httpd_request(server,&req,&gResponse);
+	TEST_ASSERT_EQUAL(200,gResponse.status);
+	TEST_ASSERT_EQUAL_STRING("deflate",mock_httpd_response_header(&gResponse,"Content-Encoding"));
+	TEST_ASSERT_TRUE(gResponse.body_len < plainLen / 2);
+
+	static char inflated[MOCK_HTTPD_MAX_BODY];
+	uLongf inflatedLen = sizeof(inflated);
+	TEST_ASSERT_EQUAL(Z_OK,uncompress((Bytef*)inflated,&inflatedLen,(Bytef*)gResponse.body,gResponse.body_len));
+	TEST_ASSERT_EQUAL(plainLen,inflatedLen);
+	TEST_ASSERT_TRUE(memcmp(plain,inflated,plainLen) == 0);
+
+	char deflatedTag[48];
+	strcpy(deflatedTag,mock_httpd_response_header(&gResponse,"ETag"));
+
+	// the stored copy is sent again , the compressor only runs once per description
+	mock_heap_stats_t before,after;
+	mock_heap_stats(&before);
+	for(int i = 0;i < 3;i++)
+		mock_httpd_request(server,&req,&gResponse);
+	mock_heap_stats(&after);
+	TEST_ASSERT_EQUAL(before.allocs,after.allocs);
+
+	// clients which do not ask for it get the plain text , under another tag
+	request(server,HTTP_GET,"/",NULL);
+	TEST_ASSERT_NULL(mock_httpd_response_header(&gResponse,"Content-Encoding"));
+	TEST_ASSERT_EQUAL_STRING(plain,gResponse.body);
+	TEST_ASSERT_TRUE(strcmp(deflatedTag,mock_httpd_response_header(&gResponse,"ETag")) != 0);
+}
+
+TEST_CASE("deflate is only sent when Accept-Encoding does not refuse it","[description][deflate]")
+{
+	static const struct {
+		const char* acceptEncoding;
+		bool deflated;
+	} cases[] = {
+		{"deflate",true},
+		{"DEFLATE;q=0.1",true},
+		{"*",true},
+		{"gzip;q=1.0, *;q=0.5",true},
+		{"deflate;q=0",false},
+		{"gzip, deflate ; q=0.000",false},
+		{"deflate;q=0, *",false},
+		{"*;q=0",false},
+		{"gzip, identity",false},
+		{"deflater",false},
+	};
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	httpd_handle_t server = startThing(thing);
+	mock_httpd_request_t req = {0};
+	req.method = HTTP_GET;
+	req.uri = "/";
+	for(size_t i = 0;i < sizeof(cases) / sizeof(cases[0]);i++)
+	{
+		req.headers[0] = (mock_httpd_header_t){"Accept-Encoding",cases[i].acceptEncoding};
+		mock_httpd_request(server,&req,&gResponse);
+		TEST_ASSERT_EQUAL(200,gResponse.status);
+		TEST_ASSERT_MESSAGE((mock_httpd_response_header(&gResponse,"Content-Encoding") != NULL) == cases[i].deflated,
+							cases[i].acceptEncoding);
+	}
+}
+#endif
+
+/*
+	Properties
+*/
+TEST_CASE("findProperty finds every property by key","[property]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	int count = 0;
+	for(ThingProperty* property = thing->property;property;property = property->next)
+	{
+		TEST_ASSERT_TRUE(findProperty(thing,get_property_keyname(property)) == property);
+		TEST_ASSERT_TRUE(thing->properties[property->index] == property);
+		count++;
+	}
+	TEST_ASSERT_EQUAL(SAMPLE_THING_MAX_PROPERTIES,count);
+	TEST_ASSERT_EQUAL(count,thing->propertyCount);
+	TEST_ASSERT_NULL(findProperty(thing,"missing"));
+	TEST_ASSERT_NULL(findProperty(thing,""));
+	freeSampleThing(thing);
+}
+
+TEST_CASE("property types are described and URLs are set up by addProperty","[property]")
+{
+	for(int type = 0;type < eKEEP_LAST;type++)
+	{
+		const PropertyTypeDescriptor* descriptor = getPropertyTypeDescriptor(type);
+		TEST_ASSERT_NOT_NULL(descriptor->key);
+		TEST_ASSERT_NOT_NULL(descriptor->schema);
+	}
+	TEST_ASSERT_EQUAL_STRING("LAST_PROPERTY",getPropertyTypeDescriptor(eKEEP_LAST + 3)->schema);
+	TEST_ASSERT_EQUAL(NUMBER,getPropertyTypeDescriptor(eBRIGHTNESS)->valueType);
+	TEST_ASSERT_TRUE(getPropertyTypeDescriptor(eBRIGHTNESS)->isRange);
+
+	Thing* thing = createSampleThing(3,NULL);
+	char expected[96];
+	snprintf(expected,sizeof(expected),"/things/%s/properties",thing->id);
+	TEST_ASSERT_EQUAL_STRING(expected,thing->propertiesHref);
+	ThingProperty* property = findProperty(thing,"brightness");
+	TEST_ASSERT_EQUAL_STRING("brightness",property->key);
+	snprintf(expected,sizeof(expected),"/things/%s/properties/brightness",thing->id);
+	TEST_ASSERT_EQUAL_STRING(expected,property->href);
+	char* url = getPropertyEndpointUrl(thing,property);
+	TEST_ASSERT_EQUAL_STRING(expected,url);
+	free(url);
+
+	// properties not added yet have a key but no URL
+	PropertyInfo info = {0};
+	info.type = eVOLTAGE;
+	ThingProperty* loose = createProperty("Voltage",info,NULL);
+	TEST_ASSERT_EQUAL_STRING("voltage",loose->key);
+	TEST_ASSERT_NULL(loose->href);
+	addProperty(thing,loose);
+	TEST_ASSERT_CONTAINS("/properties/voltage",loose->href);
+	freeSampleThing(thing);
+}
+
+TEST_CASE("properties of the same type get unique keys and URLs","[property][http]")
+{
+	// a multi-zone board , 8 temperature and 8 level channels plus two named ones
+	Thing* thing = createSampleThing(0,countCallback);
+	PropertyInfo info = {0};
+	info.maximum = 100;
+	for(int i = 0;i < 8;i++)
+	{
+		info.type = eTEMPERATURE;
+		info.value.number = i;
+		addProperty(thing,createProperty("Zone temperature",info,countCallback));
+		info.type = eLEVEL;
+		addProperty(thing,createProperty("Zone level",info,countCallback));
+	}
+	info.type = eTEMPERATURE;
+	info.key = "outside";
+	info.value.number = 100;
+	addProperty(thing,createProperty("Outside",info,countCallback));
+	info.key = "temp";		// taken , numbered like the automatic ones
+	addProperty(thing,createProperty("Another",info,countCallback));
+	info.key = "no/slash";	// not usable in a URL , falls back to the type key
+	addProperty(thing,createProperty("Invalid",info,countCallback));
+	TEST_ASSERT_EQUAL(19,thing->propertyCount);
+
+	TEST_ASSERT_EQUAL_DOUBLE(0,findProperty(thing,"temp")->info.value.number);
+	TEST_ASSERT_EQUAL_DOUBLE(7,findProperty(thing,"temp_8")->info.value.number);
+	TEST_ASSERT_EQUAL_DOUBLE(7,findProperty(thing,"level_8")->info.value.number);
+	TEST_ASSERT_EQUAL_DOUBLE(100,findProperty(thing,"outside")->info.value.number);
+	TEST_ASSERT_EQUAL_STRING("Another",findProperty(thing,"temp_9")->title);
+	TEST_ASSERT_EQUAL_STRING("Invalid",findProperty(thing,"temp_10")->title);
+	for(ThingProperty* property = thing->property;property;property = property->next)
+	{
+		TEST_ASSERT_TRUE(findProperty(thing,property->key) == property);
+		TEST_ASSERT_TRUE(strcmp(property->key,property->info.key) == 0);
+	}
+
+	// every property has its own member in the description and its own URL
+	cJSON* json = cJSON_Parse(getThingDescription(thing,NULL));
+	TEST_ASSERT_EQUAL(19,cJSON_GetArraySize(cJSON_GetObjectItem(json,"properties")));
+	cJSON_Delete(json);
+	json = cJSON_CreateObject();
+	serializeDevice(thing,json);
+	TEST_ASSERT_EQUAL(19,cJSON_GetArraySize(cJSON_GetObjectItem(json,"properties")));
+	cJSON_Delete(json);
+
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"temp_5");
+	TEST_ASSERT_CONTAINS("/properties/temp_5",url);
+	json = cJSON_Parse(request(server,HTTP_GET,url,NULL)->body);
+	TEST_ASSERT_EQUAL_DOUBLE(4,cJSON_GetObjectItem(json,"temp_5")->valuedouble);
+	cJSON_Delete(json);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"temp_5\":42}")->status);
+	TEST_ASSERT_EQUAL_DOUBLE(42,findProperty(thing,"temp_5")->info.value.number);
+	TEST_ASSERT_EQUAL_DOUBLE(0,findProperty(thing,"temp")->info.value.number);
+	free(url);
+}
+
+TEST_CASE("GET on a property streams its value","[property][http]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	httpd_handle_t server = startThing(thing);
+	for(ThingProperty* property = thing->property;property;property = property->next)
+	{
+		cJSON* json = cJSON_CreateObject();
+		serialise_property_item(property,json);
+		char* expected = JSON_WRITER_FORMAT ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+		char* url = getPropertyEndpointUrl(thing,property);
+
+		mock_httpd_response_t* res = request(server,HTTP_GET,url,NULL);
+		TEST_ASSERT_EQUAL(200,res->status);
+		TEST_ASSERT_TRUE(res->chunked);
+		TEST_ASSERT_EQUAL_STRING(expected,res->body);
+
+		free(url);
+		free(expected);
+		cJSON_Delete(json);
+	}
+}
+
+TEST_CASE("GET on the properties URL lists all values","[property][http]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	httpd_handle_t server = startThing(thing);
+	char url[64];
+	snprintf(url,sizeof(url),"/things/%s/properties",thing->id);
+
+	char* expected = printValues(thing,JSON_WRITER_FORMAT);
+	mock_httpd_response_t* res = request(server,HTTP_GET,url,NULL);
+	TEST_ASSERT_EQUAL(200,res->status);
+	TEST_ASSERT_EQUAL_STRING(expected,res->body);
+	free(expected);
+}
+
+TEST_CASE("PUT on a property updates it and calls the callback","[property][http]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,countCallback);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"brightness");
+
+	mock_httpd_response_t* res = request(server,HTTP_PUT,url,"{\"brightness\":75}");
+	TEST_ASSERT_EQUAL(200,res->status);
+	TEST_ASSERT_EQUAL_STRING(JSON_WRITER_FORMAT ? "{\n\t\"brightness\":\t75\n}" : "{\"brightness\":75}",res->body);
+	TEST_ASSERT_EQUAL_DOUBLE(75,findProperty(thing,"brightness")->info.value.number);
+	TEST_ASSERT_EQUAL(1,callbacks());
+	TEST_ASSERT_EQUAL_DOUBLE(75,gLastValue.number);
+
+	res = request(server,HTTP_PUT,url,"{\"brightness\":\"bright\"}");
+	TEST_ASSERT_EQUAL(400,res->status);
+	res = request(server,HTTP_PUT,url,"{\"brightness\":");
+	TEST_ASSERT_EQUAL(400,res->status);
+	TEST_ASSERT_EQUAL_DOUBLE(75,findProperty(thing,"brightness")->info.value.number);
+	TEST_ASSERT_EQUAL(1,callbacks());
+	free(url);
+}
+
+TEST_CASE("PUT on the properties URL sets several properties at once","[property][http]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,countCallback);
+	httpd_handle_t server = startThing(thing);
+	char url[64];
+	snprintf(url,sizeof(url),"/things/%s/properties",thing->id);
+
+	mock_httpd_response_t* res = request(server,HTTP_PUT,url,"{\"on\":true,\"brightness\":10,\"color\":\"#00ff00\",\"on\":true}");
+	TEST_ASSERT_EQUAL(200,res->status);
+	TEST_ASSERT_TRUE(findProperty(thing,"on")->info.value.boolean);
+	TEST_ASSERT_EQUAL_DOUBLE(10,findProperty(thing,"brightness")->info.value.number);
+	TEST_ASSERT_EQUAL_STRING("#00ff00",findProperty(thing,"color")->info.value.string);
+	TEST_ASSERT_EQUAL(3,callbacks());
+	char* expected = printValues(thing,JSON_WRITER_FORMAT);
+	TEST_ASSERT_EQUAL_STRING(expected,res->body);
+	free(expected);
+
+	// one bad member leaves everything untouched
+	res = request(server,HTTP_PUT,url,"{\"on\":false,\"missing\":1}");
+	TEST_ASSERT_EQUAL(400,res->status);
+	res = request(server,HTTP_PUT,url,"{\"on\":false,\"brightness\":\"x\"}");
+	TEST_ASSERT_EQUAL(400,res->status);
+	res = request(server,HTTP_PUT,url,"[1,2]");
+	TEST_ASSERT_EQUAL(400,res->status);
+	TEST_ASSERT_TRUE(findProperty(thing,"on")->info.value.boolean);
+	TEST_ASSERT_EQUAL(3,callbacks());
+}
+
+/* Hardware which only reaches brightness in steps of 10 and only knows lower case colours */
+static ThingProperty* gDimmer;
+static ThingProperty* gLamp;
+
+static void dimmerCallback(ThingPropertyValue value)
+{
+	ThingPropertyValue reached = {.number = floor(value.number / 10) * 10};
+	setPropertyValue(gDimmer,reached);
+}
+
+static void lampCallback(ThingPropertyValue value)
+{
+	char color[8] = {0};
+	for(int i = 0;i < sizeof(color) - 1 && value.string[i];i++)
+		color[i] = tolower((unsigned char)value.string[i]);
+	setPropertyValue(gLamp,(ThingPropertyValue){.string = color});
+}
+
+TEST_CASE("PUT answers with the value the callback applied","[property][http][callbacks]")
+{
+	Thing* thing = createSampleThing(0,NULL);
+	PropertyInfo info = {0};
+	info.type = eBRIGHTNESS;
+	info.maximum = 100;
+	gDimmer = createProperty("Brightness",info,dimmerCallback);
+	addProperty(thing,gDimmer);
+	info.type = eCOLOR;
+	info.value.string = "#000000";
+	gLamp = createProperty("Color",info,lampCallback);
+	addProperty(thing,gLamp);
+	httpd_handle_t server = startThing(thing);
+	char* brightness = propertyUrl(thing,"brightness");
+	char* color = propertyUrl(thing,"color");
+
+	mock_httpd_response_t* res = request(server,HTTP_PUT,brightness,"{\"brightness\":47}");
+	TEST_ASSERT_EQUAL(200,res->status);
+#ifndef CONFIG_WEB_THING_ASYNC_CALLBACKS
+	TEST_ASSERT_EQUAL_STRING(JSON_WRITER_FORMAT ? "{\n\t\"brightness\":\t40\n}" : "{\"brightness\":40}",res->body);
+#endif
+	res = request(server,HTTP_PUT,color,"{\"color\":\"#00FF00\"}");
+	TEST_ASSERT_EQUAL(200,res->status);
+#ifndef CONFIG_WEB_THING_ASYNC_CALLBACKS
+	TEST_ASSERT_CONTAINS("\"#00ff00\"",res->body);
+#endif
+	res = request(server,HTTP_PUT,thing->propertiesHref,"{\"brightness\":99,\"color\":\"#ABCDEF\"}");
+	TEST_ASSERT_EQUAL(200,res->status);
+#ifndef CONFIG_WEB_THING_ASYNC_CALLBACKS
+	TEST_ASSERT_CONTAINS("90",res->body);
+	TEST_ASSERT_CONTAINS("\"#abcdef\"",res->body);
+#endif
+
+	// with the callback task the response may be older , the stored value is not
+	callbacks();
+	char buf[16];
+	ThingPropertyValue value;
+	TEST_ASSERT_TRUE(getPropertyValue(gDimmer,&value,buf,sizeof(buf)));
+	TEST_ASSERT_EQUAL_DOUBLE(90,value.number);
+	TEST_ASSERT_TRUE(getPropertyValue(gLamp,&value,buf,sizeof(buf)));
+	TEST_ASSERT_EQUAL_STRING("#abcdef",value.string);
+	free(brightness);
+	free(color);
+}
+
+TEST_CASE("values outside the constraints are rejected before the callback","[property][http]")
+{
+	static const char* modes[] = {"off","heating","cooling",NULL};
+	Thing* thing = createSampleThing(0,countCallback);
+	PropertyInfo info = {0};
+	info.type = eBRIGHTNESS;
+	info.maximum = 100;
+	info.multipleOf = 5;
+	addProperty(thing,createProperty("Brightness",info,countCallback));
+	info.type = eLEVEL;
+	info.maximum = 1;
+	info.multipleOf = 0.1;
+	addProperty(thing,createProperty("Level",info,countCallback));
+	info.type = eHEATING_COOLING;
+	info.value.string = "off";
+	info.propertyEnum = modes;
+	addProperty(thing,createProperty("Mode",info,countCallback));
+	httpd_handle_t server = startThing(thing);
+	char* brightness = propertyUrl(thing,"brightness");
+	char* level = propertyUrl(thing,"level");
+	char* heating = propertyUrl(thing,"heating");
+
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,brightness,"{\"brightness\":150}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,brightness,"{\"brightness\":-5}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,brightness,"{\"brightness\":12}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,brightness,"{\"level\":10}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,level,"{\"level\":1e999}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,level,"{\"level\":0.35}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,heating,"{\"heating\":\"warming\"}")->status);
+	TEST_ASSERT_EQUAL(0,callbacks());
+
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,brightness,"{\"brightness\":15}")->status);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,level,"{\"level\":0.3}")->status);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,heating,"{\"heating\":\"cooling\"}")->status);
+	TEST_ASSERT_EQUAL(3,callbacks());
+	TEST_ASSERT_EQUAL_STRING("cooling",findProperty(thing,"heating")->info.value.string);
+
+	// one bad member leaves the others alone and says why
+	mock_httpd_response_t* res = request(server,HTTP_PUT,thing->propertiesHref,"{\"brightness\":20,\"level\":2}");
+	TEST_ASSERT_EQUAL(400,res->status);
+	TEST_ASSERT_EQUAL_STRING("above maximum",res->body);
+	TEST_ASSERT_EQUAL_DOUBLE(15,findProperty(thing,"brightness")->info.value.number);
+	TEST_ASSERT_EQUAL(3,callbacks());
+	free(brightness);
+	free(level);
+	free(heating);
+}
+
+/* {"level":<value>,"level_2":<value>...} for the first count properties of the thing */
+static void formatLevels(Thing* thing,int count,int value,char* buf,size_t size)
+{
+	int len = snprintf(buf,size,"{");
+	ThingProperty* property = thing->property;
+	for(int i = 0;i < count;i++,property = property->next)
+		len += snprintf(buf + len,size - len,"%s\"%s\":%d",i ? "," : "",property->key,value);
+	snprintf(buf + len,size - len,"}");
+}
+
+TEST_CASE("a bulk update sets up to CONFIG_MAX_PROPERTY properties","[property][http]")
+{
+	Thing* thing = createSampleThing(0,NULL);
+	PropertyInfo info = {0};
+	info.type = eLEVEL;
+	info.maximum = 100;
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	int count = CONFIG_MAX_PROPERTY;
+#else
+	int count = CONFIG_MAX_PROPERTY + 1;
+#endif
+	for(int i = 0;i < count;i++)
+		addProperty(thing,createProperty("Level",info,countCallback));
+	TEST_ASSERT_EQUAL(count,thing->propertyCount);
+	httpd_handle_t server = startThing(thing);
+
+	static char body[CONFIG_WEB_THING_MAX_BODY_SIZE];
+	formatLevels(thing,CONFIG_MAX_PROPERTY,7,body,sizeof(body));
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,thing->propertiesHref,body)->status);
+	int called = callbacks();
+	TEST_ASSERT_TRUE(called > 0);
+	for(int i = 0;i < CONFIG_MAX_PROPERTY;i++)
+		TEST_ASSERT_EQUAL_DOUBLE(7,thing->properties[i]->info.value.number);
+
+#ifndef CONFIG_WEB_THING_STATIC_POOL
+	// one more is refused whole , over HTTP and WebSocket alike
+	formatLevels(thing,count,8,body,sizeof(body));
+	mock_httpd_response_t* res = request(server,HTTP_PUT,thing->propertiesHref,body);
+	TEST_ASSERT_EQUAL(400,res->status);
+	TEST_ASSERT_EQUAL_STRING(THING_ERROR_TOO_MANY,res->body);
+	const char* error = NULL;
+	cJSON* values = cJSON_Parse(body);
+	TEST_ASSERT_FALSE(update_thing_properties(thing,values,&error));
+	TEST_ASSERT_EQUAL_STRING(THING_ERROR_TOO_MANY,error);
+	cJSON_Delete(values);
+	TEST_ASSERT_EQUAL_DOUBLE(7,thing->property->info.value.number);
+	TEST_ASSERT_EQUAL(called,callbacks());
+#endif
+}
+
+TEST_CASE("one wildcard handler per method serves all property URLs","[property][http]")
+{
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	int count = CONFIG_MAX_PROPERTY;
+#else
+	int count = 200;
+#endif
+	Thing* thing = createSampleThing(count,countCallback);
+	TEST_ASSERT_EQUAL(count,thing->propertyCount);
+	httpd_handle_t server = startThing(thing);
+	for(ThingProperty* property = thing->property;property;property = property->next)
+	{
+		mock_httpd_response_t* res = request(server,HTTP_GET,property->href,NULL);
+		TEST_ASSERT_EQUAL(200,res->status);
+		TEST_ASSERT_CONTAINS(property->key,res->body);
+	}
+
+	char url[128];
+	snprintf(url,sizeof(url),"%s?fields=all",findProperty(thing,"brightness")->href);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,url,NULL)->status);
+	const char* missing[] = {"/properties/","/properties/missing","/properties/brightness/x","/propertiesx","/actions",""};
+	for(int i = 0;i < sizeof(missing) / sizeof(missing[0]);i++)
+	{
+		snprintf(url,sizeof(url),"%s%s",thing->href,missing[i]);
+		if(*missing[i])
+		{
+			TEST_ASSERT_EQUAL(404,request(server,HTTP_PUT,url,"{}")->status);
+			TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,url,NULL)->status);
+		}
+		else
+		{
+			// the thing URL itself only has GET
+			TEST_ASSERT_EQUAL(405,request(server,HTTP_PUT,url,"{}")->status);
+		}
+	}
+
+	findProperty(thing,"temp")->info.readOnly = true;
+	TEST_ASSERT_EQUAL(405,request(server,HTTP_PUT,findProperty(thing,"temp")->href,"{\"temp\":1}")->status);
+	TEST_ASSERT_EQUAL(0,callbacks());
+
+	// the handler table does not grow with the properties , the application has room for its own
+	for(int i = 0;i < 4;i++)
+	{
+		snprintf(url,sizeof(url),"/app/%d",i);
+		httpd_uri_t uri = {.uri = url,.method = HTTP_GET,.handler = NULL};
+		TEST_ASSERT_EQUAL(ESP_OK,httpd_register_uri_handler(server,&uri));
+	}
+	freeSampleThing(thing);
+}
+
+TEST_CASE("unknown URLs and methods are rejected","[http]")
+{
+	Thing* thing = createSampleThing(3,NULL);
+	httpd_handle_t server = startThing(thing);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,"/things/nothing",NULL)->status);
+	TEST_ASSERT_EQUAL(405,request(server,HTTP_POST,"/",NULL)->status);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,"/?query=1",NULL)->status);
+
+	static char body[CONFIG_WEB_THING_MAX_BODY_SIZE + 32];
+	snprintf(body,sizeof(body),"{\"on\":true,\"pad\":\"%0*d\"}",CONFIG_WEB_THING_MAX_BODY_SIZE,0);
+	TEST_ASSERT_EQUAL(413,request(server,HTTP_PUT,thing->propertiesHref,body)->status);
+}
+
+static mock_httpd_request_t putRequest(const char* uri,const char* body)
+{
+	mock_httpd_request_t req = {0};
+	req.method = HTTP_PUT;
+	req.uri = uri;
+	req.body = body;
+	req.body_len = strlen(body);
+	return req;
+}
+
+static int sendRequest(httpd_handle_t server,const mock_httpd_request_t* req)
+{
+	mock_httpd_request(server,req,&gResponse);
+	return gResponse.status;
+}
+
+TEST_CASE("PUT bodies are received in pieces and from slow clients","[http]")
+{
+	Thing* thing = createSampleThing(3,countCallback);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"alarm");
+
+	mock_httpd_request_t req = putRequest(url,"{\"alarm\":true}");
+	req.fragment = 1;
+	TEST_ASSERT_EQUAL(200,sendRequest(server,&req));
+	TEST_ASSERT_EQUAL(1,callbacks());
+	TEST_ASSERT_TRUE(gLastValue.boolean);
+
+	// every piece comes after as many receive timeouts as are allowed
+	req = putRequest(url,"{\"alarm\":false}");
+	req.fragment = 4;
+	req.stalls = CONFIG_WEB_THING_BODY_RECV_RETRIES;
+	TEST_ASSERT_EQUAL(200,sendRequest(server,&req));
+	TEST_ASSERT_EQUAL(2,callbacks());
+	TEST_ASSERT_FALSE(gLastValue.boolean);
+
+	// one more and the client is dropped with what it sent so far
+	req = putRequest(url,"{\"alarm\":true}");
+	req.fragment = 4;
+	req.stalls = CONFIG_WEB_THING_BODY_RECV_RETRIES + 1;
+	TEST_ASSERT_EQUAL(408,sendRequest(server,&req));
+	TEST_ASSERT_TRUE(gResponse.closed);
+
+	// a client closing before the announced length is not answered
+	req = putRequest(url,"{\"alarm\":true}");
+	req.fragment = 3;
+	req.content_len = req.body_len + 5;
+	sendRequest(server,&req);
+	TEST_ASSERT_TRUE(gResponse.closed);
+	TEST_ASSERT_EQUAL(2,callbacks());
+
+	// the whole body of all properties in pieces too
+	req = putRequest(thing->propertiesHref,"{\"alarm\":true}");
+	req.fragment = 2;
+	req.stalls = 1;
+	TEST_ASSERT_EQUAL(200,sendRequest(server,&req));
+	TEST_ASSERT_EQUAL(3,callbacks());
+	free(url);
+}
+
+TEST_CASE("bodies are refused by length and type before they are read","[http]")
+{
+	Thing* thing = createSampleThing(3,countCallback);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"alarm");
+
+	// the announced length alone is refused , reading the body would find it cut short
+	mock_httpd_request_t req = putRequest(url,"{\"alarm\":true}");
+	req.content_len = 100000;
+	TEST_ASSERT_EQUAL(413,sendRequest(server,&req));
+	TEST_ASSERT_TRUE(gResponse.closed);
+
+	req = putRequest(url,"{\"alarm\":true}");
+	req.headers[0] = (mock_httpd_header_t){"Content-Type","text/plain"};
+	TEST_ASSERT_EQUAL(415,sendRequest(server,&req));
+	TEST_ASSERT_FALSE(gResponse.closed);
+	req.headers[0] = (mock_httpd_header_t){"Content-Type","application/jsonp"};
+	TEST_ASSERT_EQUAL(415,sendRequest(server,&req));
+	TEST_ASSERT_EQUAL(0,callbacks());
+
+	req.headers[0] = (mock_httpd_header_t){"Content-Type","Application/JSON; charset=utf-8"};
+	TEST_ASSERT_EQUAL(200,sendRequest(server,&req));
+	TEST_ASSERT_EQUAL(1,callbacks());
+
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,url,"")->status);
+	TEST_ASSERT_FALSE(gResponse.closed);
+
+	// a body of exactly CONFIG_WEB_THING_MAX_BODY_SIZE bytes fits , one more does not
+	static char body[CONFIG_WEB_THING_MAX_BODY_SIZE + 2];
+	memset(body,' ',sizeof(body) - 1);
+	body[sizeof(body) - 1] = '\0';
+	memcpy(body,"{\"alarm\":false",14);
+	body[CONFIG_WEB_THING_MAX_BODY_SIZE - 1] = '}';
+	body[CONFIG_WEB_THING_MAX_BODY_SIZE] = '\0';
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,body)->status);
+	body[CONFIG_WEB_THING_MAX_BODY_SIZE - 1] = ' ';
+	body[CONFIG_WEB_THING_MAX_BODY_SIZE] = '}';
+	TEST_ASSERT_EQUAL(413,request(server,HTTP_PUT,url,body)->status);
+
+	free(url);
+}
+
+/* GET with If-None-Match , etag NULL sends none */
+static mock_httpd_response_t* conditionalGet(httpd_handle_t server,const char* uri,const char* etag)
+{
+	mock_httpd_request_t req = {0};
+	req.method = HTTP_GET;
+	req.uri = uri;
+	if(etag)
+		req.headers[0] = (mock_httpd_header_t){"If-None-Match",etag};
+	mock_httpd_request(server,&req,&gResponse);
+	return &gResponse;
+}
+
+/* Copies the ETag of the last response */
+static const char* lastETag(char* buf)
+{
+	const char* etag = mock_httpd_response_header(&gResponse,"ETag");
+	TEST_ASSERT_NOT_NULL(etag);
+	strcpy(buf,etag);
+	return buf;
+}
+
+TEST_CASE("GET answers 304 while the ETag still matches","[http][etag]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	httpd_handle_t server = startThing(thing);
+	ThingProperty* brightness = findProperty(thing,"brightness");
+	char* url = getPropertyEndpointUrl(thing,brightness);
+	char description[32],value[32],values[32],other[48];
+
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,"/",NULL)->status);
+	lastETag(description);
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,url,NULL)->status);
+	lastETag(value);
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,thing->propertiesHref,NULL)->status);
+	lastETag(values);
+
+	mock_httpd_response_t* res = conditionalGet(server,url,value);
+	TEST_ASSERT_EQUAL(304,res->status);
+	TEST_ASSERT_EQUAL(0,res->body_len);
+	TEST_ASSERT_EQUAL_STRING(value,mock_httpd_response_header(res,"ETag"));
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,thing->propertiesHref,values)->status);
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,"/",description)->status);
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,thing->href,description)->status);
+
+	// lists , weak tags and * match too , a tag of another resource does not
+	snprintf(other,sizeof(other),"\"x\", W/%s",value);
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,url,other)->status);
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,url,"*")->status);
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,url,description)->status);
+
+	// a change of another property only changes the tag of all values
+	ThingPropertyValue on = {.boolean = !findProperty(thing,"on")->info.value.boolean};
+	setPropertyValue(findProperty(thing,"on"),on);
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,url,value)->status);
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,thing->propertiesHref,values)->status);
+	TEST_ASSERT_TRUE(strcmp(values,lastETag(other)) != 0);
+
+	// the PUT response carries the tag of the new value
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"brightness\":33}")->status);
+	TEST_ASSERT_TRUE(strcmp(value,lastETag(other)) != 0);
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,url,value)->status);
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,url,other)->status);
+
+	PropertyInfo info = {0};
+	info.type = eLEVEL;
+	addProperty(thing,createProperty("Level",info,NULL));
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,"/",description)->status);
+	TEST_ASSERT_TRUE(strcmp(description,lastETag(other)) != 0);
+	free(url);
+}
+
+TEST_CASE("GET and PUT requests do not allocate once the description is cached","[alloc][http]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"brightness");
+	char all[64];
+	snprintf(all,sizeof(all),"/things/%s/properties",thing->id);
+	request(server,HTTP_GET,"/",NULL);
+
+	mock_heap_stats_t before,after;
+	ThingAllocStats statsBefore,statsAfter;
+	mock_heap_stats(&before);
+	getThingAllocStats(&statsBefore);
+	for(int i = 0;i < 10;i++)
+	{
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,"/",NULL)->status);
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,url,NULL)->status);
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,all,NULL)->status);
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,i % 2 ? "{\"brightness\":40}" : "{\"brightness\":60}")->status);
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,all,"{\"on\":true,\"brightness\":50}")->status);
+	}
+	mock_heap_stats(&after);
+	getThingAllocStats(&statsAfter);
+	TEST_ASSERT_EQUAL(before.allocs,after.allocs);
+	TEST_ASSERT_EQUAL(statsBefore.heapAllocs,statsAfter.heapAllocs);
+	free(url);
+}
+
+static bool runNothing(ThingActionRequest* request)
+{
+	return true;
+}
+
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+TEST_CASE("things and properties come from the static pool","[alloc][pool]")
+{
+	mock_heap_stats_t before,after;
+	mock_heap_stats(&before);
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,countCallback);
+	getThingDescription(thing,NULL);
+	mock_heap_stats(&after);
+	TEST_ASSERT_EQUAL(before.allocs,after.allocs);
+
+	ThingAllocStats stats;
+	getThingAllocStats(&stats);
+	TEST_ASSERT_EQUAL(0,stats.heapAllocs);
+	TEST_ASSERT_EQUAL(0,stats.poolFailures);
+	TEST_ASSERT_TRUE(stats.poolUsed > 0 && stats.poolUsed <= stats.poolSize);
+	size_t used = stats.poolUsed;
+
+	// string values are copied into their fixed buffer , longer ones are refused
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"color");
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"color\":\"#00ff00\"}")->status);
+	TEST_ASSERT_EQUAL_STRING("#00ff00",findProperty(thing,"color")->info.value.string);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,url,"{\"color\":\"0123456789abcdef0123456789abcdef\"}")->status);
+	TEST_ASSERT_EQUAL_STRING("#00ff00",findProperty(thing,"color")->info.value.string);
+
+	// rebuilding the description reuses its buffer
+	invalidateThingDescription(thing);
+	TEST_ASSERT_CONTAINS("\"color\"",getThingDescription(thing,NULL));
+	getThingAllocStats(&stats);
+	TEST_ASSERT_EQUAL(used,stats.poolUsed);
+	TEST_ASSERT_EQUAL(0,stats.heapAllocs);
+
+	free(url);
+
+	// the pool holds CONFIG_MAX_PROPERTY properties and is reset with the last thing
+	PropertyInfo info = {0};
+	for(int i = thing->propertyCount;i < CONFIG_MAX_PROPERTY + 2;i++)
+	{
+		info.type = eLEVEL;
+		addProperty(thing,createProperty("Level",info,NULL));
+	}
+	TEST_ASSERT_EQUAL(CONFIG_MAX_PROPERTY,thing->propertyCount);
+	freeSampleThing(thing);
+	getThingAllocStats(&stats);
+	TEST_ASSERT_EQUAL(0,stats.poolUsed);
+}
+
+TEST_CASE("creating fails cleanly once the pool is full","[alloc][pool]")
+{
+	Thing* thing = createThing("Pool",NULL);
+	TEST_ASSERT_NOT_NULL(thing);
+	PropertyInfo info = {0};
+	info.type = eCOLOR;
+	info.value.string = "#ff0000";
+	ThingAllocStats stats;
+
+	// whatever runs out first , the objects made before stay complete
+	int made = 0;
+	ThingProperty* property;
+	while((property = createProperty("A property with a long title to fill the pool",info,NULL)) != NULL)
+	{
+		TEST_ASSERT_NOT_NULL(property->key);
+		TEST_ASSERT_EQUAL_STRING("#ff0000",property->info.value.string);
+		made++;
+	}
+	TEST_ASSERT_TRUE(made > 0);
+	while(createEvent("overheated","Overheated",NUMBER) != NULL)
+		;
+	while(createAction("reset","Reset",NO_STATE,runNothing) != NULL)
+		;
+	TEST_ASSERT_NULL(createThingWithId("other","Other",NULL));
+	getThingAllocStats(&stats);
+	TEST_ASSERT_TRUE(stats.poolFailures > 0);
+	TEST_ASSERT_EQUAL(0,stats.heapAllocs);
+	freeSampleThing(thing);
+}
+
+TEST_CASE("rebuilding the description does not use up the pool","[alloc][pool]")
+{
+	static char title[160];
+	Thing* thing = createSampleThing(8,NULL);
+	ThingProperty* property = findProperty(thing,"brightness");
+	char* created = property->title;
+	ThingAllocStats stats;
+	getThingDescription(thing,NULL);
+	getThingDescriptionDeflated(thing,NULL);
+
+	// a title growing with every rebuild , then changing back and forth
+	size_t grown = 0;
+	for(int i = 0;i < 600;i++)
+	{
+		size_t len = i < 150 ? i + 1 : 1 + (i * 37) % 150;
+		memset(title,'t',len);
+		title[len] = '\0';
+		property->title = title;
+		invalidateThingDescription(thing);
+		TEST_ASSERT_NOT_NULL(getThingDescription(thing,NULL));
+		getThingDescriptionDeflated(thing,NULL);
+		getThingAllocStats(&stats);
+		if(i == 149)
+			grown = stats.poolUsed;
+	}
+	TEST_ASSERT_EQUAL(0,stats.poolFailures);
+	TEST_ASSERT_EQUAL(grown,stats.poolUsed);
+	TEST_ASSERT_TRUE(stats.poolUsed < stats.poolSize / CONFIG_WEB_THING_POOL_THINGS);
+	property->title = created;
+	freeSampleThing(thing);
+}
+
+TEST_CASE("bulk updates store pool strings all or none","[property][pool]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,countCallback);
+	httpd_handle_t server = startThing(thing);
+	ThingProperty* brightness = findProperty(thing,"brightness");
+	ThingProperty* color = findProperty(thing,"color");
+	double level = brightness->info.value.number;
+
+	// a string too long for its buffer is refused with the other members
+	mock_httpd_response_t* res = request(server,HTTP_PUT,thing->propertiesHref,
+		"{\"brightness\":41,\"color\":\"0123456789abcdef0123456789abcdef\"}");
+	TEST_ASSERT_EQUAL(400,res->status);
+	TEST_ASSERT_EQUAL_STRING("longer than the value buffer",res->body);
+	TEST_ASSERT_EQUAL_DOUBLE(level,brightness->info.value.number);
+	TEST_ASSERT_EQUAL(0,callbacks());
+
+	// while the string is being read nothing is stored and the update can be retried
+	__atomic_fetch_add(&color->readers,1,__ATOMIC_SEQ_CST);
+	res = request(server,HTTP_PUT,thing->propertiesHref,"{\"brightness\":42,\"color\":\"#123456\"}");
+	TEST_ASSERT_EQUAL(503,res->status);
+	TEST_ASSERT_EQUAL_STRING(THING_ERROR_BUSY,res->body);
+	TEST_ASSERT_EQUAL(503,request(server,HTTP_PUT,color->href,"{\"color\":\"#123456\"}")->status);
+
+	const char* error = NULL;
+	cJSON* values = cJSON_Parse("{\"brightness\":43,\"color\":\"#654321\"}");
+	TEST_ASSERT_FALSE(update_thing_properties(thing,values,&error));
+	TEST_ASSERT_EQUAL_STRING(THING_ERROR_BUSY,error);
+	TEST_ASSERT_EQUAL_DOUBLE(level,brightness->info.value.number);
+	TEST_ASSERT_EQUAL(0,callbacks());
+	__atomic_fetch_sub(&color->readers,1,__ATOMIC_SEQ_CST);
+
+	TEST_ASSERT_TRUE(update_thing_properties(thing,values,&error));
+	TEST_ASSERT_EQUAL_DOUBLE(43,brightness->info.value.number);
+	TEST_ASSERT_EQUAL_STRING("#654321",color->info.value.string);
+	TEST_ASSERT_EQUAL(2,callbacks());
+	cJSON_Delete(values);
+}
+#endif
+
+TEST_CASE("mDNS advertises the web thing service","[adapter]")
+{
+	Thing* thing = createSampleThing(3,NULL);
+	startThing(thing);
+	const mock_mdns_state_t* mdns = mock_mdns_state();
+	TEST_ASSERT_EQUAL_STRING("webthing",mdns->hostname);
+	TEST_ASSERT_EQUAL_STRING("Sample Thing",mdns->instance);
+	TEST_ASSERT_EQUAL_STRING("_webthing",mdns->service);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_PORT,mdns->port);
+}
+
+/*
+	Several things on one adapter
+*/
+static httpd_handle_t startThings(Thing** things,int count)
+{
+	mock_httpd_set_port(0);
+	initAdapter(things[0]);
+	for(int i = 1;i < count;i++)
+		TEST_ASSERT_TRUE(addThing(things[i]));
+	startAdapter();
+	httpd_handle_t server = mock_httpd_last_server();
+	TEST_ASSERT_NOT_NULL(server);
+	return server;
+}
+
+TEST_CASE("one server lists several things and routes by id","[gateway][http]")
+{
+	Thing* things[3] = {
+		createSampleThingWithId("lamp",3,countCallback),
+		createSampleThingWithId("plug",3,countCallback),
+		createSampleThingWithId("sensor-1",3,countCallback)
+	};
+	httpd_handle_t server = startThings(things,3);
+	TEST_ASSERT_EQUAL(1,mock_mdns_state()->services);
+	TEST_ASSERT_TRUE(findThing("plug") == things[1]);
+	TEST_ASSERT_NULL(findThing("plu"));
+
+	// "/" is the array of the descriptions , each at the URL of its thing
+	cJSON* list = getJson(server,"/");
+	TEST_ASSERT_TRUE(cJSON_IsArray(list));
+	TEST_ASSERT_EQUAL(3,cJSON_GetArraySize(list));
+	for(int i = 0;i < 3;i++)
+	{
+		cJSON* description = cJSON_Parse(getThingDescription(things[i],NULL));
+		char* expected = cJSON_PrintUnformatted(description);
+		char* listed = cJSON_PrintUnformatted(cJSON_GetArrayItem(list,i));
+		TEST_ASSERT_EQUAL_STRING(expected,listed);
+		free(expected);
+		free(listed);
+		cJSON_Delete(description);
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,things[i]->href,NULL)->status);
+		TEST_ASSERT_EQUAL_STRING(getThingDescription(things[i],NULL),gResponse.body);
+	}
+	cJSON_Delete(list);
+
+	// a PUT reaches the addressed thing only
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,"/things/plug/properties/alarm","{\"alarm\":true}")->status);
+	TEST_ASSERT_TRUE(findProperty(things[1],"alarm")->info.value.boolean);
+	TEST_ASSERT_FALSE(findProperty(things[0],"alarm")->info.value.boolean);
+	TEST_ASSERT_FALSE(findProperty(things[2],"alarm")->info.value.boolean);
+	TEST_ASSERT_EQUAL(1,callbacks());
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,"/things/sensor-1/properties/alarm?x=1",NULL)->status);
+	TEST_ASSERT_CONTAINS("false",gResponse.body);
+
+	const char* missing[] = {"/things/","/things/lam","/things/lampx/properties","/things/other/properties/alarm"};
+	for(int i = 0;i < sizeof(missing) / sizeof(missing[0]);i++)
+	{
+		TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,missing[i],NULL)->status);
+		TEST_ASSERT_EQUAL(404,request(server,HTTP_PUT,missing[i],"{\"alarm\":true}")->status);
+	}
+	TEST_ASSERT_EQUAL(1,callbacks());
+
+	// the list is tagged like a description and changes with any of them
+	char etag[64];
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,"/",NULL)->status);
+	lastETag(etag);
+	TEST_ASSERT_EQUAL(304,conditionalGet(server,"/",etag)->status);
+	addProperty(things[2],createProperty("Extra",(PropertyInfo){.type = eLEVEL},NULL));
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,"/",etag)->status);
+}
+
+TEST_CASE("a thing added while the server runs is served and pushes","[gateway][http]")
+{
+	Thing* things[2] = {createSampleThingWithId("lamp",3,NULL),createSampleThingWithId("plug",3,NULL)};
+	httpd_handle_t server = startThings(things,2);
+	char etag[64];
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,"/",NULL)->status);
+	lastETag(etag);
+
+	// even a thing without properties changes the list
+	Thing* hub = createThingWithId("hub","Hub",NULL);
+	TEST_ASSERT_TRUE(addThing(hub));
+	TEST_ASSERT_EQUAL(200,conditionalGet(server,"/",etag)->status);
+	TEST_ASSERT_CONTAINS("/things/hub",gResponse.body);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,"/things/hub",NULL)->status);
+
+	// its actions get the POST handler the first things did not need
+	Thing* sensor = createSampleThingWithId("sensor",3,countCallback);
+	addAction(sensor,createAction("reset","Reset",NO_STATE,runNothing));
+	TEST_ASSERT_TRUE(addThing(sensor));
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,"/things/sensor/properties/alarm","{\"alarm\":true}")->status);
+	TEST_ASSERT_EQUAL(1,callbacks());
+	TEST_ASSERT_EQUAL(201,request(server,HTTP_POST,sensor->actionsHref,"{\"reset\":{}}")->status);
+
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+	char message[512];
+	int fd = mock_httpd_ws_connect(server,"/things/sensor");
+	TEST_ASSERT_TRUE(fd >= 0);
+	TEST_ASSERT_TRUE(setPropertyValue(findProperty(sensor,"alarm"),(ThingPropertyValue){.boolean = false}));
+	mock_timers_flush();
+	// the action status comes first
+	bool pushed = false;
+	while(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0)
+		pushed |= strstr(message,"\"propertyStatus\"") != NULL;
+	TEST_ASSERT_TRUE(pushed);
+#endif
+}
+
+TEST_CASE("things with a used or invalid id are refused","[gateway]")
+{
+	Thing* lamp = createSampleThingWithId("lamp",1,NULL);
+	TEST_ASSERT_NULL(createThingWithId("bad id","Bad",NULL));
+	TEST_ASSERT_NULL(createThingWithId("a/b","Bad",NULL));
+	TEST_ASSERT_EQUAL_STRING("/things/lamp",lamp->href);
+
+	initAdapter(lamp);
+	Thing* twin = createSampleThingWithId("lamp",1,NULL);
+	TEST_ASSERT_FALSE(addThing(twin));
+	TEST_ASSERT_FALSE(addThing(NULL));
+	TEST_ASSERT_TRUE(findThing("lamp") == lamp);
+	freeSampleThing(twin);
+	freeSampleThing(lamp);
+}
+
+TEST_CASE("the registry holds CONFIG_WEB_THING_MAX_THINGS things","[gateway][http]")
+{
+	static Thing* things[CONFIG_WEB_THING_MAX_THINGS + 1];
+	char id[16];
+	for(int i = 0;i <= CONFIG_WEB_THING_MAX_THINGS;i++)
+	{
+		snprintf(id,sizeof(id),"dev%d",i);
+		things[i] = createSampleThingWithId(id,2,NULL);
+		// the last one is refused by the registry , the pool may already be full for it
+		if(i < CONFIG_WEB_THING_MAX_THINGS)
+			TEST_ASSERT_NOT_NULL(things[i]);
+	}
+	httpd_handle_t server = startThings(things,CONFIG_WEB_THING_MAX_THINGS);
+	TEST_ASSERT_FALSE(addThing(things[CONFIG_WEB_THING_MAX_THINGS]));
+
+	for(int i = 0;i < CONFIG_WEB_THING_MAX_THINGS;i++)
+	{
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,things[i]->propertiesHref,NULL)->status);
+		TEST_ASSERT_TRUE(findThing(things[i]->id) == things[i]);
+	}
+	snprintf(id,sizeof(id),"/things/dev%d",CONFIG_WEB_THING_MAX_THINGS);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,id,NULL)->status);
+	cJSON* list = getJson(server,"/");
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_MAX_THINGS,cJSON_GetArraySize(list));
+	cJSON_Delete(list);
+}
+
+/*
+	Metrics
+*/
+#ifdef CONFIG_WEB_THING_METRICS
+static double routeCounter(cJSON* metrics,const char* route,const char* counter)
+{
+	cJSON* item = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(metrics,"routes"),route),counter);
+	TEST_ASSERT_NOT_NULL(item);
+	return item->valuedouble;
+}
+
+TEST_CASE("GET /metrics counts requests per route with their durations","[metrics][http]")
+{
+	Thing* thing = createSampleThing(3,countCallback);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"alarm");
+	size_t bytes = 0;
+	for(int i = 0;i < 3;i++)
+	{
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,url,NULL)->status);
+		bytes += gResponse.body_len;
+	}
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"alarm\":true}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,url,"{\"alarm\":")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_PUT,url,"{\"alarm\":5}")->status);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,"/things/nothing",NULL)->status);
+	TEST_ASSERT_EQUAL(1,callbacks());
+
+	cJSON* metrics = getJson(server,"/metrics");
+	TEST_ASSERT_EQUAL_DOUBLE(3,routeCounter(metrics,"property.get","requests"));
+	TEST_ASSERT_EQUAL_DOUBLE(bytes,routeCounter(metrics,"property.get","bytesOut"));
+	TEST_ASSERT_EQUAL_DOUBLE(0,routeCounter(metrics,"property.get","failures"));
+	TEST_ASSERT_EQUAL_DOUBLE(3,routeCounter(metrics,"property.put","requests"));
+	TEST_ASSERT_EQUAL_DOUBLE(1,routeCounter(metrics,"other","requests"));
+	TEST_ASSERT_NULL(cJSON_GetObjectItem(cJSON_GetObjectItem(metrics,"routes"),"metrics"));
+	TEST_ASSERT_EQUAL_DOUBLE(1,cJSON_GetObjectItem(metrics,"parseFailures")->valuedouble);
+
+	// every request lands in exactly one bucket , one bound fewer than buckets
+	cJSON* buckets = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(metrics,"routes"),"property.put"),"buckets");
+	TEST_ASSERT_EQUAL(THING_METRIC_BUCKETS,cJSON_GetArraySize(buckets));
+	TEST_ASSERT_EQUAL(THING_METRIC_BUCKETS - 1,cJSON_GetArraySize(cJSON_GetObjectItem(metrics,"bucketBoundsUs")));
+	double counted = 0;
+	for(cJSON* bucket = buckets->child;bucket;bucket = bucket->next)
+		counted += bucket->valuedouble;
+	TEST_ASSERT_EQUAL_DOUBLE(3,counted);
+
+	cJSON* callbackMetrics = cJSON_GetObjectItem(metrics,"callbacks");
+	TEST_ASSERT_EQUAL_DOUBLE(1,cJSON_GetObjectItem(callbackMetrics,"count")->valuedouble);
+	TEST_ASSERT_TRUE(cJSON_GetObjectItem(metrics,"minFreeHeap")->valuedouble >= esp_get_minimum_free_heap_size());
+	TEST_ASSERT_TRUE(cJSON_GetObjectItem(metrics,"freeHeap")->valuedouble > 0);
+	TEST_ASSERT_EQUAL_DOUBLE(7,cJSON_GetObjectItem(cJSON_GetObjectItem(metrics,"sockets"),"max")->valuedouble);
+	cJSON_Delete(metrics);
+
+	// the metrics request itself shows up in the next read
+	metrics = getJson(server,"/metrics");
+	TEST_ASSERT_EQUAL_DOUBLE(1,routeCounter(metrics,"metrics","requests"));
+	cJSON_Delete(metrics);
+	free(url);
+}
+
+TEST_CASE("durations land in log scale buckets","[metrics]")
+{
+	ThingMetrics metrics;
+	int64_t now = esp_timer_get_time();
+	recordRequest(eMETRIC_EVENTS_GET,now,10,false);
+	recordRequest(eMETRIC_EVENTS_GET,now - 20,10,true);
+	recordRequest(eMETRIC_EVENTS_GET,now - 100000,10,false);
+	recordRequest(eMETRIC_EVENTS_GET,now - 100000000,10,false);
+	getThingMetrics(&metrics);
+
+	ThingRouteMetrics* route = &metrics.routes[eMETRIC_EVENTS_GET];
+	TEST_ASSERT_EQUAL(4,route->requests);
+	TEST_ASSERT_EQUAL(1,route->failures);
+	TEST_ASSERT_EQUAL(40,route->bytesOut);
+	TEST_ASSERT_TRUE(route->maxUs >= 100000000);
+	uint32_t shortOnes = 0;
+	for(int i = 0;i < 8;i++)
+		shortOnes += route->buckets[i];
+	TEST_ASSERT_EQUAL(2,shortOnes);
+	// 100 ms is past the last bound of 16 << 12 us , like everything longer
+	TEST_ASSERT_EQUAL(2,route->buckets[THING_METRIC_BUCKETS - 1]);
+}
+#endif
+
+/*
+	Logging and tracing
+*/
+static int gLogArgs = 0;
+
+static int logArg(void)
+{
+	return ++gLogArgs;
+}
+
+TEST_CASE("messages above the compiled log level do not evaluate their arguments","[log]")
+{
+	THING_LOGD("test","%d",logArg());
+	THING_LOGE("test","%d",logArg());
+	int evaluated = logArg() - 1;
+#if CONFIG_WEB_THING_LOG_LEVEL < 4
+	// up to the compiled level esp_log still filters at runtime , past it nothing is left
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_LOG_LEVEL >= 1 ? 1 : 0,evaluated);
+#else
+	TEST_ASSERT_TRUE(evaluated >= 1);
+#endif
+}
+
+#ifdef CONFIG_WEB_THING_TRACE
+typedef struct {
+	ThingTraceRecord records[CONFIG_WEB_THING_TRACE_SIZE];
+	uint16_t count;
+} TraceCapture;
+
+static void captureTrace(const ThingTraceRecord* record,void* ctx)
+{
+	TraceCapture* capture = (TraceCapture*)ctx;
+	capture->records[capture->count++] = *record;
+}
+
+/* Position of the first record of point from start on , fails if there is none */
+static uint16_t findTrace(const TraceCapture* capture,uint16_t start,ThingTracePoint point)
+{
+	for(uint16_t i = start;i < capture->count;i++)
+	{
+		if(capture->records[i].point == point)
+			return i;
+	}
+	TEST_ASSERT_MESSAGE(false,"trace point missing");
+	return 0;
+}
+
+TEST_CASE("a PUT leaves its trace points in order","[trace][http]")
+{
+	Thing* thing = createSampleThing(3,countCallback);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"alarm");
+	const char* body = "{\"alarm\":true}";
+	uint32_t cursor = 0;
+	TraceCapture capture = {0};
+
+	// nothing is recorded until tracing is switched on
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_GET,url,NULL)->status);
+	TEST_ASSERT_EQUAL(0,takeThingTrace(&cursor,captureTrace,&capture));
+
+	setThingTrace(true);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,body)->status);
+	TEST_ASSERT_EQUAL(1,callbacks());
+	setThingTrace(false);
+	takeThingTrace(&cursor,captureTrace,&capture);
+
+	uint16_t begin = findTrace(&capture,0,eTRACE_REQUEST_BEGIN);
+	uint16_t received = findTrace(&capture,begin,eTRACE_BODY_RECEIVED);
+	uint16_t end = findTrace(&capture,received,eTRACE_REQUEST_END);
+	TEST_ASSERT_EQUAL(HTTP_PUT,capture.records[begin].arg);
+	TEST_ASSERT_EQUAL(strlen(body),capture.records[received].arg);
+	TEST_ASSERT_EQUAL(eMETRIC_PROPERTY_PUT,capture.records[end].arg);
+	TEST_ASSERT_TRUE(capture.records[end].timeUs >= capture.records[begin].timeUs);
+	uint16_t callback = findTrace(&capture,0,eTRACE_CALLBACK_BEGIN);
+	TEST_ASSERT_EQUAL(findProperty(thing,"alarm")->index,capture.records[callback].arg);
+	TEST_ASSERT_TRUE(findTrace(&capture,callback,eTRACE_CALLBACK_END) > callback);
+#ifndef CONFIG_WEB_THING_ASYNC_CALLBACKS
+	// run by the handler itself
+	TEST_ASSERT_TRUE(callback > received && callback < end);
+#endif
+	for(uint16_t i = 1;i < capture.count;i++)
+		TEST_ASSERT_EQUAL(capture.records[i - 1].sequence + 1,capture.records[i].sequence);
+	free(url);
+}
+
+TEST_CASE("the trace keeps the newest records","[trace]")
+{
+	uint32_t cursor = 0;
+	TraceCapture capture = {0};
+	setThingTrace(true);
+	for(uint32_t i = 0;i < CONFIG_WEB_THING_TRACE_SIZE + 5;i++)
+		THING_TRACE(eTRACE_ACTION_BEGIN,i);
+	setThingTrace(false);
+	THING_TRACE(eTRACE_ACTION_END,0);
+
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_TRACE_SIZE,takeThingTrace(&cursor,captureTrace,&capture));
+	TEST_ASSERT_EQUAL(5,capture.records[0].arg);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_TRACE_SIZE + 4,capture.records[capture.count - 1].arg);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_TRACE_SIZE + 5,cursor);
+	TEST_ASSERT_EQUAL(0,takeThingTrace(&cursor,captureTrace,&capture));
+}
+#endif
+
+/*
+	Actions and events
+*/
+static ThingEvent* addSampleEvent(Thing* thing,const char* name,ThingPropertyValueType valueType)
+{
+	ThingEvent* event = createEvent(name,name,valueType);
+	TEST_ASSERT_NOT_NULL(event);
+	addEvent(thing,event);
+	return event;
+}
+
+TEST_CASE("events keep the newest in a ring of bounded size","[events][http]")
+{
+	Thing* thing = createSampleThing(3,NULL);
+	ThingEvent* overheated = addSampleEvent(thing,"overheated",NUMBER);
+	ThingEvent* reset = addSampleEvent(thing,"reset",NO_STATE);
+	ThingEvent* message = addSampleEvent(thing,"message",STRING);
+	httpd_handle_t server = startThing(thing);
+	const int emitted = CONFIG_WEB_THING_EVENT_LOG_SIZE + 5;
+
+	mock_heap_stats_t before,after;
+	mock_heap_stats(&before);
+	TEST_ASSERT_TRUE(emitEvent(reset,(ThingPropertyValue){0}));
+	for(int i = 1;i < emitted - 1;i++)
+		TEST_ASSERT_TRUE(emitEvent(overheated,(ThingPropertyValue){.number = i}));
+	char text[CONFIG_WEB_THING_LOG_STRING_SIZE * 2];
+	memset(text,'x',sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+	TEST_ASSERT_TRUE(emitEvent(message,(ThingPropertyValue){.string = text}));
+	mock_heap_stats(&after);
+	TEST_ASSERT_EQUAL(before.allocs,after.allocs);
+
+	ThingEventStats stats;
+	getThingEventStats(thing,&stats);
+	TEST_ASSERT_EQUAL(emitted,stats.emitted);
+	TEST_ASSERT_EQUAL(5,stats.overwritten);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_EVENT_LOG_SIZE,stats.stored);
+
+	// oldest first , the reset and the first overheated events were pushed out
+	cJSON* json = getJson(server,thing->eventsHref);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_EVENT_LOG_SIZE,cJSON_GetArraySize(json));
+	cJSON* first = cJSON_GetArrayItem(json,0);
+	TEST_ASSERT_EQUAL_STRING("overheated",first->child->string);
+	TEST_ASSERT_EQUAL_DOUBLE(5,innerItem(first,"data")->valuedouble);
+	TEST_ASSERT_NOT_NULL(cJSON_GetStringValue(innerItem(first,"timestamp")));
+	cJSON* last = cJSON_GetArrayItem(json,CONFIG_WEB_THING_EVENT_LOG_SIZE - 1);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_LOG_STRING_SIZE - 1,strlen(cJSON_GetStringValue(innerItem(last,"data"))));
+	cJSON_Delete(json);
+
+	json = getJson(server,overheated->href);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_EVENT_LOG_SIZE - 1,cJSON_GetArraySize(json));
+	cJSON_Delete(json);
+	TEST_ASSERT_EQUAL_STRING("[]",request(server,HTTP_GET,reset->href,NULL)->body);
+
+	char url[128];
+	snprintf(url,sizeof(url),"%s/missing",thing->eventsHref);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,url,NULL)->status);
+	TEST_ASSERT_EQUAL(405,request(server,HTTP_PUT,thing->eventsHref,"{}")->status);
+}
+
+static bool gActionHold;
+static bool gActionBusy;
+
+/* runs until the test releases it or the request is cancelled , an input of 13 fails */
+static bool fadeRun(ThingActionRequest* request)
+{
+	__atomic_store_n(&gActionBusy,true,__ATOMIC_RELEASE);
+	while(__atomic_load_n(&gActionHold,__ATOMIC_ACQUIRE) && !isActionCancelled(request))
+		usleep(1000);
+	return request->input.number != 13;
+}
+
+static ThingAction* addFadeAction(Thing* thing)
+{
+	ThingAction* fade = createAction("fade","Fade",NUMBER,fadeRun);
+	TEST_ASSERT_NOT_NULL(fade);
+	fade->minimum = 0;
+	fade->maximum = 100;
+	addAction(thing,fade);
+	return fade;
+}
+
+static int postFade(httpd_handle_t server,const char* uri,int input)
+{
+	char body[64];
+	snprintf(body,sizeof(body),"{\"fade\":{\"input\":%d}}",input);
+	return request(server,HTTP_POST,uri,body)->status;
+}
+
+static const char* requestStatus(httpd_handle_t server,ThingAction* action,uint32_t id)
+{
+	static char status[16];
+	char url[128];
+	snprintf(url,sizeof(url),"%s/%u",action->href,(unsigned)id);
+	cJSON* json = getJson(server,url);
+	snprintf(status,sizeof(status),"%s",cJSON_GetStringValue(innerItem(json,"status")));
+	cJSON_Delete(json);
+	return status;
+}
+
+TEST_CASE("action requests are refused while every slot is busy and recycled once finished","[actions][http]")
+{
+	Thing* thing = createSampleThing(3,NULL);
+	ThingAction* fade = addFadeAction(thing);
+	httpd_handle_t server = startThing(thing);
+	char url[128];
+
+	__atomic_store_n(&gActionHold,true,__ATOMIC_RELEASE);
+	TEST_ASSERT_EQUAL(201,postFade(server,thing->actionsHref,50));
+	cJSON* json = cJSON_Parse(gResponse.body);
+	TEST_ASSERT_NOT_NULL(json);
+	snprintf(url,sizeof(url),"%s/1",fade->href);
+	TEST_ASSERT_EQUAL_STRING(url,cJSON_GetStringValue(innerItem(json,"href")));
+	TEST_ASSERT_EQUAL_DOUBLE(50,innerItem(json,"input")->valuedouble);
+	cJSON_Delete(json);
+	while(!__atomic_load_n(&gActionBusy,__ATOMIC_ACQUIRE))
+		usleep(1000);
+	for(int i = 2;i <= CONFIG_WEB_THING_ACTION_LOG_SIZE;i++)
+		TEST_ASSERT_EQUAL(201,postFade(server,fade->href,i));
+	TEST_ASSERT_EQUAL(503,postFade(server,fade->href,1));
+
+	ThingActionStats stats;
+	getThingActionStats(thing,&stats);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_ACTION_LOG_SIZE,stats.requested);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_ACTION_LOG_SIZE,stats.busy);
+	TEST_ASSERT_EQUAL(1,stats.rejected);
+
+	// bad requests do not take a slot
+	TEST_ASSERT_EQUAL(400,postFade(server,fade->href,150));
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_POST,fade->href,"{\"dim\":{\"input\":1}}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_POST,fade->href,"{\"fade\":{\"input\":true}}")->status);
+	TEST_ASSERT_EQUAL(400,request(server,HTTP_POST,fade->href,"{\"fade\":")->status);
+	snprintf(url,sizeof(url),"%s/missing",thing->actionsHref);
+	TEST_ASSERT_EQUAL(404,postFade(server,url,1));
+	TEST_ASSERT_EQUAL(405,request(server,HTTP_PUT,fade->href,"{}")->status);
+	TEST_ASSERT_EQUAL(405,postFade(server,thing->propertiesHref,1));
+
+	// a pending request is cancelled at once , a running one when it returns
+	snprintf(url,sizeof(url),"%s/2",fade->href);
+	TEST_ASSERT_EQUAL(204,request(server,HTTP_DELETE,url,NULL)->status);
+	TEST_ASSERT_EQUAL_STRING("cancelled",requestStatus(server,fade,2));
+	TEST_ASSERT_EQUAL_STRING("running",requestStatus(server,fade,1));
+	snprintf(url,sizeof(url),"%s/1",fade->href);
+	TEST_ASSERT_EQUAL(204,request(server,HTTP_DELETE,url,NULL)->status);
+	__atomic_store_n(&gActionHold,false,__ATOMIC_RELEASE);
+	TEST_ASSERT_TRUE(waitThingActions(1000));
+	TEST_ASSERT_EQUAL_STRING("cancelled",requestStatus(server,fade,1));
+	TEST_ASSERT_EQUAL_STRING("completed",requestStatus(server,fade,3));
+
+	getThingActionStats(thing,&stats);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_ACTION_LOG_SIZE - 2,stats.completed);
+	TEST_ASSERT_EQUAL(2,stats.cancelled);
+	TEST_ASSERT_EQUAL(0,stats.busy);
+
+	json = getJson(server,thing->actionsHref);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_ACTION_LOG_SIZE,cJSON_GetArraySize(json));
+	TEST_ASSERT_EQUAL_DOUBLE(50,innerItem(cJSON_GetArrayItem(json,0),"input")->valuedouble);
+	TEST_ASSERT_NOT_NULL(innerItem(cJSON_GetArrayItem(json,0),"timeCompleted"));
+	cJSON_Delete(json);
+
+	// the oldest finished request makes room for the next one
+	TEST_ASSERT_EQUAL(201,postFade(server,fade->href,13));
+	TEST_ASSERT_TRUE(waitThingActions(1000));
+	snprintf(url,sizeof(url),"%s/1",fade->href);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,url,NULL)->status);
+	TEST_ASSERT_EQUAL_STRING("failed",requestStatus(server,fade,CONFIG_WEB_THING_ACTION_LOG_SIZE + 1));
+	getThingActionStats(thing,&stats);
+	TEST_ASSERT_EQUAL(1,stats.failed);
+
+	// deleting a finished request removes it
+	snprintf(url,sizeof(url),"%s/%d",fade->href,CONFIG_WEB_THING_ACTION_LOG_SIZE + 1);
+	TEST_ASSERT_EQUAL(204,request(server,HTTP_DELETE,url,NULL)->status);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_DELETE,url,NULL)->status);
+	snprintf(url,sizeof(url),"%s/0",fade->href);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_GET,url,NULL)->status);
+	snprintf(url,sizeof(url),"%s/abc",fade->href);
+	TEST_ASSERT_EQUAL(404,request(server,HTTP_DELETE,url,NULL)->status);
+}
+
+TEST_CASE("description lists actions and events like serializeDevice","[description]")
+{
+	Thing* thing = createSampleThing(3,NULL);
+	addFadeAction(thing)->description = "Fades to a level";
+	addAction(thing,createAction("reboot",NULL,NO_STATE,fadeRun));
+	addSampleEvent(thing,"overheated",NUMBER)->description = "Too hot";
+
+	cJSON* json = cJSON_CreateObject();
+	serializeDevice(thing,json);
+	char* expected = JSON_WRITER_FORMAT ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+	TEST_ASSERT_EQUAL_STRING(expected,getThingDescription(thing,NULL));
+
+	cJSON* links = cJSON_GetObjectItem(json,"links");
+	TEST_ASSERT_EQUAL(3,cJSON_GetArraySize(links));
+	TEST_ASSERT_EQUAL_STRING(thing->actionsHref,cJSON_GetStringValue(cJSON_GetObjectItem(cJSON_GetArrayItem(links,1),"href")));
+	TEST_ASSERT_EQUAL_STRING("events",cJSON_GetStringValue(cJSON_GetObjectItem(cJSON_GetArrayItem(links,2),"rel")));
+	cJSON* fade = cJSON_GetObjectItem(cJSON_GetObjectItem(json,"actions"),"fade");
+	TEST_ASSERT_EQUAL_DOUBLE(100,cJSON_GetObjectItem(cJSON_GetObjectItem(fade,"input"),"maximum")->valuedouble);
+	TEST_ASSERT_NULL(cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(json,"actions"),"reboot"),"input"));
+	free(expected);
+	cJSON_Delete(json);
+	freeSampleThing(thing);
+}
+
+/*
+	Notifications
+*/
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+static int connectWs(httpd_handle_t server,Thing* thing)
+{
+	char* url = getThingDescriptionUrl(thing);
+	int fd = mock_httpd_ws_connect(server,url);
+	free(url);
+	TEST_ASSERT_TRUE(fd >= 0);
+	return fd;
+}
+
+TEST_CASE("subscribers get changed properties in one message","[websocket]")
+{
+	char message[2048];
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	httpd_handle_t server = startThing(thing);
+	int fd = connectWs(server,thing);
+
+	ThingPropertyValue on = {.boolean = true};
+	ThingPropertyValue level = {.number = 12.5};
+	TEST_ASSERT_TRUE(setPropertyValue(findProperty(thing,"on"),on));
+	TEST_ASSERT_TRUE(setPropertyValue(findProperty(thing,"level"),level));
+	TEST_ASSERT_FALSE(setPropertyValue(findProperty(thing,"on"),on));
+	mock_timers_flush();
+
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0);
+	TEST_ASSERT_EQUAL_STRING("{\"messageType\":\"propertyStatus\",\"data\":{\"level\":12.5,\"on\":true}}",message);
+	TEST_ASSERT_EQUAL(-1,mock_httpd_ws_receive(server,fd,message,sizeof(message)));
+}
+
+TEST_CASE("long property messages are sent as fragments","[websocket]")
+{
+	static char message[8192];
+	char* text = malloc(CONFIG_WEB_THING_JSON_CHUNK_SIZE * 3);
+	memset(text,'a',CONFIG_WEB_THING_JSON_CHUNK_SIZE * 3 - 1);
+	text[CONFIG_WEB_THING_JSON_CHUNK_SIZE * 3 - 1] = '\0';
+
+	// the initial value is as long , with the static pool that sizes the value buffer
+	Thing* thing = createSampleThing(0,NULL);
+	PropertyInfo info = {0};
+	info.type = eCOLOR;
+	info.value.string = text;
+	addProperty(thing,createProperty("Color",info,NULL));
+	httpd_handle_t server = startThing(thing);
+	int fd = connectWs(server,thing);
+
+	memset(text,'b',CONFIG_WEB_THING_JSON_CHUNK_SIZE * 3 - 1);
+	TEST_ASSERT_TRUE(setPropertyValue(findProperty(thing,"color"),(ThingPropertyValue){.string = text}));
+	mock_timers_flush();
+
+	int len = mock_httpd_ws_receive(server,fd,message,sizeof(message));
+	TEST_ASSERT_TRUE(len > CONFIG_WEB_THING_JSON_CHUNK_SIZE * 3);
+	cJSON* json = cJSON_Parse(message);
+	TEST_ASSERT_NOT_NULL(json);
+	TEST_ASSERT_EQUAL_STRING(text,cJSON_GetStringValue(cJSON_GetObjectItem(cJSON_GetObjectItem(json,"data"),"color")));
+	cJSON_Delete(json);
+	free(text);
+}
+
+TEST_CASE("setProperty messages update properties","[websocket]")
+{
+	char message[512];
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,countCallback);
+	httpd_handle_t server = startThing(thing);
+	int fd = connectWs(server,thing);
+
+	TEST_ASSERT_EQUAL(ESP_OK,mock_httpd_ws_send_text(server,fd,"{\"messageType\":\"setProperty\",\"data\":{\"on\":true}}"));
+	TEST_ASSERT_TRUE(findProperty(thing,"on")->info.value.boolean);
+	TEST_ASSERT_EQUAL(1,callbacks());
+	mock_timers_flush();
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0);
+	TEST_ASSERT_EQUAL_STRING("{\"messageType\":\"propertyStatus\",\"data\":{\"on\":true}}",message);
+
+	TEST_ASSERT_EQUAL(ESP_OK,mock_httpd_ws_send_text(server,fd,"{\"messageType\":\"requestAction\"}"));
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0);
+	TEST_ASSERT_CONTAINS("\"messageType\":\"error\"",message);
+	TEST_ASSERT_EQUAL(ESP_OK,mock_httpd_ws_send_text(server,fd,"not json"));
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0);
+	TEST_ASSERT_CONTAINS("invalid JSON",message);
+}
+
+TEST_CASE("closed subscribers are dropped","[websocket]")
+{
+	char message[512];
+	Thing* thing = createSampleThing(3,NULL);
+	httpd_handle_t server = startThing(thing);
+	int first = connectWs(server,thing);
+	int second = connectWs(server,thing);
+	mock_httpd_ws_close(server,first);
+
+	TEST_ASSERT_TRUE(setPropertyValue(findProperty(thing,"alarm"),(ThingPropertyValue){.boolean = true}));
+	mock_timers_flush();
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,second,message,sizeof(message)) > 0);
+	TEST_ASSERT_EQUAL(-1,mock_httpd_ws_receive(server,first,message,sizeof(message)));
+}
+
+TEST_CASE("subscribers only get the messages of their thing","[websocket][gateway]")
+{
+	char message[512];
+	Thing* things[2] = {createSampleThingWithId("lamp",3,NULL),createSampleThingWithId("plug",3,countCallback)};
+	httpd_handle_t server = startThings(things,2);
+	int lamp = connectWs(server,things[0]);
+	int plug = connectWs(server,things[1]);
+	TEST_ASSERT_TRUE(mock_httpd_ws_connect(server,"/things/plug/properties") < 0);
+
+	TEST_ASSERT_TRUE(setPropertyValue(findProperty(things[0],"alarm"),(ThingPropertyValue){.boolean = true}));
+	mock_timers_flush();
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,lamp,message,sizeof(message)) > 0);
+	TEST_ASSERT_EQUAL(-1,mock_httpd_ws_receive(server,plug,message,sizeof(message)));
+
+	// a setProperty message goes to the thing the socket subscribed to
+	TEST_ASSERT_EQUAL(ESP_OK,mock_httpd_ws_send_text(server,plug,"{\"messageType\":\"setProperty\",\"data\":{\"alarm\":true}}"));
+	TEST_ASSERT_TRUE(findProperty(things[1],"alarm")->info.value.boolean);
+	TEST_ASSERT_EQUAL(1,callbacks());
+	mock_timers_flush();
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,plug,message,sizeof(message)) > 0);
+	TEST_ASSERT_EQUAL(-1,mock_httpd_ws_receive(server,lamp,message,sizeof(message)));
+}
+
+TEST_CASE("subscribers get events and action status messages","[websocket][events][actions]")
+{
+	char message[512];
+	Thing* thing = createSampleThing(3,NULL);
+	ThingEvent* overheated = addSampleEvent(thing,"overheated",NUMBER);
+	addFadeAction(thing);
+	httpd_handle_t server = startThing(thing);
+
+	// events before the first subscriber are only in the log
+	TEST_ASSERT_TRUE(emitEvent(overheated,(ThingPropertyValue){.number = 1}));
+	mock_timers_flush();
+	int fd = connectWs(server,thing);
+	TEST_ASSERT_TRUE(emitEvent(overheated,(ThingPropertyValue){.number = 90}));
+	mock_timers_flush();
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0);
+	TEST_ASSERT_CONTAINS("{\"messageType\":\"event\",\"data\":{\"overheated\":{\"data\":90,\"timestamp\":",message);
+	TEST_ASSERT_EQUAL(-1,mock_httpd_ws_receive(server,fd,message,sizeof(message)));
+
+	TEST_ASSERT_EQUAL(ESP_OK,mock_httpd_ws_send_text(server,fd,"{\"messageType\":\"requestAction\",\"data\":{\"fade\":{\"input\":30}}}"));
+	TEST_ASSERT_TRUE(waitThingActions(1000));
+	mock_timers_flush();
+	const char* status = NULL;
+	while(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0)
+	{
+		TEST_ASSERT_CONTAINS("{\"messageType\":\"actionStatus\",\"data\":{\"fade\":{\"input\":30,",message);
+		status = strstr(message,"\"status\":");
+	}
+	TEST_ASSERT_NOT_NULL(status);
+	TEST_ASSERT_CONTAINS("completed",message);
+
+	TEST_ASSERT_EQUAL(ESP_OK,mock_httpd_ws_send_text(server,fd,"{\"messageType\":\"requestAction\",\"data\":{\"fade\":{\"input\":300}}}"));
+	TEST_ASSERT_TRUE(mock_httpd_ws_receive(server,fd,message,sizeof(message)) > 0);
+	TEST_ASSERT_CONTAINS("input out of range",message);
+}
+#endif
+
+TEST_CASE("deadband drops small number changes","[notify]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	ThingProperty* temp = findProperty(thing,"temp");
+	temp->info.deadband = 0.5;
+	TEST_ASSERT_FALSE(setPropertyValue(temp,(ThingPropertyValue){.number = 20.9}));
+	TEST_ASSERT_EQUAL_DOUBLE(20.5,temp->info.value.number);
+	TEST_ASSERT_TRUE(setPropertyValue(temp,(ThingPropertyValue){.number = 21.1}));
+	TEST_ASSERT_EQUAL_DOUBLE(21.1,temp->info.value.number);
+	freeSampleThing(thing);
+}
+
+static void countVisit(ThingProperty* property,void* ctx)
+{
+	(*(int*)ctx)++;
+}
+
+TEST_CASE("minInterval holds changes back until the interval passed","[notify]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	ThingProperty* temp = findProperty(thing,"temp");
+	temp->info.minInterval = 1000;
+	int visits = 0;
+
+	setPropertyValue(temp,(ThingPropertyValue){.number = 1});
+	TEST_ASSERT_EQUAL(1,takeChangedProperties(thing,countVisit,&visits));
+	setPropertyValue(temp,(ThingPropertyValue){.number = 2});
+	setPropertyValue(temp,(ThingPropertyValue){.number = 3});
+	TEST_ASSERT_EQUAL(0,takeChangedProperties(thing,countVisit,&visits));
+
+	mock_timer_advance(1000 * 1000);
+	TEST_ASSERT_EQUAL(1,takeChangedProperties(thing,countVisit,&visits));
+	TEST_ASSERT_EQUAL_DOUBLE(3,temp->info.value.number);
+	TEST_ASSERT_EQUAL(0,takeChangedProperties(thing,countVisit,&visits));
+	TEST_ASSERT_EQUAL(2,visits);
+	freeSampleThing(thing);
+}
+
+/*
+	Persistence
+*/
+/* brightness , on and color are persisted , level is not , plus levels persisted level_N */
+static Thing* createPersistedThing(int levels)
+{
+	Thing* thing = createSampleThing(0,NULL);
+	PropertyInfo info = {0};
+	info.maximum = 100;
+	info.persist = true;
+	info.type = eBRIGHTNESS;
+	info.value.number = 50;
+	addProperty(thing,createProperty("Brightness",info,NULL));
+	info.type = eON_OFF;
+	info.value.boolean = false;
+	addProperty(thing,createProperty("On",info,NULL));
+	info.type = eCOLOR;
+	info.value.string = "#ff0000";
+	addProperty(thing,createProperty("Color",info,NULL));
+	info.persist = false;
+	info.type = eLEVEL;
+	info.value.number = 1;
+	addProperty(thing,createProperty("Level",info,NULL));
+	info.persist = true;
+	for(int i = 0;i < levels;i++)
+		addProperty(thing,createProperty("Zone level",info,NULL));
+	return thing;
+}
+
+TEST_CASE("persisted values are restored when the property is added","[persist]")
+{
+	mock_nvs_stats_t stats;
+	Thing* thing = createPersistedThing(0);
+	TEST_ASSERT_EQUAL_DOUBLE(50,findProperty(thing,"brightness")->info.value.number);
+	setPropertyValue(findProperty(thing,"brightness"),(ThingPropertyValue){.number = 42});
+	setPropertyValue(findProperty(thing,"on"),(ThingPropertyValue){.boolean = true});
+	setPropertyValue(findProperty(thing,"color"),(ThingPropertyValue){.string = "#00ff00"});
+	setPropertyValue(findProperty(thing,"level"),(ThingPropertyValue){.number = 7});
+	TEST_ASSERT_TRUE(saveThingProperties(thing));
+	mock_nvs_stats(&stats);
+	TEST_ASSERT_EQUAL(3,stats.writes);
+	TEST_ASSERT_EQUAL(1,stats.commits);
+	freeSampleThing(thing);
+
+	mock_nvs_reboot();
+	thing = createPersistedThing(0);
+	TEST_ASSERT_EQUAL_DOUBLE(42,findProperty(thing,"brightness")->info.value.number);
+	TEST_ASSERT_TRUE(findProperty(thing,"on")->info.value.boolean);
+	TEST_ASSERT_EQUAL_STRING("#00ff00",findProperty(thing,"color")->info.value.string);
+	TEST_ASSERT_EQUAL_DOUBLE(1,findProperty(thing,"level")->info.value.number);
+	ThingPropertyValue value;
+	char text[16];
+	TEST_ASSERT_TRUE(getPropertyValue(findProperty(thing,"color"),&value,text,sizeof(text)));
+	TEST_ASSERT_EQUAL_STRING("#00ff00",value.string);
+	freeSampleThing(thing);
+}
+
+TEST_CASE("changes are written together by the save timer","[persist][http]")
+{
+	mock_nvs_stats_t stats;
+	Thing* thing = createPersistedThing(0);
+	httpd_handle_t server = startThing(thing);
+	ThingProperty* brightness = findProperty(thing,"brightness");
+	for(int i = 1;i <= 50;i++)
+		setPropertyValue(brightness,(ThingPropertyValue){.number = i});
+	char* url = propertyUrl(thing,"color");
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"color\":\"#0000ff\"}")->status);
+	free(url);
+
+	// nothing is written by the requests
+	mock_nvs_stats(&stats);
+	TEST_ASSERT_EQUAL(0,stats.writes);
+	TEST_ASSERT_TRUE(xTimerIsTimerActive(thing->saveTimer));
+	mock_timers_flush();
+	mock_nvs_stats(&stats);
+	TEST_ASSERT_EQUAL(2,stats.writes);
+	TEST_ASSERT_EQUAL(1,stats.commits);
+
+	// a change not saved yet is lost on a power cut
+	setPropertyValue(brightness,(ThingPropertyValue){.number = 99});
+	mock_nvs_reboot();
+	Thing* rebooted = createPersistedThing(0);
+	TEST_ASSERT_EQUAL_DOUBLE(50,findProperty(rebooted,"brightness")->info.value.number);
+	TEST_ASSERT_EQUAL_STRING("#0000ff",findProperty(rebooted,"color")->info.value.string);
+}
+
+TEST_CASE("many unsaved properties are written without waiting","[persist]")
+{
+	mock_nvs_stats_t stats;
+	Thing* thing = createPersistedThing(CONFIG_WEB_THING_PERSIST_UNSAVED_MAX);
+	int changed = 0;
+	for(ThingProperty* property = thing->property;property;property = property->next)
+	{
+		if(property->info.persist && property->info.valueType == NUMBER && changed < CONFIG_WEB_THING_PERSIST_UNSAVED_MAX)
+		{
+			setPropertyValue(property,(ThingPropertyValue){.number = 5});
+			changed++;
+		}
+	}
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_PERSIST_UNSAVED_MAX,changed);
+
+	// the save timer was cut short to one tick
+	for(int i = 0;i < 1000;i++)
+	{
+		mock_nvs_stats(&stats);
+		if(stats.commits)
+			break;
+		usleep(1000);
+	}
+	TEST_ASSERT_EQUAL(1,stats.commits);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_PERSIST_UNSAVED_MAX,stats.writes);
+	freeSampleThing(thing);
+}
+
+TEST_CASE("values a failed save could not write are saved by the next one","[persist]")
+{
+	mock_nvs_stats_t stats;
+	Thing* thing = createPersistedThing(0);
+	ThingProperty* brightness = findProperty(thing,"brightness");
+	ThingProperty* color = findProperty(thing,"color");
+
+	// the store can not be opened , the timer tries again
+	setPropertyValue(brightness,(ThingPropertyValue){.number = 42});
+	mock_nvs_fail(1,0);
+	TEST_ASSERT_FALSE(saveThingProperties(thing));
+	TEST_ASSERT_TRUE(xTimerIsTimerActive(thing->saveTimer));
+	mock_timers_flush();
+	mock_nvs_stats(&stats);
+	TEST_ASSERT_EQUAL(1,stats.writes);
+	TEST_ASSERT_EQUAL(1,stats.commits);
+
+	// the values are written but not committed
+	setPropertyValue(color,(ThingPropertyValue){.string = "#00ff00"});
+	setPropertyValue(brightness,(ThingPropertyValue){.number = 43});
+	mock_nvs_fail(0,1);
+	TEST_ASSERT_FALSE(saveThingProperties(thing));
+	TEST_ASSERT_TRUE(xTimerIsTimerActive(thing->saveTimer));
+	mock_timers_flush();
+	mock_nvs_stats(&stats);
+	TEST_ASSERT_EQUAL(2,stats.commits);
+	TEST_ASSERT_TRUE(saveThingProperties(thing));
+
+	mock_nvs_reboot();
+	Thing* rebooted = createPersistedThing(0);
+	TEST_ASSERT_EQUAL_DOUBLE(43,findProperty(rebooted,"brightness")->info.value.number);
+	TEST_ASSERT_EQUAL_STRING("#00ff00",findProperty(rebooted,"color")->info.value.string);
+}
+
+TEST_CASE("cleanUpThing waits for a save running on the timer task","[persist]")
+{
+	mock_nvs_stats_t stats;
+	mock_nvs_set_commit_delay(3000);
+	for(int round = 0;round < 20;round++)
+	{
+		mock_nvs_erase();
+		Thing* thing = createPersistedThing(CONFIG_WEB_THING_PERSIST_UNSAVED_MAX);
+		int changed = 0;
+		for(ThingProperty* property = thing->property;property;property = property->next)
+		{
+			if(property->info.persist && property->info.valueType == NUMBER && changed < CONFIG_WEB_THING_PERSIST_UNSAVED_MAX)
+			{
+				setPropertyValue(property,(ThingPropertyValue){.number = round + 10});
+				changed++;
+			}
+		}
+		// the save timer fires one tick from now and commits for 3 ms , the thing goes
+		// away before , during or after that
+		usleep(round * 100);
+		freeSampleThing(thing);
+		mock_nvs_stats(&stats);
+		// every change was written exactly once before the thing was gone
+		TEST_ASSERT_EQUAL((round + 1) * CONFIG_WEB_THING_PERSIST_UNSAVED_MAX,stats.writes);
+		TEST_ASSERT_EQUAL(round + 1,stats.commits);
+	}
+}
+
+/*
+	Callback task , built with -DWEBTHING_HOST_CONFIG="CONFIG_WEB_THING_ASYNC_CALLBACKS=1"
+*/
+#ifdef CONFIG_WEB_THING_ASYNC_CALLBACKS
+static bool gCallbackBusy;
+static bool gCallbackRelease;
+
+/* holds the callback task until the test sets gCallbackRelease */
+static void blockingCallback(ThingPropertyValue value)
+{
+	__atomic_store_n(&gCallbackBusy,true,__ATOMIC_RELEASE);
+	while(!__atomic_load_n(&gCallbackRelease,__ATOMIC_ACQUIRE))
+		usleep(1000);
+	gCallbacks++;
+}
+
+static void slowCallback(ThingPropertyValue value)
+{
+	usleep(100 * 1000);
+	gCallbacks++;
+	gLastValue = value;
+}
+
+TEST_CASE("slow callbacks run in the callback task after the response","[callbacks][http]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,slowCallback);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"brightness");
+
+	int64_t start = esp_timer_get_time();
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"brightness\":10}")->status);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"brightness\":20}")->status);
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"brightness\":30}")->status);
+	TEST_ASSERT_TRUE(esp_timer_get_time() - start < 100 * 1000);
+
+	TEST_ASSERT_EQUAL(3,callbacks());
+	TEST_ASSERT_EQUAL_DOUBLE(30,gLastValue.number);
+	ThingCallbackStats stats;
+	getThingCallbackStats(&stats);
+	TEST_ASSERT_EQUAL(3,stats.queued);
+	TEST_ASSERT_EQUAL(3,stats.dispatched);
+	TEST_ASSERT_EQUAL(0,stats.dropped);
+	TEST_ASSERT_EQUAL(0,stats.waiting);
+	TEST_ASSERT_TRUE(stats.maxRunUs >= 100 * 1000);
+	TEST_ASSERT_TRUE(stats.maxWaitUs >= 100 * 1000);	// the last one waited for two
+	TEST_ASSERT_TRUE(stats.totalWaitUs >= stats.maxWaitUs);
+	free(url);
+}
+
+TEST_CASE("callbacks beyond the queue depth are dropped","[callbacks][http]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,blockingCallback);
+	httpd_handle_t server = startThing(thing);
+	char* url = propertyUrl(thing,"brightness");
+	char body[32];
+
+	TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,"{\"brightness\":0}")->status);
+	while(!__atomic_load_n(&gCallbackBusy,__ATOMIC_ACQUIRE))
+		usleep(1000);
+	for(int i = 1;i <= CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH + 2;i++)
+	{
+		snprintf(body,sizeof(body),"{\"brightness\":%d}",i);
+		TEST_ASSERT_EQUAL(200,request(server,HTTP_PUT,url,body)->status);
+	}
+
+	ThingCallbackStats stats;
+	getThingCallbackStats(&stats);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH,stats.waiting);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH,stats.highWater);
+	TEST_ASSERT_EQUAL(2,stats.dropped);
+
+	__atomic_store_n(&gCallbackRelease,true,__ATOMIC_RELEASE);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH + 1,callbacks());
+	getThingCallbackStats(&stats);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH + 1,stats.dispatched);
+	TEST_ASSERT_EQUAL(0,stats.waiting);
+	free(url);
+}
+#endif
+
+/*
+	Concurrency , run the TSan build (-DWEBTHING_HOST_TSAN=ON) to check the memory ordering
+*/
+typedef struct {
+	Thing* thing;
+	httpd_handle_t server;
+	bool stop;
+	int reads;
+} StressContext;
+
+static bool running(StressContext* ctx)
+{
+	return !__atomic_load_n(&ctx->stop,__ATOMIC_RELAXED);
+}
+
+/* writers only set whole numbers and strings of one letter whose count matches the letter */
+static bool checkString(const char* value)
+{
+	size_t len = strlen(value);
+	if(len < 8 || len != 8 + (value[0] - 'a'))
+		return false;
+	for(size_t i = 1;i < len;i++)
+		if(value[i] != value[0])
+			return false;
+	return true;
+}
+
+static void* stressWriter(void* arg)
+{
+	StressContext* ctx = (StressContext*)arg;
+	ThingProperty* brightness = findProperty(ctx->thing,"brightness");
+	ThingProperty* color = findProperty(ctx->thing,"color");
+	char text[32];
+	for(unsigned n = 0;running(ctx);n++)
+	{
+		setPropertyValue(brightness,(ThingPropertyValue){.number = n % 100});
+		memset(text,'a' + n % 16,8 + n % 16);
+		text[8 + n % 16] = '\0';
+		setPropertyValue(color,(ThingPropertyValue){.string = text});
+	}
+	return NULL;
+}
+
+static void* stressReader(void* arg)
+{
+	StressContext* ctx = (StressContext*)arg;
+	ThingProperty* brightness = findProperty(ctx->thing,"brightness");
+	ThingProperty* color = findProperty(ctx->thing,"color");
+	ThingPropertyValue value;
+	char text[32];
+	while(running(ctx))
+	{
+		TEST_ASSERT_TRUE(getPropertyValue(brightness,&value,NULL,0));
+		TEST_ASSERT_EQUAL_DOUBLE(floor(value.number),value.number);
+		TEST_ASSERT_TRUE(getPropertyValue(color,&value,text,sizeof(text)));
+		TEST_ASSERT_TRUE(checkString(value.string));
+		__atomic_fetch_add(&ctx->reads,1,__ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/* plays the http server task , which is the only caller of the handlers */
+static void* stressServer(void* arg)
+{
+	StressContext* ctx = (StressContext*)arg;
+	mock_httpd_response_t* res = malloc(sizeof(mock_httpd_response_t));
+	char url[64];
+	snprintf(url,sizeof(url),"/things/%s/properties",ctx->thing->id);
+	while(running(ctx))
+	{
+		mock_httpd_request_t req = {.method = HTTP_GET,.uri = url};
+		mock_httpd_request(ctx->server,&req,res);
+		TEST_ASSERT_EQUAL(200,res->status);
+		cJSON* json = cJSON_Parse(res->body);
+		TEST_ASSERT_NOT_NULL(json);
+		double number = cJSON_GetObjectItem(json,"brightness")->valuedouble;
+		TEST_ASSERT_EQUAL_DOUBLE(floor(number),number);
+		TEST_ASSERT_TRUE(checkString(cJSON_GetObjectItem(json,"color")->valuestring));
+		cJSON_Delete(json);
+
+		req.method = HTTP_PUT;
+		req.body = "{\"brightness\":50,\"color\":\"ddddddddddd\"}";
+		req.body_len = strlen(req.body);
+		mock_httpd_request(ctx->server,&req,res);
+		__atomic_fetch_add(&ctx->reads,1,__ATOMIC_RELAXED);
+	}
+	free(res);
+	return NULL;
+}
+
+TEST_CASE("readers never see a torn value while values are set","[concurrency]")
+{
+	Thing* thing = createSampleThing(SAMPLE_THING_MAX_PROPERTIES,NULL);
+	ThingProperty* color = findProperty(thing,"color");
+	TEST_ASSERT_TRUE(setPropertyValue(color,(ThingPropertyValue){.string = "aaaaaaaa"}));
+	StressContext ctx = {.thing = thing,.server = startThing(thing)};
+	pthread_t threads[5];
+	pthread_create(&threads[0],NULL,stressWriter,&ctx);
+	pthread_create(&threads[1],NULL,stressWriter,&ctx);
+	pthread_create(&threads[2],NULL,stressReader,&ctx);
+	pthread_create(&threads[3],NULL,stressReader,&ctx);
+	pthread_create(&threads[4],NULL,stressServer,&ctx);
+	usleep(300 * 1000);
+	__atomic_store_n(&ctx.stop,true,__ATOMIC_RELAXED);
+	for(int i = 0;i < 5;i++)
+		pthread_join(threads[i],NULL);
+
+	TEST_ASSERT_TRUE(ctx.reads > 0);
+	TEST_ASSERT_TRUE(checkString(color->info.value.string));
+}
+
+typedef struct {
+	ThingEvent* event;
+	int count;
+} EmitContext;
+
+static void* emitter(void* arg)
+{
+	EmitContext* ctx = (EmitContext*)arg;
+	for(int i = 0;i < ctx->count;i++)
+		TEST_ASSERT_TRUE(emitEvent(ctx->event,(ThingPropertyValue){.number = i}));
+	return NULL;
+}
+
+static void checkEventOrder(const ThingEventRecord* record,void* ctx)
+{
+	uint32_t* last = (uint32_t*)ctx;
+	TEST_ASSERT_TRUE(record->seq > *last);
+	TEST_ASSERT_EQUAL_DOUBLE(floor(record->data.number),record->data.number);
+	*last = record->seq;
+}
+
+TEST_CASE("events emitted from several tasks are all counted and read in order","[concurrency][events]")
+{
+	Thing* thing = createSampleThing(3,NULL);
+	ThingEvent* event = addSampleEvent(thing,"tick",NUMBER);
+	EmitContext ctx = {event,20000};
+	pthread_t threads[4];
+	for(int i = 0;i < 4;i++)
+		pthread_create(&threads[i],NULL,emitter,&ctx);
+
+	// a reader behind the emitters skips what was overwritten , never goes back
+	uint32_t cursor = 0,last = 0;
+	ThingEventStats stats;
+	do
+	{
+		getThingEventStats(thing,&stats);
+		takeNewEvents(thing,&cursor,checkEventOrder,&last);
+	}
+	while(stats.emitted < 4 * 20000);
+	for(int i = 0;i < 4;i++)
+		pthread_join(threads[i],NULL);
+
+	getThingEventStats(thing,&stats);
+	TEST_ASSERT_EQUAL(4 * 20000,stats.emitted);
+	TEST_ASSERT_EQUAL(4 * 20000 - CONFIG_WEB_THING_EVENT_LOG_SIZE,stats.overwritten);
+	TEST_ASSERT_EQUAL(CONFIG_WEB_THING_EVENT_LOG_SIZE,stats.stored);
+	takeNewEvents(thing,&cursor,checkEventOrder,&last);
+	TEST_ASSERT_EQUAL(4 * 20000,cursor);
+	TEST_ASSERT_EQUAL(4 * 20000,last);
+	freeSampleThing(thing);
+}
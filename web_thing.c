@@ -21,42 +21,60 @@
 */
 
 #include "web_thing.h"
+#include <ctype.h>
+#include <math.h>
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "web_thing_actions.h"
+#include "web_thing_callbacks.h"
+#include "web_thing_events.h"
+#include "web_thing_log.h"
+#include "web_thing_metrics.h"
+#include "web_thing_persist.h"
+#include "web_thing_trace.h"
+
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+#if __has_include("esp32/rom/miniz.h")
+#include "esp32/rom/miniz.h"
+#else
+#include "rom/miniz.h"
+#endif
+#endif
 
 static const char* TAG="web_thing";
 
+static void createValueLocks(void);
+
 /*
-Property Type Structure :
-{<const char* title>,<const char* property_keyname>,<ThingPropertyValueType value_type>,<bool isRange>,<const char* schema_description>}
+	Property types , indexed by ThingPropertyType. eKEEP_LAST stands in for unknown types.
+	{<key>,<@type>,<value type>,<isRange>}
 */
-#define PropertyTypeInfo_keyname 		0
-#define PropertyTypeInfo_ValueType 		1
-#define PropertyTypeInfo_IsRange 		2
-#define PropertyTypeInfo_TypeSchema		3
-const char* PropertyTypeInfo[][5]=
-{
-	{"alarm",BOOLEAN,false,"AlarmProperty"},
-	{"bool",BOOLEAN,false,"BooleanProperty"},
-	{"brightness",NUMBER,true,"BrightnessProperty"},
-	{"color",STRING,false,"ColorProperty"},
-	{"colortemp",NUMBER,false,"ColorTemperatureProperty"},
-	{"current",NUMBER,false,"CurrentProperty"},
-	{"freq",NUMBER,false,"FrequencyProperty"},
-	{"heating",STRING,false,"HeatingCoolingProperty"},
-	{"image",NO_STATE,false,"ImageProperty"},
-	{"instpower",NUMBER,false,"InstantaneousPowerProperty"},
-	{"leak",BOOLEAN,false,"LeakProperty"},
-	{"level",NUMBER,true,"LevelProperty"},
-	{"locked",STRING,false,"LockedProperty"},
-	{"motion",BOOLEAN,false,"MotionProperty"},
-	{"on",BOOLEAN,false,"OnOffProperty"},
-	{"open",BOOLEAN,false,"OpenProperty"},
-	{"pushed",BOOLEAN,false,"PushedProperty"},
-	{"targettemp",NUMBER,false,"TargetTemperatureProperty"},
-	{"temp",NUMBER,false,"TemperatureProperty"},
-	{"thermostatMode",STRING,false,"ThermostatModeProperty"},
-	{"video",NO_STATE,false,"VideoProperty"},
-	{"voltage",NUMBER,false,"VoltageProperty"},
-	{"NULL",NO_STATE,true,"LAST_PROPERTY"}
+static const PropertyTypeDescriptor PropertyTypes[eKEEP_LAST+1] =
+{
+	[eALARM]               = {"alarm","AlarmProperty",BOOLEAN,false},
+	[eBOOLEAN]             = {"bool","BooleanProperty",BOOLEAN,false},
+	[eBRIGHTNESS]          = {"brightness","BrightnessProperty",NUMBER,true},
+	[eCOLOR]               = {"color","ColorProperty",STRING,false},
+	[eCOLOR_TEMPERATURE]   = {"colortemp","ColorTemperatureProperty",NUMBER,false},
+	[eCURRENT]             = {"current","CurrentProperty",NUMBER,false},
+	[eFREQUENCY]           = {"freq","FrequencyProperty",NUMBER,false},
+	[eHEATING_COOLING]     = {"heating","HeatingCoolingProperty",STRING,false},
+	[eIMAGE]               = {"image","ImageProperty",NO_STATE,false},
+	[eINSTANTANEOUS_POWER] = {"instpower","InstantaneousPowerProperty",NUMBER,false},
+	[eLEAK]                = {"leak","LeakProperty",BOOLEAN,false},
+	[eLEVEL]               = {"level","LevelProperty",NUMBER,true},
+	[eLOCKED]              = {"locked","LockedProperty",STRING,false},
+	[eMOTION]              = {"motion","MotionProperty",BOOLEAN,false},
+	[eON_OFF]              = {"on","OnOffProperty",BOOLEAN,false},
+	[eOPEN]                = {"open","OpenProperty",BOOLEAN,false},
+	[ePUSHED]              = {"pushed","PushedProperty",BOOLEAN,false},
+	[eTARGET_TEMPERATURE]  = {"targettemp","TargetTemperatureProperty",NUMBER,false},
+	[eTEMPERATURE]         = {"temp","TemperatureProperty",NUMBER,false},
+	[eTHERMOSTAT]          = {"thermostatMode","ThermostatModeProperty",STRING,false},
+	[eVIDEO]               = {"video","VideoProperty",NO_STATE,false},
+	[eVOLTAGE]             = {"voltage","VoltageProperty",NUMBER,false},
+	[eKEEP_LAST]           = {"NULL","LAST_PROPERTY",NO_STATE,true},
 };
 
 //TODO: Its not clear from the spec as to how to change the units, revisit again
@@ -71,381 +89,2017 @@ const char* UnitsToStr[] =
 
 Thing* createThing(const char* _title, char** _type)
 {
-	Thing* thing = malloc(sizeof(Thing));
-
 	// Mac ID will be used as device ID 
-	thing->id = malloc(sizeof(char)*13);// MAC ID is 12+1 characters long    
+	char id[13];// MAC ID is 12+1 characters long    
 	uint8_t mac[6];
     esp_wifi_get_mac(WIFI_IF_STA, mac);
-    sprintf(thing->id, "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-
-	thing->title = strdup(_title);	
-	thing->type = _type;
-	thing->property = NULL;
-	return thing;
+    sprintf(id, "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	return createThingWithId(id,_title,_type);
 }
 
-ThingProperty* createProperty(char* _title,PropertyInfo _info,PropertyChange_cb _callback)
+Thing* createThingWithId(const char* _id,const char* _title,char** _type)
 {
-	ThingProperty* property = malloc(sizeof(ThingProperty));
-	if(_title)
+	if(_id == NULL || !isValidThingKey(_id))
 	{
-		property->title = strdup(_title);
+		THING_LOGE(TAG,"thing id is not a valid URL segment");
+		return NULL;
 	}
-
-	property->info = _info;
-	property->info.valueType = get_property_valueType(property);
-	if(property->info.valueType == STRING)
+	Thing* thing = thingAlloc(sizeof(Thing));
+	if(thing == NULL)
 	{
-		property->info.value.string = strdup(_info.value.string);
+		THING_LOGE(TAG,"No memory for thing");
+		return NULL;
 	}
-	else
+	thingPoolAcquire();
+
+	thing->id = thingStrdup(_id);
+	thing->title = thingStrdup(_title);	
+	thing->type = _type;
+	thing->href = thingAlloc(strlen("/things/")+strlen(_id)+1);
+	thing->propertiesHref = thingAlloc(strlen("/things/")+strlen(_id)+strlen("/properties")+1);
+	if(thing->id == NULL || (_title && thing->title == NULL) || thing->href == NULL || thing->propertiesHref == NULL)
 	{
-		property->info.value = _info.value;
+		THING_LOGE(TAG,"No memory for thing %s",_id);
+		thingFree(thing->id);
+		thingFree(thing->title);
+		thingFree(thing->href);
+		thingFree(thing->propertiesHref);
+		thingFree(thing);
+		thingPoolRelease();
+		return NULL;
 	}
+	sprintf(thing->href,"/things/%s",thing->id);
+	sprintf(thing->propertiesHref,"%s/properties",thing->href);
+	thing->property = NULL;
+	thing->propertyTail = NULL;
+	thing->propertyIndex = NULL;
+	thing->propertyIndexSize = 0;
+	thing->propertyCount = 0;
+	thing->propertyCapacity = 0;
+	thing->properties = NULL;
+	thing->changed = NULL;
+	thing->unsaved = NULL;
+	thing->unsavedCount = 0;
+	thing->saveTimer = NULL;
+	thing->actionsHref = NULL;
+	thing->eventsHref = NULL;
+	thing->action = NULL;
+	thing->actionLog = NULL;
+	thing->event = NULL;
+	thing->eventLog = NULL;
+	thing->propertyChanged = NULL;
+	thing->version = 0;
+	thing->descriptionVersion = 0;
+	thing->description = NULL;
+	thing->descriptionLen = 0;
+	thing->descriptionSize = 0;
+	thing->descriptionDeflated = NULL;
+	thing->descriptionDeflatedLen = 0;
+	thing->descriptionDeflatedSize = 0;
+	thing->descriptionNotDeflated = false;
+	createValueLocks();
+	return thing;
+}
 
-	property->next = NULL;
-	property->callback = _callback;
+/*
+	Property values
+
+	The http server task reads and sets values while firmware tasks set them too. Readers
+	never wait : writers put the new value into the other entry of published[] and then
+	advance seq , readers copy the newest entry and only retry if a writer started to
+	overwrite that entry meanwhile. Writers are serialised by gValueLock (a mutex , so a
+	preempted writer inherits the priority of the next) and never wait for readers.
+	info.value is the copy of the writers.
+
+	String buffers are never changed while published. A new string gets a new buffer and
+	the old one goes to the retired list of the property , which is freed as soon as no
+	reader is using a string of the property. With the static pool the two buffers of the
+	property take turns instead , a new string is refused while a reader still uses one.
+*/
+static StaticSemaphore_t gValueLockBuffer;
+static SemaphoreHandle_t gValueLock = NULL;
+static StaticSemaphore_t gUpdateLockBuffer;
+static SemaphoreHandle_t gUpdateLock = NULL;	// held by bulk updates , see gPending
 
-	return property;	
+/* Called when the first thing or property is created , before any task uses the locks */
+static void createValueLocks(void)
+{
+	if(gValueLock == NULL)
+		gValueLock = xSemaphoreCreateMutexStatic(&gValueLockBuffer);
+	if(gUpdateLock == NULL)
+		gUpdateLock = xSemaphoreCreateMutexStatic(&gUpdateLockBuffer);
 }
 
-void addProperty(Thing* _thing,ThingProperty* _property)
+/* The value as words , so that published[] is only accessed with atomics */
+typedef union ValueWords
 {
-	//ESP_LOGI(TAG,"In addingproperty:%d",(int)_property->type);
-	ThingProperty** nextproperty = &(_thing->property);
-	
-	while(*nextproperty != NULL)
-	{
-		nextproperty = &(((ThingProperty*)*nextproperty)->next);
-		ESP_LOGI(TAG,"In addProperty fetching next property");
-	}
-	*nextproperty = _property;	
-	if(_property->next == NULL)
-		ESP_LOGI(TAG,"next property os NULL");
-}
+	ThingPropertyValue value;
+	uint32_t words[(sizeof(ThingPropertyValue) + 3) / 4];
+}ValueWords;
 
-void cleanUpProperty(ThingProperty** property)
+static void publishValue(ThingProperty* property,ThingPropertyValue value)
 {
-	if(((ThingProperty*)*property)->title)
-	{
-		free(((ThingProperty*)*property)->title);
-		((ThingProperty*)*property)->title = NULL;
-	}
+	ValueWords in = {.value = value};
+	uint32_t seq = __atomic_load_n(&property->seq,__ATOMIC_RELAXED);
+	ValueWords* slot = (ValueWords*)&property->published[((seq >> 1) + 1) & 1];
+
+	// odd seq tells readers of this entry that it is being overwritten , a reader
+	// which loads one of the new words also sees the odd seq
+	__atomic_fetch_add(&property->seq,1,__ATOMIC_RELAXED);
+	for(int i = 0;i < sizeof(in.words) / sizeof(in.words[0]);i++)
+		__atomic_store_n(&slot->words[i],in.words[i],__ATOMIC_RELEASE);
+	__atomic_fetch_add(&property->seq,1,__ATOMIC_SEQ_CST);
+	property->info.value = value;
+
+	// after the value , so a version read before the values is never newer than them
+	if(property->thing)
+		__atomic_fetch_add(&property->thing->version,1,__ATOMIC_RELEASE);
+}
 
-	if(((ThingProperty*)*property)->info.valueType == STRING)
+/* Copies the newest published value , strings stay valid until releaseValue() */
+static ThingPropertyValue acquireValue(ThingProperty* property)
+{
+	ValueWords out;
+	__atomic_fetch_add(&property->readers,1,__ATOMIC_SEQ_CST);
+	for(;;)
 	{
-		if(((ThingProperty*)*property)->info.value.string)
-		{
-			free(((ThingProperty*)*property)->info.value.string);
-		}
+		uint32_t seq = __atomic_load_n(&property->seq,__ATOMIC_SEQ_CST);
+		ValueWords* slot = (ValueWords*)&property->published[(seq >> 1) & 1];
+		for(int i = 0;i < sizeof(out.words) / sizeof(out.words[0]);i++)
+			out.words[i] = __atomic_load_n(&slot->words[i],__ATOMIC_ACQUIRE);
+
+		// the entry is overwritten by the write after next , which makes seq at least (seq | 1) + 2
+		if(__atomic_load_n(&property->seq,__ATOMIC_RELAXED) - (seq & ~1u) <= 2)
+			return out.value;
 	}
+}
 
-	while(((ThingProperty*)*property)->next != NULL)
-	{
-		cleanUpProperty(&(((ThingProperty*)*property)->next));
-	}
+static void releaseValue(ThingProperty* property)
+{
+	__atomic_fetch_sub(&property->readers,1,__ATOMIC_SEQ_CST);
+}
 
-	free(((ThingProperty*)*property));	
-	*property = NULL;
+/* seq and readers are both seq_cst , a reader missed here sees the value published before */
+static bool hasReaders(ThingProperty* property)
+{
+	return __atomic_load_n(&property->readers,__ATOMIC_SEQ_CST) != 0;
 }
 
-void cleanUpThing(Thing* thing)
+/*
+	Heap strings are preceded by the link of the retired list , a retired string may
+	still be copied by a reader so the string itself is left alone.
+*/
+static char* allocString(const char* str)
 {
-	//ESP_LOGI(TAG,"In cleanUpThing");	
-	if(thing->title != NULL)
-		free(thing->title);
+	size_t len = strlen(str) + 1;
+	char* buf = thingAlloc(sizeof(char*) + len);
+	if(buf == NULL)
+		return NULL;
+	memcpy(buf + sizeof(char*),str,len);
+	return buf + sizeof(char*);
+}
 
-	if(thing->id != NULL)
-		free(thing->id);
+static void freeString(ThingProperty* property,char* str)
+{
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	thingFree(str);
+#else
+	if(str)
+		thingFree(str - sizeof(char*));
+#endif
+}
 
-	if(thing->property != NULL)
-		cleanUpProperty(&(thing->property));
-	else
-		ESP_LOGI(TAG,"No Property");
+static void retireString(ThingProperty* property,char* str)
+{
+	memcpy(str - sizeof(char*),&property->retired,sizeof(char*));
+	property->retired = str;
 }
 
-// TODO: create unique URLs for properties of same type
-char* getPropertyEndpointUrl(Thing* device,ThingProperty* property)
+static void freeRetired(ThingProperty* property)
 {
-	int urlLen = strlen("/things/")+strlen(device->id)+strlen("/properties/")+strlen(get_property_keyname(property))+1; 
-	ESP_LOGI(TAG,"urlLen=%d",urlLen);
-	char* linkUrl = malloc(sizeof(char)*urlLen);
-	if(linkUrl == NULL)
+	while(property->retired)
 	{
-		ESP_LOGE(TAG,"ERROR:NO MEMORY");
-		return NULL;
+		char* next;
+		memcpy(&next,property->retired - sizeof(char*),sizeof(next));
+		freeString(property,property->retired);
+		property->retired = next;
 	}
-
-	sprintf(linkUrl,"/things/%s/properties/%s",device->id,get_property_keyname(property));
-	return linkUrl;
 }
 
-char* getThingDescriptionUrl(Thing* device)
+bool isValidThingKey(const char* key)
 {
-	int urlLen = strlen("/things/")+strlen(device->id)+1; 
-	ESP_LOGI(TAG,"urlLen=%d",urlLen);
-	char* linkUrl = malloc(sizeof(char)*urlLen);
-	if(linkUrl == NULL)
+	if(*key == '\0')
+		return false;
+	for(;*key;key++)
 	{
-		ESP_LOGE(TAG,"ERROR:NO MEMORY");
-		return NULL;
+		if(!isalnum((unsigned char)*key) && strchr("-._~",*key) == NULL)
+			return false;
 	}
-
-	sprintf(linkUrl,"/things/%s",device->id);
-	return linkUrl;
+	return true;
 }
 
-cJSON* serializePropertyOrEvent(Thing* device,ThingProperty* property)
+static bool compileConstraints(ThingProperty* property);
+void cleanUpProperty(ThingProperty** property);
+
+ThingProperty* createProperty(char* _title,PropertyInfo _info,PropertyChange_cb _callback)
 {
-	//ESP_LOGI(TAG,"In serializePropertyOrEvent");
-	cJSON* prop = cJSON_CreateObject();
-	switch (property->info.valueType) 
+	ThingProperty* property = thingAlloc(sizeof(ThingProperty));
+	if(property == NULL)
 	{
-		case NO_STATE:
-		break;
-
-		case BOOLEAN:
-		cJSON_AddStringToObject(prop,"type","boolean");
-		break;
-
-		case NUMBER:
-		cJSON_AddStringToObject(prop,"type","number");
-		break;
-
-		case STRING:
-		cJSON_AddStringToObject(prop,"type","string");
-		break;
-
-		default:
-			ESP_LOGE(TAG,"Unknnown value");
-			return NULL;
+		THING_LOGE(TAG,"No memory for property");
+		return NULL;
+	}
+	property->title = NULL;
+	if(_title)
+	{
+		property->title = thingStrdup(_title);
 	}
 
-	if (property->info.readOnly) 
+	property->info = _info;
+	const char* key = getPropertyTypeDescriptor(_info.type)->key;
+	if(_info.key)
 	{
-		cJSON_AddTrueToObject(prop,"readOnly");
+		if(isValidThingKey(_info.key))
+			key = _info.key;
+		else
+			THING_LOGE(TAG,"property key \"%s\" is not a valid URL segment , using %s",_info.key,key);
+	}
+	property->key = thingStrdup(key);
+	property->info.key = property->key;
+	property->info.valueType = get_property_valueType(property);
+	property->valueSize = 0;
+	property->retired = NULL;
+	property->spare = NULL;
+	if(property->info.valueType == STRING)
+	{
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+		// two fixed buffers which take turns , see storeValueLocked()
+		size_t size = strlen(_info.value.string) + 1;
+		if(size < CONFIG_WEB_THING_POOL_STRING_SIZE)
+			size = CONFIG_WEB_THING_POOL_STRING_SIZE;
+		property->info.value.string = thingAlloc(size);
+		property->spare = thingAlloc(size);
+		if(property->info.value.string && property->spare)
+		{
+			strcpy(property->info.value.string,_info.value.string);
+			property->valueSize = size;
+		}
+#else
+		property->info.value.string = allocString(_info.value.string);
+#endif
 	}
 	else
 	{
-		cJSON_AddFalseToObject(prop,"readOnly");
+		property->info.value = _info.value;
 	}
 
-	if (property->info.unit != eNONE) 
+	createValueLocks();
+	property->seq = 0;
+	property->readers = 0;
+	property->published[0] = property->info.value;
+	property->published[1] = property->info.value;
+
+	property->next = NULL;
+	property->callback = _callback;
+	property->thing = NULL;
+	property->href = NULL;
+	property->lastNotified = 0;
+	property->keyHash = 0;
+	property->index = 0;
+	property->enumIndex = NULL;
+
+	bool allocated = (_title == NULL || property->title) && property->key;
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	if(property->info.valueType == STRING)
+		allocated = allocated && property->valueSize;
+#else
+	if(property->info.valueType == STRING)
+		allocated = allocated && property->info.value.string;
+#endif
+	if(!allocated)
+		THING_LOGE(TAG,"No memory for property %s",key);
+	if(!allocated || !compileConstraints(property))
 	{
-		cJSON_AddStringToObject(prop,"unit",UnitsToStr[property->info.unit]);
+		cleanUpProperty(&property);
+		return NULL;
 	}
 
-	cJSON_AddStringToObject(prop,"title",property->title);
+	return property;	
+}
 
-	if(get_property_isRange(property))
+/* FNV-1a , good enough for the short property keys */
+uint32_t hashThingKey(const char* key,size_t len)
+{
+	uint32_t hash = 2166136261u;
+	while(len--)
 	{
-		if (property->info.minimum < property->info.maximum) 
-		{
-			cJSON_AddNumberToObject(prop,"minimum",property->info.minimum );
-			cJSON_AddNumberToObject(prop,"maximum",property->info.maximum );
-		}
+		hash ^= (uint8_t)*key++;
+		hash *= 16777619u;
 	}
+	return hash;
+}
 
-	if (property->info.multipleOf > 0) 
+/*
+	Validation
+
+	The constraints are prepared by createProperty() so that checking a request costs a
+	few comparisons : the range check is decided once , multipleOf is kept as its inverse
+	and the enum becomes an open addressing hash set of positions in info.propertyEnum.
+*/
+static bool compileConstraints(ThingProperty* property)
+{
+	property->checkRange = get_property_isRange(property) && property->info.minimum < property->info.maximum;
+	property->stepInverse = property->info.multipleOf > 0 ? 1.0 / property->info.multipleOf : 0;
+	property->enumIndex = NULL;
+	property->enumIndexSize = 0;
+
+	const char** values = property->info.propertyEnum;
+	if(property->info.valueType != STRING || values == NULL || values[0] == NULL)
+		return true;
+
+	uint16_t count = 0;
+	while(values[count] != NULL)
+		count++;
+	uint16_t size = 4;
+	while(size < count * 2)
+		size *= 2;
+	property->enumIndex = thingCalloc(size,sizeof(uint16_t));
+	if(property->enumIndex == NULL)
 	{
-		cJSON_AddNumberToObject(prop,"multipleOf",property->info.multipleOf );
+		THING_LOGE(TAG,"No memory for the enum of %s",property->key);
+		return false;
 	}
+	property->enumIndexSize = size;
+	for(uint16_t i = 0;i < count;i++)
+	{
+		uint16_t slot = hashThingKey(values[i],strlen(values[i])) & (size - 1);
+		while(property->enumIndex[slot])
+			slot = (slot + 1) & (size - 1);
+		property->enumIndex[slot] = i + 1;
+	}
+	return true;
+}
 
-	const char **enumVal = property->info.propertyEnum;
-	bool hasEnum = (property->info.propertyEnum != NULL) && ((*property->info.propertyEnum) != NULL);
-
-	if (hasEnum) {
-		enumVal = property->info.propertyEnum;
-		cJSON* enumJsonArray = cJSON_CreateArray();
-		while (property->info.propertyEnum != NULL && (*enumVal) != NULL)
-		{
-			cJSON* jsonStr = cJSON_CreateString(*enumVal);
-			cJSON_AddItemToArray(enumJsonArray,jsonStr);
-			enumVal++;
-		}
-		cJSON_AddItemToObject(prop,"enum",enumJsonArray);
+static bool isEnumValue(ThingProperty* property,const char* value)
+{
+	uint16_t mask = property->enumIndexSize - 1;
+	for(uint16_t slot = hashThingKey(value,strlen(value)) & mask;property->enumIndex[slot];slot = (slot + 1) & mask)
+	{
+		if(strcmp(property->info.propertyEnum[property->enumIndex[slot] - 1],value) == 0)
+			return true;
 	}
+	return false;
+}
 
-	cJSON_AddStringToObject(prop,"@type",get_property_typeschema(property));
-	char* propUri = getPropertyEndpointUrl(device,property);
+const char* checkPropertyValue(ThingProperty* _property,ThingPropertyValue _value)
+{
+	switch(_property->info.valueType)
+	{
+		case NUMBER:
+			if(!isfinite(_value.number))
+				return "not a finite number";
+			if(_property->checkRange && _value.number < _property->info.minimum)
+				return "below minimum";
+			if(_property->checkRange && _value.number > _property->info.maximum)
+				return "above maximum";
+			if(_property->stepInverse > 0)
+			{
+				// allow for the rounding of decimal steps such as 0.1
+				double steps = _value.number * _property->stepInverse;
+				if(fabs(steps - round(steps)) > 1e-9 * fmax(1.0,fabs(steps)))
+					return "not a multiple of multipleOf";
+			}
+		break;
 
-	cJSON* linksJsonArray = cJSON_CreateArray();
-	cJSON* href = cJSON_CreateObject();
-	cJSON_AddStringToObject(href,"href",propUri);
-	cJSON_AddItemToArray(linksJsonArray,href);
-	cJSON_AddItemToObject(prop,"links",linksJsonArray);
+		case STRING:
+			if(_property->enumIndex && !isEnumValue(_property,_value.string))
+				return "not one of enum";
+			// a static pool string has to fit its buffer
+			if(_property->valueSize && strlen(_value.string) >= _property->valueSize)
+				return "longer than the value buffer";
+		break;
 
-	if(propUri)
-	{
-		free(propUri);
+		default:
+		break;
 	}
+	return NULL;
+}
 
-	return prop;
-} 
-
-void serializeDevice(Thing* thing,cJSON* deviceJson) 
+/* Inserts the property into the index , the table must have a free slot */
+static bool indexProperty(ThingProperty** table,uint16_t size,ThingProperty* property)
 {
-	if(!deviceJson)
+	const char* key = property->key;
+	uint16_t mask = size - 1;
+	uint16_t slot = property->keyHash & mask;
+	while(table[slot] != NULL)
 	{
-		ESP_LOGE(TAG,"No Json object passes in arg");
-		return;
+		if(table[slot]->keyHash == property->keyHash && strcmp(table[slot]->key,key) == 0)
+			return false;
+		slot = (slot + 1) & mask;
 	}
-    cJSON_AddStringToObject(deviceJson,"id",thing->id);
-    cJSON_AddStringToObject(deviceJson,"title",thing->title);
-    cJSON_AddStringToObject(deviceJson,"@context","https://iot.mozilla.org/schemas");
-	// TODO: descr["base"] = ???
+	table[slot] = property;
+	return true;
+}
 
-    cJSON* secScheme = cJSON_CreateObject();
-    cJSON_AddStringToObject(secScheme,"scheme","nosec");
-    cJSON* noSecSc = cJSON_CreateObject();
-    cJSON_AddItemToObject(noSecSc,"nosec_sc",secScheme);
-    cJSON_AddItemToObject(deviceJson,"securityDefinitions",noSecSc);
+/* Keeps the index at most half full so that probe sequences stay short */
+static bool growPropertyIndex(Thing* _thing)
+{
+	if((_thing->propertyCount + 1) * 2 <= _thing->propertyIndexSize)
+		return true;
 
-    cJSON_AddStringToObject(deviceJson,"security","nosec_sc");
+	if(_thing->propertyIndexSize >= 0x8000)
+	{
+		THING_LOGE(TAG,"Too many properties");
+		return false;
+	}
 
-   	cJSON* linksArrayJson = cJSON_CreateArray();
+	uint16_t size = _thing->propertyIndexSize ? _thing->propertyIndexSize * 2 : 8;
+	while(size < CONFIG_MAX_PROPERTY * 2)
+		size *= 2;
 
-   	//adding properties link
-   	cJSON* propertiesLinkJson = cJSON_CreateObject();
-    cJSON_AddStringToObject(propertiesLinkJson,"rel","properties");
+	ThingProperty** table = thingCalloc(size,sizeof(ThingProperty*));
+	if(!table)
+	{
+		THING_LOGE(TAG,"No memory for property index");
+		return false;
+	}
 
-    char* propUrl = (char*)malloc(sizeof(char)*(strlen("/things/")+strlen(thing->id)+strlen("/properties")+1));
-    if(!propUrl)
-    {
-    	ESP_LOGE(TAG,"No memory for propUrl");
-    	cJSON_Delete(deviceJson);
-    	return NULL;
-    }
-    sprintf(propUrl,"/things/%s/properties",thing->id);
-    cJSON_AddStringToObject(propertiesLinkJson,"href",propUrl);
+	for(ThingProperty* property = _thing->property;property != NULL;property = property->next)
+		indexProperty(table,size,property);
 
-	cJSON_AddItemToArray(linksArrayJson,propertiesLinkJson);
-	cJSON_AddItemToObject(deviceJson,"links",linksArrayJson);
+	thingFree(_thing->propertyIndex);
+	_thing->propertyIndex = table;
+	_thing->propertyIndexSize = size;
+	return true;
+}
 
-   	cJSON* typeJson = cJSON_CreateArray();
-	const char** type = thing->type;
-	while ((type != NULL)&&(*type) != NULL) 
+/* Makes room for one more property in the properties array and the changed and unsaved bitmaps */
+static bool growPropertyTable(Thing* _thing)
+{
+	if(_thing->propertyCount < _thing->propertyCapacity)
+		return true;
+
+	uint16_t capacity = _thing->propertyCapacity ? _thing->propertyCapacity * 2 : ((CONFIG_MAX_PROPERTY + 31) / 32) * 32;
+	ThingProperty** properties = thingAlloc(capacity * sizeof(ThingProperty*));
+	uint32_t* changed = thingCalloc(capacity / 32,sizeof(uint32_t));
+	uint32_t* unsaved = thingCalloc(capacity / 32,sizeof(uint32_t));
+	if(!properties || !changed || !unsaved)
 	{
-		cJSON* jsonStr = cJSON_CreateString(*type);
-		cJSON_AddItemToArray(typeJson,jsonStr);
-		type++;
+		THING_LOGE(TAG,"No memory for property table");
+		thingFree(properties);
+		thingFree(changed);
+		thingFree(unsaved);
+		return false;
 	}
-	cJSON_AddItemToObject(deviceJson,"@type",typeJson);
 
-   	cJSON* propertiesJson = cJSON_CreateObject();
+	if(_thing->propertyCapacity)
+	{
+		memcpy(properties,_thing->properties,_thing->propertyCount * sizeof(ThingProperty*));
+		memcpy(changed,_thing->changed,(_thing->propertyCapacity / 32) * sizeof(uint32_t));
+		memcpy(unsaved,_thing->unsaved,(_thing->propertyCapacity / 32) * sizeof(uint32_t));
+	}
+	thingFree(_thing->properties);
+	thingFree(_thing->changed);
+	thingFree(_thing->unsaved);
+	_thing->properties = properties;
+	_thing->changed = changed;
+	_thing->unsaved = unsaved;
+	_thing->propertyCapacity = capacity;
+	return true;
+}
 
-	ThingProperty* property = thing->property;
-	while (property != NULL) 
+/* Appends _2 , _3 ... to the key of the property until no other property of the thing uses it */
+static bool makeUniqueKey(Thing* _thing,ThingProperty* _property)
+{
+	char* key = thingAlloc(strlen(_property->key) + 7);
+	if(key == NULL)
 	{
-		cJSON* propertyJson = serializePropertyOrEvent(thing,property);
-		cJSON_AddItemToObject(propertiesJson,get_property_keyname(property),propertyJson);
-		property = (ThingProperty*)property->next;
+		THING_LOGE(TAG,"No memory for property key");
+		return false;
 	}
-	cJSON_AddItemToObject(deviceJson,"properties",propertiesJson);
-	return deviceJson;
+
+	for(unsigned n = 2;n <= UINT16_MAX;n++)
+	{
+		sprintf(key,"%s_%u",_property->key,n);
+		if(findProperty(_thing,key) == NULL)
+		{
+			THING_LOGI(TAG,"property key %s is taken , using %s",_property->key,key);
+			thingFree(_property->key);
+			_property->key = key;
+			_property->info.key = key;
+			return true;
+		}
+	}
+	thingFree(key);
+	return false;
 }
 
+/*
+	Persistence
+
+	Saving is kept off the request path : a changed persisted property only sets its bit
+	in unsaved , the save timer writes all of them with one commit from the timer task.
+	The timer is not restarted by later changes , so a value changing all the time is
+	still written once per interval , and it is cut short once enough properties wait.
+	A save which fails keeps the marks of what it could not write and runs again after
+	the interval.
+*/
+#define SAVE_BATCH_WORDS 8		// words of the unsaved bitmap written with one commit
 
-// const char* get_property_title(ThingProperty* property)
-// {
-// 	return PropertyTypeInfo[property->info.type][PropertyTypeInfo_title];
-// }
+static bool storePropertyValue(ThingProperty* property,ThingPropertyValue value,bool* changed);
 
-const char* get_property_keyname(ThingProperty* property)
+static void saveTimerCallback(TimerHandle_t timer)
 {
-	return PropertyTypeInfo[property->info.type][PropertyTypeInfo_keyname];
+	saveThingProperties((Thing*)pvTimerGetTimerID(timer));
 }
 
-const char* get_property_typeschema(ThingProperty* property)
+static StaticQueue_t gSaveTimerGoneBuffer;
+static uint8_t gSaveTimerGoneStorage;
+static QueueHandle_t gSaveTimerGone = NULL;
+
+static void signalSaveTimerGone(void* queue,uint32_t unused)
 {
-	return PropertyTypeInfo[property->info.type][PropertyTypeInfo_TypeSchema];
+	uint8_t gone = 1;
+	xQueueSend((QueueHandle_t)queue,&gone,0);
 }
 
-const bool get_property_isRange(ThingProperty* property)
+/*
+	Deletes the save timer of the thing and waits for the timer task to process the delete.
+	The timer task runs callbacks and commands in order , so afterwards no save of the thing
+	is running or pending. Must not be called from a timer callback.
+*/
+static void deleteSaveTimer(Thing* thing)
 {
-	return PropertyTypeInfo[property->info.type][PropertyTypeInfo_IsRange];
+	if(gSaveTimerGone == NULL)
+		gSaveTimerGone = xQueueCreateStatic(1,sizeof(uint8_t),&gSaveTimerGoneStorage,&gSaveTimerGoneBuffer);
+
+	xTimerDelete(thing->saveTimer,portMAX_DELAY);
+	thing->saveTimer = NULL;
+	uint8_t gone;
+	if(xTimerPendFunctionCall(signalSaveTimerGone,gSaveTimerGone,0,portMAX_DELAY) == pdPASS)
+		xQueueReceive(gSaveTimerGone,&gone,portMAX_DELAY);
+	else
+		THING_LOGE(TAG,"could not wait for the save timer to stop");
 }
 
-const ThingPropertyValueType get_property_valueType(ThingProperty* property)
+static void markPropertyUnsaved(Thing* thing,ThingProperty* property)
 {
-	return (ThingPropertyValueType)PropertyTypeInfo[property->info.type][PropertyTypeInfo_ValueType];
+	uint32_t bit = 1u << (property->index % 32);
+	if(__atomic_fetch_or(&thing->unsaved[property->index / 32],bit,__ATOMIC_RELEASE) & bit)
+		return;
+
+	uint16_t count = __atomic_add_fetch(&thing->unsavedCount,1,__ATOMIC_RELAXED);
+	if(thing->saveTimer == NULL)
+		return;
+	if(count >= CONFIG_WEB_THING_PERSIST_UNSAVED_MAX)
+		xTimerChangePeriod(thing->saveTimer,1,0);
+	else if(!xTimerIsTimerActive(thing->saveTimer))
+		xTimerChangePeriod(thing->saveTimer,pdMS_TO_TICKS(CONFIG_WEB_THING_PERSIST_INTERVAL_MS),0);
 }
 
-void serialise_property_item(ThingProperty* property,cJSON* jsonProp)
+/* Replaces the initial value with the saved one , called by addProperty() */
+static void restorePropertyValue(Thing* thing,ThingProperty* property)
 {
-	if(!jsonProp)
-	{
-		ESP_LOGE(TAG,"No Json object passes in arg");
-		return;
-	}	
+	nvs_handle_t handle;
+	ThingPropertyValue value;
+	bool changed;
 
-	const char* propertyKeyName = get_property_keyname(property);
-	switch(property->info.valueType)
+	if(thing->saveTimer == NULL)
 	{
-		case NO_STATE:
-		break;
+		thing->saveTimer = xTimerCreate("thing_save",pdMS_TO_TICKS(CONFIG_WEB_THING_PERSIST_INTERVAL_MS),
+										pdFALSE,thing,saveTimerCallback);
+	}
+
+	if(!openPropertyStore(thing,NVS_READONLY,&handle))
+		return;
+	if(readStoredValue(handle,property,&value))
+	{
+		// the constraints may have changed with the firmware
+		if(checkPropertyValue(property,value) != NULL || !storePropertyValue(property,value,&changed))
+			THING_LOGW(TAG,"saved value of %s not restored",property->key);
+		if(property->info.valueType == STRING)
+			thingFree(value.string);
+	}
+	closePropertyStore(handle,false);
+}
+
+/* Counts the marks left after a failed save and tries again after the interval */
+static void retrySave(Thing* thing)
+{
+	uint16_t count = 0;
+	for(uint16_t word = 0;word < thing->propertyCapacity / 32;word++)
+		count += __builtin_popcount(__atomic_load_n(&thing->unsaved[word],__ATOMIC_RELAXED));
+	__atomic_store_n(&thing->unsavedCount,count,__ATOMIC_RELAXED);
+	if(thing->saveTimer != NULL)
+		xTimerChangePeriod(thing->saveTimer,pdMS_TO_TICKS(CONFIG_WEB_THING_PERSIST_INTERVAL_MS),0);
+}
+
+/*
+	Writes the marked properties of count words of the unsaved bitmap with one commit.
+	The marks are only taken once the store is open , a value which is not written or
+	not committed gets its mark back.
+*/
+static bool saveWords(Thing* thing,uint16_t first,uint16_t count)
+{
+	nvs_handle_t handle;
+	uint32_t taken[SAVE_BATCH_WORDS];
+	bool marked = false;
+	bool saved = true;
+
+	for(uint16_t i = 0;i < count && !marked;i++)
+		marked = __atomic_load_n(&thing->unsaved[first + i],__ATOMIC_RELAXED) != 0;
+	if(!marked)
+		return true;
+	if(!openPropertyStore(thing,NVS_READWRITE,&handle))
+		return false;
+
+	for(uint16_t i = 0;i < count;i++)
+	{
+		taken[i] = __atomic_exchange_n(&thing->unsaved[first + i],0,__ATOMIC_ACQUIRE);
+		uint32_t bits = taken[i];
+		while(bits)
+		{
+			uint32_t bit = bits & -bits;
+			ThingProperty* property = thing->properties[(first + i) * 32 + __builtin_ctz(bits)];
+			bits &= bits - 1;
+
+			ThingPropertyValue value = acquireValue(property);
+			if(!writeStoredValue(handle,property,value))
+			{
+				taken[i] &= ~bit;
+				__atomic_or_fetch(&thing->unsaved[first + i],bit,__ATOMIC_RELEASE);
+				saved = false;
+			}
+			releaseValue(property);
+		}
+	}
+
+	if(!closePropertyStore(handle,true))
+	{
+		for(uint16_t i = 0;i < count;i++)
+			__atomic_or_fetch(&thing->unsaved[first + i],taken[i],__ATOMIC_RELEASE);
+		return false;
+	}
+	return saved;
+}
+
+bool saveThingProperties(Thing* _thing)
+{
+	uint16_t words = _thing->propertyCapacity / 32;
+	bool saved = true;
+
+	__atomic_store_n(&_thing->unsavedCount,0,__ATOMIC_RELAXED);
+	for(uint16_t first = 0;first < words;first += SAVE_BATCH_WORDS)
+		saved &= saveWords(_thing,first,words - first < SAVE_BATCH_WORDS ? words - first : SAVE_BATCH_WORDS);
+	if(!saved)
+		retrySave(_thing);
+	return saved;
+}
+
+void addProperty(Thing* _thing,ThingProperty* _property)
+{
+	if(_thing == NULL || _property == NULL)
+		return;
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	if(_thing->propertyCount >= CONFIG_MAX_PROPERTY)
+	{
+		THING_LOGE(TAG,"CONFIG_MAX_PROPERTY properties reached");
+		return;
+	}
+#endif
+	if(!growPropertyIndex(_thing) || !growPropertyTable(_thing))
+		return;
+
+	if(findProperty(_thing,_property->key) != NULL && !makeUniqueKey(_thing,_property))
+		return;
+
+	// the URL is built once here , handlers and descriptions only copy it
+	_property->href = thingAlloc(strlen(_thing->propertiesHref)+1+strlen(_property->key)+1);
+	if(_property->href == NULL)
+	{
+		THING_LOGE(TAG,"No memory for property URL");
+		return;
+	}
+	sprintf(_property->href,"%s/%s",_thing->propertiesHref,_property->key);
+
+	_property->thing = _thing;
+	_property->next = NULL;
+	_property->index = _thing->propertyCount;
+	_property->keyHash = hashThingKey(_property->key,strlen(_property->key));
+	if(!indexProperty(_thing->propertyIndex,_thing->propertyIndexSize,_property))
+		THING_LOGW(TAG,"property key %s is used twice",_property->key);
+
+	if(_thing->propertyTail)
+		_thing->propertyTail->next = _property;
+	else
+		_thing->property = _property;
+	_thing->propertyTail = _property;
+	_thing->properties[_thing->propertyCount++] = _property;
+
+	if(_property->info.persist)
+		restorePropertyValue(_thing,_property);
+	invalidateThingDescription(_thing);
+}
+
+/* Queues the property for the next push */
+static void markPropertyChanged(ThingProperty* _property)
+{
+	Thing* thing = _property->thing;
+	if(thing == NULL)
+		return;
+
+	__atomic_fetch_or(&thing->changed[_property->index / 32],1u << (_property->index % 32),__ATOMIC_RELEASE);
+	if(_property->info.persist)
+		markPropertyUnsaved(thing,_property);
+	if(thing->propertyChanged)
+		thing->propertyChanged(thing);
+}
+
+void notifyPropertyChanged(ThingProperty* _property)
+{
+	if(_property->info.valueType == BOOLEAN || _property->info.valueType == NUMBER)
+	{
+		// the firmware may have written info.value directly
+		xSemaphoreTake(gValueLock,portMAX_DELAY);
+		publishValue(_property,_property->info.value);
+		xSemaphoreGive(gValueLock);
+	}
+	markPropertyChanged(_property);
+}
+
+uint16_t takeChangedProperties(Thing* _thing,PropertyVisit_cb visit,void* ctx)
+{
+	uint16_t count = 0;
+	bool deferred = false;
+	int64_t now = esp_timer_get_time();
+	for(uint16_t word = 0;word < _thing->propertyCapacity / 32;word++)
+	{
+		uint32_t bits = __atomic_exchange_n(&_thing->changed[word],0,__ATOMIC_ACQUIRE);
+		uint32_t keep = 0;
+		while(bits)
+		{
+			uint32_t bit = bits & -bits;
+			uint16_t index = word * 32 + __builtin_ctz(bits);
+			bits &= bits - 1;
+			if(index >= _thing->propertyCount)
+				continue;
+
+			ThingProperty* property = _thing->properties[index];
+			if(property->info.minInterval && property->lastNotified != 0 &&
+				now - property->lastNotified < (int64_t)property->info.minInterval * 1000)
+			{
+				keep |= bit;
+				continue;
+			}
+			property->lastNotified = now;
+			visit(property,ctx);
+			count++;
+		}
+
+		if(keep)
+		{
+			__atomic_fetch_or(&_thing->changed[word],keep,__ATOMIC_RELEASE);
+			deferred = true;
+		}
+	}
+
+	// throttled properties go out with a later push
+	if(deferred && _thing->propertyChanged)
+		_thing->propertyChanged(_thing);
+	return count;
+}
+
+ThingProperty* findProperty(Thing* _thing,const char* _key)
+{
+	return findPropertyN(_thing,_key,strlen(_key));
+}
+
+ThingProperty* findPropertyN(Thing* _thing,const char* _key,size_t _len)
+{
+	if(_thing->propertyIndex == NULL)
+		return NULL;
+
+	uint32_t hash = hashThingKey(_key,_len);
+	uint16_t mask = _thing->propertyIndexSize - 1;
+	uint16_t slot = hash & mask;
+	ThingProperty* property;
+	while((property = _thing->propertyIndex[slot]) != NULL)
+	{
+		if(property->keyHash == hash && strncmp(property->key,_key,_len) == 0 && property->key[_len] == '\0')
+			return property;
+		slot = (slot + 1) & mask;
+	}
+	return NULL;
+}
+
+void cleanUpProperty(ThingProperty** property)
+{
+	if(((ThingProperty*)*property)->title)
+	{
+		thingFree(((ThingProperty*)*property)->title);
+		((ThingProperty*)*property)->title = NULL;
+	}
+
+	if(((ThingProperty*)*property)->key)
+	{
+		thingFree(((ThingProperty*)*property)->key);
+		((ThingProperty*)*property)->key = NULL;
+	}
+
+	if(((ThingProperty*)*property)->href)
+	{
+		thingFree(((ThingProperty*)*property)->href);
+		((ThingProperty*)*property)->href = NULL;
+	}
+
+	thingFree(((ThingProperty*)*property)->enumIndex);
+	((ThingProperty*)*property)->enumIndex = NULL;
+
+	if(((ThingProperty*)*property)->info.valueType == STRING)
+	{
+		freeString((ThingProperty*)*property,((ThingProperty*)*property)->info.value.string);
+		thingFree(((ThingProperty*)*property)->spare);
+		freeRetired((ThingProperty*)*property);
+	}
+
+	while(((ThingProperty*)*property)->next != NULL)
+	{
+		cleanUpProperty(&(((ThingProperty*)*property)->next));
+	}
+
+	thingFree(((ThingProperty*)*property));	
+	*property = NULL;
+}
+
+void cleanUpThing(Thing* thing)
+{
+	//THING_LOGI(TAG,"In cleanUpThing");	
+	// changes still waiting for the save timer are written now , once the timer is gone
+	if(thing->saveTimer != NULL)
+	{
+		deleteSaveTimer(thing);
+		saveThingProperties(thing);
+	}
+
+	if(thing->title != NULL)
+		thingFree(thing->title);
+
+	if(thing->id != NULL)
+		thingFree(thing->id);
+
+	if(thing->href != NULL)
+		thingFree(thing->href);
+
+	if(thing->propertiesHref != NULL)
+		thingFree(thing->propertiesHref);
+	thing->title = thing->id = thing->href = thing->propertiesHref = NULL;
+
+	if(thing->property != NULL)
+		cleanUpProperty(&(thing->property));
+	else
+		THING_LOGI(TAG,"No Property");
+	thing->propertyTail = NULL;
+	thing->propertyCount = 0;
+
+	if(thing->properties != NULL)
+	{
+		thingFree(thing->properties);
+		thing->properties = NULL;
+	}
+	if(thing->changed != NULL)
+	{
+		thingFree(thing->changed);
+		thing->changed = NULL;
+	}
+	thingFree(thing->unsaved);
+	thing->unsaved = NULL;
+	thing->propertyCapacity = 0;
+
+	if(thing->propertyIndex != NULL)
+	{
+		thingFree(thing->propertyIndex);
+		thing->propertyIndex = NULL;
+	}
+	thing->propertyIndexSize = 0;
+
+	cleanUpActions(thing);
+	cleanUpEvents(thing);
+
+	invalidateThingDescription(thing);
+	thingFree(thing->description);
+	thing->description = NULL;
+	thing->descriptionSize = 0;
+	thingFree(thing->descriptionDeflated);
+	thing->descriptionDeflated = NULL;
+	thing->descriptionDeflatedSize = 0;
+	thingPoolRelease();
+}
+
+void invalidateThingDescription(Thing* _thing)
+{
+	// the buffers are kept and reused when the new description fits
+	_thing->descriptionLen = 0;
+	_thing->descriptionDeflatedLen = 0;
+	_thing->descriptionNotDeflated = false;
+	_thing->descriptionVersion++;
+}
+
+/* 
+	Size of a new description buffer. Arena memory is not reused , so with the static pool
+	the buffer gets some headroom and a description which grows a little does not need
+	a new one.
+*/
+static size_t descriptionBufferSize(size_t needed)
+{
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	return needed + needed / 4;
+#else
+	return needed;
+#endif
+}
+
+typedef struct DescriptionOutput
+{
+	char* buf;
+	size_t len;
+	size_t size;		// room for the text , without the terminating NUL
+}DescriptionOutput;
+
+/* Refuses a chunk which does not fit , the description grew since it was measured */
+static int copyDescriptionChunk(void* ctx,const char* buf,size_t len)
+{
+	DescriptionOutput* out = (DescriptionOutput*)ctx;
+	if(len > out->size - out->len)
+		return -1;
+	memcpy(out->buf + out->len,buf,len);
+	out->len += len;
+	return 0;
+}
+
+const char* getThingDescription(Thing* _thing,size_t* _len)
+{
+	if(_thing->descriptionLen == 0)
+	{
+		// first pass only measures , second pass renders into an exactly sized buffer
+		JsonWriter writer;
+		jsonWriterInit(&writer,JSON_WRITER_FORMAT,NULL,NULL);
+		writeThingDescription(&writer,_thing);
+		jsonWriterFinish(&writer);
+
+		size_t len = writer.total;
+		char* description = _thing->description;
+		if(len+1 > _thing->descriptionSize)
+		{
+			// freed first , with the static pool the last allocation then grows in place
+			thingFree(_thing->description);
+			_thing->description = NULL;
+			_thing->descriptionSize = 0;
+			description = thingAlloc(descriptionBufferSize(len+1));
+			if(!description)
+			{
+				THING_LOGE(TAG,"No memory for thing description");
+				return NULL;
+			}
+			_thing->description = description;
+			_thing->descriptionSize = descriptionBufferSize(len+1);
+		}
+
+		DescriptionOutput out = {description,0,len};
+		jsonWriterInit(&writer,JSON_WRITER_FORMAT,copyDescriptionChunk,&out);
+		writeThingDescription(&writer,_thing);
+		if(!jsonWriterFinish(&writer) || out.len != len)
+		{
+			THING_LOGE(TAG,"Thing description changed while rendering");
+			return NULL;
+		}
+		description[len] = '\0';
+		_thing->descriptionLen = len;
+	}
+
+	if(_len)
+		*_len = _thing->descriptionLen;
+	return _thing->description;
+}
+
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+typedef struct DeflateOutput
+{
+	char* buf;
+	size_t len;
+	size_t size;
+}DeflateOutput;
+
+static mz_bool putDeflatedData(const void* pBuf,int len,void* pUser)
+{
+	DeflateOutput* out = (DeflateOutput*)pUser;
+	if(out->len + len > out->size)
+		return MZ_FALSE;	// bigger than the original , not worth it
+
+	memcpy(out->buf + out->len,pBuf,len);
+	out->len += len;
+	return MZ_TRUE;
+}
+
+static void deflateThingDescription(Thing* _thing)
+{
+	DeflateOutput out = {0};
+	out.size = _thing->descriptionLen;
+	out.buf = _thing->descriptionDeflated;
+	if(out.size > _thing->descriptionDeflatedSize)
+	{
+		thingFree(_thing->descriptionDeflated);
+		out.buf = thingAlloc(descriptionBufferSize(out.size));
+		_thing->descriptionDeflated = out.buf;
+		_thing->descriptionDeflatedSize = out.buf ? descriptionBufferSize(out.size) : 0;
+	}
+	// the compressor state is large and only needed while rebuilding , it stays on the heap
+	tdefl_compressor* compressor = thingHeapAlloc(sizeof(tdefl_compressor));
+	if(!out.buf || !compressor)
+	{
+		THING_LOGE(TAG,"No memory to compress thing description");
+		goto cleanup;
+	}
+
+	int flags = TDEFL_WRITE_ZLIB_HEADER | 128;	// zlib stream , fast compression level
+	if(tdefl_init(compressor,putDeflatedData,&out,flags) != TDEFL_STATUS_OKAY ||
+		tdefl_compress_buffer(compressor,_thing->description,_thing->descriptionLen,TDEFL_FINISH) != TDEFL_STATUS_DONE)
+	{
+		THING_LOGI(TAG,"thing description not compressed");
+		goto cleanup;
+	}
+
+	_thing->descriptionDeflatedLen = out.len;
+cleanup:
+	thingFree(compressor);
+}
+#endif
+
+const char* getThingDescriptionDeflated(Thing* _thing,size_t* _len)
+{
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+	if(_thing->descriptionDeflatedLen == 0 && !_thing->descriptionNotDeflated &&
+		getThingDescription(_thing,NULL) != NULL)
+	{
+		// tried once per description , a request never pays for the compressor again
+		deflateThingDescription(_thing);
+		_thing->descriptionNotDeflated = _thing->descriptionDeflatedLen == 0;
+	}
+	if(_len)
+		*_len = _thing->descriptionDeflatedLen;
+	return _thing->descriptionDeflatedLen ? _thing->descriptionDeflated : NULL;
+#else
+	if(_len)
+		*_len = 0;
+	return NULL;
+#endif
+}
+
+char* getPropertyEndpointUrl(Thing* device,ThingProperty* property)
+{
+	if(property->href)
+		return strdup(property->href);
+
+	// not added to a thing yet
+	int urlLen = strlen(device->propertiesHref)+1+strlen(property->key)+1; 
+	char* linkUrl = malloc(sizeof(char)*urlLen);
+	if(linkUrl == NULL)
+	{
+		THING_LOGE(TAG,"ERROR:NO MEMORY");
+		return NULL;
+	}
+
+	sprintf(linkUrl,"%s/%s",device->propertiesHref,property->key);
+	return linkUrl;
+}
+
+char* getThingDescriptionUrl(Thing* device)
+{
+	return strdup(device->href);
+}
+
+cJSON* serializePropertyOrEvent(Thing* device,ThingProperty* property)
+{
+	//THING_LOGI(TAG,"In serializePropertyOrEvent");
+	cJSON* prop = cJSON_CreateObject();
+	switch (property->info.valueType) 
+	{
+		case NO_STATE:
+		break;
+
+		case BOOLEAN:
+		cJSON_AddStringToObject(prop,"type","boolean");
+		break;
+
+		case NUMBER:
+		cJSON_AddStringToObject(prop,"type","number");
+		break;
+
+		case STRING:
+		cJSON_AddStringToObject(prop,"type","string");
+		break;
+
+		default:
+			THING_LOGE(TAG,"Unknnown value");
+			return NULL;
+	}
+
+	if (property->info.readOnly) 
+	{
+		cJSON_AddTrueToObject(prop,"readOnly");
+	}
+	else
+	{
+		cJSON_AddFalseToObject(prop,"readOnly");
+	}
+
+	if (property->info.unit != eNONE) 
+	{
+		cJSON_AddStringToObject(prop,"unit",UnitsToStr[property->info.unit]);
+	}
+
+	cJSON_AddStringToObject(prop,"title",property->title);
+
+	if(get_property_isRange(property))
+	{
+		if (property->info.minimum < property->info.maximum) 
+		{
+			cJSON_AddNumberToObject(prop,"minimum",property->info.minimum );
+			cJSON_AddNumberToObject(prop,"maximum",property->info.maximum );
+		}
+	}
+
+	if (property->info.multipleOf > 0) 
+	{
+		cJSON_AddNumberToObject(prop,"multipleOf",property->info.multipleOf );
+	}
+
+	const char **enumVal = property->info.propertyEnum;
+	bool hasEnum = (property->info.propertyEnum != NULL) && ((*property->info.propertyEnum) != NULL);
+
+	if (hasEnum) {
+		enumVal = property->info.propertyEnum;
+		cJSON* enumJsonArray = cJSON_CreateArray();
+		while (property->info.propertyEnum != NULL && (*enumVal) != NULL)
+		{
+			cJSON* jsonStr = cJSON_CreateString(*enumVal);
+			cJSON_AddItemToArray(enumJsonArray,jsonStr);
+			enumVal++;
+		}
+		cJSON_AddItemToObject(prop,"enum",enumJsonArray);
+	}
+
+	cJSON_AddStringToObject(prop,"@type",get_property_typeschema(property));
+
+	cJSON* linksJsonArray = cJSON_CreateArray();
+	cJSON* href = cJSON_CreateObject();
+	cJSON_AddStringToObject(href,"href",property->href);
+	cJSON_AddItemToArray(linksJsonArray,href);
+	cJSON_AddItemToObject(prop,"links",linksJsonArray);
+
+	return prop;
+} 
+
+void serializeDevice(Thing* thing,cJSON* deviceJson) 
+{
+	if(!deviceJson)
+	{
+		THING_LOGE(TAG,"No Json object passes in arg");
+		return;
+	}
+    cJSON_AddStringToObject(deviceJson,"id",thing->id);
+    cJSON_AddStringToObject(deviceJson,"title",thing->title);
+    cJSON_AddStringToObject(deviceJson,"@context","https://iot.mozilla.org/schemas");
+	// TODO: descr["base"] = ???
+
+    cJSON* secScheme = cJSON_CreateObject();
+    cJSON_AddStringToObject(secScheme,"scheme","nosec");
+    cJSON* noSecSc = cJSON_CreateObject();
+    cJSON_AddItemToObject(noSecSc,"nosec_sc",secScheme);
+    cJSON_AddItemToObject(deviceJson,"securityDefinitions",noSecSc);
+
+    cJSON_AddStringToObject(deviceJson,"security","nosec_sc");
+
+   	cJSON* linksArrayJson = cJSON_CreateArray();
+
+   	//adding properties link
+   	cJSON* propertiesLinkJson = cJSON_CreateObject();
+    cJSON_AddStringToObject(propertiesLinkJson,"rel","properties");
+
+    cJSON_AddStringToObject(propertiesLinkJson,"href",thing->propertiesHref);
+
+	cJSON_AddItemToArray(linksArrayJson,propertiesLinkJson);
+	if(thing->action)
+	{
+		cJSON* actionsLinkJson = cJSON_CreateObject();
+		cJSON_AddStringToObject(actionsLinkJson,"rel","actions");
+		cJSON_AddStringToObject(actionsLinkJson,"href",thing->actionsHref);
+		cJSON_AddItemToArray(linksArrayJson,actionsLinkJson);
+	}
+	if(thing->event)
+	{
+		cJSON* eventsLinkJson = cJSON_CreateObject();
+		cJSON_AddStringToObject(eventsLinkJson,"rel","events");
+		cJSON_AddStringToObject(eventsLinkJson,"href",thing->eventsHref);
+		cJSON_AddItemToArray(linksArrayJson,eventsLinkJson);
+	}
+	cJSON_AddItemToObject(deviceJson,"links",linksArrayJson);
+
+   	cJSON* typeJson = cJSON_CreateArray();
+	char** type = thing->type;
+	while ((type != NULL)&&(*type) != NULL) 
+	{
+		cJSON* jsonStr = cJSON_CreateString(*type);
+		cJSON_AddItemToArray(typeJson,jsonStr);
+		type++;
+	}
+	cJSON_AddItemToObject(deviceJson,"@type",typeJson);
+
+   	cJSON* propertiesJson = cJSON_CreateObject();
+
+	ThingProperty* property = thing->property;
+	while (property != NULL) 
+	{
+		cJSON* propertyJson = serializePropertyOrEvent(thing,property);
+		cJSON_AddItemToObject(propertiesJson,property->key,propertyJson);
+		property = (ThingProperty*)property->next;
+	}
+	cJSON_AddItemToObject(deviceJson,"properties",propertiesJson);
+	serializeActions(thing,deviceJson);
+	serializeEvents(thing,deviceJson);
+}
+
+
+const char* valueTypeToStr(ThingPropertyValueType valueType)
+{
+	switch(valueType)
+	{
+		case BOOLEAN:
+			return "boolean";
+		case NUMBER:
+			return "number";
+		case STRING:
+			return "string";
+		default:
+			return NULL;
+	}
+}
+
+void writePropertyDescription(JsonWriter* w,Thing* device,ThingProperty* property)
+{
+	jsonBeginObject(w);
+	const char* valueType = valueTypeToStr(property->info.valueType);
+	if(valueType)
+	{
+		jsonKey(w,"type");
+		jsonString(w,valueType);
+	}
+
+	jsonKey(w,"readOnly");
+	jsonBool(w,property->info.readOnly);
+
+	if (property->info.unit != eNONE) 
+	{
+		jsonKey(w,"unit");
+		jsonString(w,UnitsToStr[property->info.unit]);
+	}
+
+	if(property->title)
+	{
+		jsonKey(w,"title");
+		jsonString(w,property->title);
+	}
+
+	if(get_property_isRange(property) && (property->info.minimum < property->info.maximum))
+	{
+		jsonKey(w,"minimum");
+		jsonNumber(w,property->info.minimum);
+		jsonKey(w,"maximum");
+		jsonNumber(w,property->info.maximum);
+	}
+
+	if (property->info.multipleOf > 0) 
+	{
+		jsonKey(w,"multipleOf");
+		jsonNumber(w,property->info.multipleOf);
+	}
+
+	const char **enumVal = property->info.propertyEnum;
+	if ((enumVal != NULL) && (*enumVal != NULL))
+	{
+		jsonKey(w,"enum");
+		jsonBeginArray(w);
+		for(;*enumVal != NULL;enumVal++)
+		{
+			jsonString(w,*enumVal);
+		}
+		jsonEndArray(w);
+	}
+
+	jsonKey(w,"@type");
+	jsonString(w,get_property_typeschema(property));
+
+	jsonKey(w,"links");
+	jsonBeginArray(w);
+	jsonBeginObject(w);
+	jsonKey(w,"href");
+	jsonString(w,property->href);
+	jsonEndObject(w);
+	jsonEndArray(w);
+
+	jsonEndObject(w);
+}
+
+void writeThingDescription(JsonWriter* w,Thing* thing)
+{
+	jsonBeginObject(w);
+	jsonKey(w,"id");
+	jsonString(w,thing->id);
+	jsonKey(w,"title");
+	jsonString(w,thing->title);
+	jsonKey(w,"@context");
+	jsonString(w,"https://iot.mozilla.org/schemas");
+
+	jsonKey(w,"securityDefinitions");
+	jsonBeginObject(w);
+	jsonKey(w,"nosec_sc");
+	jsonBeginObject(w);
+	jsonKey(w,"scheme");
+	jsonString(w,"nosec");
+	jsonEndObject(w);
+	jsonEndObject(w);
+
+	jsonKey(w,"security");
+	jsonString(w,"nosec_sc");
+
+	jsonKey(w,"links");
+	jsonBeginArray(w);
+	jsonBeginObject(w);
+	jsonKey(w,"rel");
+	jsonString(w,"properties");
+	jsonKey(w,"href");
+	jsonString(w,thing->propertiesHref);
+	jsonEndObject(w);
+	if(thing->action)
+	{
+		jsonBeginObject(w);
+		jsonKey(w,"rel");
+		jsonString(w,"actions");
+		jsonKey(w,"href");
+		jsonString(w,thing->actionsHref);
+		jsonEndObject(w);
+	}
+	if(thing->event)
+	{
+		jsonBeginObject(w);
+		jsonKey(w,"rel");
+		jsonString(w,"events");
+		jsonKey(w,"href");
+		jsonString(w,thing->eventsHref);
+		jsonEndObject(w);
+	}
+	jsonEndArray(w);
+
+	jsonKey(w,"@type");
+	jsonBeginArray(w);
+	char** type = thing->type;
+	while ((type != NULL) && (*type) != NULL) 
+	{
+		jsonString(w,*type);
+		type++;
+	}
+	jsonEndArray(w);
+
+	jsonKey(w,"properties");
+	jsonBeginObject(w);
+	ThingProperty* property = thing->property;
+	while (property != NULL) 
+	{
+		jsonKey(w,property->key);
+		writePropertyDescription(w,thing,property);
+		property = property->next;
+	}
+	jsonEndObject(w);
+	writeActionsDescription(w,thing);
+	writeEventsDescription(w,thing);
+
+	jsonEndObject(w);
+}
+
+void writePropertyValue(JsonWriter* w,ThingProperty* property)
+{
+	ThingPropertyValue value = acquireValue(property);
+	switch(property->info.valueType)
+	{
+		case NO_STATE:
+		break;
+
+		case BOOLEAN:
+			jsonKey(w,property->key);
+			jsonBool(w,value.boolean);
+		break;
+
+		case NUMBER:
+			jsonKey(w,property->key);
+			jsonNumber(w,value.number);
+		break;
+
+		case STRING:
+			if(value.string)
+			{
+				jsonKey(w,property->key);
+				jsonString(w,value.string);
+			}
+		break;
+
+		default:
+			THING_LOGE(TAG,"Unknnown value");
+	}
+	releaseValue(property);
+}
+
+void writeThingValue(JsonWriter* w,ThingPropertyValueType valueType,ThingPropertyValue value)
+{
+	switch(valueType)
+	{
+		case BOOLEAN:
+			jsonBool(w,value.boolean);
+		break;
+
+		case NUMBER:
+			jsonNumber(w,value.number);
+		break;
+
+		case STRING:
+			if(value.string)
+				jsonString(w,value.string);
+			else
+				jsonNull(w);
+		break;
+
+		default:
+			jsonNull(w);
+	}
+}
+
+void writeThingTime(JsonWriter* w,time_t time)
+{
+	struct tm utc;
+	char text[32];
+	gmtime_r(&time,&utc);
+	strftime(text,sizeof(text),"%Y-%m-%dT%H:%M:%S+00:00",&utc);
+	jsonString(w,text);
+}
+
+const PropertyTypeDescriptor* getPropertyTypeDescriptor(ThingPropertyType type)
+{
+	if((unsigned)type >= eKEEP_LAST)
+		return &PropertyTypes[eKEEP_LAST];
+	return &PropertyTypes[type];
+}
+
+const char* get_property_keyname(ThingProperty* property)
+{
+	return property->key;
+}
+
+const char* get_property_typeschema(ThingProperty* property)
+{
+	return getPropertyTypeDescriptor(property->info.type)->schema;
+}
+
+const bool get_property_isRange(ThingProperty* property)
+{
+	return getPropertyTypeDescriptor(property->info.type)->isRange;
+}
+
+const ThingPropertyValueType get_property_valueType(ThingProperty* property)
+{
+	return getPropertyTypeDescriptor(property->info.type)->valueType;
+}
+
+void serialise_property_item(ThingProperty* property,cJSON* jsonProp)
+{
+	if(!jsonProp)
+	{
+		THING_LOGE(TAG,"No Json object passes in arg");
+		return;
+	}	
+
+	const char* propertyKeyName = property->key;
+	ThingPropertyValue value = acquireValue(property);
+	switch(property->info.valueType)
+	{
+		case NO_STATE:
+		break;
 
 		case BOOLEAN:
-			if(property->info.value.boolean)
+			if(value.boolean)
 				cJSON_AddTrueToObject(jsonProp,propertyKeyName);
 			else
 				cJSON_AddFalseToObject(jsonProp,propertyKeyName);
 		break;
 
 		case NUMBER:
-			cJSON_AddNumberToObject(jsonProp,propertyKeyName,property->info.value.number);
+			cJSON_AddNumberToObject(jsonProp,propertyKeyName,value.number);
 		break;
 
 		case STRING:
-			cJSON_AddStringToObject(jsonProp,propertyKeyName,property->info.value.string);
+			cJSON_AddStringToObject(jsonProp,propertyKeyName,value.string);
 		break;
 
 		default:
-			ESP_LOGE(TAG,"Unknnown value");
+			THING_LOGE(TAG,"Unknnown value");
 	}
+	releaseValue(property);
 }
 
-bool update_thing_property(ThingProperty* property,cJSON* newvalue)
+/* Reads the new value of the property from a JSON value , false if the type does not match */
+static bool readPropertyValue(ThingProperty* property,cJSON* item,ThingPropertyValue* value)
 {
-	cJSON* valueItem = cJSON_GetObjectItem(newvalue,get_property_keyname(property));
-	char* newstr = NULL;
 	switch(property->info.valueType)
 	{
 		case BOOLEAN:
-			property->info.value.boolean = cJSON_IsTrue(valueItem);
+			if(!cJSON_IsBool(item))
+				return false;
+			value->boolean = cJSON_IsTrue(item);
+			return true;
+
+		case NUMBER:
+			if(!cJSON_IsNumber(item))
+				return false;
+			value->number = item->valuedouble;
+			return true;
+
+		case STRING:
+			value->string = cJSON_GetStringValue(item);
+			return value->string != NULL;
+
+		default:
+			THING_LOGD(TAG,"unknown value");
+			return false;
+	}
+}
+
+/* A checked value waiting to be stored , see storePendingValues() */
+typedef struct PendingValue
+{
+	ThingProperty* property;
+	ThingPropertyValue value;
+	bool changed;
+}PendingValue;
+
+/*
+	Puts a new value where it will be published from , gValueLock held. Returns why it
+	cannot be stored , the value is then left as it was.
+*/
+static const char* stageValueLocked(PendingValue* pending)
+{
+	ThingProperty* property = pending->property;
+	pending->changed = false;
+	switch(property->info.valueType)
+	{
+		case BOOLEAN:
+			pending->changed = property->info.value.boolean != pending->value.boolean;
 		break;
 
 		case NUMBER:
-			property->info.value.number = valueItem->valueint;
+			pending->changed = property->info.value.number != pending->value.number;
 		break;
 
 		case STRING:
-			newstr = cJSON_GetStringValue(valueItem);
-			if(newstr)
+			if(property->info.value.string && strcmp(property->info.value.string,pending->value.string) == 0)
+				return NULL;
+
+			if(property->valueSize)
+			{
+				// static pool , the spare buffer takes the new value
+				if(strlen(pending->value.string) >= property->valueSize)
+					return "longer than the value buffer";
+				if(hasReaders(property))
+					return THING_ERROR_BUSY;
+				strcpy(property->spare,pending->value.string);
+				pending->value.string = property->spare;
+			}
+			else
 			{
-				if(property->info.value.string)
-				{
-					free(property->info.value.string);
-					property->info.value.string = NULL;
-				}
-
-				property->info.value.string = strdup(newstr);
-				if(property->info.value.string == NULL)
-				{
-					return false;
-				}
+				char* newstr = allocString(pending->value.string);
+				if(newstr == NULL)
+					return "no memory";
+				pending->value.string = newstr;
 			}
+			pending->changed = true;
 		break;
 
 		default:
-			ESP_LOGI(TAG,"unknown value");
+			return "invalid value";
+	}
+	return NULL;
+}
+
+/* Gives back what stageValueLocked() took for a value that is not published , gValueLock held */
+static void unstageValueLocked(PendingValue* pending)
+{
+	if(pending->changed && pending->property->info.valueType == STRING && !pending->property->valueSize)
+		freeString(pending->property,pending->value.string);
+}
+
+/* Publishes a staged value , this cannot fail , gValueLock held */
+static void commitValueLocked(PendingValue* pending)
+{
+	ThingProperty* property = pending->property;
+	if(!pending->changed)
+		return;
+
+	char* oldstr = property->info.valueType == STRING ? property->info.value.string : NULL;
+	publishValue(property,pending->value);
+
+	if(oldstr && property->valueSize)
+	{
+		property->spare = oldstr;
+	}
+	else if(oldstr)
+	{
+		retireString(property,oldstr);
+		if(!hasReaders(property))
+			freeRetired(property);
+	}
+}
+
+/* Sets and publishes the value , gValueLock held */
+static bool storeValueLocked(ThingProperty* property,ThingPropertyValue value,bool* changed)
+{
+	PendingValue pending = {property,value,false};
+	const char* error = stageValueLocked(&pending);
+	*changed = false;
+	if(error)
+	{
+		THING_LOGD(TAG,"%s: %s",property->key,error);
+		return false;
+	}
+	commitValueLocked(&pending);
+	*changed = pending.changed;
+	return true;
+}
+
+/* Stores a value read by readPropertyValue() , changed is set if it differs from the current one */
+static bool storePropertyValue(ThingProperty* property,ThingPropertyValue value,bool* changed)
+{
+	xSemaphoreTake(gValueLock,portMAX_DELAY);
+	bool stored = storeValueLocked(property,value,changed);
+	xSemaphoreGive(gValueLock);
+	return stored;
+}
+
+/*
+	Stores checked values all or none : every value is staged before the first one is
+	published , so a full heap or a busy reader leaves all properties as they were.
+*/
+static bool storePendingValues(PendingValue* pending,uint16_t count,const char** error)
+{
+	uint16_t staged = 0;
+	xSemaphoreTake(gValueLock,portMAX_DELAY);
+	while(staged < count && (*error = stageValueLocked(&pending[staged])) == NULL)
+		staged++;
+	if(staged < count)
+	{
+		while(staged > 0)
+			unstageValueLocked(&pending[--staged]);
+		xSemaphoreGive(gValueLock);
+		return false;
+	}
+	for(uint16_t i = 0;i < count;i++)
+		commitValueLocked(&pending[i]);
+	xSemaphoreGive(gValueLock);
+
+	for(uint16_t i = 0;i < count;i++)
+	{
+		if(pending[i].changed)
+			markPropertyChanged(pending[i].property);
+	}
+	return true;
+}
+
+bool setPropertyValue(ThingProperty* _property,ThingPropertyValue _value)
+{
+	bool changed = false;
+	if(_property->info.valueType == STRING && _value.string == NULL)
+	{
+		return false;
+	}
+
+	xSemaphoreTake(gValueLock,portMAX_DELAY);
+	if(_property->info.valueType == NUMBER && _property->info.deadband > 0 &&
+		fabs(_value.number - _property->info.value.number) <= _property->info.deadband)
+	{
+		xSemaphoreGive(gValueLock);
+		return false;
+	}
+	bool stored = storeValueLocked(_property,_value,&changed);
+	xSemaphoreGive(gValueLock);
+
+	if(!stored)
+	{
+		THING_LOGE(TAG,"could not set %s",_property->key);
+		return false;
+	}
+
+	if(changed)
+		markPropertyChanged(_property);
+	return changed;
+}
+
+uint32_t getPropertyVersion(ThingProperty* _property)
+{
+	// a write in progress still counts as the old version
+	return __atomic_load_n(&_property->seq,__ATOMIC_ACQUIRE) >> 1;
+}
+
+uint32_t getThingVersion(Thing* _thing)
+{
+	return __atomic_load_n(&_thing->version,__ATOMIC_ACQUIRE);
+}
+
+bool getPropertyValue(ThingProperty* _property,ThingPropertyValue* _value,char* _buf,size_t _size)
+{
+	if(_property->info.valueType == NO_STATE)
+		return false;
+
+	*_value = acquireValue(_property);
+	if(_property->info.valueType == STRING)
+	{
+		if(_value->string == NULL || _size == 0)
+		{
+			releaseValue(_property);
 			return false;
+		}
+		strncpy(_buf,_value->string,_size - 1);
+		_buf[_size - 1] = '\0';
+		_value->string = _buf;
+	}
+	releaseValue(_property);
+	return true;
+}
+
+void runPropertyCallback(ThingProperty* _property)
+{
+	if(_property->callback == NULL)
+		return;
+
+	int64_t start = metricsStart();
+	THING_TRACE(eTRACE_CALLBACK_BEGIN,_property->index);
+	if(_property->info.valueType == STRING && _property->valueSize)
+	{
+		// a static pool string is copied , so the callback can set the property without
+		// its own read holding off the write
+		char buf[_property->valueSize];
+		ThingPropertyValue value;
+		if(getPropertyValue(_property,&value,buf,sizeof(buf)))
+			_property->callback(value);
+	}
+	else
+	{
+		ThingPropertyValue value = acquireValue(_property);
+		_property->callback(value);
+		releaseValue(_property);
+	}
+	recordCallback(start);
+	THING_TRACE(eTRACE_CALLBACK_END,_property->index);
+}
+
+/* Runs the callback of the property now or hands it to the callback task */
+static void callPropertyCallback(ThingProperty* property)
+{
+	if(property->callback && !queuePropertyCallback(property))
+		runPropertyCallback(property);
+}
+
+bool update_thing_property(ThingProperty* property,cJSON* newvalue)
+{
+	cJSON* valueItem = cJSON_GetObjectItem(newvalue,property->key);
+	ThingPropertyValue value;
+	bool changed;
+	if(!readPropertyValue(property,valueItem,&value))
+	{
+		THING_LOGD(TAG,"no valid value for %s",property->key);
+		return false;
+	}
+	const char* error = checkPropertyValue(property,value);
+	if(error)
+	{
+		THING_LOGD(TAG,"%s: %s",property->key,error);
+		return false;
+	}
+
+	if(!storePropertyValue(property,value,&changed))
+	{
+		return false;
 	}
+	if(changed)
+		markPropertyChanged(property);
 	
-	if(property->callback)
+	callPropertyCallback(property);
+	return true;
+}
+
+/*
+	The values of a bulk update wait here until all of them are checked. A fixed table ,
+	so that the stack of the server task does not grow with the thing , used under
+	gUpdateLock.
+*/
+static PendingValue gPending[CONFIG_MAX_PROPERTY];
+
+/* Adds a checked value to gPending , a property listed twice takes the last value */
+static const char* addPendingValue(uint16_t* count,ThingProperty* property,ThingPropertyValue value)
+{
+	uint16_t i = 0;
+	while(i < *count && gPending[i].property != property)
+		i++;
+	if(i == CONFIG_MAX_PROPERTY)
+		return THING_ERROR_TOO_MANY;
+	gPending[i].property = property;
+	gPending[i].value = value;
+	gPending[i].changed = false;
+	if(i == *count)
+		(*count)++;
+	return NULL;
+}
+
+/* Stores the values in gPending and runs the callbacks of the changed properties , gUpdateLock held */
+static bool applyPendingValues(uint16_t count,const char** error)
+{
+	if(!storePendingValues(gPending,count,error))
+		return false;
+
+	// callbacks run once per changed property , even if it was listed twice
+	for(uint16_t i = 0;i < count;i++)
+	{
+		if(gPending[i].changed)
+			callPropertyCallback(gPending[i].property);
+	}
+	return true;
+}
+
+/* update_thing_properties() , gUpdateLock held */
+static bool updatePropertiesLocked(Thing* thing,cJSON* newvalues,const char** error)
+{
+	cJSON* item = NULL;
+	ThingPropertyValue value;
+	uint16_t count = 0;
+	if(!cJSON_IsObject(newvalues))
+	{
+		*error = "expected an object";
+		return false;
+	}
+
+	// check every member first so that a bad one leaves all properties untouched
+	cJSON_ArrayForEach(item,newvalues)
+	{
+		ThingProperty* property = findProperty(thing,item->string);
+		if(property == NULL)
+		{
+			*error = "unknown property";
+			return false;
+		}
+		if(property->info.readOnly)
+		{
+			*error = "property is read only";
+			return false;
+		}
+		if(!readPropertyValue(property,item,&value))
+		{
+			*error = "invalid value";
+			return false;
+		}
+		if((*error = checkPropertyValue(property,value)) != NULL)
+			return false;
+		if((*error = addPendingValue(&count,property,value)) != NULL)
+			return false;
+	}
+	return applyPendingValues(count,error);
+}
+
+bool update_thing_properties(Thing* thing,cJSON* newvalues,const char** error)
+{
+	xSemaphoreTake(gUpdateLock,portMAX_DELAY);
+	bool updated = updatePropertiesLocked(thing,newvalues,error);
+	xSemaphoreGive(gUpdateLock);
+	return updated;
+}
+
+/* Reads the new value of the property from a member of a request body , false if the type does not match */
+static bool readMemberValue(ThingProperty* property,const JsonMember* member,ThingPropertyValue* value)
+{
+	switch(property->info.valueType)
+	{
+		case BOOLEAN:
+			value->boolean = member->boolean;
+			return member->type == JSON_VALUE_BOOL;
+
+		case NUMBER:
+			value->number = member->number;
+			return member->type == JSON_VALUE_NUMBER;
+
+		case STRING:
+			value->string = (char*)member->string;
+			return member->type == JSON_VALUE_STRING;
+
+		default:
+			return false;
+	}
+}
+
+bool update_thing_property_json(ThingProperty* property,char* body,size_t len,const char** error)
+{
+	JsonReader reader;
+	JsonMember member;
+	ThingPropertyValue value;
+	bool found = false;
+	int ret;
+
+	// the first member with exactly the key counts , matched case-sensitively like
+	// cJSON_GetObjectItemCaseSensitive() , the rest only has to be valid
+	jsonReaderInit(&reader,body,len);
+	while((ret = jsonReaderNext(&reader,&member)) > 0)
+	{
+		if(!found && strcmp(member.key,property->key) == 0)
+		{
+			if(!readMemberValue(property,&member,&value))
+			{
+				*error = "invalid value";
+				return false;
+			}
+			found = true;
+		}
+	}
+	if(ret < 0)
+	{
+		*error = THING_ERROR_INVALID_JSON;
+		return false;
+	}
+	if(!found)
+	{
+		*error = "invalid value";
+		return false;
+	}
+	if((*error = checkPropertyValue(property,value)) != NULL)
 	{
-		property->callback(property->info.value);
+		return false;
 	}
+
+	PendingValue pending = {property,value,false};
+	if(!storePendingValues(&pending,1,error))
+		return false;
+
+	callPropertyCallback(property);
 	return true;
 }
+
+/* update_thing_properties_json() , gUpdateLock held */
+static bool updatePropertiesJsonLocked(Thing* thing,char* body,size_t len,const char** error)
+{
+	JsonReader reader;
+	JsonMember member;
+	uint16_t count = 0;
+	int ret;
+
+	// check every member first so that a bad one leaves all properties untouched
+	jsonReaderInit(&reader,body,len);
+	while((ret = jsonReaderNext(&reader,&member)) > 0)
+	{
+		ThingProperty* property = findProperty(thing,member.key);
+		ThingPropertyValue value;
+		if(property == NULL)
+		{
+			*error = "unknown property";
+			return false;
+		}
+		if(property->info.readOnly)
+		{
+			*error = "property is read only";
+			return false;
+		}
+		if(!readMemberValue(property,&member,&value))
+		{
+			*error = "invalid value";
+			return false;
+		}
+		if((*error = checkPropertyValue(property,value)) != NULL)
+			return false;
+		if((*error = addPendingValue(&count,property,value)) != NULL)
+			return false;
+	}
+	if(ret < 0)
+	{
+		*error = THING_ERROR_INVALID_JSON;
+		return false;
+	}
+	return applyPendingValues(count,error);
+}
+
+bool update_thing_properties_json(Thing* thing,char* body,size_t len,const char** error)
+{
+	xSemaphoreTake(gUpdateLock,portMAX_DELAY);
+	bool updated = updatePropertiesJsonLocked(thing,body,len,error);
+	xSemaphoreGive(gUpdateLock);
+	return updated;
+}
@@ -0,0 +1,690 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "web_thing_actions.h"
+#include "web_thing_log.h"
+#include "web_thing_trace.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+static const char* TAG = "web_thing_actions";
+
+static const char* const gStatusNames[] = {
+	"none",
+	"pending",
+	"running",
+	"completed",
+	"failed",
+	"cancelled"
+};
+
+struct ThingActionLog
+{
+	ThingActionRequest requests[CONFIG_WEB_THING_ACTION_LOG_SIZE];
+	uint32_t lastId;
+	uint32_t changes;		// status changes so far , see ThingActionRequest.changed
+	ThingActionStats stats;
+};
+
+/* 
+	The queue holds the id next to the request , a pending request which was cancelled
+	leaves its slot free for a new request while it is still queued.
+*/
+typedef struct QueuedAction
+{
+	ThingActionRequest* request;
+	uint32_t id;
+}QueuedAction;
+
+// requests are changed and copied under the lock , the run functions are called without it
+static StaticSemaphore_t gActionLockBuffer;
+static SemaphoreHandle_t gActionLock = NULL;
+static StaticQueue_t gQueueBuffer;
+static uint8_t gQueueStorage[CONFIG_WEB_THING_ACTION_LOG_SIZE * sizeof(QueuedAction)];
+static QueueHandle_t gQueue = NULL;
+static uint32_t gQueued;	// queue entries not yet taken by the action task
+
+static bool isFinished(const ThingActionRequest* request)
+{
+	return request->status >= eACTION_COMPLETED;
+}
+
+/* Marks a status change of the request , action lock held */
+static void markChanged(ThingActionLog* log,ThingActionRequest* request)
+{
+	request->changed = ++log->changes;
+}
+
+static void notifyThing(Thing* thing)
+{
+	if(thing->propertyChanged)
+		thing->propertyChanged(thing);
+}
+
+static void copyRequest(ThingActionRequest* copy,const ThingActionRequest* request)
+{
+	*copy = *request;
+	if(copy->action->inputType == STRING)
+		copy->input.string = copy->string;
+}
+
+ThingAction* createAction(const char* _name,const char* _title,ThingPropertyValueType _inputType,ActionRun_cb _run)
+{
+	if(_name == NULL || !isValidThingKey(_name) || _run == NULL)
+	{
+		THING_LOGE(TAG,"action needs a name which is a valid URL segment and a run function");
+		return NULL;
+	}
+	ThingAction* action = thingAlloc(sizeof(ThingAction));
+	if(action == NULL)
+	{
+		THING_LOGE(TAG,"No memory for action");
+		return NULL;
+	}
+	action->name = thingStrdup(_name);
+	action->title = _title ? thingStrdup(_title) : NULL;
+	if(action->name == NULL || (_title && action->title == NULL))
+	{
+		THING_LOGE(TAG,"No memory for action %s",_name);
+		thingFree(action->name);
+		thingFree(action->title);
+		thingFree(action);
+		return NULL;
+	}
+	action->description = NULL;
+	action->inputType = _inputType;
+	action->minimum = 0;
+	action->maximum = 0;
+	action->run = _run;
+	action->href = NULL;
+	action->next = NULL;
+	action->thing = NULL;
+
+	if(gActionLock == NULL)
+		gActionLock = xSemaphoreCreateMutexStatic(&gActionLockBuffer);
+	return action;
+}
+
+void addAction(Thing* _thing,ThingAction* _action)
+{
+	if(_thing == NULL || _action == NULL)
+		return;
+	if(findAction(_thing,_action->name,strlen(_action->name)) != NULL)
+	{
+		THING_LOGE(TAG,"action %s is added twice",_action->name);
+		return;
+	}
+
+	if(_thing->actionLog == NULL)
+	{
+		_thing->actionsHref = thingAlloc(strlen(_thing->href)+strlen("/actions")+1);
+		_thing->actionLog = thingAlloc(sizeof(ThingActionLog));
+		if(_thing->actionsHref == NULL || _thing->actionLog == NULL)
+		{
+			THING_LOGE(TAG,"No memory for the action log");
+			return;
+		}
+		sprintf(_thing->actionsHref,"%s/actions",_thing->href);
+		memset(_thing->actionLog,0,sizeof(ThingActionLog));
+	}
+
+	_action->href = thingAlloc(strlen(_thing->actionsHref)+1+strlen(_action->name)+1);
+	if(_action->href == NULL)
+	{
+		THING_LOGE(TAG,"No memory for action URL");
+		return;
+	}
+	sprintf(_action->href,"%s/%s",_thing->actionsHref,_action->name);
+	_action->thing = _thing;
+
+	ThingAction** tail = &_thing->action;
+	while(*tail)
+		tail = &(*tail)->next;
+	*tail = _action;
+	invalidateThingDescription(_thing);
+}
+
+ThingAction* findAction(Thing* _thing,const char* _name,size_t _len)
+{
+	for(ThingAction* action = _thing->action;action;action = action->next)
+	{
+		if(strncmp(action->name,_name,_len) == 0 && action->name[_len] == '\0')
+			return action;
+	}
+	return NULL;
+}
+
+static void actionTask(void* arg)
+{
+	QueuedAction queued;
+	for(;;)
+	{
+		if(xQueueReceive(gQueue,&queued,portMAX_DELAY) != pdPASS)
+			continue;
+
+		ThingActionRequest* request = queued.request;
+		Thing* thing = request->action->thing;
+		ThingActionLog* log = thing->actionLog;
+		xSemaphoreTake(gActionLock,portMAX_DELAY);
+		bool run = request->id == queued.id && request->status == eACTION_PENDING;
+		if(run)
+		{
+			request->status = eACTION_RUNNING;
+			markChanged(log,request);
+		}
+		xSemaphoreGive(gActionLock);
+
+		if(run)
+		{
+			notifyThing(thing);
+
+			// a running request keeps its slot , so it can be used without the lock
+			THING_TRACE(eTRACE_ACTION_BEGIN,request->id);
+			bool ok = request->action->run(request);
+			THING_TRACE(eTRACE_ACTION_END,request->id);
+
+			xSemaphoreTake(gActionLock,portMAX_DELAY);
+			if(isActionCancelled(request))
+			{
+				request->status = eACTION_CANCELLED;
+				log->stats.cancelled++;
+			}
+			else if(ok)
+			{
+				request->status = eACTION_COMPLETED;
+				log->stats.completed++;
+			}
+			else
+			{
+				request->status = eACTION_FAILED;
+				log->stats.failed++;
+			}
+			request->timeCompleted = time(NULL);
+			log->stats.busy--;
+			markChanged(log,request);
+			xSemaphoreGive(gActionLock);
+			notifyThing(thing);
+		}
+		__atomic_sub_fetch(&gQueued,1,__ATOMIC_RELEASE);
+	}
+}
+
+bool startActionTask()
+{
+	if(gQueue)
+		return true;
+
+	gQueue = xQueueCreateStatic(CONFIG_WEB_THING_ACTION_LOG_SIZE,sizeof(QueuedAction),gQueueStorage,&gQueueBuffer);
+	if(xTaskCreate(actionTask,"thing_actions",CONFIG_WEB_THING_ACTION_TASK_STACK,NULL,
+		CONFIG_WEB_THING_ACTION_TASK_PRIORITY,NULL) != pdPASS)
+	{
+		THING_LOGE(TAG,"could not start the action task");
+		gQueue = NULL;
+		return false;
+	}
+	return true;
+}
+
+/* Checks the input against the type and range of the action , returns the reason if it does not fit */
+static const char* checkActionInput(ThingAction* action,ThingPropertyValue input)
+{
+	switch(action->inputType)
+	{
+		case NUMBER:
+			if(action->minimum < action->maximum && (input.number < action->minimum || input.number > action->maximum))
+				return "input out of range";
+			return NULL;
+		case STRING:
+			if(input.string == NULL)
+				return "invalid input";
+			if(strlen(input.string) >= CONFIG_WEB_THING_LOG_STRING_SIZE)
+				return "input too long";
+			return NULL;
+		default:
+			return NULL;
+	}
+}
+
+/* 
+	Takes a free slot , else the slot of the oldest finished request. Returns NULL while all
+	slots are pending or running. Action lock held.
+*/
+static ThingActionRequest* takeSlot(ThingActionLog* log)
+{
+	ThingActionRequest* oldest = NULL;
+	for(int i = 0;i < CONFIG_WEB_THING_ACTION_LOG_SIZE;i++)
+	{
+		ThingActionRequest* request = &log->requests[i];
+		if(request->status == eACTION_NONE)
+			return request;
+		if(isFinished(request) && (oldest == NULL || request->id < oldest->id))
+			oldest = request;
+	}
+	return oldest;
+}
+
+uint32_t requestAction(ThingAction* _action,ThingPropertyValue _input,const char** _error)
+{
+	if(_action == NULL || _action->thing == NULL || _action->thing->actionLog == NULL)
+	{
+		*_error = "unknown action";
+		return 0;
+	}
+	if(gQueue == NULL)
+	{
+		*_error = "action task not running";
+		return 0;
+	}
+	const char* reason = checkActionInput(_action,_input);
+	if(reason)
+	{
+		*_error = reason;
+		return 0;
+	}
+
+	Thing* thing = _action->thing;
+	ThingActionLog* log = thing->actionLog;
+	xSemaphoreTake(gActionLock,portMAX_DELAY);
+	ThingActionRequest* request = takeSlot(log);
+	if(request == NULL)
+	{
+		log->stats.rejected++;
+		xSemaphoreGive(gActionLock);
+		*_error = ACTION_ERROR_BUSY;
+		return 0;
+	}
+	memset(request,0,sizeof(ThingActionRequest));
+	request->action = _action;
+	request->id = ++log->lastId;
+	request->status = eACTION_PENDING;
+	request->timeRequested = time(NULL);
+	request->input = _input;
+	if(_action->inputType == STRING)
+	{
+		strcpy(request->string,_input.string);
+		request->input.string = request->string;
+	}
+	QueuedAction queued = {request,request->id};
+	log->stats.requested++;
+	log->stats.busy++;
+	markChanged(log,request);
+
+	// the queue is as long as the log , it is only full when several things share it
+	__atomic_add_fetch(&gQueued,1,__ATOMIC_RELAXED);
+	if(xQueueSend(gQueue,&queued,0) != pdPASS)
+	{
+		__atomic_sub_fetch(&gQueued,1,__ATOMIC_RELEASE);
+		request->status = eACTION_NONE;
+		log->stats.requested--;
+		log->stats.busy--;
+		log->stats.rejected++;
+		xSemaphoreGive(gActionLock);
+		*_error = ACTION_ERROR_BUSY;
+		return 0;
+	}
+	xSemaphoreGive(gActionLock);
+
+	notifyThing(thing);
+	return queued.id;
+}
+
+/* Reads the input of the action from the JSON value , false if the type does not match */
+static bool readActionInput(ThingAction* action,cJSON* item,ThingPropertyValue* input)
+{
+	switch(action->inputType)
+	{
+		case BOOLEAN:
+			if(!cJSON_IsBool(item))
+				return false;
+			input->boolean = cJSON_IsTrue(item);
+			return true;
+
+		case NUMBER:
+			if(!cJSON_IsNumber(item))
+				return false;
+			input->number = item->valuedouble;
+			return true;
+
+		case STRING:
+			input->string = cJSON_GetStringValue(item);
+			return input->string != NULL;
+
+		default:
+			return true;
+	}
+}
+
+uint32_t requestActionJson(Thing* _thing,ThingAction* _action,cJSON* _body,const char** _error)
+{
+	if(!cJSON_IsObject(_body) || _body->child == NULL || _body->child->next != NULL)
+	{
+		*_error = "expected one action";
+		return 0;
+	}
+
+	cJSON* item = _body->child;
+	ThingAction* action = findAction(_thing,item->string,strlen(item->string));
+	if(action == NULL || (_action != NULL && action != _action))
+	{
+		*_error = "unknown action";
+		return 0;
+	}
+
+	ThingPropertyValue input = {0};
+	if(!cJSON_IsObject(item) || !readActionInput(action,cJSON_GetObjectItemCaseSensitive(item,"input"),&input))
+	{
+		*_error = "invalid input";
+		return 0;
+	}
+	return requestAction(action,input,_error);
+}
+
+/* Looks up the kept request with the id , action lock held */
+static ThingActionRequest* findRequest(ThingActionLog* log,uint32_t id)
+{
+	for(int i = 0;i < CONFIG_WEB_THING_ACTION_LOG_SIZE;i++)
+	{
+		if(log->requests[i].id == id && log->requests[i].status != eACTION_NONE)
+			return &log->requests[i];
+	}
+	return NULL;
+}
+
+bool cancelAction(Thing* _thing,uint32_t _id)
+{
+	ThingActionLog* log = _thing->actionLog;
+	bool changed = false;
+	if(log == NULL || _id == 0)
+		return false;
+
+	xSemaphoreTake(gActionLock,portMAX_DELAY);
+	ThingActionRequest* request = findRequest(log,_id);
+	if(request == NULL)
+	{
+		xSemaphoreGive(gActionLock);
+		return false;
+	}
+	switch(request->status)
+	{
+		case eACTION_PENDING:
+			// the action task skips it when it comes out of the queue
+			request->status = eACTION_CANCELLED;
+			request->timeCompleted = time(NULL);
+			log->stats.cancelled++;
+			log->stats.busy--;
+			markChanged(log,request);
+			changed = true;
+		break;
+
+		case eACTION_RUNNING:
+			__atomic_store_n(&request->cancel,true,__ATOMIC_RELEASE);
+		break;
+
+		default:
+			request->status = eACTION_NONE;
+	}
+	xSemaphoreGive(gActionLock);
+
+	if(changed)
+		notifyThing(_thing);
+	return true;
+}
+
+bool isActionCancelled(ThingActionRequest* _request)
+{
+	return __atomic_load_n(&_request->cancel,__ATOMIC_ACQUIRE);
+}
+
+bool getActionRequest(Thing* _thing,uint32_t _id,ThingActionRequest* _copy)
+{
+	if(_thing->actionLog == NULL)
+		return false;
+	xSemaphoreTake(gActionLock,portMAX_DELAY);
+	ThingActionRequest* request = findRequest(_thing->actionLog,_id);
+	if(request)
+		copyRequest(_copy,request);
+	xSemaphoreGive(gActionLock);
+	return request != NULL;
+}
+
+bool waitThingActions(uint32_t _timeoutMs)
+{
+	int64_t deadline = esp_timer_get_time() + (int64_t)_timeoutMs * 1000;
+	while(__atomic_load_n(&gQueued,__ATOMIC_ACQUIRE) != 0)
+	{
+		if(esp_timer_get_time() >= deadline)
+			return false;
+		vTaskDelay(1);
+	}
+	return true;
+}
+
+void getThingActionStats(Thing* _thing,ThingActionStats* _stats)
+{
+	memset(_stats,0,sizeof(ThingActionStats));
+	if(_thing->actionLog == NULL)
+		return;
+	xSemaphoreTake(gActionLock,portMAX_DELAY);
+	*_stats = _thing->actionLog->stats;
+	xSemaphoreGive(gActionLock);
+}
+
+void writeActionRequest(JsonWriter* w,const ThingActionRequest* request)
+{
+	char id[12];
+	sprintf(id,"/%u",(unsigned)request->id);
+
+	jsonBeginObject(w);
+	jsonKey(w,request->action->name);
+	jsonBeginObject(w);
+	if(request->action->inputType != NO_STATE)
+	{
+		jsonKey(w,"input");
+		writeThingValue(w,request->action->inputType,request->input);
+	}
+	jsonKey(w,"href");
+	jsonStringBegin(w);
+	jsonStringAppend(w,request->action->href);
+	jsonStringAppend(w,id);
+	jsonStringEnd(w);
+	jsonKey(w,"timeRequested");
+	writeThingTime(w,request->timeRequested);
+	if(isFinished(request))
+	{
+		jsonKey(w,"timeCompleted");
+		writeThingTime(w,request->timeCompleted);
+	}
+	jsonKey(w,"status");
+	jsonString(w,gStatusNames[request->status]);
+	jsonEndObject(w);
+	jsonEndObject(w);
+}
+
+void writeActionLog(JsonWriter* w,Thing* thing,ThingAction* filter)
+{
+	uint32_t ids[CONFIG_WEB_THING_ACTION_LOG_SIZE];
+	int count = 0;
+	ThingActionRequest request;
+	jsonBeginArray(w);
+	if(thing->actionLog)
+	{
+		// ids in order under the lock , then the requests one at a time
+		xSemaphoreTake(gActionLock,portMAX_DELAY);
+		for(int i = 0;i < CONFIG_WEB_THING_ACTION_LOG_SIZE;i++)
+		{
+			const ThingActionRequest* kept = &thing->actionLog->requests[i];
+			if(kept->status == eACTION_NONE || (filter != NULL && kept->action != filter))
+				continue;
+			int at = count++;
+			while(at > 0 && ids[at - 1] > kept->id)
+			{
+				ids[at] = ids[at - 1];
+				at--;
+			}
+			ids[at] = kept->id;
+		}
+		xSemaphoreGive(gActionLock);
+
+		for(int i = 0;i < count;i++)
+		{
+			if(getActionRequest(thing,ids[i],&request))
+				writeActionRequest(w,&request);
+		}
+	}
+	jsonEndArray(w);
+}
+
+uint16_t takeChangedActions(Thing* thing,uint32_t* cursor,ActionVisit_cb visit,void* ctx)
+{
+	ThingActionLog* log = thing->actionLog;
+	ThingActionRequest request;
+	uint16_t count = 0;
+	if(log == NULL)
+		return 0;
+
+	// a request which changed twice meanwhile is visited once , with its last status
+	for(;;)
+	{
+		const ThingActionRequest* next = NULL;
+		xSemaphoreTake(gActionLock,portMAX_DELAY);
+		for(int i = 0;i < CONFIG_WEB_THING_ACTION_LOG_SIZE;i++)
+		{
+			const ThingActionRequest* kept = &log->requests[i];
+			if(kept->status != eACTION_NONE && kept->changed > *cursor && (next == NULL || kept->changed < next->changed))
+				next = kept;
+		}
+		if(next)
+			copyRequest(&request,next);
+		xSemaphoreGive(gActionLock);
+
+		if(next == NULL)
+			return count;
+		*cursor = request.changed;
+		visit(&request,ctx);
+		count++;
+	}
+}
+
+void writeActionsDescription(JsonWriter* w,Thing* thing)
+{
+	if(thing->action == NULL)
+		return;
+
+	jsonKey(w,"actions");
+	jsonBeginObject(w);
+	for(ThingAction* action = thing->action;action;action = action->next)
+	{
+		jsonKey(w,action->name);
+		jsonBeginObject(w);
+		if(action->title)
+		{
+			jsonKey(w,"title");
+			jsonString(w,action->title);
+		}
+		if(action->description)
+		{
+			jsonKey(w,"description");
+			jsonString(w,action->description);
+		}
+		if(valueTypeToStr(action->inputType))
+		{
+			jsonKey(w,"input");
+			jsonBeginObject(w);
+			jsonKey(w,"type");
+			jsonString(w,valueTypeToStr(action->inputType));
+			if(action->inputType == NUMBER && action->minimum < action->maximum)
+			{
+				jsonKey(w,"minimum");
+				jsonNumber(w,action->minimum);
+				jsonKey(w,"maximum");
+				jsonNumber(w,action->maximum);
+			}
+			jsonEndObject(w);
+		}
+		jsonKey(w,"links");
+		jsonBeginArray(w);
+		jsonBeginObject(w);
+		jsonKey(w,"href");
+		jsonString(w,action->href);
+		jsonEndObject(w);
+		jsonEndArray(w);
+		jsonEndObject(w);
+	}
+	jsonEndObject(w);
+}
+
+void serializeActions(Thing* thing,cJSON* deviceJson)
+{
+	if(thing->action == NULL)
+		return;
+
+	cJSON* actionsJson = cJSON_CreateObject();
+	for(ThingAction* action = thing->action;action;action = action->next)
+	{
+		cJSON* actionJson = cJSON_CreateObject();
+		if(action->title)
+			cJSON_AddStringToObject(actionJson,"title",action->title);
+		if(action->description)
+			cJSON_AddStringToObject(actionJson,"description",action->description);
+		if(valueTypeToStr(action->inputType))
+		{
+			cJSON* inputJson = cJSON_CreateObject();
+			cJSON_AddStringToObject(inputJson,"type",valueTypeToStr(action->inputType));
+			if(action->inputType == NUMBER && action->minimum < action->maximum)
+			{
+				cJSON_AddNumberToObject(inputJson,"minimum",action->minimum);
+				cJSON_AddNumberToObject(inputJson,"maximum",action->maximum);
+			}
+			cJSON_AddItemToObject(actionJson,"input",inputJson);
+		}
+		cJSON* links = cJSON_CreateArray();
+		cJSON* href = cJSON_CreateObject();
+		cJSON_AddStringToObject(href,"href",action->href);
+		cJSON_AddItemToArray(links,href);
+		cJSON_AddItemToObject(actionJson,"links",links);
+		cJSON_AddItemToObject(actionsJson,action->name,actionJson);
+	}
+	cJSON_AddItemToObject(deviceJson,"actions",actionsJson);
+}
+
+void cleanUpActions(Thing* thing)
+{
+	ThingAction* action = thing->action;
+	while(action)
+	{
+		ThingAction* next = action->next;
+		thingFree(action->name);
+		thingFree(action->title);
+		thingFree(action->href);
+		thingFree(action);
+		action = next;
+	}
+	thing->action = NULL;
+	thingFree(thing->actionLog);
+	thingFree(thing->actionsHref);
+	thing->actionLog = NULL;
+	thing->actionsHref = NULL;
+}
@@ -22,23 +22,114 @@
 #include "web_thing_adapter.h"
 #include <esp_wifi.h>
 #include <esp_event_loop.h>
-#include <esp_log.h>
 #include <esp_system.h>
 #include <nvs_flash.h>
+#include <strings.h>
 #include <sys/param.h>
 #include <mdns.h>
 
 #include <esp_http_server.h>
+#include "web_thing_actions.h"
+#include "web_thing_callbacks.h"
+#include "web_thing_events.h"
+#include "web_thing_log.h"
+#include "web_thing_metrics.h"
+#include "web_thing_trace.h"
 
-static Thing* gThing=NULL;
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+#include <unistd.h>
+#include "freertos/timers.h"
+#endif
+
+static httpd_handle_t gServer = NULL;
 static const char* MDNS_INSTANCE_NAME = "webthing";
 static const char* REST_TAG ="web_thing_adapter";
 
-static void initialise_mdns(char* instance_name)
+/*
+	Things
+
+	One http server and one mDNS service serve every thing added to the adapter , "/" lists
+	them and "/things/<id>/..." finds the thing by its id in a small hash index. So neither
+	the handler table nor the cost of routing a request grows with the number of things.
+	A thing can be added while the server runs : its entry is filled before its index slot
+	and gThingCount are stored , and the server task loads those with acquire.
+*/
+#define THING_INDEX_SIZE (CONFIG_WEB_THING_MAX_THINGS * 2)
+
+typedef struct AdapterThing
 {
-	if(gThing == NULL)
-		return;
+	Thing* thing;
+	uint32_t eventCursor;		// last event and action change sent to the subscribers
+	uint32_t actionCursor;
+}AdapterThing;
+
+static AdapterThing gThings[CONFIG_WEB_THING_MAX_THINGS];
+static uint16_t gThingCount = 0;
+static uint8_t gThingIndex[THING_INDEX_SIZE];	// position in gThings + 1 , 0 is a free slot
+
+static void schedulePush(Thing* thing);
+static void registerActionHandlers(httpd_handle_t server);
+
+/* Number of things added , gThings below it are complete */
+static uint16_t thingCount(void)
+{
+	return __atomic_load_n(&gThingCount,__ATOMIC_ACQUIRE);
+}
+
+/* Looks up a thing by its id of len characters , the index is at most half full */
+static AdapterThing* findAdapterThing(const char* id,size_t len)
+{
+	uint8_t position;
+	for(uint16_t slot = hashThingKey(id,len) % THING_INDEX_SIZE;(position = __atomic_load_n(&gThingIndex[slot],__ATOMIC_ACQUIRE));slot = (slot + 1) % THING_INDEX_SIZE)
+	{
+		AdapterThing* entry = &gThings[position - 1];
+		if(strncmp(entry->thing->id,id,len) == 0 && entry->thing->id[len] == '\0')
+			return entry;
+	}
+	return NULL;
+}
+
+bool addThing(Thing* thing)
+{
+	if(thing == NULL)
+		return false;
+	if(gThingCount == CONFIG_WEB_THING_MAX_THINGS)
+	{
+		THING_LOGE(REST_TAG,"no room for thing %s , see CONFIG_WEB_THING_MAX_THINGS",thing->id);
+		return false;
+	}
+	if(findAdapterThing(thing->id,strlen(thing->id)) != NULL)
+	{
+		THING_LOGE(REST_TAG,"thing id %s is used twice",thing->id);
+		return false;
+	}
+
+	uint16_t slot = hashThingKey(thing->id,strlen(thing->id)) % THING_INDEX_SIZE;
+	while(gThingIndex[slot])
+		slot = (slot + 1) % THING_INDEX_SIZE;
+	gThings[gThingCount].thing = thing;
+	gThings[gThingCount].eventCursor = 0;
+	gThings[gThingCount].actionCursor = 0;
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+	// pushes start with the server , schedulePush() does nothing before
+	thing->propertyChanged = schedulePush;
+#endif
+	__atomic_store_n(&gThingIndex[slot],gThingCount + 1,__ATOMIC_RELEASE);
+	__atomic_store_n(&gThingCount,gThingCount + 1,__ATOMIC_RELEASE);
+
+	if(gServer != NULL && thing->action != NULL)
+		registerActionHandlers(gServer);
+	return true;
+}
+
+Thing* findThing(const char* id)
+{
+	AdapterThing* entry = findAdapterThing(id,strlen(id));
+	return entry ? entry->thing : NULL;
+}
 
+static void initialise_mdns(char* instance_name)
+{
 	mdns_init();
 	mdns_hostname_set(MDNS_INSTANCE_NAME);
 	mdns_instance_name_set(instance_name);
@@ -51,238 +142,1230 @@ static void initialise_mdns(char* instance_name)
 									 sizeof(serviceTxtData) / sizeof(serviceTxtData[0])));
 }
 
-esp_err_t handleGetThing(httpd_req_t *req)
+/*
+	Metrics
+
+	Every handler runs through countRequest() , the bytes it sends go through respond() and
+	respondChunk() and are added up for the route it was counted under.
+*/
+typedef esp_err_t (*ServeRequest_cb)(httpd_req_t *req,ThingMetricRoute* metric);
+
+static uint32_t gResponseBytes = 0;		// body bytes of the current response , server task only
+static uint16_t gMaxSockets = 0;
+
+static esp_err_t respond(httpd_req_t *req,const char* buf,ssize_t len)
 {
-	Thing* device = NULL;
-	cJSON* responseJson = NULL;
-	if(req->user_ctx != NULL)
+	if(len == HTTPD_RESP_USE_STRLEN)
+		len = buf ? strlen(buf) : 0;
+	gResponseBytes += len;
+	return httpd_resp_send(req,buf,len);
+}
+
+static esp_err_t respondChunk(httpd_req_t *req,const char* buf,ssize_t len)
+{
+	if(len == HTTPD_RESP_USE_STRLEN)
+		len = buf ? strlen(buf) : 0;
+	gResponseBytes += len;
+	return httpd_resp_send_chunk(req,buf,len);
+}
+
+/* Runs the handler , requests it does not set a route for are counted as eMETRIC_OTHER */
+static esp_err_t countRequest(httpd_req_t *req,ServeRequest_cb serve)
+{
+	ThingMetricRoute metric = eMETRIC_OTHER;
+	int64_t start = metricsStart();
+	THING_TRACE(eTRACE_REQUEST_BEGIN,req->method);
+	gResponseBytes = 0;
+	esp_err_t ret = serve(req,&metric);
+	recordRequest(metric,start,gResponseBytes,ret != ESP_OK);
+	THING_TRACE(eTRACE_REQUEST_END,metric);
+	return ret;
+}
+
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+/* True if the q value in the parameters of a coding is 0 , which refuses it */
+static bool isRefusedCoding(const char* params)
+{
+	for(const char* param = strchr(params,';');param;param = strchr(param + 1,';'))
 	{
-		device = (Thing*)req->user_ctx;
+		const char* name = param + 1;
+		while(*name == ' ' || *name == '\t')
+			name++;
+		if((name[0] == 'q' || name[0] == 'Q') && name[1] == '=')
+			return strtod(name + 2,NULL) <= 0;
 	}
-	else
+	return false;
+}
+
+/* 
+	True if Accept-Encoding allows the deflate content encoding , by name or by "*" , and
+	does not refuse it with q=0
+*/
+static bool acceptsDeflate(httpd_req_t *req)
+{
+	char acceptEncoding[128];
+	char* save = NULL;
+	bool anyCoding = false;
+	if(httpd_req_get_hdr_value_len(req,"Accept-Encoding") == 0)
+		return false;
+
+	esp_err_t err = httpd_req_get_hdr_value_str(req,"Accept-Encoding",acceptEncoding,sizeof(acceptEncoding));
+	if(err == ESP_ERR_NOT_FOUND)
+		return false;
+	acceptEncoding[sizeof(acceptEncoding)-1] = '\0';
+	if(err == ESP_ERR_HTTPD_RESULT_TRUNC)
 	{
-		ESP_LOGI(REST_TAG,"user_ctx is null");
+		// the last coding may have lost its parameters , only the complete ones count
+		char* last = strrchr(acceptEncoding,',');
+		if(last == NULL)
+			return false;
+		*last = '\0';
 	}
 
-	if(device)
+	for(char* coding = strtok_r(acceptEncoding,",",&save);coding;coding = strtok_r(NULL,",",&save))
 	{
-		cJSON* responseJson = cJSON_CreateObject();
-		serializeDevice(device,responseJson);
-		const char* strRes = cJSON_Print(responseJson);		
-		httpd_resp_set_type(req, "application/json");
-		httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-		httpd_resp_send(req, strRes, strlen(strRes));
+		while(*coding == ' ' || *coding == '\t')
+			coding++;
+		size_t nameLen = strcspn(coding,"; \t");
+		if(nameLen == 7 && strncasecmp(coding,"deflate",7) == 0)
+			return !isRefusedCoding(coding);
+		if(nameLen == 1 && coding[0] == '*')
+			anyCoding = !isRefusedCoding(coding);
+	}
+	return anyCoding;
+}
+#endif
+
+/*
+	ETags
+
+	Responses carry the version of what they contain , the property version , the version
+	of all values or the description version , behind a tag which is new every boot so
+	that a restarted device never matches a tag of the previous run. A GET whose
+	If-None-Match holds the current tag is answered with 304 and nothing is serialised.
+*/
+#define ETAG_SIZE 24
+
+static uint32_t gBootTag = 0;
+
+/* Writes the tag for a version of kind 'p'roperty , 'v'alues or 'd'escription */
+static void formatETag(char* etag,char kind,uint32_t version,bool deflated)
+{
+	snprintf(etag,ETAG_SIZE,"\"%08x-%c%u%s\"",(unsigned)gBootTag,kind,(unsigned)version,deflated ? "z" : "");
+}
+
+/* True if If-None-Match lists the tag or is * */
+static bool matchesETag(httpd_req_t *req,const char* etag)
+{
+	char ifNoneMatch[96];
+	if(httpd_req_get_hdr_value_len(req,"If-None-Match") == 0)
+		return false;
+
+	// a truncated list can still hold the whole tag , a tag cut off does not match
+	if(httpd_req_get_hdr_value_str(req,"If-None-Match",ifNoneMatch,sizeof(ifNoneMatch)) == ESP_ERR_NOT_FOUND)
+		return false;
+	ifNoneMatch[sizeof(ifNoneMatch)-1] = '\0';
+	return strcmp(ifNoneMatch,"*") == 0 || strstr(ifNoneMatch,etag) != NULL;
+}
+
+/* Adds the tag to the response , clients are asked to check it before using a cached copy */
+static void setETag(httpd_req_t *req,const char* etag)
+{
+	httpd_resp_set_hdr(req, "ETag", etag);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+}
+
+static esp_err_t sendNotModified(httpd_req_t *req,const char* etag)
+{
+	httpd_resp_set_status(req, "304 Not Modified");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	setETag(req,etag);
+	return respond(req, NULL, 0);
+}
+
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+/*
+	WebSocket API
 
-		//cleanup
-		free(strRes);
-		cJSON_Delete(responseJson);
+	Subscribers are the sockets which completed the WebSocket handshake on a thing URL ,
+	each gets the messages of that thing. notifyPropertyChanged() marks properties in the
+	thing and arms a one shot timer , when it expires the marked properties of every thing
+	are sent in one propertyStatus message per thing from the http server task. Events and
+	action status changes arm the same timer , they are read from the logs behind the
+	cursors of the thing and sent as one event or actionStatus message each. The subscriber
+	list is only touched from that task.
+*/
+typedef struct WsClient
+{
+	int fd;				// -1 when free
+	Thing* thing;
+}WsClient;
+
+typedef struct WsMessage
+{
+	JsonWriter writer;
+	Thing* thing;		// the message goes to the subscribers of this thing
+	bool started;		// the first fragment was sent
+}WsMessage;
+
+static WsClient gWsClients[CONFIG_WEB_THING_WS_MAX_CLIENTS];
+static TimerHandle_t gPushTimer = NULL;
+static uint8_t gPushScheduled = 0;
+
+static void addWsClient(int fd,Thing* thing)
+{
+	for(int i = 0;i < CONFIG_WEB_THING_WS_MAX_CLIENTS;i++)
+	{
+		if(gWsClients[i].fd < 0)
+		{
+			gWsClients[i].fd = fd;
+			gWsClients[i].thing = thing;
+			return;
+		}
 	}
-    return ESP_OK;
+	THING_LOGW(REST_TAG,"no room for websocket client %d",fd);
 }
 
-esp_err_t handleThingGetItem(httpd_req_t *req)
+static void removeWsClient(int fd)
 {
-	ThingProperty* property = NULL;
-	cJSON* responseJson = NULL;
-	if(req->user_ctx != NULL)
+	for(int i = 0;i < CONFIG_WEB_THING_WS_MAX_CLIENTS;i++)
 	{
-		property = (ThingProperty*)req->user_ctx;
+		if(gWsClients[i].fd == fd)
+			gWsClients[i].fd = -1;
 	}
-	if(property)
+}
+
+/* The thing the socket subscribed to , NULL if it is no subscriber */
+static Thing* findWsThing(int fd)
+{
+	for(int i = 0;i < CONFIG_WEB_THING_WS_MAX_CLIENTS;i++)
 	{
-		responseJson = cJSON_CreateObject();
-		serialise_property_item(property,responseJson);
-		const char* strRes = cJSON_Print(responseJson);
-		httpd_resp_set_type(req, "application/json");
-		httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-		httpd_resp_send(req, strRes, strlen(strRes));
-
-		//cleanup
-		free(strRes);
-		cJSON_Delete(responseJson);
-	}
-    return ESP_OK;
-}
-
-esp_err_t handleThingPutItem(httpd_req_t *req)
-{
-	ThingProperty* property = NULL;
-	cJSON* responseJson = NULL;
-	esp_err_t resCode = ESP_OK;
-	if(req->user_ctx != NULL)
-	{
-		property = (ThingProperty*)req->user_ctx;
-	}
-
-	if(property)
-	{
-		char* content = malloc(sizeof(char)*(req->content_len+1));
-		cJSON *newvalue = NULL;
-    	int ret = httpd_req_recv(req, content, req->content_len);
-    	content[req->content_len] = '\0';
-	    if (ret <= 0) 
-	    {  /* 0 return value indicates connection closed */
-	        /* Check if timeout occurred */
-	        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-	            /* In case of timeout one can choose to retry calling
-	             * httpd_req_recv(), but to keep it simple, here we
-	             * respond with an HTTP 408 (Request Timeout) error */
-	            httpd_resp_send_408(req);
-	        }
-	        /* In case of error, returning ESP_FAIL will
-	         * ensure that the underlying socket is closed */
-	        resCode = ESP_FAIL;
-	        goto cleanup;
-	    }
-	    newvalue = cJSON_Parse((char *)content);
-        if(newvalue == NULL)
-        {
-            ESP_LOGI(REST_TAG,"handle_directives::Parsing failed");
-            resCode = ESP_FAIL;
-	        goto cleanup;
-        }
-		if(update_thing_property(property,newvalue))
+		if(gWsClients[i].fd == fd)
+			return gWsClients[i].thing;
+	}
+	return NULL;
+}
+
+static uint16_t countWsClients()
+{
+	uint16_t count = 0;
+	for(int i = 0;i < CONFIG_WEB_THING_WS_MAX_CLIENTS;i++)
+	{
+		if(gWsClients[i].fd >= 0)
+			count++;
+	}
+	return count;
+}
+
+static bool hasWsClients(Thing* thing)
+{
+	for(int i = 0;i < CONFIG_WEB_THING_WS_MAX_CLIENTS;i++)
+	{
+		if(gWsClients[i].fd >= 0 && gWsClients[i].thing == thing)
+			return true;
+	}
+	return false;
+}
+
+static void closeSocket(httpd_handle_t hd,int sockfd)
+{
+	removeWsClient(sockfd);
+	close(sockfd);
+}
+
+/* Sends a frame to every subscriber of the thing , subscribers which fail are dropped */
+static void sendWsFrame(Thing* thing,httpd_ws_frame_t* frame)
+{
+	for(int i = 0;i < CONFIG_WEB_THING_WS_MAX_CLIENTS;i++)
+	{
+		int fd = gWsClients[i].fd;
+		if(fd < 0 || gWsClients[i].thing != thing)
+			continue;
+
+		if(httpd_ws_get_fd_info(gServer,fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+			httpd_ws_send_frame_async(gServer,fd,frame) != ESP_OK)
 		{
-			httpd_resp_set_type(req, "application/json");
-			httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-			httpd_resp_send(req, content, strlen(content));
+			THING_LOGD(REST_TAG,"dropping websocket client %d",fd);
+			gWsClients[i].fd = -1;
+			continue;
 		}
-cleanup:
-		if(newvalue)
-			cJSON_Delete(newvalue);
+		recordWsFrame(frame->len,frame->final);
+	}
+}
+
+/* Messages longer than the writer buffer go out as fragments */
+static int sendWsFragment(void* ctx,const char* buf,size_t len)
+{
+	WsMessage* message = (WsMessage*)ctx;
+	httpd_ws_frame_t frame = {
+		.final = false,
+		.fragmented = true,
+		.type = message->started ? HTTPD_WS_TYPE_CONTINUE : HTTPD_WS_TYPE_TEXT,
+		.payload = (uint8_t*)buf,
+		.len = len
+	};
+	sendWsFrame(message->thing,&frame);
+	message->started = true;
+	return 0;
+}
+
+/* Starts a {"messageType":..,"data":..} message , the data is written next */
+static void beginWsMessage(WsMessage* message,Thing* thing,const char* messageType)
+{
+	message->thing = thing;
+	message->started = false;
+	jsonWriterInit(&message->writer,false,sendWsFragment,message);
+	jsonBeginObject(&message->writer);
+	jsonKey(&message->writer,"messageType");
+	jsonString(&message->writer,messageType);
+	jsonKey(&message->writer,"data");
+}
+
+/* Ends the message and sends what is left of it as the final frame */
+static void finishWsMessage(WsMessage* message)
+{
+	jsonEndObject(&message->writer);
+	size_t len = 0;
+	const char* last = jsonWriterTakePending(&message->writer,&len);
+	if(last == NULL)
+		return;
+
+	httpd_ws_frame_t frame = {
+		.final = true,
+		.fragmented = message->started,
+		.type = message->started ? HTTPD_WS_TYPE_CONTINUE : HTTPD_WS_TYPE_TEXT,
+		.payload = (uint8_t*)last,
+		.len = len
+	};
+	sendWsFrame(message->thing,&frame);
+}
+
+static void writeChangedProperty(ThingProperty* property,void* ctx)
+{
+	writePropertyValue((JsonWriter*)ctx,property);
+}
+
+static void skipChangedProperty(ThingProperty* property,void* ctx)
+{
+}
+
+static void sendEventMessage(const ThingEventRecord* record,void* ctx)
+{
+	WsMessage message;
+	beginWsMessage(&message,(Thing*)ctx,"event");
+	writeEventRecord(&message.writer,record);
+	finishWsMessage(&message);
+}
+
+static void sendActionStatusMessage(const ThingActionRequest* request,void* ctx)
+{
+	WsMessage message;
+	beginWsMessage(&message,(Thing*)ctx,"actionStatus");
+	writeActionRequest(&message.writer,request);
+	finishWsMessage(&message);
+}
+
+static void skipEvent(const ThingEventRecord* record,void* ctx)
+{
+}
+
+static void skipActionStatus(const ThingActionRequest* request,void* ctx)
+{
+}
+
+static void pushThingChanges(AdapterThing* entry)
+{
+	Thing* thing = entry->thing;
+	if(!hasWsClients(thing))
+	{
+		takeChangedProperties(thing,skipChangedProperty,NULL);
+		takeNewEvents(thing,&entry->eventCursor,skipEvent,NULL);
+		takeChangedActions(thing,&entry->actionCursor,skipActionStatus,NULL);
+		return;
+	}
+
+	// all changed properties in one message , events and action updates one message each
+	WsMessage message;
+	beginWsMessage(&message,thing,"propertyStatus");
+	jsonBeginObject(&message.writer);
+	uint16_t count = takeChangedProperties(thing,writeChangedProperty,&message.writer);
+	jsonEndObject(&message.writer);
+	if(count > 0)
+		finishWsMessage(&message);
+
+	takeNewEvents(thing,&entry->eventCursor,sendEventMessage,thing);
+	takeChangedActions(thing,&entry->actionCursor,sendActionStatusMessage,thing);
+}
 
-		if(content)
-			free(content);
+/* Runs in the http server task , the things without changes cost a look at their bits */
+static void pushChanges(void* arg)
+{
+	// re-arm first , a change marked while we are sending goes out with the next push
+	__atomic_store_n(&gPushScheduled,0,__ATOMIC_RELEASE);
+	uint16_t count = thingCount();
+	THING_TRACE(eTRACE_PUSH_BEGIN,count);
+	for(uint16_t i = 0;i < count;i++)
+		pushThingChanges(&gThings[i]);
+	THING_TRACE(eTRACE_PUSH_END,0);
+}
+
+static void pushTimerExpired(TimerHandle_t timer)
+{
+	if(httpd_queue_work(gServer,pushChanges,NULL) != ESP_OK)
+	{
+		THING_LOGW(REST_TAG,"could not queue property push");
+		__atomic_store_n(&gPushScheduled,0,__ATOMIC_RELEASE);
 	}
-    return resCode;
 }
 
-esp_err_t handleThingGetAllProperties(httpd_req_t *req)
+/* Called by notifyPropertyChanged() , from any task */
+static void schedulePush(Thing* thing)
 {
-	ESP_LOGI(REST_TAG,"handleThingGetAllProperties hit");
-	Thing* thing = NULL;
-	cJSON* responseJson = NULL;
-	if(req->user_ctx != NULL)
+	if(gServer == NULL)
+		return;
+
+	if(__atomic_exchange_n(&gPushScheduled,1,__ATOMIC_ACQ_REL))
+		return;
+
+	if(xTimerStart(gPushTimer,0) != pdPASS)
+		__atomic_store_n(&gPushScheduled,0,__ATOMIC_RELEASE);
+}
+
+static void sendWsError(httpd_req_t *req,const char* status,const char* message)
+{
+	char text[128];
+	int len = snprintf(text,sizeof(text),"{\"messageType\":\"error\",\"data\":{\"status\":\"%s\",\"message\":\"%s\"}}",status,message);
+	httpd_ws_frame_t frame = {
+		.final = true,
+		.fragmented = false,
+		.type = HTTPD_WS_TYPE_TEXT,
+		.payload = (uint8_t*)text,
+		.len = len < sizeof(text) ? len : sizeof(text) - 1
+	};
+	httpd_ws_send_frame(req,&frame);
+}
+
+/* 
+	Handles a message from a subscriber , setProperty and requestAction are supported.
+	Frames carry no URI , the thing is the one the socket subscribed to.
+*/
+static esp_err_t handleWsMessage(httpd_req_t *req)
+{
+	char message[CONFIG_WEB_THING_WS_MAX_MESSAGE+1];
+	Thing* thing = findWsThing(httpd_req_to_sockfd(req));
+	if(thing == NULL)
+		return ESP_FAIL;
+
+	httpd_ws_frame_t frame = {0};
+	esp_err_t ret = httpd_ws_recv_frame(req,&frame,0);
+	if(ret != ESP_OK)
+		return ret;
+
+	if(frame.len > CONFIG_WEB_THING_WS_MAX_MESSAGE)
+	{
+		THING_LOGD(REST_TAG,"websocket message too long (%d)",(int)frame.len);
+		return ESP_FAIL;
+	}
+
+	frame.payload = (uint8_t*)message;
+	ret = httpd_ws_recv_frame(req,&frame,CONFIG_WEB_THING_WS_MAX_MESSAGE);
+	if(ret != ESP_OK)
+		return ret;
+	if(frame.type != HTTPD_WS_TYPE_TEXT)
+		return ESP_OK;
+	message[frame.len] = '\0';
+
+	cJSON* json = cJSON_Parse(message);
+	const char* messageType = cJSON_GetStringValue(cJSON_GetObjectItem(json,"messageType"));
+	const char* error = NULL;
+	if(json == NULL)
 	{
-		thing = (Thing*)req->user_ctx;
+		error = THING_ERROR_INVALID_JSON;
+		recordParseFailure();
+	}
+	else if(messageType != NULL && strcmp(messageType,"setProperty") == 0)
+	{
+		// the new values reach all subscribers , this one included , with the next push
+		update_thing_properties(thing,cJSON_GetObjectItem(json,"data"),&error);
+	}
+	else if(messageType != NULL && strcmp(messageType,"requestAction") == 0)
+	{
+		// the request is announced with an actionStatus message like its later changes
+		requestActionJson(thing,NULL,cJSON_GetObjectItem(json,"data"),&error);
 	}
 	else
 	{
+		error = "unsupported messageType";
+	}
+
+	if(error)
+		sendWsError(req,"400 Bad Request",error);
+	if(json)
+		cJSON_Delete(json);
+	return ESP_OK;
+}
+
+static void startWebSocketApi(httpd_config_t* config)
+{
+	for(int i = 0;i < CONFIG_WEB_THING_WS_MAX_CLIENTS;i++)
+		gWsClients[i].fd = -1;
+
+	config->close_fn = closeSocket;
+	if(gPushTimer == NULL)
+		gPushTimer = xTimerCreate("webthing_push",pdMS_TO_TICKS(CONFIG_WEB_THING_WS_PUSH_INTERVAL_MS),pdFALSE,NULL,pushTimerExpired);
+}
+#endif
+
+/* Sends the cached description of the thing , deflated if the client accepts it */
+static esp_err_t sendThingDescription(httpd_req_t *req,Thing* device)
+{
+	size_t len = 0;
+	const char* strRes = NULL;
+	char etag[ETAG_SIZE];
+	bool deflate = false;
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+	deflate = acceptsDeflate(req);
+#endif
+	formatETag(etag,'d',device->descriptionVersion,deflate);
+	if(matchesETag(req,etag))
+		return sendNotModified(req,etag);
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+#ifdef CONFIG_WEB_THING_DEFLATE_DESCRIPTION
+	httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+	if(deflate)
+	{
+		strRes = getThingDescriptionDeflated(device,&len);
+		if(strRes)
+		{
+			setETag(req,etag);
+			httpd_resp_set_hdr(req, "Content-Encoding", "deflate");
+			return respond(req, strRes, len);
+		}
+		formatETag(etag,'d',device->descriptionVersion,false);
+	}
+#endif
+
+	strRes = getThingDescription(device,&len);
+	if(!strRes)
+	{
+		httpd_resp_send_500(req);
+		return ESP_OK;
+	}
+	setETag(req,etag);
+	return respond(req, strRes, len);
+}
+
+/* 
+	Sends the array of the cached descriptions of all things. Its tag is the number of things
+	plus the sum of their description versions , which only grow , so an added thing or any
+	rebuilt description changes it.
+*/
+static esp_err_t sendThingList(httpd_req_t *req)
+{
+	char etag[ETAG_SIZE];
+	uint16_t count = thingCount();
+	uint32_t version = count;
+	for(uint16_t i = 0;i < count;i++)
+		version += gThings[i].thing->descriptionVersion;
+	formatETag(etag,'l',version,false);
+	if(matchesETag(req,etag))
+		return sendNotModified(req,etag);
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	setETag(req,etag);
+	for(uint16_t i = 0;i < count;i++)
+	{
+		size_t len = 0;
+		const char* description = getThingDescription(gThings[i].thing,&len);
+		if(description == NULL)
+		{
+			THING_LOGE(REST_TAG,"no description of %s",gThings[i].thing->id);
+			return ESP_FAIL;
+		}
+		if(respondChunk(req,i == 0 ? "[" : ",",1) != ESP_OK ||
+			respondChunk(req,description,len) != ESP_OK)
+			return ESP_FAIL;
+	}
+	if(respondChunk(req,count == 0 ? "[]" : "]",HTTPD_RESP_USE_STRLEN) != ESP_OK)
+		return ESP_FAIL;
+	return respondChunk(req,NULL,0);
+}
+
+static int sendJsonChunk(void* ctx,const char* buf,size_t len)
+{
+	return respondChunk((httpd_req_t*)ctx,buf,len);
+}
+
+/* Finishes a streamed response , returns ESP_FAIL to close the socket when sending failed */
+static esp_err_t endJsonResponse(httpd_req_t *req,JsonWriter* writer)
+{
+	if(!jsonWriterFinish(writer))
+	{
+		THING_LOGD(REST_TAG,"sending response failed");
+		return ESP_FAIL;
+	}
+	return respondChunk(req,NULL,0);
+}
+
+static esp_err_t sendPropertyValue(httpd_req_t *req,ThingProperty* property)
+{
+	JsonWriter writer;
+	char etag[ETAG_SIZE];
+	formatETag(etag,'p',getPropertyVersion(property),false);
+	if(req->method == HTTP_GET && matchesETag(req,etag))
+		return sendNotModified(req,etag);
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	setETag(req,etag);
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendJsonChunk,req);
+	jsonBeginObject(&writer);
+	writePropertyValue(&writer,property);
+	jsonEndObject(&writer);
+	return endJsonResponse(req,&writer);
+}
+
+/* Sends an error status with a short plain text reason */
+static esp_err_t sendError(httpd_req_t *req,const char* status,const char* message)
+{
+	httpd_resp_set_status(req, status);
+	httpd_resp_set_type(req, "text/plain");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	return respond(req, message, strlen(message));
+}
+
+// handlers run one at a time in the server task , so one body buffer is enough , plus
+// the terminating NUL
+static char gBody[CONFIG_WEB_THING_MAX_BODY_SIZE + 1];
+
+/* True if the request has no Content-Type or application/json , with or without parameters */
+static bool isJsonContentType(httpd_req_t *req)
+{
+	static const char json[] = "application/json";
+	char contentType[48];
+	if(httpd_req_get_hdr_value_len(req,"Content-Type") == 0)
+		return true;
+
+	// a longer value is truncated , which still leaves the media type to compare
+	if(httpd_req_get_hdr_value_str(req,"Content-Type",contentType,sizeof(contentType)) == ESP_ERR_NOT_FOUND)
+		return true;
+	const char* type = contentType;
+	while(*type == ' ' || *type == '\t')
+		type++;
+	if(strncasecmp(type,json,sizeof(json) - 1) != 0)
+		return false;
+	char next = type[sizeof(json) - 1];
+	return next == '\0' || next == ';' || next == ' ' || next == '\t';
+}
+
+/* 
+	Receives the body of a request into gBody , it is parsed in place from there. Bodies
+	which are too long or not JSON are refused before they are read. The body may arrive
+	in any number of pieces , a client that sends nothing for more than
+	CONFIG_WEB_THING_BODY_RECV_RETRIES receive timeouts in a row gets 408.
+	Returns ESP_FAIL if the socket has to be closed , otherwise ESP_OK with len set to 0
+	if an error response was already sent.
+*/
+static esp_err_t receiveBody(httpd_req_t *req,size_t* len)
+{
+	*len = 0;
+	if(req->content_len > CONFIG_WEB_THING_MAX_BODY_SIZE)
+	{
+		// closing is cheaper than reading and dropping the rest of the body
+		sendError(req,"413 Payload Too Large","body too large");
 		return ESP_FAIL;
 	}
+	if(!isJsonContentType(req))
+	{
+		sendError(req,"415 Unsupported Media Type","body must be application/json");
+		return ESP_OK;
+	}
+	if(req->content_len == 0)
+	{
+		recordParseFailure();
+		sendError(req,"400 Bad Request",THING_ERROR_INVALID_JSON);
+		return ESP_OK;
+	}
+
+	size_t received = 0;
+	int timeouts = 0;
+	while(received < req->content_len)
+	{
+		int ret = httpd_req_recv(req,gBody + received,req->content_len - received);
+		if(ret == HTTPD_SOCK_ERR_TIMEOUT && timeouts++ < CONFIG_WEB_THING_BODY_RECV_RETRIES)
+			continue;
+		if(ret <= 0)
+		{
+			// 0 means the client closed before the whole body arrived
+			if(ret == HTTPD_SOCK_ERR_TIMEOUT)
+				httpd_resp_send_408(req);
+			THING_LOGD(REST_TAG,"body ended after %u of %u bytes",(unsigned)received,(unsigned)req->content_len);
+			return ESP_FAIL;
+		}
+		received += ret;
+		timeouts = 0;
+	}
+	gBody[received] = '\0';
+	*len = received;
+	THING_TRACE(eTRACE_BODY_RECEIVED,received);
+	return ESP_OK;
+}
+
+/* Answers a refused property update , a busy property can be tried again */
+static esp_err_t sendUpdateError(httpd_req_t *req,const char* error)
+{
+	if(strcmp(error,THING_ERROR_INVALID_JSON) == 0)
+		recordParseFailure();
+	if(strcmp(error,THING_ERROR_BUSY) == 0)
+		return sendError(req,"503 Service Unavailable",error);
+	return sendError(req,"400 Bad Request",error);
+}
+
+/* Sets the property from the body and answers with its stored value */
+static esp_err_t putPropertyValue(httpd_req_t *req,ThingProperty* property)
+{
+	size_t len;
+	const char* error = NULL;
+	esp_err_t resCode = receiveBody(req,&len);
+	if(len == 0)
+		return resCode;
 
+	if(update_thing_property_json(property,gBody,len,&error))
+		return sendPropertyValue(req,property);
 
+	THING_LOGD(REST_TAG,"%s: %s",property->key,error);
+	return sendUpdateError(req,error);
+}
+
+/* Streams the values of all properties of the thing as one object */
+static esp_err_t sendAllProperties(httpd_req_t *req,Thing* thing)
+{
+	JsonWriter writer;
+	char etag[ETAG_SIZE];
+	formatETag(etag,'v',getThingVersion(thing),false);
+	if(req->method == HTTP_GET && matchesETag(req,etag))
+		return sendNotModified(req,etag);
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	setETag(req,etag);
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendJsonChunk,req);
+	jsonBeginObject(&writer);
     ThingProperty* property = thing->property;
-    responseJson = cJSON_CreateObject();
 	while (property != NULL) 
 	{
-		serialise_property_item(property,responseJson);
+		writePropertyValue(&writer,property);
 		property = (ThingProperty*)property->next;
 	}
-	const char* strRes = cJSON_Print(responseJson);
+	jsonEndObject(&writer);
+	return endJsonResponse(req,&writer);
+}
+
+/* Sets several properties from one object and answers with the resulting state of all of them */
+static esp_err_t putAllProperties(httpd_req_t *req,Thing* thing)
+{
+	size_t len;
+	const char* error = NULL;
+	esp_err_t resCode = receiveBody(req,&len);
+	if(len == 0)
+		return resCode;
+
+	if(update_thing_properties_json(thing,gBody,len,&error))
+		return sendAllProperties(req,thing);
+	return sendUpdateError(req,error);
+}
+
+/* Streams the kept action requests , of one action unless filter is NULL */
+static esp_err_t sendActionLog(httpd_req_t *req,Thing* thing,ThingAction* filter)
+{
+	JsonWriter writer;
 	httpd_resp_set_type(req, "application/json");
 	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-	httpd_resp_send(req, strRes, strlen(strRes));
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendJsonChunk,req);
+	writeActionLog(&writer,thing,filter);
+	return endJsonResponse(req,&writer);
+}
 
-	//cleanup
-	free(strRes);
-	cJSON_Delete(responseJson);
-	
-    return ESP_OK;
+static esp_err_t sendActionRequest(httpd_req_t *req,Thing* thing,ThingAction* action,uint32_t id)
+{
+	JsonWriter writer;
+	ThingActionRequest request;
+	if(!getActionRequest(thing,id,&request) || request.action != action)
+		return httpd_resp_send_404(req);
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendJsonChunk,req);
+	writeActionRequest(&writer,&request);
+	return endJsonResponse(req,&writer);
+}
+
+/* Queues the action request in the body and answers with it , of the one action unless action is NULL */
+static esp_err_t postAction(httpd_req_t *req,Thing* thing,ThingAction* action)
+{
+	size_t len;
+	const char* error = NULL;
+	esp_err_t resCode = receiveBody(req,&len);
+	if(len == 0)
+		return resCode;
+
+	cJSON* body = cJSON_Parse(gBody);
+	uint32_t id = body ? requestActionJson(thing,action,body,&error) : 0;
+	if(body)
+		cJSON_Delete(body);
+	if(id == 0)
+	{
+		if(body == NULL)
+		{
+			recordParseFailure();
+			return sendError(req,"400 Bad Request",THING_ERROR_INVALID_JSON);
+		}
+		THING_LOGD(REST_TAG,"action request refused: %s",error);
+		if(strcmp(error,ACTION_ERROR_BUSY) == 0)
+			return sendError(req,"503 Service Unavailable",error);
+		return sendError(req,"400 Bad Request",error);
+	}
+
+	JsonWriter writer;
+	ThingActionRequest request;
+	if(!getActionRequest(thing,id,&request))
+	{
+		// only with more requests in between than the log keeps
+		httpd_resp_set_status(req, "202 Accepted");
+		httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+		return respond(req, NULL, 0);
+	}
+	httpd_resp_set_status(req, "201 Created");
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendJsonChunk,req);
+	writeActionRequest(&writer,&request);
+	return endJsonResponse(req,&writer);
 }
 
-void startRestAPIServer(Thing* thing)
+/* Streams the logged events , of one event unless filter is NULL */
+static esp_err_t sendEventLog(httpd_req_t *req,Thing* thing,ThingEvent* filter)
+{
+	JsonWriter writer;
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendJsonChunk,req);
+	writeEventLog(&writer,thing,filter);
+	return endJsonResponse(req,&writer);
+}
+
+/*
+	Everything below "/things/" goes through one wildcard handler per method , the thing
+	is looked up by its id and the property , action or event in the lists of the thing.
+	So the handler table does not grow with the number of things or properties and no URI
+	has to be matched per property.
+*/
+typedef enum ThingRoute
+{
+	eROUTE_NONE,			// nothing there , 404
+	eROUTE_THING,			// <thing>
+	eROUTE_PROPERTIES,		// <thing>/properties
+	eROUTE_PROPERTY,		// <thing>/properties/<key>
+	eROUTE_ACTIONS,			// <thing>/actions
+	eROUTE_ACTION,			// <thing>/actions/<name>
+	eROUTE_ACTION_REQUEST,	// <thing>/actions/<name>/<id>
+	eROUTE_EVENTS,			// <thing>/events
+	eROUTE_EVENT			// <thing>/events/<name>
+}ThingRoute;
+
+typedef struct ThingTarget
+{
+	ThingProperty* property;
+	ThingAction* action;
+	ThingEvent* event;
+	uint32_t id;
+}ThingTarget;
+
+/* Takes "/<segment>" off the front of the path , false if the path does not start with it */
+static bool takeSegment(const char** path,size_t* len,const char* segment)
+{
+	size_t segmentLen = strlen(segment);
+	if(*len < segmentLen + 1 || (*path)[0] != '/' || strncmp(*path + 1,segment,segmentLen) != 0)
+		return false;
+	if(*len > segmentLen + 1 && (*path)[segmentLen + 1] != '/')
+		return false;
+	*path += segmentLen + 1;
+	*len -= segmentLen + 1;
+	return true;
+}
+
+/* Length of the segment after the leading '/' */
+static size_t segmentLength(const char* path,size_t len)
+{
+	size_t n = 1;
+	while(n < len && path[n] != '/')
+		n++;
+	return n - 1;
+}
+
+/* Reads the id of an action request , 0 if it is not a number up to 4294967295 */
+static uint32_t parseRequestId(const char* text,size_t len)
+{
+	uint64_t id = 0;
+	if(len == 0 || len > 10 || text[0] == '0')
+		return 0;
+	for(size_t i = 0;i < len;i++)
+	{
+		if(text[i] < '0' || text[i] > '9')
+			return 0;
+		id = id * 10 + (text[i] - '0');
+	}
+	return id > UINT32_MAX ? 0 : (uint32_t)id;
+}
+
+/* The thing of a URI below "/things/" , NULL if there is no thing with the id */
+static Thing* findUrlThing(httpd_req_t *req)
+{
+	const char* id = req->uri + strlen("/things/");
+	AdapterThing* entry = findAdapterThing(id,strcspn(id,"/?"));
+	return entry ? entry->thing : NULL;
+}
+
+static ThingRoute routeThingUrl(httpd_req_t *req,Thing* thing,ThingTarget* target)
+{
+	// the id matched the thing URL up to here , the query is ignored like httpd does
+	const char* path = req->uri + strlen(thing->href);
+	size_t len = strcspn(path,"?");
+	size_t nameLen;
+	memset(target,0,sizeof(ThingTarget));
+
+	if(len == 0)
+		return eROUTE_THING;
+	if(takeSegment(&path,&len,"properties"))
+	{
+		if(len == 0)
+			return eROUTE_PROPERTIES;
+		target->property = findPropertyN(thing,path + 1,len - 1);
+		return target->property ? eROUTE_PROPERTY : eROUTE_NONE;
+	}
+	if(thing->action && takeSegment(&path,&len,"actions"))
+	{
+		if(len == 0)
+			return eROUTE_ACTIONS;
+		nameLen = segmentLength(path,len);
+		target->action = findAction(thing,path + 1,nameLen);
+		if(target->action == NULL)
+			return eROUTE_NONE;
+		path += nameLen + 1;
+		len -= nameLen + 1;
+		if(len == 0)
+			return eROUTE_ACTION;
+		target->id = parseRequestId(path + 1,len - 1);
+		return target->id ? eROUTE_ACTION_REQUEST : eROUTE_NONE;
+	}
+	if(thing->event && takeSegment(&path,&len,"events"))
+	{
+		if(len == 0)
+			return eROUTE_EVENTS;
+		target->event = findEvent(thing,path + 1,len - 1);
+		return target->event ? eROUTE_EVENT : eROUTE_NONE;
+	}
+	return eROUTE_NONE;
+}
+
+static esp_err_t serveThingGet(httpd_req_t *req,ThingMetricRoute* metric)
+{
+	Thing* thing = findUrlThing(req);
+	ThingTarget target;
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+	// frame on an established WebSocket , it carries no URI
+	if(req->method != HTTP_GET)
+	{
+		*metric = eMETRIC_WEBSOCKET;
+		return handleWsMessage(req);
+	}
+#endif
+	if(thing == NULL)
+		return httpd_resp_send_404(req);
+
+	ThingRoute route = routeThingUrl(req,thing,&target);
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+	// the handshake was answered by httpd , from now on the socket gets the messages of the thing
+	if(httpd_req_get_hdr_value_len(req,"Upgrade") > 0)
+	{
+		if(route != eROUTE_THING)
+			return ESP_FAIL;
+		*metric = eMETRIC_WEBSOCKET;
+		addWsClient(httpd_req_to_sockfd(req),thing);
+		return ESP_OK;
+	}
+#endif
+	switch(route)
+	{
+		case eROUTE_THING:
+			*metric = eMETRIC_THING;
+			return sendThingDescription(req,thing);
+		case eROUTE_PROPERTIES:
+			*metric = eMETRIC_PROPERTIES_GET;
+			return sendAllProperties(req,thing);
+		case eROUTE_PROPERTY:
+			*metric = eMETRIC_PROPERTY_GET;
+			return sendPropertyValue(req,target.property);
+		case eROUTE_ACTIONS:
+			*metric = eMETRIC_ACTIONS_GET;
+			return sendActionLog(req,thing,NULL);
+		case eROUTE_ACTION:
+			*metric = eMETRIC_ACTIONS_GET;
+			return sendActionLog(req,thing,target.action);
+		case eROUTE_ACTION_REQUEST:
+			*metric = eMETRIC_ACTIONS_GET;
+			return sendActionRequest(req,thing,target.action,target.id);
+		case eROUTE_EVENTS:
+			*metric = eMETRIC_EVENTS_GET;
+			return sendEventLog(req,thing,NULL);
+		case eROUTE_EVENT:
+			*metric = eMETRIC_EVENTS_GET;
+			return sendEventLog(req,thing,target.event);
+		default:
+			return httpd_resp_send_404(req);
+	}
+}
+
+static esp_err_t serveThingPut(httpd_req_t *req,ThingMetricRoute* metric)
+{
+	Thing* thing = findUrlThing(req);
+	ThingTarget target;
+	if(thing == NULL)
+		return httpd_resp_send_404(req);
+	switch(routeThingUrl(req,thing,&target))
+	{
+		case eROUTE_PROPERTIES:
+			*metric = eMETRIC_PROPERTIES_PUT;
+			return putAllProperties(req,thing);
+		case eROUTE_PROPERTY:
+			if(target.property->info.readOnly)
+				return sendError(req,"405 Method Not Allowed","read only property");
+			*metric = eMETRIC_PROPERTY_PUT;
+			return putPropertyValue(req,target.property);
+		case eROUTE_NONE:
+			return httpd_resp_send_404(req);
+		default:
+			return sendError(req,"405 Method Not Allowed","method not allowed");
+	}
+}
+
+static esp_err_t serveThingPost(httpd_req_t *req,ThingMetricRoute* metric)
+{
+	Thing* thing = findUrlThing(req);
+	ThingTarget target;
+	if(thing == NULL)
+		return httpd_resp_send_404(req);
+	switch(routeThingUrl(req,thing,&target))
+	{
+		case eROUTE_ACTIONS:
+			*metric = eMETRIC_ACTIONS_POST;
+			return postAction(req,thing,NULL);
+		case eROUTE_ACTION:
+			*metric = eMETRIC_ACTIONS_POST;
+			return postAction(req,thing,target.action);
+		case eROUTE_NONE:
+			return httpd_resp_send_404(req);
+		default:
+			return sendError(req,"405 Method Not Allowed","method not allowed");
+	}
+}
+
+static esp_err_t serveThingDelete(httpd_req_t *req,ThingMetricRoute* metric)
+{
+	Thing* thing = findUrlThing(req);
+	ThingTarget target;
+	ThingActionRequest request;
+	if(thing == NULL)
+		return httpd_resp_send_404(req);
+	switch(routeThingUrl(req,thing,&target))
+	{
+		case eROUTE_ACTION_REQUEST:
+			*metric = eMETRIC_ACTIONS_DELETE;
+			if(!getActionRequest(thing,target.id,&request) || request.action != target.action ||
+				!cancelAction(thing,target.id))
+				return httpd_resp_send_404(req);
+			httpd_resp_set_status(req, "204 No Content");
+			httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+			return respond(req, NULL, 0);
+		case eROUTE_NONE:
+			return httpd_resp_send_404(req);
+		default:
+			return sendError(req,"405 Method Not Allowed","method not allowed");
+	}
+}
+
+static esp_err_t serveRoot(httpd_req_t *req,ThingMetricRoute* metric)
+{
+	*metric = eMETRIC_ROOT;
+	if(thingCount() == 1)
+		return sendThingDescription(req,gThings[0].thing);
+	return sendThingList(req);
+}
+
+#ifdef CONFIG_WEB_THING_METRICS
+/* GET /metrics , the counters of web_thing_metrics.c and the sockets of the server */
+static esp_err_t serveMetrics(httpd_req_t *req,ThingMetricRoute* metric)
+{
+	JsonWriter writer;
+	int clients[gMaxSockets];
+	size_t open = gMaxSockets;
+	*metric = eMETRIC_METRICS;
+	if(httpd_get_client_list(gServer,&open,clients) != ESP_OK)
+		open = 0;
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	jsonWriterInit(&writer,JSON_WRITER_FORMAT,sendJsonChunk,req);
+	jsonBeginObject(&writer);
+	writeThingMetrics(&writer);
+	jsonKey(&writer,"sockets");
+	jsonBeginObject(&writer);
+	jsonKey(&writer,"open");
+	jsonNumber(&writer,open);
+	jsonKey(&writer,"max");
+	jsonNumber(&writer,gMaxSockets);
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+	jsonKey(&writer,"subscribers");
+	jsonNumber(&writer,countWsClients());
+#endif
+	jsonEndObject(&writer);
+	jsonEndObject(&writer);
+	return endJsonResponse(req,&writer);
+}
+
+esp_err_t handleMetrics(httpd_req_t *req)
+{
+	return countRequest(req,serveMetrics);
+}
+#endif
+
+esp_err_t handleGetRoot(httpd_req_t *req)
+{
+	return countRequest(req,serveRoot);
+}
+
+esp_err_t handleThingGet(httpd_req_t *req)
+{
+	return countRequest(req,serveThingGet);
+}
+
+esp_err_t handleThingPut(httpd_req_t *req)
+{
+	return countRequest(req,serveThingPut);
+}
+
+esp_err_t handleThingPost(httpd_req_t *req)
+{
+	return countRequest(req,serveThingPost);
+}
+
+esp_err_t handleThingDelete(httpd_req_t *req)
+{
+	return countRequest(req,serveThingDelete);
+}
+
+/* The wildcards for POST and DELETE , once the first thing with actions is served */
+static bool gActionHandlers = false;
+
+static void registerActionHandlers(httpd_handle_t server)
+{
+	if(gActionHandlers)
+		return;
+	gActionHandlers = true;
+
+	httpd_uri_t request_handle = {0};
+	request_handle.uri = "/things/*";
+	request_handle.method = HTTP_POST;
+	request_handle.handler = handleThingPost;
+	httpd_register_uri_handler(server, &request_handle);
+
+	request_handle.method = HTTP_DELETE;
+	request_handle.handler = handleThingDelete;
+	httpd_register_uri_handler(server, &request_handle);
+}
+
+void startRestAPIServer()
 {
 	httpd_handle_t server = NULL;
 	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+	bool hasActions = false;
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+	startWebSocketApi(&config);
+#endif
 
 	/*
-	 	3 handles for "/","/things" and "/things/properties" 
-		2 handlers for each property one GET and one PUT 
-		We are considering max 3 properties , so MAX_URI_HANDLERS = 3+ 2*<MAX_NUMBER_OF_PROPERTIES> 
-		you can increase this depending upon your usecase 
+		3 handlers , "/" and a wildcard for GET and PUT below "/things/" , however many things
+		and properties there are , a wildcard for POST and DELETE if a thing has actions and
+		"/metrics" with CONFIG_WEB_THING_METRICS. The remaining slots of the default table are
+		left for handlers of the application.
 	*/
-	config.max_uri_handlers = CONFIG_MAX_PROPERTY*2 + 3;
+	config.uri_match_fn = httpd_uri_match_wildcard;
 	config.server_port = CONFIG_WEB_THING_PORT;
+	gMaxSockets = config.max_open_sockets;
 
-	ESP_LOGI(REST_TAG, "Starting webthing Server");
+	THING_LOGI(REST_TAG, "Starting webthing Server");
 	
 	if(httpd_start(&server, &config) != ESP_OK)
 	{
-		ESP_LOGI(REST_TAG,"server start failed!");
+		THING_LOGI(REST_TAG,"server start failed!");
 		return;
 	}
+	gServer = server;
 
-	/* URI handler for fetching system info */
 	httpd_uri_t system_info_get_uri = {
 		.uri = "/",
 		.method = HTTP_GET,
-		.handler = handleGetThing,
-		.user_ctx = thing
+		.handler = handleGetRoot,
+		.user_ctx = NULL
 	};
 	httpd_register_uri_handler(server, &system_info_get_uri);
-
-	char* thingDescriptionUrl = getThingDescriptionUrl(thing);
-	system_info_get_uri.uri = thingDescriptionUrl;
-	system_info_get_uri.method = HTTP_GET;
-	system_info_get_uri.handler = handleGetThing;
-	system_info_get_uri.user_ctx = thing;
+#ifdef CONFIG_WEB_THING_METRICS
+	system_info_get_uri.uri = "/metrics";
+	system_info_get_uri.handler = handleMetrics;
 	httpd_register_uri_handler(server, &system_info_get_uri);
+#endif
 
-    ThingProperty* property = thing->property;
-    httpd_uri_t request_handle;
-	while (property != NULL) 
-	{
-		char* propUri = getPropertyEndpointUrl(thing,property);
-		ESP_LOGI(REST_TAG,"url:%s",propUri);
-		request_handle.uri = propUri;
-		request_handle.method = HTTP_GET;
-		request_handle.handler = handleThingGetItem;
-		request_handle.user_ctx = property;
-		httpd_register_uri_handler(server, &request_handle);
-
-		if(!property->info.readOnly)
-		{
-			request_handle.uri = propUri;
-			request_handle.method = HTTP_PUT;
-			request_handle.handler = handleThingPutItem;
-			request_handle.user_ctx = property;
-			httpd_register_uri_handler(server, &request_handle);	
-		}
-		
-		if(propUri)
-		{
-			free(propUri);
-			propUri = NULL;
-		}
-		property = (ThingProperty*)property->next;
-	}
-
-	// request_handle.uri ="/things/properties";
-	char* thingPropertiesUrl = (char*) malloc(sizeof(char)*(strlen(thingDescriptionUrl)+strlen("/properties")+1));
-	sprintf(thingPropertiesUrl,"%s/properties",thingDescriptionUrl); 
-
-	request_handle.uri = thingPropertiesUrl;
+	httpd_uri_t request_handle = {0};
+	request_handle.uri = "/things/*";
 	request_handle.method = HTTP_GET;
-	request_handle.handler = handleThingGetAllProperties;
-	request_handle.user_ctx = thing;
+	request_handle.handler = handleThingGet;
+#ifdef CONFIG_WEB_THING_WEBSOCKET
+	request_handle.is_websocket = true;
+#endif
 	httpd_register_uri_handler(server, &request_handle);
 
-	if(thingPropertiesUrl)
-		free(thingPropertiesUrl);
-
-	if(thingDescriptionUrl)
-		free(thingDescriptionUrl);
+	request_handle.is_websocket = false;
+	request_handle.method = HTTP_PUT;
+	request_handle.handler = handleThingPut;
+	httpd_register_uri_handler(server, &request_handle);
 
+	gActionHandlers = false;
+	for(uint16_t i = 0;i < gThingCount;i++)
+		hasActions |= gThings[i].thing->action != NULL;
+	if(hasActions)
+		registerActionHandlers(server);
 }
 
 void initAdapter(Thing* thing)
 {
-	gThing = thing;
-	initialise_mdns(gThing->title);
+	static bool mdnsStarted = false;
+	gThingCount = 0;
+	memset(gThingIndex,0,sizeof(gThingIndex));
+	addThing(thing);
+	if(!mdnsStarted)
+		initialise_mdns(thing->title);
+	mdnsStarted = true;
 }
 
 void startAdapter()
 {
-	startRestAPIServer(gThing);
+	while(gBootTag == 0)
+		gBootTag = esp_random();
+	startCallbackTask();
+	startActionTask();
+	startRestAPIServer();
 }
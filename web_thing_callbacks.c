@@ -0,0 +1,167 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "web_thing_callbacks.h"
+#include "web_thing_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#ifdef CONFIG_WEB_THING_ASYNC_CALLBACKS
+static const char* TAG = "web_thing_callbacks";
+
+typedef struct CallbackEvent
+{
+	ThingProperty* property;
+	int64_t queuedAt;
+}CallbackEvent;
+
+static StaticQueue_t gQueueBuffer;
+static uint8_t gQueueStorage[CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH * sizeof(CallbackEvent)];
+static QueueHandle_t gQueue = NULL;
+static ThingCallbackStats gStats;
+static uint32_t gPending;	// events queued and not yet dispatched or dropped
+
+static void raiseMax(uint32_t* max,uint32_t value)
+{
+	uint32_t seen = __atomic_load_n(max,__ATOMIC_RELAXED);
+	while(value > seen && !__atomic_compare_exchange_n(max,&seen,value,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+}
+
+static void callbackTask(void* arg)
+{
+	CallbackEvent event;
+	for(;;)
+	{
+		if(xQueueReceive(gQueue,&event,portMAX_DELAY) != pdPASS)
+			continue;
+
+		int64_t start = esp_timer_get_time();
+		runPropertyCallback(event.property);
+		int64_t end = esp_timer_get_time();
+
+		raiseMax(&gStats.maxWaitUs,(uint32_t)(start - event.queuedAt));
+		raiseMax(&gStats.maxRunUs,(uint32_t)(end - start));
+		__atomic_add_fetch(&gStats.totalWaitUs,(uint64_t)(start - event.queuedAt),__ATOMIC_RELAXED);
+		__atomic_add_fetch(&gStats.dispatched,1,__ATOMIC_RELAXED);
+		__atomic_sub_fetch(&gPending,1,__ATOMIC_RELEASE);
+	}
+}
+
+bool startCallbackTask()
+{
+	if(gQueue)
+		return true;
+
+	gQueue = xQueueCreateStatic(CONFIG_WEB_THING_CALLBACK_QUEUE_DEPTH,sizeof(CallbackEvent),gQueueStorage,&gQueueBuffer);
+	if(xTaskCreate(callbackTask,"thing_callbacks",CONFIG_WEB_THING_CALLBACK_TASK_STACK,NULL,
+		CONFIG_WEB_THING_CALLBACK_TASK_PRIORITY,NULL) != pdPASS)
+	{
+		THING_LOGE(TAG,"could not start the callback task");
+		gQueue = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool queuePropertyCallback(ThingProperty* _property)
+{
+	if(gQueue == NULL)
+		return false;
+
+	CallbackEvent event = {_property,esp_timer_get_time()};
+	__atomic_add_fetch(&gPending,1,__ATOMIC_RELAXED);
+	if(xQueueSend(gQueue,&event,0) != pdPASS)
+	{
+#ifdef CONFIG_WEB_THING_CALLBACK_DROP_OLDEST
+		CallbackEvent oldest;
+		if(xQueueReceive(gQueue,&oldest,0) == pdPASS)
+		{
+			__atomic_sub_fetch(&gPending,1,__ATOMIC_RELEASE);
+			__atomic_add_fetch(&gStats.dropped,1,__ATOMIC_RELAXED);
+			THING_LOGW(TAG,"queue full , dropped the callback of %s",oldest.property->key);
+		}
+		if(xQueueSend(gQueue,&event,0) != pdPASS)
+#endif
+		{
+			__atomic_sub_fetch(&gPending,1,__ATOMIC_RELEASE);
+			__atomic_add_fetch(&gStats.dropped,1,__ATOMIC_RELAXED);
+			THING_LOGW(TAG,"queue full , dropped the callback of %s",_property->key);
+			return true;
+		}
+	}
+	__atomic_add_fetch(&gStats.queued,1,__ATOMIC_RELAXED);
+
+	uint16_t waiting = uxQueueMessagesWaiting(gQueue);
+	uint16_t seen = __atomic_load_n(&gStats.highWater,__ATOMIC_RELAXED);
+	while(waiting > seen && !__atomic_compare_exchange_n(&gStats.highWater,&seen,waiting,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+	return true;
+}
+
+bool waitPropertyCallbacks(uint32_t _timeoutMs)
+{
+	int64_t deadline = esp_timer_get_time() + (int64_t)_timeoutMs * 1000;
+	while(__atomic_load_n(&gPending,__ATOMIC_ACQUIRE) != 0)
+	{
+		if(esp_timer_get_time() >= deadline)
+			return false;
+		vTaskDelay(1);
+	}
+	return true;
+}
+
+void getThingCallbackStats(ThingCallbackStats* stats)
+{
+	stats->queued = __atomic_load_n(&gStats.queued,__ATOMIC_RELAXED);
+	stats->dispatched = __atomic_load_n(&gStats.dispatched,__ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&gStats.dropped,__ATOMIC_RELAXED);
+	stats->waiting = gQueue ? uxQueueMessagesWaiting(gQueue) : 0;
+	stats->highWater = __atomic_load_n(&gStats.highWater,__ATOMIC_RELAXED);
+	stats->maxWaitUs = __atomic_load_n(&gStats.maxWaitUs,__ATOMIC_RELAXED);
+	stats->totalWaitUs = __atomic_load_n(&gStats.totalWaitUs,__ATOMIC_RELAXED);
+	stats->maxRunUs = __atomic_load_n(&gStats.maxRunUs,__ATOMIC_RELAXED);
+}
+
+#else
+
+bool startCallbackTask()
+{
+	return true;
+}
+
+bool queuePropertyCallback(ThingProperty* _property)
+{
+	return false;
+}
+
+bool waitPropertyCallbacks(uint32_t _timeoutMs)
+{
+	return true;
+}
+
+void getThingCallbackStats(ThingCallbackStats* stats)
+{
+	memset(stats,0,sizeof(ThingCallbackStats));
+}
+#endif
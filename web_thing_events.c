@@ -0,0 +1,329 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "web_thing_events.h"
+#include "web_thing_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char* TAG = "web_thing_events";
+
+struct ThingEventLog
+{
+	ThingEventRecord records[CONFIG_WEB_THING_EVENT_LOG_SIZE];	// event seq is at (seq - 1) % size
+	uint32_t last;			// seq of the newest event , 0 before the first
+	uint32_t overwritten;
+};
+
+// emitters copy one record in and readers one record out , nobody waits for long
+static StaticSemaphore_t gEventLockBuffer;
+static SemaphoreHandle_t gEventLock = NULL;
+
+ThingEvent* createEvent(const char* _name,const char* _title,ThingPropertyValueType _valueType)
+{
+	if(_name == NULL || !isValidThingKey(_name))
+	{
+		THING_LOGE(TAG,"event name is not a valid URL segment");
+		return NULL;
+	}
+	ThingEvent* event = thingAlloc(sizeof(ThingEvent));
+	if(event == NULL)
+	{
+		THING_LOGE(TAG,"No memory for event");
+		return NULL;
+	}
+	event->name = thingStrdup(_name);
+	event->title = _title ? thingStrdup(_title) : NULL;
+	if(event->name == NULL || (_title && event->title == NULL))
+	{
+		THING_LOGE(TAG,"No memory for event %s",_name);
+		thingFree(event->name);
+		thingFree(event->title);
+		thingFree(event);
+		return NULL;
+	}
+	event->description = NULL;
+	event->valueType = _valueType;
+	event->href = NULL;
+	event->next = NULL;
+	event->thing = NULL;
+
+	if(gEventLock == NULL)
+		gEventLock = xSemaphoreCreateMutexStatic(&gEventLockBuffer);
+	return event;
+}
+
+void addEvent(Thing* _thing,ThingEvent* _event)
+{
+	if(_thing == NULL || _event == NULL)
+		return;
+	if(findEvent(_thing,_event->name,strlen(_event->name)) != NULL)
+	{
+		THING_LOGE(TAG,"event %s is added twice",_event->name);
+		return;
+	}
+
+	if(_thing->eventLog == NULL)
+	{
+		_thing->eventsHref = thingAlloc(strlen(_thing->href)+strlen("/events")+1);
+		_thing->eventLog = thingAlloc(sizeof(ThingEventLog));
+		if(_thing->eventsHref == NULL || _thing->eventLog == NULL)
+		{
+			THING_LOGE(TAG,"No memory for the event log");
+			return;
+		}
+		sprintf(_thing->eventsHref,"%s/events",_thing->href);
+		memset(_thing->eventLog,0,sizeof(ThingEventLog));
+	}
+
+	_event->href = thingAlloc(strlen(_thing->eventsHref)+1+strlen(_event->name)+1);
+	if(_event->href == NULL)
+	{
+		THING_LOGE(TAG,"No memory for event URL");
+		return;
+	}
+	sprintf(_event->href,"%s/%s",_thing->eventsHref,_event->name);
+	_event->thing = _thing;
+
+	ThingEvent** tail = &_thing->event;
+	while(*tail)
+		tail = &(*tail)->next;
+	*tail = _event;
+	invalidateThingDescription(_thing);
+}
+
+ThingEvent* findEvent(Thing* _thing,const char* _name,size_t _len)
+{
+	for(ThingEvent* event = _thing->event;event;event = event->next)
+	{
+		if(strncmp(event->name,_name,_len) == 0 && event->name[_len] == '\0')
+			return event;
+	}
+	return NULL;
+}
+
+bool emitEvent(ThingEvent* _event,ThingPropertyValue _data)
+{
+	if(_event == NULL || _event->thing == NULL || _event->thing->eventLog == NULL)
+		return false;
+
+	Thing* thing = _event->thing;
+	ThingEventLog* log = thing->eventLog;
+	xSemaphoreTake(gEventLock,portMAX_DELAY);
+	uint32_t seq = log->last + 1;
+	ThingEventRecord* record = &log->records[(seq - 1) % CONFIG_WEB_THING_EVENT_LOG_SIZE];
+	if(record->seq != 0)
+		log->overwritten++;
+	record->event = _event;
+	record->seq = seq;
+	record->timestamp = time(NULL);
+	record->data = _data;
+	if(_event->valueType == STRING)
+	{
+		strncpy(record->string,_data.string ? _data.string : "",sizeof(record->string) - 1);
+		record->string[sizeof(record->string) - 1] = '\0';
+		record->data.string = record->string;
+	}
+	log->last = seq;
+	xSemaphoreGive(gEventLock);
+
+	if(thing->propertyChanged)
+		thing->propertyChanged(thing);
+	return true;
+}
+
+void getThingEventStats(Thing* _thing,ThingEventStats* _stats)
+{
+	memset(_stats,0,sizeof(ThingEventStats));
+	if(_thing->eventLog == NULL)
+		return;
+	xSemaphoreTake(gEventLock,portMAX_DELAY);
+	_stats->emitted = _thing->eventLog->last;
+	_stats->overwritten = _thing->eventLog->overwritten;
+	_stats->stored = _stats->emitted - _stats->overwritten;
+	xSemaphoreGive(gEventLock);
+}
+
+/* Copies the event seq out of the log , false if it was overwritten or not emitted yet */
+static bool copyEventRecord(ThingEventLog* log,uint32_t seq,ThingEventRecord* copy)
+{
+	xSemaphoreTake(gEventLock,portMAX_DELAY);
+	const ThingEventRecord* record = &log->records[(seq - 1) % CONFIG_WEB_THING_EVENT_LOG_SIZE];
+	bool found = record->seq == seq;
+	if(found)
+	{
+		*copy = *record;
+		if(copy->event->valueType == STRING)
+			copy->data.string = copy->string;
+	}
+	xSemaphoreGive(gEventLock);
+	return found;
+}
+
+static uint32_t lastEventSeq(ThingEventLog* log)
+{
+	xSemaphoreTake(gEventLock,portMAX_DELAY);
+	uint32_t last = log->last;
+	xSemaphoreGive(gEventLock);
+	return last;
+}
+
+uint16_t takeNewEvents(Thing* thing,uint32_t* cursor,EventVisit_cb visit,void* ctx)
+{
+	ThingEventRecord record;
+	uint16_t count = 0;
+	if(thing->eventLog == NULL)
+		return 0;
+
+	// records are copied one at a time , emitters never wait for a client. A cursor which
+	// fell behind skips the overwritten records without looking at them
+	uint32_t last = lastEventSeq(thing->eventLog);
+	uint32_t first = last > CONFIG_WEB_THING_EVENT_LOG_SIZE ? last - CONFIG_WEB_THING_EVENT_LOG_SIZE + 1 : 1;
+	if(first < *cursor + 1)
+		first = *cursor + 1;
+	for(uint32_t seq = first;seq <= last;seq++)
+	{
+		if(copyEventRecord(thing->eventLog,seq,&record))
+		{
+			visit(&record,ctx);
+			count++;
+		}
+	}
+	*cursor = last;
+	return count;
+}
+
+void writeEventRecord(JsonWriter* w,const ThingEventRecord* record)
+{
+	jsonBeginObject(w);
+	jsonKey(w,record->event->name);
+	jsonBeginObject(w);
+	if(record->event->valueType != NO_STATE)
+	{
+		jsonKey(w,"data");
+		writeThingValue(w,record->event->valueType,record->data);
+	}
+	jsonKey(w,"timestamp");
+	writeThingTime(w,record->timestamp);
+	jsonEndObject(w);
+	jsonEndObject(w);
+}
+
+void writeEventLog(JsonWriter* w,Thing* thing,ThingEvent* filter)
+{
+	ThingEventRecord record;
+	jsonBeginArray(w);
+	if(thing->eventLog)
+	{
+		uint32_t last = lastEventSeq(thing->eventLog);
+		uint32_t first = last > CONFIG_WEB_THING_EVENT_LOG_SIZE ? last - CONFIG_WEB_THING_EVENT_LOG_SIZE + 1 : 1;
+		for(uint32_t seq = first;seq <= last;seq++)
+		{
+			if(copyEventRecord(thing->eventLog,seq,&record) && (filter == NULL || record.event == filter))
+				writeEventRecord(w,&record);
+		}
+	}
+	jsonEndArray(w);
+}
+
+void writeEventsDescription(JsonWriter* w,Thing* thing)
+{
+	if(thing->event == NULL)
+		return;
+
+	jsonKey(w,"events");
+	jsonBeginObject(w);
+	for(ThingEvent* event = thing->event;event;event = event->next)
+	{
+		jsonKey(w,event->name);
+		jsonBeginObject(w);
+		if(event->title)
+		{
+			jsonKey(w,"title");
+			jsonString(w,event->title);
+		}
+		if(event->description)
+		{
+			jsonKey(w,"description");
+			jsonString(w,event->description);
+		}
+		if(valueTypeToStr(event->valueType))
+		{
+			jsonKey(w,"type");
+			jsonString(w,valueTypeToStr(event->valueType));
+		}
+		jsonKey(w,"links");
+		jsonBeginArray(w);
+		jsonBeginObject(w);
+		jsonKey(w,"href");
+		jsonString(w,event->href);
+		jsonEndObject(w);
+		jsonEndArray(w);
+		jsonEndObject(w);
+	}
+	jsonEndObject(w);
+}
+
+void serializeEvents(Thing* thing,cJSON* deviceJson)
+{
+	if(thing->event == NULL)
+		return;
+
+	cJSON* eventsJson = cJSON_CreateObject();
+	for(ThingEvent* event = thing->event;event;event = event->next)
+	{
+		cJSON* eventJson = cJSON_CreateObject();
+		if(event->title)
+			cJSON_AddStringToObject(eventJson,"title",event->title);
+		if(event->description)
+			cJSON_AddStringToObject(eventJson,"description",event->description);
+		if(valueTypeToStr(event->valueType))
+			cJSON_AddStringToObject(eventJson,"type",valueTypeToStr(event->valueType));
+		cJSON* links = cJSON_CreateArray();
+		cJSON* href = cJSON_CreateObject();
+		cJSON_AddStringToObject(href,"href",event->href);
+		cJSON_AddItemToArray(links,href);
+		cJSON_AddItemToObject(eventJson,"links",links);
+		cJSON_AddItemToObject(eventsJson,event->name,eventJson);
+	}
+	cJSON_AddItemToObject(deviceJson,"events",eventsJson);
+}
+
+void cleanUpEvents(Thing* thing)
+{
+	ThingEvent* event = thing->event;
+	while(event)
+	{
+		ThingEvent* next = event->next;
+		thingFree(event->name);
+		thingFree(event->title);
+		thingFree(event->href);
+		thingFree(event);
+		event = next;
+	}
+	thing->event = NULL;
+	thingFree(thing->eventLog);
+	thingFree(thing->eventsHref);
+	thing->eventLog = NULL;
+	thing->eventsHref = NULL;
+}
@@ -0,0 +1,598 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include "web_thing_json.h"
+
+static void jsonFlush(JsonWriter* w)
+{
+	if(w->len == 0)
+		return;
+
+	if(!w->error && w->flush && w->flush(w->ctx,w->buf,w->len) != 0)
+	{
+		w->error = true;
+	}
+	w->len = 0;
+}
+
+static void jsonWrite(JsonWriter* w,const char* data,size_t len)
+{
+	w->total += len;
+	if(w->error)
+		return;
+
+	while(len > 0)
+	{
+		size_t space = sizeof(w->buf) - w->len;
+		size_t n = len < space ? len : space;
+		memcpy(w->buf + w->len,data,n);
+		w->len += n;
+		data += n;
+		len -= n;
+		if(w->len == sizeof(w->buf))
+			jsonFlush(w);
+	}
+}
+
+static void jsonPutc(JsonWriter* w,char c)
+{
+	jsonWrite(w,&c,1);
+}
+
+static void jsonIndent(JsonWriter* w,uint8_t level)
+{
+	while(level--)
+		jsonPutc(w,'\t');
+}
+
+static void jsonEscaped(JsonWriter* w,const char* str)
+{
+	const char* run = str;
+	for(;*str;str++)
+	{
+		unsigned char c = (unsigned char)*str;
+		if(c >= 32 && c != '"' && c != '\\')
+			continue;
+
+		jsonWrite(w,run,str - run);
+		run = str + 1;
+		switch(c)
+		{
+			case '"': jsonWrite(w,"\\\"",2); break;
+			case '\\': jsonWrite(w,"\\\\",2); break;
+			case '\b': jsonWrite(w,"\\b",2); break;
+			case '\f': jsonWrite(w,"\\f",2); break;
+			case '\n': jsonWrite(w,"\\n",2); break;
+			case '\r': jsonWrite(w,"\\r",2); break;
+			case '\t': jsonWrite(w,"\\t",2); break;
+			default:
+			{
+				char esc[7];
+				snprintf(esc,sizeof(esc),"\\u%04x",c);
+				jsonWrite(w,esc,6);
+			}
+		}
+	}
+	jsonWrite(w,run,str - run);
+}
+
+/* Separator in front of an array element , object members get theirs from jsonKey(). */
+static void jsonBeforeValue(JsonWriter* w)
+{
+	if(w->depth == 0)
+		return;
+
+	uint32_t bit = 1u << (w->depth - 1);
+	if(w->isArray & bit)
+	{
+		if(w->hasItems & bit)
+		{
+			jsonPutc(w,',');
+			if(w->format)
+				jsonPutc(w,' ');
+		}
+		w->hasItems |= bit;
+	}
+}
+
+static void jsonOpen(JsonWriter* w,char c,bool isArray)
+{
+	jsonBeforeValue(w);
+	jsonPutc(w,c);
+	if(w->depth >= JSON_WRITER_MAX_DEPTH)
+	{
+		w->error = true;
+		return;
+	}
+
+	uint32_t bit = 1u << w->depth;
+	w->hasItems &= ~bit;
+	if(isArray)
+		w->isArray |= bit;
+	else
+		w->isArray &= ~bit;
+	w->depth++;
+}
+
+void jsonWriterInit(JsonWriter* w,bool format,JsonWriterFlush_cb flush,void* ctx)
+{
+	w->len = 0;
+	w->total = 0;
+	w->hasItems = 0;
+	w->isArray = 0;
+	w->depth = 0;
+	w->format = format;
+	w->error = false;
+	w->flush = flush;
+	w->ctx = ctx;
+}
+
+bool jsonWriterFinish(JsonWriter* w)
+{
+	jsonFlush(w);
+	return !w->error;
+}
+
+const char* jsonWriterTakePending(JsonWriter* w,size_t* len)
+{
+	*len = w->len;
+	w->len = 0;
+	return w->error ? NULL : w->buf;
+}
+
+void jsonBeginObject(JsonWriter* w)
+{
+	jsonOpen(w,'{',false);
+	if(w->format)
+		jsonPutc(w,'\n');
+}
+
+void jsonEndObject(JsonWriter* w)
+{
+	if(w->depth == 0)
+	{
+		w->error = true;
+		return;
+	}
+
+	w->depth--;
+	if(w->format)
+	{
+		if(w->hasItems & (1u << w->depth))
+			jsonPutc(w,'\n');
+		jsonIndent(w,w->depth);
+	}
+	jsonPutc(w,'}');
+}
+
+void jsonBeginArray(JsonWriter* w)
+{
+	jsonOpen(w,'[',true);
+}
+
+void jsonEndArray(JsonWriter* w)
+{
+	if(w->depth == 0)
+	{
+		w->error = true;
+		return;
+	}
+
+	w->depth--;
+	jsonPutc(w,']');
+}
+
+void jsonKey(JsonWriter* w,const char* key)
+{
+	uint32_t bit = w->depth ? 1u << (w->depth - 1) : 0;
+	if(w->hasItems & bit)
+	{
+		jsonPutc(w,',');
+		if(w->format)
+			jsonPutc(w,'\n');
+	}
+	w->hasItems |= bit;
+
+	if(w->format)
+		jsonIndent(w,w->depth);
+	jsonPutc(w,'"');
+	jsonEscaped(w,key);
+	jsonPutc(w,'"');
+	jsonPutc(w,':');
+	if(w->format)
+		jsonPutc(w,'\t');
+}
+
+void jsonString(JsonWriter* w,const char* value)
+{
+	jsonStringBegin(w);
+	jsonStringAppend(w,value);
+	jsonStringEnd(w);
+}
+
+void jsonStringBegin(JsonWriter* w)
+{
+	jsonBeforeValue(w);
+	jsonPutc(w,'"');
+}
+
+void jsonStringAppend(JsonWriter* w,const char* part)
+{
+	if(part)
+		jsonEscaped(w,part);
+}
+
+void jsonStringEnd(JsonWriter* w)
+{
+	jsonPutc(w,'"');
+}
+
+size_t jsonFormatNumber(double value,char* buf)
+{
+	int len;
+	if(isnan(value) || isinf(value))
+	{
+		strcpy(buf,"null");
+		return 4;
+	}
+
+	// same rules as cJSON: integers as %d , everything else with the shortest exact precision
+	int valueint = value >= INT_MAX ? INT_MAX : (value <= (double)INT_MIN ? INT_MIN : (int)value);
+	if(value == (double)valueint)
+	{
+		len = sprintf(buf,"%d",valueint);
+	}
+	else
+	{
+		double test = 0.0;
+		len = sprintf(buf,"%1.15g",value);
+		if((sscanf(buf,"%lg",&test) != 1) || (fabs(test - value) > DBL_EPSILON * fabs(value)))
+		{
+			len = sprintf(buf,"%1.17g",value);
+		}
+	}
+	return (size_t)len;
+}
+
+void jsonNumber(JsonWriter* w,double value)
+{
+	char num[32];
+	size_t len = jsonFormatNumber(value,num);
+	jsonBeforeValue(w);
+	jsonWrite(w,num,len);
+}
+
+void jsonBool(JsonWriter* w,bool value)
+{
+	jsonBeforeValue(w);
+	if(value)
+		jsonWrite(w,"true",4);
+	else
+		jsonWrite(w,"false",5);
+}
+
+void jsonNull(JsonWriter* w)
+{
+	jsonBeforeValue(w);
+	jsonWrite(w,"null",4);
+}
+
+/*
+	Reader
+*/
+enum
+{
+	READER_START,		// before the opening brace
+	READER_FIRST,		// after the opening brace
+	READER_MEMBER,		// after a comma
+	READER_AFTER,		// after a value
+	READER_DONE,
+	READER_FAILED
+};
+
+#define JSON_READER_MAX_NUMBER 64
+
+void jsonReaderInit(JsonReader* r,char* buf,size_t len)
+{
+	r->pos = buf;
+	r->end = buf + len;
+	r->state = READER_START;
+}
+
+static void skipWhitespace(JsonReader* r)
+{
+	while(r->pos < r->end && (*r->pos == ' ' || *r->pos == '\t' || *r->pos == '\n' || *r->pos == '\r'))
+		r->pos++;
+}
+
+static bool readerTake(JsonReader* r,char c)
+{
+	skipWhitespace(r);
+	if(r->pos == r->end || *r->pos != c)
+		return false;
+	r->pos++;
+	return true;
+}
+
+static bool readerLiteral(JsonReader* r,const char* literal,size_t len)
+{
+	if((size_t)(r->end - r->pos) < len || memcmp(r->pos,literal,len) != 0)
+		return false;
+	r->pos += len;
+	return true;
+}
+
+static int hexValue(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Reads the 4 hex digits of a \u escape , -1 if they are not */
+static long readHex4(JsonReader* r)
+{
+	long value = 0;
+	if(r->end - r->pos < 4)
+		return -1;
+	for(int i = 0;i < 4;i++)
+	{
+		int digit = hexValue(*r->pos++);
+		if(digit < 0)
+			return -1;
+		value = (value << 4) | digit;
+	}
+	return value;
+}
+
+static char* putUtf8(char* out,unsigned long code)
+{
+	if(code < 0x80)
+	{
+		*out++ = (char)code;
+	}
+	else if(code < 0x800)
+	{
+		*out++ = (char)(0xC0 | (code >> 6));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	else if(code < 0x10000)
+	{
+		*out++ = (char)(0xE0 | (code >> 12));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	else
+	{
+		*out++ = (char)(0xF0 | (code >> 18));
+		*out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	return out;
+}
+
+/* 
+	Unescapes the string starting at the opening quote into the buffer itself , the
+	escaped form is never shorter than the result. NULL if the string is invalid.
+*/
+static char* readerString(JsonReader* r)
+{
+	if(r->pos == r->end || *r->pos != '"')
+		return NULL;
+	char* start = ++r->pos;
+	char* out = start;
+	while(r->pos < r->end)
+	{
+		unsigned char c = (unsigned char)*r->pos++;
+		if(c == '"')
+		{
+			*out = '\0';
+			return start;
+		}
+		if(c < 32)
+			return NULL;
+		if(c != '\\')
+		{
+			*out++ = (char)c;
+			continue;
+		}
+
+		if(r->pos == r->end)
+			return NULL;
+		switch(*r->pos++)
+		{
+			case '"': *out++ = '"'; break;
+			case '\\': *out++ = '\\'; break;
+			case '/': *out++ = '/'; break;
+			case 'b': *out++ = '\b'; break;
+			case 'f': *out++ = '\f'; break;
+			case 'n': *out++ = '\n'; break;
+			case 'r': *out++ = '\r'; break;
+			case 't': *out++ = '\t'; break;
+			case 'u':
+			{
+				long code = readHex4(r);
+				if(code <= 0 || (code >= 0xDC00 && code <= 0xDFFF))
+					return NULL;	// \u0000 would cut the string , lone low surrogate
+				if(code >= 0xD800 && code <= 0xDBFF)
+				{
+					if(!readerLiteral(r,"\\u",2))
+						return NULL;
+					long low = readHex4(r);
+					if(low < 0xDC00 || low > 0xDFFF)
+						return NULL;
+					code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+				}
+				out = putUtf8(out,(unsigned long)code);
+				break;
+			}
+			default:
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+static bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* Checks the JSON number grammar before strtod , which would accept far more */
+static bool readerNumber(JsonReader* r,double* value)
+{
+	char num[JSON_READER_MAX_NUMBER];
+	char* start = r->pos;
+	char* p = start;
+	if(p < r->end && *p == '-')
+		p++;
+	if(p == r->end || !isDigit(*p))
+		return false;
+	if(*p == '0')
+	{
+		p++;
+	}
+	else
+	{
+		while(p < r->end && isDigit(*p))
+			p++;
+	}
+	if(p < r->end && *p == '.')
+	{
+		p++;
+		if(p == r->end || !isDigit(*p))
+			return false;
+		while(p < r->end && isDigit(*p))
+			p++;
+	}
+	if(p < r->end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		if(p < r->end && (*p == '+' || *p == '-'))
+			p++;
+		if(p == r->end || !isDigit(*p))
+			return false;
+		while(p < r->end && isDigit(*p))
+			p++;
+	}
+
+	size_t len = (size_t)(p - start);
+	if(len >= sizeof(num))
+		return false;
+	// the body is not terminated after the number , strtod needs a copy
+	memcpy(num,start,len);
+	num[len] = '\0';
+	*value = strtod(num,NULL);
+	r->pos = p;
+	return true;
+}
+
+static bool readerValue(JsonReader* r,JsonMember* member)
+{
+	skipWhitespace(r);
+	if(r->pos == r->end)
+		return false;
+
+	switch(*r->pos)
+	{
+		case '"':
+			member->type = JSON_VALUE_STRING;
+			member->string = readerString(r);
+			return member->string != NULL;
+		case 't':
+			member->type = JSON_VALUE_BOOL;
+			member->boolean = true;
+			return readerLiteral(r,"true",4);
+		case 'f':
+			member->type = JSON_VALUE_BOOL;
+			member->boolean = false;
+			return readerLiteral(r,"false",5);
+		case 'n':
+			member->type = JSON_VALUE_NULL;
+			return readerLiteral(r,"null",4);
+		default:
+			member->type = JSON_VALUE_NUMBER;
+			return readerNumber(r,&member->number);
+	}
+}
+
+int jsonReaderNext(JsonReader* r,JsonMember* member)
+{
+	switch(r->state)
+	{
+		case READER_DONE:
+			return 0;
+		case READER_FAILED:
+			return -1;
+		case READER_START:
+			if(!readerTake(r,'{'))
+				goto fail;
+			r->state = READER_FIRST;
+			break;
+		case READER_AFTER:
+			if(readerTake(r,','))
+			{
+				r->state = READER_MEMBER;
+				break;
+			}
+			goto close;
+	}
+
+	if(r->state == READER_FIRST)
+	{
+		skipWhitespace(r);
+		if(r->pos < r->end && *r->pos == '}')
+			goto close;
+	}
+
+	memset(member,0,sizeof(JsonMember));
+	skipWhitespace(r);
+	member->key = readerString(r);
+	if(member->key == NULL || !readerTake(r,':') || !readerValue(r,member))
+		goto fail;
+	r->state = READER_AFTER;
+	return 1;
+
+close:
+	if(!readerTake(r,'}'))
+		goto fail;
+	skipWhitespace(r);
+	if(r->pos != r->end)
+		goto fail;
+	r->state = READER_DONE;
+	return 0;
+
+fail:
+	r->state = READER_FAILED;
+	return -1;
+}
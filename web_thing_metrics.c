@@ -0,0 +1,203 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <string.h>
+#include "web_thing_metrics.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#ifdef CONFIG_WEB_THING_METRICS
+static const char* ROUTE_NAMES[eMETRIC_ROUTE_COUNT] = {
+	"root","thing","properties.get","properties.put","property.get","property.put",
+	"actions.get","actions.post","actions.delete","events.get","websocket","metrics","other"
+};
+
+static ThingMetrics gMetrics;
+
+static void raiseMax(uint32_t* max,uint32_t value)
+{
+	uint32_t seen = __atomic_load_n(max,__ATOMIC_RELAXED);
+	while(value > seen && !__atomic_compare_exchange_n(max,&seen,value,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+}
+
+static uint16_t bucketOf(uint32_t us)
+{
+	if(us < THING_METRIC_FIRST_BOUND_US)
+		return 0;
+	// 16..31 us is bucket 1 , every further bit one more
+	uint16_t bucket = 32 - __builtin_clz(us) - 4;
+	return bucket < THING_METRIC_BUCKETS ? bucket : THING_METRIC_BUCKETS - 1;
+}
+
+static uint32_t elapsedUs(int64_t start)
+{
+	int64_t us = esp_timer_get_time() - start;
+	return us < 0 ? 0 : us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+int64_t metricsStart()
+{
+	return esp_timer_get_time();
+}
+
+void recordRequest(ThingMetricRoute route,int64_t start,uint32_t bytes,bool failed)
+{
+	ThingRouteMetrics* metrics = &gMetrics.routes[route];
+	uint32_t us = elapsedUs(start);
+	__atomic_add_fetch(&metrics->requests,1,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&metrics->bytesOut,bytes,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&metrics->buckets[bucketOf(us)],1,__ATOMIC_RELAXED);
+	if(failed)
+		__atomic_add_fetch(&metrics->failures,1,__ATOMIC_RELAXED);
+	raiseMax(&metrics->maxUs,us);
+}
+
+void recordCallback(int64_t start)
+{
+	uint32_t us = elapsedUs(start);
+	__atomic_add_fetch(&gMetrics.callbacks,1,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&gMetrics.callbackBuckets[bucketOf(us)],1,__ATOMIC_RELAXED);
+	raiseMax(&gMetrics.callbackMaxUs,us);
+}
+
+void recordParseFailure()
+{
+	__atomic_add_fetch(&gMetrics.parseFailures,1,__ATOMIC_RELAXED);
+}
+
+void recordWsFrame(uint32_t bytes,bool final)
+{
+	if(final)
+		__atomic_add_fetch(&gMetrics.wsMessagesOut,1,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&gMetrics.wsBytesOut,bytes,__ATOMIC_RELAXED);
+}
+
+static void copyCounters(uint32_t* to,const uint32_t* from,size_t count)
+{
+	for(size_t i = 0;i < count;i++)
+		to[i] = __atomic_load_n(&from[i],__ATOMIC_RELAXED);
+}
+
+void getThingMetrics(ThingMetrics* metrics)
+{
+	// every member is a uint32_t counter
+	copyCounters((uint32_t*)metrics,(const uint32_t*)&gMetrics,sizeof(ThingMetrics) / sizeof(uint32_t));
+}
+
+static void writeBuckets(JsonWriter* writer,const uint32_t* buckets)
+{
+	jsonKey(writer,"buckets");
+	jsonBeginArray(writer);
+	for(uint16_t i = 0;i < THING_METRIC_BUCKETS;i++)
+		jsonNumber(writer,buckets[i]);
+	jsonEndArray(writer);
+}
+
+void writeThingMetrics(JsonWriter* writer)
+{
+	ThingMetrics metrics;
+	getThingMetrics(&metrics);
+
+	jsonKey(writer,"uptimeUs");
+	jsonNumber(writer,(double)esp_timer_get_time());
+	jsonKey(writer,"freeHeap");
+	jsonNumber(writer,esp_get_free_heap_size());
+	jsonKey(writer,"minFreeHeap");
+	jsonNumber(writer,esp_get_minimum_free_heap_size());
+
+	// the upper bounds , the last bucket has none
+	jsonKey(writer,"bucketBoundsUs");
+	jsonBeginArray(writer);
+	for(uint16_t i = 0;i < THING_METRIC_BUCKETS - 1;i++)
+		jsonNumber(writer,THING_METRIC_FIRST_BOUND_US << i);
+	jsonEndArray(writer);
+
+	jsonKey(writer,"routes");
+	jsonBeginObject(writer);
+	for(uint16_t i = 0;i < eMETRIC_ROUTE_COUNT;i++)
+	{
+		ThingRouteMetrics* route = &metrics.routes[i];
+		if(route->requests == 0)
+			continue;
+		jsonKey(writer,ROUTE_NAMES[i]);
+		jsonBeginObject(writer);
+		jsonKey(writer,"requests");
+		jsonNumber(writer,route->requests);
+		jsonKey(writer,"failures");
+		jsonNumber(writer,route->failures);
+		jsonKey(writer,"bytesOut");
+		jsonNumber(writer,route->bytesOut);
+		jsonKey(writer,"maxUs");
+		jsonNumber(writer,route->maxUs);
+		writeBuckets(writer,route->buckets);
+		jsonEndObject(writer);
+	}
+	jsonEndObject(writer);
+
+	jsonKey(writer,"parseFailures");
+	jsonNumber(writer,metrics.parseFailures);
+	jsonKey(writer,"callbacks");
+	jsonBeginObject(writer);
+	jsonKey(writer,"count");
+	jsonNumber(writer,metrics.callbacks);
+	jsonKey(writer,"maxUs");
+	jsonNumber(writer,metrics.callbackMaxUs);
+	writeBuckets(writer,metrics.callbackBuckets);
+	jsonEndObject(writer);
+	jsonKey(writer,"websocket");
+	jsonBeginObject(writer);
+	jsonKey(writer,"messagesOut");
+	jsonNumber(writer,metrics.wsMessagesOut);
+	jsonKey(writer,"bytesOut");
+	jsonNumber(writer,metrics.wsBytesOut);
+	jsonEndObject(writer);
+}
+#else
+int64_t metricsStart()
+{
+	return 0;
+}
+
+void recordRequest(ThingMetricRoute route,int64_t start,uint32_t bytes,bool failed)
+{
+}
+
+void recordCallback(int64_t start)
+{
+}
+
+void recordParseFailure()
+{
+}
+
+void recordWsFrame(uint32_t bytes,bool final)
+{
+}
+
+void getThingMetrics(ThingMetrics* metrics)
+{
+	memset(metrics,0,sizeof(ThingMetrics));
+}
+
+void writeThingMetrics(JsonWriter* writer)
+{
+}
+#endif
@@ -0,0 +1,146 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "web_thing_log.h"
+#include "web_thing_persist.h"
+
+static const char* TAG = "web_thing_persist";
+
+/* prefix and name , or prefix and a hash of name if that is too long for NVS */
+static void storeName(char* out,const char* prefix,const char* name)
+{
+	if(strlen(prefix) + strlen(name) < NVS_KEY_NAME_MAX_SIZE)
+	{
+		sprintf(out,"%s%s",prefix,name);
+		return;
+	}
+
+	uint32_t hash = 2166136261u;
+	for(const char* c = name;*c;c++)
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	sprintf(out,"%s~%08x",prefix,(unsigned)hash);
+}
+
+bool openPropertyStore(Thing* _thing,nvs_open_mode_t _mode,nvs_handle_t* _handle)
+{
+	char name[NVS_KEY_NAME_MAX_SIZE];
+	storeName(name,"wt",_thing->id);
+	esp_err_t err = nvs_open(name,_mode,_handle);
+	if(err != ESP_OK)
+	{
+		// a namespace which was never written can not be opened read only
+		if(err != ESP_ERR_NVS_NOT_FOUND)
+			THING_LOGE(TAG,"nvs_open %s failed: 0x%x",name,err);
+		return false;
+	}
+	return true;
+}
+
+bool readStoredValue(nvs_handle_t _handle,ThingProperty* _property,ThingPropertyValue* _value)
+{
+	char key[NVS_KEY_NAME_MAX_SIZE];
+	storeName(key,"",_property->key);
+
+	esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+	switch(_property->info.valueType)
+	{
+		case BOOLEAN:
+		{
+			uint8_t flag;
+			err = nvs_get_u8(_handle,key,&flag);
+			_value->boolean = flag != 0;
+		}
+		break;
+
+		case NUMBER:
+		{
+			size_t len = sizeof(double);
+			err = nvs_get_blob(_handle,key,&_value->number,&len);
+			if(err == ESP_OK && len != sizeof(double))
+				err = ESP_ERR_NVS_INVALID_LENGTH;
+		}
+		break;
+
+		case STRING:
+		{
+			size_t len = 0;
+			err = nvs_get_str(_handle,key,NULL,&len);
+			if(err != ESP_OK)
+				break;
+			_value->string = thingHeapAlloc(len);
+			if(_value->string == NULL)
+				return false;
+			err = nvs_get_str(_handle,key,_value->string,&len);
+			if(err != ESP_OK)
+				thingFree(_value->string);
+		}
+		break;
+
+		default:
+		break;
+	}
+
+	if(err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+		THING_LOGW(TAG,"could not restore %s: 0x%x",_property->key,err);
+	return err == ESP_OK;
+}
+
+bool writeStoredValue(nvs_handle_t _handle,ThingProperty* _property,ThingPropertyValue _value)
+{
+	char key[NVS_KEY_NAME_MAX_SIZE];
+	storeName(key,"",_property->key);
+
+	// NVS leaves the flash alone when the key already has this value
+	esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+	switch(_property->info.valueType)
+	{
+		case BOOLEAN:
+			err = nvs_set_u8(_handle,key,_value.boolean ? 1 : 0);
+		break;
+
+		case NUMBER:
+			err = nvs_set_blob(_handle,key,&_value.number,sizeof(double));
+		break;
+
+		case STRING:
+			err = nvs_set_str(_handle,key,_value.string);
+		break;
+
+		default:
+		break;
+	}
+
+	if(err != ESP_OK)
+		THING_LOGE(TAG,"could not save %s: 0x%x",_property->key,err);
+	return err == ESP_OK;
+}
+
+bool closePropertyStore(nvs_handle_t _handle,bool _commit)
+{
+	esp_err_t err = _commit ? nvs_commit(_handle) : ESP_OK;
+	if(err != ESP_OK)
+		THING_LOGE(TAG,"nvs_commit failed: 0x%x",err);
+	nvs_close(_handle);
+	return err == ESP_OK;
+}
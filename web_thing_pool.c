@@ -0,0 +1,137 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "web_thing_log.h"
+#include "web_thing_pool.h"
+
+static ThingAllocStats gStats;
+
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+static const char* TAG = "web_thing_pool";
+static uint8_t gPool[WEB_THING_POOL_SIZE] __attribute__((aligned(8)));
+static size_t gPoolUsed = 0;
+static size_t gPoolLast = 0;		// start of the most recent allocation , gPoolUsed if it was freed
+static uint16_t gPoolThings = 0;
+
+static bool isPoolMemory(void* ptr)
+{
+	return (uint8_t*)ptr >= gPool && (uint8_t*)ptr < gPool + sizeof(gPool);
+}
+#endif
+
+void* thingAlloc(size_t size)
+{
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	size_t aligned = (size + 7) & ~(size_t)7;
+	if(aligned > sizeof(gPool) - gPoolUsed)
+	{
+		THING_LOGE(TAG,"pool full , %u bytes needed , raise CONFIG_WEB_THING_POOL_BYTES_PER_PROPERTY",(unsigned)size);
+		gStats.poolFailures++;
+		return NULL;
+	}
+	void* ptr = gPool + gPoolUsed;
+	gPoolLast = gPoolUsed;
+	gPoolUsed += aligned;
+	return ptr;
+#else
+	return thingHeapAlloc(size);
+#endif
+}
+
+void* thingHeapAlloc(size_t size)
+{
+	void* ptr = malloc(size);
+	if(ptr)
+		__atomic_add_fetch(&gStats.heapAllocs,1,__ATOMIC_RELAXED);
+	return ptr;
+}
+
+void* thingCalloc(size_t count,size_t size)
+{
+	void* ptr = thingAlloc(count*size);
+	if(ptr)
+		memset(ptr,0,count*size);
+	return ptr;
+}
+
+char* thingStrdup(const char* str)
+{
+	if(str == NULL)
+		return NULL;
+	size_t len = strlen(str) + 1;
+	char* copy = thingAlloc(len);
+	if(copy)
+		memcpy(copy,str,len);
+	return copy;
+}
+
+void thingFree(void* ptr)
+{
+	if(ptr == NULL)
+		return;
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	if(isPoolMemory(ptr))
+	{
+		// only the most recent allocation can be given back , so that a buffer freed
+		// and allocated again at once grows in place
+		if(gPoolLast < gPoolUsed && ptr == gPool + gPoolLast)
+			gPoolUsed = gPoolLast;
+		return;
+	}
+#endif
+	__atomic_add_fetch(&gStats.heapFrees,1,__ATOMIC_RELAXED);
+	free(ptr);
+}
+
+void thingPoolAcquire()
+{
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	gPoolThings++;
+#endif
+}
+
+void thingPoolRelease()
+{
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	if(gPoolThings > 0 && --gPoolThings == 0)
+	{
+		gPoolUsed = 0;
+		gPoolLast = 0;
+	}
+#endif
+}
+
+void getThingAllocStats(ThingAllocStats* stats)
+{
+	*stats = gStats;
+	stats->heapAllocs = __atomic_load_n(&gStats.heapAllocs,__ATOMIC_RELAXED);
+	stats->heapFrees = __atomic_load_n(&gStats.heapFrees,__ATOMIC_RELAXED);
+#ifdef CONFIG_WEB_THING_STATIC_POOL
+	stats->poolUsed = gPoolUsed;
+	stats->poolSize = sizeof(gPool);
+#else
+	stats->poolUsed = 0;
+	stats->poolSize = 0;
+#endif
+}
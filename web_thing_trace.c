@@ -0,0 +1,87 @@
+/*
+  Copyright (c) 2019 Akshay Vernekar
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include "web_thing_trace.h"
+#include "esp_timer.h"
+
+#ifdef CONFIG_WEB_THING_TRACE
+bool gThingTraceOn = false;
+
+static ThingTraceRecord gTrace[CONFIG_WEB_THING_TRACE_SIZE];
+static uint32_t gTraced = 0;		// records ever written
+
+void setThingTrace(bool on)
+{
+	__atomic_store_n(&gThingTraceOn,on,__ATOMIC_RELAXED);
+}
+
+void recordThingTrace(ThingTracePoint point,uint32_t arg)
+{
+	uint32_t number = __atomic_fetch_add(&gTraced,1,__ATOMIC_RELAXED);
+	ThingTraceRecord* record = &gTrace[number % CONFIG_WEB_THING_TRACE_SIZE];
+
+	// readers skip the record until the sequence is set again , a reader which sees one
+	// of the new fields also sees the cleared sequence
+	__atomic_store_n(&record->sequence,0,__ATOMIC_RELAXED);
+	__atomic_store_n(&record->timeUs,(uint32_t)esp_timer_get_time(),__ATOMIC_RELEASE);
+	__atomic_store_n(&record->point,point,__ATOMIC_RELEASE);
+	__atomic_store_n(&record->arg,arg,__ATOMIC_RELEASE);
+	__atomic_store_n(&record->sequence,number + 1,__ATOMIC_RELEASE);
+}
+
+uint16_t takeThingTrace(uint32_t* cursor,ThingTraceVisit_cb visit,void* ctx)
+{
+	uint32_t end = __atomic_load_n(&gTraced,__ATOMIC_ACQUIRE);
+	uint32_t number = *cursor;
+	uint16_t visited = 0;
+	if(end - number > CONFIG_WEB_THING_TRACE_SIZE)
+		number = end - CONFIG_WEB_THING_TRACE_SIZE;
+
+	for(;number != end;number++)
+	{
+		ThingTraceRecord* slot = &gTrace[number % CONFIG_WEB_THING_TRACE_SIZE];
+		ThingTraceRecord record;
+		record.sequence = __atomic_load_n(&slot->sequence,__ATOMIC_ACQUIRE);
+		record.timeUs = __atomic_load_n(&slot->timeUs,__ATOMIC_ACQUIRE);
+		record.point = __atomic_load_n(&slot->point,__ATOMIC_ACQUIRE);
+		record.arg = __atomic_load_n(&slot->arg,__ATOMIC_ACQUIRE);
+		if(record.sequence != number + 1 || __atomic_load_n(&slot->sequence,__ATOMIC_RELAXED) != number + 1)
+			continue;
+		visit(&record,ctx);
+		visited++;
+	}
+	*cursor = end;
+	return visited;
+}
+#else
+void setThingTrace(bool on)
+{
+}
+
+void recordThingTrace(ThingTracePoint point,uint32_t arg)
+{
+}
+
+uint16_t takeThingTrace(uint32_t* cursor,ThingTraceVisit_cb visit,void* ctx)
+{
+	return 0;
+}
+#endif